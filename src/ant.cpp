@@ -55,8 +55,12 @@ static void scream_check(game_object *o, game_object *b)
 
 static int ant_congestion(game_object *o)
 {
-  for (game_object *d=current_level->first_active_object(); d; d=d->next_active)
+  // the y test has always been against o->x; keep it so games play the same
+  GridQuery q;
+  current_level->find_actives(q,o->x-29,o->x-19,o->x+29,o->x+19);
+  for (int i=0; i<q.total; i++)
   {
+    game_object *d=q.list[i];
     if (d->otype==o->otype && abs(o->x-d->x)<30 && abs(o->x-d->y)<20) return 1;
   }
   return 0;
@@ -310,6 +314,7 @@ void *ant_ai()
         if (ym==10)
           o->set_aistate(ANT_FALL_DOWN);
         else o->y+=ym;
+        current_level->update_grid(o);
       }
     } else
     {
@@ -367,6 +372,7 @@ void *ant_ai()
       o->y-=31;
       o->try_move(o->x,o->y,xv,yv,1);
       o->y+=31+yv;
+      current_level->update_grid(o);
       if (yv!=o->yvel())
       {
     if (o->yvel()>0)
@@ -412,6 +418,7 @@ void *ant_ai()
           !can_see(o,o->x+speed,o->y-31,o->x+speed,o->y-32))
       {
         o->x+=speed;
+        current_level->update_grid(o);
         if (!o->next_picture()) o->set_state((character_state)S_top_walk);
 
       } else o->set_aistate(ANT_FALL_DOWN);
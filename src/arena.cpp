@@ -0,0 +1,88 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "common.h"
+
+#include "arena.h"
+
+// Allocations are rounded up to this, which also keeps blocks aligned
+#define ARENA_ALIGN (sizeof(void *) > sizeof(double) ? sizeof(void *) \
+                                                     : sizeof(double))
+#define ARENA_ROUND(x) (((x) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+Arena::Arena()
+{
+    m_first = m_current = NULL;
+    m_used = 0;
+    m_allocs = m_blocks = 0;
+}
+
+Arena::~Arena()
+{
+    while (m_first)
+    {
+        Block *b = m_first;
+        m_first = m_first->next;
+        free(b);
+    }
+}
+
+void *Arena::Alloc(size_t size)
+{
+    size = ARENA_ROUND(size);
+    m_allocs++;
+
+    // Move on to the next block, reusing the ones kept by Reset()
+    while (!m_current || m_used + size > m_current->size)
+    {
+        Block *next = m_current ? m_current->next : m_first;
+        if (next && next->size < size)
+            next = NULL; // too small, insert a bigger block before it
+
+        if (!next)
+        {
+            size_t bytes = m_current ? m_current->size * 2 : ARENA_BLOCK;
+            bytes = Max(bytes, size);
+            next = (Block *)malloc(ARENA_ROUND(sizeof(Block)) + bytes);
+            next->size = bytes;
+            if (m_current)
+            {
+                next->next = m_current->next;
+                m_current->next = next;
+            }
+            else
+            {
+                next->next = m_first;
+                m_first = next;
+            }
+            m_blocks++;
+        }
+
+        m_current = next;
+        m_used = 0;
+    }
+
+    void *ret = (uint8_t *)m_current + ARENA_ROUND(sizeof(Block)) + m_used;
+    m_used += size;
+    return ret;
+}
+
+void Arena::Reset()
+{
+    m_current = NULL;
+    m_used = 0;
+    m_allocs = 0;
+}
@@ -0,0 +1,52 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdlib.h>
+
+// Size of the first block of an arena; later blocks double in size
+#define ARENA_BLOCK 4096
+
+//
+// Memory for short lived structures that are all thrown away together,
+// such as the patches of a frame. Allocating is a pointer bump, and
+// Reset() frees everything at once while keeping the blocks for reuse.
+// An arena is not thread safe, so give each thread its own.
+//
+class Arena
+{
+public:
+    Arena();
+    ~Arena();
+
+    // Pointer aligned memory, valid until the next Reset()
+    void *Alloc(size_t size);
+    void Reset();
+
+    // Allocations since the last Reset(), and blocks taken from the heap
+    // since the arena was created
+    size_t GetAllocs() const { return m_allocs; }
+    size_t GetBlocks() const { return m_blocks; }
+
+private:
+    struct Block
+    {
+        Block *next;
+        size_t size;
+    };
+
+    Block *m_first, *m_current;
+    size_t m_used; // bytes used in m_current
+    size_t m_allocs, m_blocks;
+};
+
+#endif // __ARENA_H__
@@ -42,6 +42,7 @@
 CrcManager crc_manager;
 
 int past_startup=0;
+int cache_prefetch=1;
 
 int crc_man_write_crc_file(char const *filename)
 {
@@ -659,6 +660,7 @@ void CacheList::unreg(int id)
 {
     if (list[id].file_number >= 0)
     {
+        loader.Cancel(id);
         unmalloc(&list[id]);
         list[id].file_number = -1;
     }
@@ -679,6 +681,8 @@ CacheList::CacheList()
     last_dir = NULL;
     last_file = -1;
     prof_data = NULL;
+    pf_queued = pf_hits = pf_misses = pf_stalls = 0;
+    pf_stall_ms = 0.f;
 }
 
 CacheList::~CacheList()
@@ -687,6 +691,7 @@ CacheList::~CacheList()
 
 void CacheList::empty()
 {
+  loader.Stop();
   for (int i=0; i<total; i++)
   {
     if (list[i].file_number>=0 && list[i].last_access!=-1)
@@ -712,6 +717,8 @@ void CacheList::empty()
   last_dir=NULL;
   last_file=-1;
   prof_data=NULL;
+  pf_queued=pf_hits=pf_misses=pf_stalls=0;
+  pf_stall_ms=0.f;
 }
 
 void CacheList::locate(CacheItem *i, int local_only)
@@ -722,7 +729,11 @@ void CacheList::locate(CacheItem *i, int local_only)
     if (fp) delete fp;
     if (last_dir) delete last_dir;
     if (local_only)
-      fp=new jFILE(crc_manager.get_filename(i->file_number),"rb");
+    {
+      fp=open_mapped_file(crc_manager.get_filename(i->file_number));
+      if (!fp)
+        fp=new jFILE(crc_manager.get_filename(i->file_number),"rb");
+    }
     else
       fp=open_file(crc_manager.get_filename(i->file_number),"rb");
 
@@ -738,7 +749,7 @@ void CacheList::locate(CacheItem *i, int local_only)
     last_dir=new spec_directory(fp);
     last_file=i->file_number;
   }
-  if (i->offset!=last_offset)
+  if (i->offset!=last_offset || i->zsize)  // seeking starts unpacking
   {
     fp->seek(i->offset,SEEK_SET);
     last_offset=i->offset;
@@ -746,6 +757,86 @@ void CacheList::locate(CacheItem *i, int local_only)
   used=1;
 }
 
+bFILE *CacheList::load_start(CacheItem *me)
+{
+  bool waited;
+  Timer t;
+  uint8_t *buf=loader.Take(me-list,waited);
+  if (waited)
+  {
+    pf_stalls++;
+    pf_stall_ms+=t.GetMs();
+  }
+
+  if (buf)
+  {
+    if (!waited)
+      pf_hits++;
+    used=1;
+    if (!me->zsize)
+      return new mFILE(buf,me->size,1);
+
+    // the packed bytes, unpacked as they are read
+    mFILE *m=new mFILE(buf,me->zsize,1);
+    spec_zentry z={ 0, (unsigned long)me->zsize, (unsigned long)me->size };
+    m->set_compressed(&z,1);
+    m->seek(0,SEEK_SET);
+    return m;
+  }
+
+  if (cache_prefetch)
+    pf_misses++;
+  locate(me);
+  return fp;
+}
+
+void CacheList::load_end(bFILE *f)
+{
+  if (f==fp)
+    last_offset=fp->unpacking() ? -1 : fp->tell();
+  else
+    delete f;
+}
+
+void CacheList::prefetch(int id)
+{
+  if (!cache_prefetch || id<0 || id>=total)
+    return;
+  CacheItem *me=list+id;
+  if (me->file_number<0 || me->last_access>=0 || me->size<=0)
+    return;
+
+  switch (me->type)
+  {
+    case SPEC_BACKTILE :
+    case SPEC_FORETILE :
+    case SPEC_CHARACTER :
+    case SPEC_CHARACTER2 :
+    case SPEC_IMAGE :
+    case SPEC_PARTICLE :
+    case SPEC_PALETTE : break;
+    default : return;  // not read from a spec entry
+  }
+
+  // the file may itself be inside the main spec file, e.g. with -bundle
+  char name[200];
+  long offset,size;
+  if (!locate_file(crc_manager.get_filename(me->file_number),name,offset,size))
+    return;
+  if (loader.Queue(id,name,offset+me->offset,me->zsize ? me->zsize : me->size))
+    pf_queued++;
+}
+
+void CacheList::prefetch_stats(int &queued, int &hits, int &misses,
+                               int &stalls, float &stall_ms)
+{
+  queued=pf_queued;
+  hits=pf_hits;
+  misses=pf_misses;
+  stalls=pf_stalls;
+  stall_ms=pf_stall_ms;
+}
+
 int CacheList::AllocId()
 {
     if (prof_data)
@@ -811,7 +902,7 @@ extern int total_files_open;
 int CacheList::reg(char const *filename, char const *name, int type, int rm_dups)
 {
     int fn = crc_manager.get_filenumber(filename);
-    int offset = 0;
+    int offset = 0, size = 0, zsize = 0;
 
     if (type == SPEC_EXTERN_SFX)
     {
@@ -868,6 +959,8 @@ int CacheList::reg(char const *filename, char const *name, int type, int rm_dups
 
         type = se->type;
         offset = se->offset;
+        size = se->size;
+        zsize = se->zsize;
     }
 
     // Check whether there is another entry pointing to the same
@@ -887,6 +980,8 @@ int CacheList::reg(char const *filename, char const *name, int type, int rm_dups
     list[id].last_access = -1;
     list[id].data = NULL;
     list[id].offset = offset;
+    list[id].size = size;
+    list[id].zsize = zsize;
     list[id].type = type;
 
     return id;
@@ -921,9 +1016,9 @@ backtile *CacheList::backt(int id)
   else
   {
     touch(me);
-    locate(me);
-    me->data=(void *)new backtile(fp);
-    last_offset=fp->tell();
+    bFILE *f=load_start(me);
+    me->data=(void *)new backtile(f);
+    load_end(f);
     return (backtile *)me->data;
   }
 }
@@ -942,9 +1037,9 @@ foretile *CacheList::foret(int id)
   else
   {
     touch(me);
-    locate(me);
-    me->data=(void *)new foretile(fp);
-    last_offset=fp->tell();
+    bFILE *f=load_start(me);
+    me->data=(void *)new foretile(f);
+    load_end(f);
     return (foretile *)me->data;
   }
 }
@@ -961,9 +1056,9 @@ figure *CacheList::fig(int id)
   else
   {
     touch(me);
-    locate(me);
-    me->data=(void *)new figure(fp,me->type);
-     last_offset=fp->tell();
+    bFILE *f=load_start(me);
+    me->data=(void *)new figure(f,me->type);
+    load_end(f);
     return (figure *)me->data;
   }
 }
@@ -980,10 +1075,10 @@ image *CacheList::img(int id)
   else
   {
     touch(me);                                           // hold me, feel me, be me!
-    locate(me);
-    image *im=new image(fp);
+    bFILE *f=load_start(me);
+    image *im=new image(f);
     me->data=(void *)im;
-    last_offset=fp->tell();
+    load_end(f);
 
     return (image *)me->data;
   }
@@ -1020,9 +1115,9 @@ part_frame *CacheList::part(int id)
   else
   {
     touch(me);
-    locate(me);
-    me->data=(void *)new part_frame(fp);
-    last_offset=fp->tell();
+    bFILE *f=load_start(me);
+    me->data=(void *)new part_frame(f);
+    load_end(f);
     return (part_frame *)me->data;
   }
 }
@@ -1115,9 +1210,9 @@ char_tint *CacheList::ctint(int id)
   else
   {
     touch(me);
-    locate(me);
-    me->data=(void *)new char_tint(fp);
-    last_offset=fp->tell();
+    bFILE *f=load_start(me);
+    me->data=(void *)new char_tint(f);
+    load_end(f);
     return (char_tint *)me->data;
   }
 }
@@ -19,6 +19,7 @@
 #include "specs.h"
 #include "items.h"
 #include "particle.h"
+#include "cacheloader.h"
 
 class level;
 
@@ -73,7 +74,8 @@ protected:
     int32_t last_access;
     uint8_t type;
     int16_t file_number;
-    int32_t offset;
+    int32_t offset, size;
+    int32_t zsize; // bytes in the file if the entry is compressed, else 0
 };
 
 class CacheList
@@ -98,6 +100,12 @@ private:
     void preload_cache_object(int type);
     void preload_cache(level *lev);
 
+    CacheLoader loader;
+    int pf_queued, pf_hits, pf_misses, pf_stalls;
+    float pf_stall_ms;
+    bFILE *load_start(CacheItem *me); // file to build me from
+    void load_end(bFILE *f);
+
 public:
     CacheList();
     ~CacheList();
@@ -122,6 +130,12 @@ public:
     LObject *lblock(int id);
     char_tint *ctint(int id);
 
+    // Have the loader thread read id from disk, if it is not in memory yet
+    void prefetch(int id);
+    // Items read ahead and found ready, read synchronously, or waited for
+    void prefetch_stats(int &queued, int &hits, int &misses, int &stalls,
+                        float &stall_ms);
+
     void prof_init();
     void prof_write(bFILE *fp);
     void prof_uninit();
@@ -141,6 +155,7 @@ public:
 };
 
 extern CacheList cache;
+extern int cache_prefetch; // 0 (-noprefetch) to read everything when needed
 extern CrcManager crc_manager;
 
 #endif
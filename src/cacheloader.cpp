@@ -0,0 +1,236 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+
+#include "common.h"
+
+#include "cacheloader.h"
+
+CacheLoader::CacheLoader()
+{
+    for (int i = 0; i < LOADER_SLOTS; i++)
+    {
+        m_slots[i].state = FREE;
+        m_slots[i].path = NULL;
+        m_slots[i].data = NULL;
+    }
+    m_order = 0;
+    m_quit = false;
+    m_thread = NULL;
+    m_mutex = NULL;
+    m_cond = NULL;
+    m_fp = NULL;
+    m_fp_path = NULL;
+}
+
+CacheLoader::~CacheLoader()
+{
+    Stop();
+}
+
+void CacheLoader::Stop()
+{
+    if (m_thread)
+    {
+        SDL_LockMutex(m_mutex);
+        m_quit = true;
+        SDL_CondBroadcast(m_cond);
+        SDL_UnlockMutex(m_mutex);
+        SDL_WaitThread(m_thread, NULL);
+        SDL_DestroyCond(m_cond);
+        SDL_DestroyMutex(m_mutex);
+        m_thread = NULL;
+        m_mutex = NULL;
+        m_cond = NULL;
+    }
+
+    for (int i = 0; i < LOADER_SLOTS; i++)
+        Free(m_slots + i);
+    if (m_fp)
+        fclose(m_fp);
+    free(m_fp_path);
+    m_fp = NULL;
+    m_fp_path = NULL;
+    m_quit = false;
+}
+
+void CacheLoader::Free(Slot *s)
+{
+    free(s->path);
+    free(s->data);
+    s->path = NULL;
+    s->data = NULL;
+    s->state = FREE;
+}
+
+CacheLoader::Slot *CacheLoader::Find(int id)
+{
+    for (int i = 0; i < LOADER_SLOTS; i++)
+        if (m_slots[i].state != FREE && m_slots[i].id == id)
+            return m_slots + i;
+    return NULL;
+}
+
+bool CacheLoader::Queue(int id, char const *path, int32_t offset,
+                        int32_t size)
+{
+    if (!m_thread)
+    {
+        m_mutex = SDL_CreateMutex();
+        m_cond = SDL_CreateCond();
+        m_thread = SDL_CreateThread(ThreadMain, "cache", this);
+    }
+
+    SDL_LockMutex(m_mutex);
+    Slot *s = NULL;
+    if (!Find(id))
+    {
+        // Use a free slot, or else drop the oldest read nobody took
+        for (int i = 0; i < LOADER_SLOTS && (!s || s->state != FREE); i++)
+        {
+            Slot *t = m_slots + i;
+            if (t->state == FREE || (t->state == DONE
+                 && (!s || (int32_t)(t->order - s->order) < 0)))
+                s = t;
+        }
+        if (s && s->state == DONE)
+            Free(s);
+    }
+    if (s)
+    {
+        s->id = id;
+        s->offset = offset;
+        s->size = size;
+        s->order = m_order++;
+        s->path = strdup(path);
+        s->state = QUEUED;
+        SDL_CondBroadcast(m_cond);
+    }
+    else
+        s = NULL;
+    SDL_UnlockMutex(m_mutex);
+    return s != NULL;
+}
+
+uint8_t *CacheLoader::Take(int id, bool &waited)
+{
+    waited = false;
+    if (!m_thread)
+        return NULL;
+
+    uint8_t *ret = NULL;
+    SDL_LockMutex(m_mutex);
+    Slot *s = Find(id);
+    if (s && s->state == QUEUED)
+        Free(s); // reading it right now is no slower than waiting for it
+    else if (s)
+    {
+        while (s->state == READING)
+        {
+            waited = true;
+            SDL_CondWait(m_cond, m_mutex);
+        }
+        ret = s->data; // may be NULL if the read failed
+        s->data = NULL;
+        Free(s);
+    }
+    SDL_UnlockMutex(m_mutex);
+    return ret;
+}
+
+void CacheLoader::Cancel(int id)
+{
+    if (!m_thread)
+        return;
+    SDL_LockMutex(m_mutex);
+    Slot *s = Find(id);
+    if (s && s->state == READING)
+        s->id = -1; // the thread still owns it and will free it
+    else if (s)
+        Free(s);
+    SDL_UnlockMutex(m_mutex);
+}
+
+void CacheLoader::Clear()
+{
+    if (!m_thread)
+        return;
+    SDL_LockMutex(m_mutex);
+    for (int i = 0; i < LOADER_SLOTS; i++)
+    {
+        if (m_slots[i].state == READING)
+            m_slots[i].id = -1;
+        else
+            Free(m_slots + i);
+    }
+    SDL_UnlockMutex(m_mutex);
+}
+
+int CacheLoader::ThreadMain(void *data)
+{
+    ((CacheLoader *)data)->Run();
+    return 0;
+}
+
+void CacheLoader::Run()
+{
+    SDL_LockMutex(m_mutex);
+    while (!m_quit)
+    {
+        Slot *s = NULL;
+        for (int i = 0; i < LOADER_SLOTS; i++)
+            if (m_slots[i].state == QUEUED
+                 && (!s || (int32_t)(m_slots[i].order - s->order) < 0))
+                s = m_slots + i;
+        if (!s)
+        {
+            SDL_CondWait(m_cond, m_mutex);
+            continue;
+        }
+
+        // Nobody but this thread touches a slot while it is being read
+        s->state = READING;
+        SDL_UnlockMutex(m_mutex);
+
+        if (!m_fp_path || strcmp(m_fp_path, s->path))
+        {
+            if (m_fp)
+                fclose(m_fp);
+            free(m_fp_path);
+            m_fp = fopen(s->path, "rb");
+            m_fp_path = strdup(s->path);
+        }
+
+        uint8_t *buf = (uint8_t *)malloc(Max(s->size, 1));
+        if (!m_fp || fseek(m_fp, s->offset, SEEK_SET)
+             || fread(buf, 1, s->size, m_fp) != (size_t)s->size)
+        {
+            free(buf);
+            buf = NULL;
+        }
+
+        SDL_LockMutex(m_mutex);
+        s->data = buf;
+        s->state = DONE;
+        if (s->id == -1)
+            Free(s); // cancelled while it was being read
+        SDL_CondBroadcast(m_cond);
+    }
+    SDL_UnlockMutex(m_mutex);
+}
@@ -0,0 +1,82 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __CACHELOADER_H__
+#define __CACHELOADER_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+struct SDL_Thread;
+struct SDL_mutex;
+struct SDL_cond;
+
+// Number of reads that can be queued or waiting to be taken at once
+#define LOADER_SLOTS 64
+
+//
+// Background thread reading cache items from disk before they are needed.
+// It only reads bytes; building the items still happens on the main thread
+// when they are accessed, since image and sound code is not thread safe.
+//
+class CacheLoader
+{
+public:
+    CacheLoader();
+    ~CacheLoader();
+
+    // Queue a read of size bytes at offset in the file at path, for cache
+    // item id. Returns false if id is already queued or the queue is full
+    // of pending reads; the oldest finished reads make room for new ones.
+    bool Queue(int id, char const *path, int32_t offset, int32_t size);
+
+    // Get the bytes read for id, to be freed by the caller. Waits if they
+    // are being read right now, and returns NULL if they were not asked
+    // for or not read yet, in which case the caller reads them itself.
+    uint8_t *Take(int id, bool &waited);
+
+    // Forget about id, or about everything, e.g. when items go away
+    void Cancel(int id);
+    void Clear();
+
+    // Stop the thread and free everything; Queue() starts it again
+    void Stop();
+
+private:
+    enum { FREE, QUEUED, READING, DONE };
+
+    struct Slot
+    {
+        int id, state;
+        int32_t offset, size;
+        uint32_t order; // slots are read in the order they were queued
+        char *path;
+        uint8_t *data;
+    };
+
+    static int ThreadMain(void *data);
+    void Run();
+    Slot *Find(int id);
+    void Free(Slot *s);
+
+    Slot m_slots[LOADER_SLOTS];
+    uint32_t m_order;
+    bool m_quit;
+
+    SDL_Thread *m_thread;
+    SDL_mutex *m_mutex;
+    SDL_cond *m_cond; // a read was queued or finished, or it is time to quit
+
+    // only used by the thread, so that reads from one file don't reopen it
+    FILE *m_fp;
+    char *m_fp_path;
+};
+
+#endif // __CACHELOADER_H__
@@ -105,6 +105,313 @@ static view *lget_view(void *arg, char const *msg)
   return c;
 }
 
+//
+// C functions called by most AI functions on every tick, through the
+// native table rather than c_caller(); see add_c_native()
+//
+static long c_distx(LArg const *)
+{
+    return abs(current_object->x - current_level->attacker(current_object)->x);
+}
+
+static long c_disty(LArg const *)
+{
+    return abs(current_object->y - current_level->attacker(current_object)->y);
+}
+
+static long c_bg_state(LArg const *)
+{
+    return current_level->attacker(current_object)->state;
+}
+
+static long c_aitype(LArg const *) { return current_object->aitype(); }
+
+static long c_aistate(LArg const *)
+{
+    if (!current_object->keep_ai_info())
+        current_object->set_aistate(0);
+    return current_object->aistate();
+}
+
+static long c_set_aistate(LArg const *a)
+{
+    current_object->set_aistate_time(0);
+    current_object->set_aistate(a[0].n);
+    return 1;
+}
+
+static long c_random(LArg const *a) { return jrandom(a[0].n); }
+static long c_state_time(LArg const *) { return current_object->aistate_time(); }
+static long c_state(LArg const *) { return current_object->state; }
+
+static long c_toward(LArg const *)
+{
+    return current_level->attacker(current_object)->x > current_object->x
+            ? 1 : -1;
+}
+
+static long c_move(LArg const *a)
+{
+    return current_object->move(a[0].n, a[1].n, a[2].n);
+}
+
+static long c_facing(LArg const *)
+{
+    return current_object->direction > 0 ? 1 : -1;
+}
+
+static long c_otype(LArg const *) { return current_object->otype; }
+static long c_next_picture(LArg const *) { return current_object->next_picture(); }
+
+static long c_set_fade_dir(LArg const *a)
+{
+    current_object->set_fade_dir(a[0].n);
+    return 1;
+}
+
+static long c_mover(LArg const *a)
+{
+    return current_object->mover(a[0].n, a[1].n, a[2].n);
+}
+
+static long c_set_fade_count(LArg const *a)
+{
+    current_object->set_fade_count(a[0].n);
+    return 1;
+}
+
+static long c_fade_count(LArg const *) { return current_object->fade_count(); }
+static long c_fade_dir(LArg const *) { return current_object->fade_dir(); }
+
+static long c_touching_bg(LArg const *)
+{
+    int32_t x1, y1, x2, y2, xp1, yp1, xp2, yp2;
+    current_level->attacker(current_object)->picture_space(x1, y1, x2, y2);
+    current_object->picture_space(xp1, yp1, xp2, yp2);
+    return !(xp1 > x2 || xp2 < x1 || yp1 > y2 || yp2 < y1);
+}
+
+static long c_add_power(LArg const *a)
+{
+    current_object->add_power(a[0].n);
+    return 0;
+}
+
+static long c_add_hp(LArg const *a)
+{
+    current_object->add_hp(a[0].n);
+    return 0;
+}
+
+static long c_x(LArg const *) { return current_object->x; }
+static long c_y(LArg const *) { return current_object->y; }
+
+static long c_set_x(LArg const *a)
+{
+    current_object->x = a[0].n;
+    if (current_level)
+        current_level->update_grid(current_object);
+    return 1;
+}
+
+static long c_set_y(LArg const *a)
+{
+    current_object->y = a[0].n;
+    if (current_level)
+        current_level->update_grid(current_object);
+    return 1;
+}
+
+static long c_push_characters(LArg const *a)
+{
+    return current_level->push_characters(current_object, a[0].n, a[1].n);
+}
+
+static long c_set_state(LArg const *a)
+{
+    current_object->set_state((character_state)a[0].n);
+    return a[0].n == current_object->state;
+}
+
+static long c_bg_x(LArg const *) { return current_level->attacker(current_object)->x; }
+static long c_bg_y(LArg const *) { return current_level->attacker(current_object)->y; }
+
+static long c_set_aitype(LArg const *a)
+{
+    current_object->change_aitype(a[0].n);
+    return 1;
+}
+
+static long c_xvel(LArg const *) { return current_object->xvel(); }
+static long c_yvel(LArg const *) { return current_object->yvel(); }
+
+static long c_set_xvel(LArg const *a)
+{
+    current_object->set_xvel(a[0].n);
+    return 1;
+}
+
+static long c_set_yvel(LArg const *a)
+{
+    current_object->set_yvel(a[0].n);
+    return 1;
+}
+
+static long c_away(LArg const *)
+{
+    return current_level->attacker(current_object)->x > current_object->x
+            ? -1 : 1;
+}
+
+static long c_blocked_left(LArg const *a) { return a[0].n & BLOCKED_LEFT; }
+static long c_blocked_right(LArg const *a) { return a[0].n & BLOCKED_RIGHT; }
+static long c_blocked_up(LArg const *a) { return a[0].n & BLOCKED_UP; }
+static long c_blocked_down(LArg const *a) { return a[0].n & BLOCKED_DOWN; }
+
+static long c_direction(LArg const *) { return current_object->direction; }
+
+static long c_set_direction(LArg const *a)
+{
+    current_object->direction = a[0].n;
+    return 0;
+}
+
+static long c_hp(LArg const *) { return current_object->hp(); }
+
+static long c_set_gravity(LArg const *a)
+{
+    current_object->set_gravity(a[0].n);
+    return 1;
+}
+
+static long c_tick(LArg const *) { return current_object->tick(); }
+
+static long c_set_xacel(LArg const *a)
+{
+    current_object->set_xacel(a[0].n);
+    return 1;
+}
+
+static long c_set_yacel(LArg const *a)
+{
+    current_object->set_yacel(a[0].n);
+    return 1;
+}
+
+static long c_total_objects(LArg const *) { return current_object->total_objects(); }
+static long c_total_lights(LArg const *) { return current_object->total_lights(); }
+
+static long c_light_r1(LArg const *a) { return ((light_source *)a[0].p)->inner_radius; }
+static long c_light_r2(LArg const *a) { return ((light_source *)a[0].p)->outer_radius; }
+static long c_light_x(LArg const *a) { return ((light_source *)a[0].p)->x; }
+static long c_light_y(LArg const *a) { return ((light_source *)a[0].p)->y; }
+static long c_light_xshift(LArg const *a) { return ((light_source *)a[0].p)->xshift; }
+static long c_light_yshift(LArg const *a) { return ((light_source *)a[0].p)->yshift; }
+
+static long c_xacel(LArg const *) { return current_object->xacel(); }
+static long c_yacel(LArg const *) { return current_object->yacel(); }
+
+// These always returned nil
+static long c_set_fx(LArg const *a) { current_object->set_fx(a[0].n); return 0; }
+static long c_set_fy(LArg const *a) { current_object->set_fy(a[0].n); return 0; }
+static long c_set_fxvel(LArg const *a) { current_object->set_fxvel(a[0].n); return 0; }
+static long c_set_fyvel(LArg const *a) { current_object->set_fyvel(a[0].n); return 0; }
+static long c_set_fxacel(LArg const *a) { current_object->set_fxacel(a[0].n); return 0; }
+static long c_set_fyacel(LArg const *a) { current_object->set_fyacel(a[0].n); return 0; }
+
+static long c_picture_width(LArg const *) { return current_object->picture()->Size().x; }
+static long c_picture_height(LArg const *) { return current_object->picture()->Size().y; }
+
+static long c_platform_push(LArg const *a)
+{
+    return current_level->platform_push(current_object, a[0].n, a[1].n);
+}
+
+static long c_site_angle(LArg const *a)
+{
+    game_object *o = (game_object *)a[0].p;
+    int32_t x = o->x - current_object->x,
+            y = -(o->y - o->picture()->Size().y / 2
+                   - (current_object->y - (current_object->picture()->Size().y / 2)));
+    return lisp_atan2(y, x);
+}
+
+static long c_set_course(LArg const *a)
+{
+    int32_t ang = a[0].n, mag = a[1].n;
+    int32_t xvel = (lisp_cos(ang) >> 8) * (mag >> 8);
+    current_object->set_xvel(xvel >> 16);
+    current_object->set_fxvel((xvel & 0xffff) >> 8);
+    int32_t yvel = -(lisp_sin(ang) >> 8) * (mag >> 8);
+    current_object->set_yvel(yvel >> 16);
+    current_object->set_fyvel((yvel & 0xffff) >> 8);
+    return 0;
+}
+
+static long c_set_frame_angle(LArg const *a)
+{
+    int tframes = current_object->total_frames(), f;
+
+    int32_t ang1 = a[0].n;
+    if (ang1 < 0) ang1 = (ang1 % 360) + 360;
+    else if (ang1 >= 360) ang1 = ang1 % 360;
+    int32_t ang2 = a[1].n;
+    if (ang2 < 0) ang2 = (ang2 % 360) + 360;
+    else if (ang2 >= 360) ang2 = ang2 % 360;
+
+    int32_t ang = (a[2].n + 90 / tframes) % 360;
+    if (ang1 > ang2)
+    {
+        if (ang < ang1 && ang > ang2)
+            return 0;
+        else if (ang >= ang1)
+            f = (ang - ang1) * tframes / (359 - ang1 + ang2 + 1);
+        else
+            f = (359 - ang1 + ang) * tframes / (359 - ang1 + ang2 + 1);
+    }
+    else if (ang < ang1 || ang > ang2)
+        return 0;
+    else
+        f = (ang - ang1) * tframes / (ang2 - ang1 + 1);
+    if (current_object->direction > 0)
+        current_object->current_frame = f;
+    else
+        current_object->current_frame = tframes - f - 1;
+    return 1;
+}
+
+static long c_jump_state(LArg const *a)
+{
+    int x = current_object->current_frame;
+    current_object->set_state((character_state)a[0].n);
+    current_object->current_frame = x;
+    return 0;
+}
+
+static long c_morphing(LArg const *) { return current_object->morph_status() != NULL; }
+static long c_gravity(LArg const *) { return current_object->gravity(); }
+
+static long c_has_object(LArg const *a)
+{
+    int x = current_object->total_objects();
+    for (int i = 0; i < x; i++)
+        if (current_object->get_object(i) == (game_object *)a[0].p)
+            return 1;
+    return 0;
+}
+
+static long c_current_frame(LArg const *) { return current_object->current_frame; }
+static long c_fx(LArg const *) { return current_object->fx(); }
+static long c_fy(LArg const *) { return current_object->fy(); }
+static long c_fxvel(LArg const *) { return current_object->fxvel(); }
+static long c_fyvel(LArg const *) { return current_object->fyvel(); }
+static long c_fxacel(LArg const *) { return current_object->fxacel(); }
+static long c_fyacel(LArg const *) { return current_object->fyacel(); }
+
+static long c_isa_player(LArg const *) { return current_object->controller() != NULL; }
+static long c_total_frames(LArg const *) { return current_object->total_frames(); }
+static long c_targetable(LArg const *) { return current_object->targetable(); }
+
 extern int get_option(char const *name);
 extern void set_login(char const *name);
 
@@ -205,63 +512,63 @@ void clisp_init()                            // call by lisp_init, defines symbo
   l_song_list = LSymbol::FindOrCreate("song_list");
   l_post_render = LSymbol::FindOrCreate("post_render");
 
-  add_c_function("distx",0,0,                   1);
-  add_c_function("disty",0,0,                   2);
+  add_c_native("distx",1,"",                  c_distx);
+  add_c_native("disty",2,"",                  c_disty);
   add_c_bool_fun("key_pressed",1,1,             3);
   add_c_bool_fun("local_key_pressed",1,1,       4);
 
-  add_c_function("bg_state",0,0,                5);
-  add_c_function("aitype",0,0,                  6);
-  add_c_function("aistate",0,0,                 7);
-  add_c_function("set_aistate",1,1,             8);
-  add_c_function("random",1,1,                  9);
-  add_c_function("state_time",0,0,             10);
-  add_c_function("state",0,0,                  11);
-  add_c_function("toward",0,0,                 12);
-  add_c_function("move",3,3,                   13);
-  add_c_function("facing",0,0,                 14);
-  add_c_function("otype",0,0,                  15);
-  add_c_bool_fun("next_picture",0,0,           16);
-  add_c_bool_fun("set_fade_dir",1,1,           17);
-  add_c_function("mover",3,3,                  18);
-  add_c_bool_fun("set_fade_count",1,1,         19);
-  add_c_function("fade_count",0,0,             20);
-  add_c_function("fade_dir",0,0,               21);
-  add_c_bool_fun("touching_bg",0,0,            22);
-  add_c_function("add_power",1,1,              23);
-  add_c_function("add_hp",1,1,                 24);
+  add_c_native("bg_state",5,"",               c_bg_state);
+  add_c_native("aitype",6,"",                 c_aitype);
+  add_c_native("aistate",7,"",                c_aistate);
+  add_c_native("set_aistate",8,"n",           c_set_aistate);
+  add_c_native("random",9,"n",                c_random);
+  add_c_native("state_time",10,"",            c_state_time);
+  add_c_native("state",11,"",                 c_state);
+  add_c_native("toward",12,"",                c_toward);
+  add_c_native("move",13,"nnn",               c_move);
+  add_c_native("facing",14,"",                c_facing);
+  add_c_native("otype",15,"",                 c_otype);
+  add_c_bool_native("next_picture",16,"",     c_next_picture);
+  add_c_bool_native("set_fade_dir",17,"n",    c_set_fade_dir);
+  add_c_native("mover",18,"nnn",              c_mover);
+  add_c_bool_native("set_fade_count",19,"n",  c_set_fade_count);
+  add_c_native("fade_count",20,"",            c_fade_count);
+  add_c_native("fade_dir",21,"",              c_fade_dir);
+  add_c_bool_native("touching_bg",22,"",      c_touching_bg);
+  add_c_native("add_power",23,"n",            c_add_power);
+  add_c_native("add_hp",24,"n",               c_add_hp);
 
   add_c_bool_fun("draw",0,0,                   27);
   add_c_bool_fun("edit_mode",0,0,              28);
   add_c_bool_fun("draw_above",0,0,             29);
-  add_c_function("x",0,0,                      30);
-  add_c_function("y",0,0,                      31);
-  add_c_bool_fun("set_x",1,1,                  32);
-  add_c_bool_fun("set_y",1,1,                  33);
-  add_c_bool_fun("push_characters",2,2,        34);
+  add_c_native("x",30,"",                     c_x);
+  add_c_native("y",31,"",                     c_y);
+  add_c_bool_native("set_x",32,"n",           c_set_x);
+  add_c_bool_native("set_y",33,"n",           c_set_y);
+  add_c_bool_native("push_characters",34,"nn",c_push_characters);
 
 
 
-  add_c_bool_fun("set_state",1,1,              37);
-  add_c_function("bg_x",0,0,                   38);
-  add_c_function("bg_y",0,0,                   39);
-  add_c_bool_fun("set_aitype",1,1,             40);
+  add_c_bool_native("set_state",37,"n",       c_set_state);
+  add_c_native("bg_x",38,"",                  c_bg_x);
+  add_c_native("bg_y",39,"",                  c_bg_y);
+  add_c_bool_native("set_aitype",40,"n",      c_set_aitype);
 
-  add_c_function("xvel",0,0,                   42);
-  add_c_function("yvel",0,0,                   43);
-  add_c_bool_fun("set_xvel",1,1,               44);
-  add_c_bool_fun("set_yvel",1,1,               45);
-  add_c_function("away",0,0,                   46);
-  add_c_bool_fun("blocked_left",1,1,           47);
-  add_c_bool_fun("blocked_right",1,1,          48);
+  add_c_native("xvel",42,"",                  c_xvel);
+  add_c_native("yvel",43,"",                  c_yvel);
+  add_c_bool_native("set_xvel",44,"n",        c_set_xvel);
+  add_c_bool_native("set_yvel",45,"n",        c_set_yvel);
+  add_c_native("away",46,"",                  c_away);
+  add_c_bool_native("blocked_left",47,"n",    c_blocked_left);
+  add_c_bool_native("blocked_right",48,"n",   c_blocked_right);
 
   add_c_function("add_palette",1,-1,           50);    // name, w,h,x,y,scale, tiles
   add_c_bool_fun("screen_shot",1,1,            51);    // filename
 
   add_c_bool_fun("set_zoom",1,1,               52);
   add_c_function("show_help",1,1,              55);    // type, x,y
-  add_c_function("direction",0,0,              56);
-  add_c_function("set_direction",1,1,          57);
+  add_c_native("direction",56,"",             c_direction);
+  add_c_native("set_direction",57,"n",        c_set_direction);
 
   add_c_bool_fun("freeze_player",1,1,          58);   // freeze time
 
@@ -282,14 +589,14 @@ void clisp_init()                            // call by lisp_init, defines symbo
   add_c_bool_fun("level:new",3,3,              74);    // width, height, name
 
   add_c_bool_fun("do_damage",2,4,              75);    // amount, to_object, [pushx pushy]
-  add_c_function("hp",0,0,                     76);
+  add_c_native("hp",76,"",                    c_hp);
   add_c_bool_fun("set_shift_down",2,2,         77);
   add_c_bool_fun("set_shift_right",2,2,        78);
-  add_c_bool_fun("set_gravity",1,1,            79);
-  add_c_function("tick",0,0,                   80);
+  add_c_bool_native("set_gravity",79,"n",     c_set_gravity);
+  add_c_native("tick",80,"",                  c_tick);
 
-  add_c_bool_fun("set_xacel",1,1,              81);
-  add_c_bool_fun("set_yacel",1,1,              82);
+  add_c_bool_native("set_xacel",81,"n",       c_set_xacel);
+  add_c_bool_native("set_yacel",82,"n",       c_set_yacel);
   add_c_bool_fun("set_local_players",1,1,      84);   // set # of players on this machine, unsupported?
   add_c_function("local_players",0,0,          85);
 
@@ -308,8 +615,8 @@ void clisp_init()                            // call by lisp_init, defines symbo
   add_c_bool_fun("remove_object",1,1,          99);
   add_c_bool_fun("link_light",1,1,            100);
   add_c_bool_fun("remove_light",1,1,          101);
-  add_c_function("total_objects",0,0,         102);
-  add_c_function("total_lights",0,0,          103);
+  add_c_native("total_objects",102,"",        c_total_objects);
+  add_c_native("total_lights",103,"",         c_total_lights);
 
   add_c_bool_fun("set_light_r1",2,2,          104);
   add_c_bool_fun("set_light_r2",2,2,          105);
@@ -318,27 +625,27 @@ void clisp_init()                            // call by lisp_init, defines symbo
   add_c_bool_fun("set_light_xshift",2,2,      108);
   add_c_bool_fun("set_light_yshift",2,2,      109);
 
-  add_c_function("light_r1",1,1,              110);
-  add_c_function("light_r2",1,1,              111);
-  add_c_function("light_x",1,1,               112);
-  add_c_function("light_y",1,1,               113);
-  add_c_function("light_xshift",1,1,          114);
-  add_c_function("light_yshift",1,1,          115);
+  add_c_native("light_r1",110,"p",            c_light_r1);
+  add_c_native("light_r2",111,"p",            c_light_r2);
+  add_c_native("light_x",112,"p",             c_light_x);
+  add_c_native("light_y",113,"p",             c_light_y);
+  add_c_native("light_xshift",114,"p",        c_light_xshift);
+  add_c_native("light_yshift",115,"p",        c_light_yshift);
 
-  add_c_function("xacel",0,0,                 116);
-  add_c_function("yacel",0,0,                 117);
+  add_c_native("xacel",116,"",                c_xacel);
+  add_c_native("yacel",117,"",                c_yacel);
   add_c_bool_fun("delete_light",1,1,          118);
 
-  add_c_bool_fun("set_fx",1,1,                119);
-  add_c_bool_fun("set_fy",1,1,                120);
-  add_c_bool_fun("set_fxvel",1,1,             121);
-  add_c_bool_fun("set_fyvel",1,1,             122);
-  add_c_bool_fun("set_fxacel",1,1,            123);
-  add_c_bool_fun("set_fyacel",1,1,            124);
-  add_c_function("picture_width",0,0,         125);
-  add_c_function("picture_height",0,0,        126);
+  add_c_bool_native("set_fx",119,"n",         c_set_fx);
+  add_c_bool_native("set_fy",120,"n",         c_set_fy);
+  add_c_bool_native("set_fxvel",121,"n",      c_set_fxvel);
+  add_c_bool_native("set_fyvel",122,"n",      c_set_fyvel);
+  add_c_bool_native("set_fxacel",123,"n",     c_set_fxacel);
+  add_c_bool_native("set_fyacel",124,"n",     c_set_fyacel);
+  add_c_native("picture_width",125,"",        c_picture_width);
+  add_c_native("picture_height",126,"",       c_picture_height);
   add_c_bool_fun("trap",0,0,                  127);
-  add_c_bool_fun("platform_push",2,2,         128);
+  add_c_bool_native("platform_push",128,"nn", c_platform_push);
 
   add_c_function("def_sound",1,2,             133);  // symbol, filename [ or just filenmae]
   add_c_bool_fun("play_sound",1,4,            134);
@@ -354,19 +661,19 @@ void clisp_init()                            // call by lisp_init, defines symbo
   add_c_function("current_weapon",0,0,        146);  // weapon_type, amount
   add_c_function("current_weapon_type",0,0,   147);  // returns total for type weapon
 
-  add_c_bool_fun("blocked_up",1,1,            148);
-  add_c_bool_fun("blocked_down",1,1,          149);
+  add_c_bool_native("blocked_up",148,"n",     c_blocked_up);
+  add_c_bool_native("blocked_down",149,"n",   c_blocked_down);
   add_c_bool_fun("give_weapon",1,1,           150);  // type
   add_c_function("get_ability",1,1,           151);
   add_c_bool_fun("reset_player",0,0,          152);
-  add_c_function("site_angle",1,1,            153);
-  add_c_bool_fun("set_course",2,2,            154);  // angle, magnitude
-  add_c_bool_fun("set_frame_angle",3,3,       155);  // ang1,ang2, ang
-  add_c_bool_fun("jump_state",1,1,            156);  // don't reset current_frame
+  add_c_native("site_angle",153,"p",          c_site_angle);
+  add_c_bool_native("set_course",154,"nf",    c_set_course);  // angle, magnitude
+  add_c_bool_native("set_frame_angle",155,"nnn",c_set_frame_angle);  // ang1,ang2, ang
+  add_c_bool_native("jump_state",156,"n",     c_jump_state);  // don't reset current_frame
 
-  add_c_bool_fun("morphing",0,0,              168);
+  add_c_bool_native("morphing",168,"",        c_morphing);
   add_c_bool_fun("damage_fun",6,6,            169);
-  add_c_bool_fun("gravity",0,0,               170);
+  add_c_bool_native("gravity",170,"",         c_gravity);
   add_c_bool_fun("make_view_solid",1,1,       171);
   add_c_function("find_rgb",3,3,              172);
 
@@ -379,16 +686,16 @@ void clisp_init()                            // call by lisp_init, defines symbo
   add_c_bool_fun("set_bg_scroll",4,4,         178);  // xmul xdiv ymul ydiv
   add_c_bool_fun("set_ambient_light",2,2,     179);  // player, 0..63 (out of bounds ignored)
   add_c_function("ambient_light",1,1,         180);  // player
-  add_c_bool_fun("has_object",1,1,            181);  // true if linked with object x
+  add_c_bool_native("has_object",181,"p",     c_has_object);  // true if linked with object x
   add_c_bool_fun("set_otype",1,1,             182);  // otype
 
-  add_c_function("current_frame",0,0,         184);
-  add_c_function("fx",0,0,                    185);
-  add_c_function("fy",0,0,                    186);
-  add_c_function("fxvel",0,0,                 187);
-  add_c_function("fyvel",0,0,                 188);
-  add_c_function("fxacel",0,0,                189);
-  add_c_function("fyacel",0,0,                190);
+  add_c_native("current_frame",184,"",        c_current_frame);
+  add_c_native("fx",185,"",                   c_fx);
+  add_c_native("fy",186,"",                   c_fy);
+  add_c_native("fxvel",187,"",                c_fxvel);
+  add_c_native("fyvel",188,"",                c_fyvel);
+  add_c_native("fxacel",189,"",               c_fxacel);
+  add_c_native("fyacel",190,"",               c_fyacel);
   add_c_bool_fun("set_stat_bar",2,2,          191);  // filename, object
   add_c_bool_fun("set_fg_tile",3,3,           192);  // x,y, tile #
   add_c_function("fg_tile",2,2,               193);  // x,y
@@ -435,9 +742,9 @@ void clisp_init()                            // call by lisp_init, defines symbo
   add_c_function("total_players",0,0,         233);
   add_c_bool_fun("scatter_line",6,6,          234);  // x1,y1,x2,y2, color, scatter value
   add_c_function("game_tick",0,0,             235);
-  add_c_bool_fun("isa_player",0,0,            236);
+  add_c_bool_native("isa_player",236,"",      c_isa_player);
   add_c_bool_fun("shift_rand_table",1,1,      237);  // amount
-  add_c_function("total_frames",0,0,          238);
+  add_c_native("total_frames",238,"",         c_total_frames);
   add_c_function("raise",0,0,                 239);  // call only from reload constructor!
   add_c_function("lower",0,0,                 240);  // call only from reload constructor!
 
@@ -451,7 +758,7 @@ void clisp_init()                            // call by lisp_init, defines symbo
   add_c_function("argc",0,0,                  248);
   add_c_bool_fun("play_song",1,1,             249);  // filename
   add_c_bool_fun("stop_song",0,0,             250);
-  add_c_bool_fun("targetable",0,0,            251);
+  add_c_bool_native("targetable",251,"",      c_targetable);
   add_c_bool_fun("set_targetable",1,1,        252);  // T or nil
   add_c_bool_fun("show_stats",0,0,            253);
 
@@ -707,7 +1014,8 @@ void *l_caller(long number, void *args)
       int r2=lnumber_value(CAR(args)->Eval()); args=lcdr(args);
       int xs=lnumber_value(CAR(args)->Eval()); args=lcdr(args);
       int ys=lnumber_value(CAR(args)->Eval());
-      return LPointer::Create(add_light_source(t,x,y,r1,r2,xs,ys));
+      // lights made by game code follow objects around or are short lived
+      return LPointer::Create(add_light_source(t,x,y,r1,r2,xs,ys,1));
     } break;
     case 15 :
     {
@@ -1048,17 +1356,12 @@ void *l_caller(long number, void *args)
 // arguments have already been evaled..
 long c_caller(long number, void *args)
 {
+    if (LNative const *nat = LNative::Find(number))
+        return nat->Call(args);
+
     PtrRef r1(args);
     switch (number)
     {
-        case 1:
-        {
-            return abs(current_object->x-current_level->attacker(current_object)->x);
-        } break;
-        case 2:
-        {
-            return abs(current_object->y-current_level->attacker(current_object)->y);
-        } break;
         case 3:
         {
             if( !current_object->controller() )
@@ -1074,139 +1377,18 @@ long c_caller(long number, void *args)
         {
             return the_game->key_down(lnumber_value(CAR(args)));
         } break;
-        case 5:
-        {
-            return current_level->attacker(current_object)->state;
-        } break;
-        case 6:
-        {
-            return current_object->aitype();
-        } break;
-        case 7:
-        {
-            if (!current_object->keep_ai_info())
-                current_object->set_aistate(0);
-            return current_object->aistate();
-        } break;
-        case 8:
-        {
-            int ns=lnumber_value(CAR(args));
-            current_object->set_aistate_time(0);
-            current_object->set_aistate(ns); return 1;
-        } break;
-        case 9:
-        {
-/*      if (rcheck_lp)
-      {
-    char str[100];
-    sprintf(str,"\n\nTick %d, Rand_on %d\n",current_level->tick_counter(),rand_on);
-    rcheck_lp->write(str,strlen(str)+1);
-    current_print_file=rcheck_lp;
-    print_trace_stack(6);
-    current_print_file=NULL;
-      }*/
-
-            return jrandom(lnumber_value(CAR(args)));
-        } break;
-        case 10 : return current_object->aistate_time(); break;
-        case 11 : return current_object->state; break;
-        case 12:
-        {
-            if (current_level->attacker(current_object)->x>current_object->x)
-                return 1;
-            else
-                return -1;
-        } break;
-        case 13:
-        {
-            return current_object->move(lnumber_value(CAR(args)),lnumber_value(CAR(CDR(args))), lnumber_value(CAR(CDR(CDR(args)))));
-        } break;
-        case 14:
-        {
-            if (current_object->direction>0)
-                return 1;
-            else
-                return -1;
-        } break;
-    case 15 : return current_object->otype; break;
-    case 16 : return current_object->next_picture(); break;
-    case 17 : current_object->set_fade_dir(lnumber_value(CAR(args))); return 1; break;
-    case 18 :
-    {
-      int cx=lnumber_value(CAR(args));
-      args=CDR(args);
-      int cy=lnumber_value(CAR(args));
-      args=CDR(args);
-      int but=lnumber_value(CAR(args));
-      return current_object->mover(cx,cy,but);
-    } break;
-    case 19 : current_object->set_fade_count(lnumber_value(CAR(args))); return 1; break;
-    case 20 : return current_object->fade_count(); break;
-    case 21 : return current_object->fade_dir(); break;
-    case 22 :
-    {
-      int32_t x1,y1,x2,y2,xp1,yp1,xp2,yp2;
-      current_level->attacker(current_object)->picture_space(x1,y1,x2,y2);
-      current_object->picture_space(xp1,yp1,xp2,yp2);
-      if (xp1>x2 || xp2<x1 || yp1>y2 || yp2<y1) return 0;
-      else return 1;
-    } break;
-    case 23 : current_object->add_power(lnumber_value(CAR(args))); break;
-    case 24 : current_object->add_hp(lnumber_value(CAR(args))); break;
-
     case 27 :
     { current_object->drawer(); return 1; } break;
     case 28 :
     { return (dev & EDIT_MODE); } break;
     case 29 :
     { current_object->draw_above(current_view); return 1; } break;
-    case 30 : return current_object->x; break;
-    case 31 : return current_object->y; break;
-    case 32 :
-    { int32_t v=lnumber_value(CAR(args));
-      current_object->x=v;
-//      current_object->last_x=v;
-      return 1;
-    } break;
-    case 33 :
-    { int32_t v=lnumber_value(CAR(args));
-      current_object->y=v;
-//      current_object->last_y=v;
-      return 1;
-    } break;
-
-    case 34 : { return current_level->push_characters(current_object,lnumber_value(CAR(args)),
-                        lnumber_value(CAR(CDR(args))));
-          } break;
-
-    case 37 :
-    {
-      int32_t s=lnumber_value(CAR(args));
-      current_object->set_state((character_state)s);
-      return (s==current_object->state);
-    } break;
-
-    case 38 : return current_level->attacker(current_object)->x; break;
-    case 39 : return current_level->attacker(current_object)->y; break;
-    case 40 : current_object->change_aitype(lnumber_value(CAR(args))); return 1; break;
-
-    case 42 : return current_object->xvel(); break;
-    case 43 : return current_object->yvel(); break;
-    case 44 : current_object->set_xvel(lnumber_value(CAR(args))); return 1; break;
-    case 45 : current_object->set_yvel(lnumber_value(CAR(args))); return 1; break;
-    case 46 : if (current_level->attacker(current_object)->x>current_object->x) return -1;
-              else return 1; break;
-    case 47 : return lnumber_value(CAR(args))&BLOCKED_LEFT; break;
-    case 48 : return lnumber_value(CAR(args))&BLOCKED_RIGHT; break;
-
     case 50 : dev_cont->add_palette(args); break;
     case 51 : write_PCX(main_screen,pal,lstring_value(CAR(args))); break;
 
     case 52 : the_game->zoom=lnumber_value(CAR(args)); the_game->draw(); break;
     case 55 : the_game->show_help(lstring_value(CAR(args))); break;
 
-    case 56 : return current_object->direction; break;
-    case 57 : current_object->direction=lnumber_value(CAR(args)); break;
     case 58 :
     {
       int x1=lnumber_value(CAR(args));
@@ -1256,7 +1438,6 @@ long c_caller(long number, void *args)
       }
       o->do_damage(amount,current_object,current_object->x,current_object->y,xv,yv);
     } break;
-    case 76 : return current_object->hp(); break;
     case 77 :
     {
       game_object *o=(game_object *)lpointer_value(CAR(args));
@@ -1269,10 +1450,6 @@ long c_caller(long number, void *args)
       if (!o->controller()) printf("set shift: object is not a focus\n");
       else o->controller()->m_shift.x=lnumber_value(CAR(CDR(args))); return 1;
     } break;
-    case 79 : current_object->set_gravity(lnumber_value(CAR(args))); return 1; break;
-    case 80 : return current_object->tick(); break;
-    case 81 : current_object->set_xacel((lnumber_value(CAR(args)))); return 1; break;
-    case 82 : current_object->set_yacel((lnumber_value(CAR(args)))); return 1; break;
     case 84 : set_local_players(lnumber_value(CAR(args))); return 1; break;
     case 85 : return total_local_players(); break;
     case 86 : light_detail=lnumber_value(CAR(args)); return 1; break;
@@ -1302,9 +1479,6 @@ long c_caller(long number, void *args)
     case 99 : current_object->remove_object((game_object *)lpointer_value(CAR(args))); return 1; break;
     case 100 : current_object->add_light((light_source *)lpointer_value(CAR(args))); return 1; break;
     case 101 : current_object->remove_light((light_source *)lpointer_value(CAR(args))); return 1; break;
-    case 102 : return current_object->total_objects(); break;
-    case 103 : return current_object->total_lights(); break;
-
     case 104 :
     { light_source *l=(light_source *)lpointer_value(CAR(args));
       int32_t x=lnumber_value(CAR(CDR(args)));
@@ -1345,27 +1519,8 @@ long c_caller(long number, void *args)
       l->calc_range();
       return 1;
     } break;
-    case 110 : return ((light_source *)lpointer_value(CAR(args)))->inner_radius; break;
-    case 111 : return ((light_source *)lpointer_value(CAR(args)))->outer_radius; break;
-    case 112 : return ((light_source *)lpointer_value(CAR(args)))->x; break;
-    case 113 : return ((light_source *)lpointer_value(CAR(args)))->y; break;
-    case 114 : return ((light_source *)lpointer_value(CAR(args)))->xshift; break;
-    case 115 : return ((light_source *)lpointer_value(CAR(args)))->yshift; break;
-    case 116 : return current_object->xacel(); break;
-    case 117 : return current_object->yacel(); break;
     case 118 : current_level->remove_light((light_source *)lpointer_value(CAR(args))); break;
-    case 119 : current_object->set_fx(lnumber_value(CAR(args))); break;
-    case 120 : current_object->set_fy(lnumber_value(CAR(args))); break;
-    case 121 : current_object->set_fxvel(lnumber_value(CAR(args))); break;
-    case 122 : current_object->set_fyvel(lnumber_value(CAR(args))); break;
-    case 123 : current_object->set_fxacel(lnumber_value(CAR(args))); break;
-    case 124 : current_object->set_fyacel(lnumber_value(CAR(args))); break;
-    case 125 : return current_object->picture()->Size().x; break;
-    case 126 : return current_object->picture()->Size().y; break;
     case 127 : { dprintf("trap\n"); } break;   // I use this to set gdb break points
-    case 128 : { return current_level->platform_push(current_object,lnumber_value(CAR(args)),
-                        lnumber_value(CAR(CDR(args))));
-                        } break;
     case 133 :  // def_sound
     {
       LSymbol *sym=NULL;
@@ -1476,8 +1631,6 @@ long c_caller(long number, void *args)
         return 0; }
       else return v->current_weapon;
     } break;
-    case 148 : return lnumber_value(CAR(args))&BLOCKED_UP; break;
-    case 149 : return lnumber_value(CAR(args))&BLOCKED_DOWN; break;
     case 150 :
     {
       view *v=current_object->controller();
@@ -1505,61 +1658,6 @@ long c_caller(long number, void *args)
       else
         v->reset_player();
     } break;
-    case 153 :
-    {
-      game_object *o=(game_object *)lpointer_value(CAR(args));
-      int32_t x=o->x-current_object->x,
-        y=-(o->y-o->picture()->Size().y/2-(current_object->y-(current_object->picture()->Size().y/2)));
-      return lisp_atan2(y,x);
-    } break;
-    case 154 :
-    {
-      int32_t ang=lnumber_value(CAR(args)); args=CDR(args);
-      int32_t mag=lfixed_point_value(CAR(args));
-      int32_t xvel=(lisp_cos(ang)>>8)*(mag>>8);
-      current_object->set_xvel(xvel>>16);
-      current_object->set_fxvel((xvel&0xffff)>>8);
-      int32_t yvel=-(lisp_sin(ang)>>8)*(mag>>8);
-      current_object->set_yvel(yvel>>16);
-      current_object->set_fyvel((yvel&0xffff)>>8);
-    } break;
-    case 155 :
-    {
-      int tframes=current_object->total_frames(),f;
-
-      int32_t ang1=lnumber_value(CAR(args)); args=CDR(args);
-      if (ang1<0) ang1=(ang1%360)+360;
-      else if (ang1>=360) ang1=ang1%360;
-      int32_t ang2=lnumber_value(CAR(args)); args=CDR(args);
-      if (ang2<0) ang2=(ang2%360)+360;
-      else if (ang2>=360) ang2=ang2%360;
-
-      int32_t ang=(lnumber_value(CAR(args))+90/tframes)%360;
-      if (ang1>ang2)
-      {
-        if (ang<ang1 && ang>ang2)
-      return 0;
-    else if (ang>=ang1)
-      f=(ang-ang1)*tframes/(359-ang1+ang2+1);
-    else
-      f=(359-ang1+ang)*tframes/(359-ang1+ang2+1);
-      } else if (ang<ang1 || ang>ang2)
-        return 0;
-      else f=(ang-ang1)*tframes/(ang2-ang1+1);
-      if (current_object->direction>0)
-        current_object->current_frame=f;
-      else
-        current_object->current_frame=tframes-f-1;
-      return 1;
-    } break;
-    case 156 :
-    {
-      int x=current_object->current_frame;
-      current_object->set_state((character_state)lnumber_value(CAR(args)));
-      current_object->current_frame=x;
-    } break;
-
-    case 168 : if (current_object->morph_status()) return 1; else return 0; break;
     case 169 :
     {
       int32_t am=lnumber_value(CAR(args)); args=CDR(args);
@@ -1570,7 +1668,6 @@ long c_caller(long number, void *args)
       int32_t py=lnumber_value(CAR(args)); args=CDR(args);
       current_object->damage_fun(am,from,hitx,hity,px,py);
     } break;
-    case 170 : return current_object->gravity(); break;
     case 171 :
     {
       view *v=current_object->controller();
@@ -1638,23 +1735,7 @@ long c_caller(long number, void *args)
       if (x>=0 && x<64) v->ambient=x;
     } break;
     case 180 : return lget_view(CAR(args),"ambient_light")->ambient; break;
-    case 181 :
-    {
-      int x=current_object->total_objects();
-      game_object *who=(game_object *)lpointer_value(CAR(args));
-      for (int i=0; i<x; i++)
-        if (current_object->get_object(i)==who) return 1;
-      return 0;
-    } break;
     case 182 : current_object->change_type(lnumber_value(CAR(args))); break;
-    case 184 : return current_object->current_frame; break;
-
-    case 185 : return current_object->fx(); break;
-    case 186 : return current_object->fy(); break;
-    case 187 : return current_object->fxvel(); break;
-    case 188 : return current_object->fyvel(); break;
-    case 189 : return current_object->fxacel(); break;
-    case 190 : return current_object->fyacel(); break;
     case 191 :
     {
 //      char *fn=lstring_value(CAR(args)); args=CDR(args);
@@ -1756,6 +1837,7 @@ long c_caller(long number, void *args)
       current_object->try_move(current_object->x,current_object->y,xv,yv,1|top);
       current_object->x+=xv;
       current_object->y+=yv;
+      if (current_level) current_level->update_grid(current_object);
       return (oxv==xv && oyv==yv);
     } break;
     case 201 :
@@ -1883,7 +1965,7 @@ long c_caller(long number, void *args)
     case 223 :
     {
       char *fn=lstring_value(CAR(args));
-      current_level->save(fn,1);
+      current_level->save_async(fn,savegame_written);
     } break;
     case 224 :
     {
@@ -1977,18 +2059,10 @@ long c_caller(long number, void *args)
     case 235 :
     { if (current_level) return current_level->tick_counter();
       else return 0; } break;
-    case 236 :
-    {
-      return current_object->controller()!=NULL;
-    } break;
     case 237 :
     {
       rand_on+=lnumber_value(CAR(args)); return 1;
     } break;
-    case 238 :
-    {
-      return current_object->total_frames();
-    } break;
     case 239 :
     { current_level->to_front(current_object); } break;
     case 240 :
@@ -2071,7 +2145,6 @@ long c_caller(long number, void *args)
       delete current_song;
       current_song=NULL;
     } break;
-    case 251 : return current_object->targetable(); break;
     case 252 : current_object->set_targetable( CAR(args)==NULL ? 0 : 1); break;
     case 253 : show_stats(); break;
     case 254 :
@@ -2341,4 +2414,60 @@ int get_lprop_number(void *symbol, int def)  // returns def if symbol undefined
   } else return def;
 }
 
+// Run a Lisp function reading what AI code reads on every tick once for
+// every object in the level, rounds times with the C functions called from
+// the native table and as many times through c_caller(), which is what
+// -nonatives does. Both have to add up to the same.
+void call_bench(int rounds, void (*print)(char const *format, ...))
+{
+  static char const *const names[] = { "natives", "c_caller" };
+
+  if (!player_list || !player_list->m_focus)
+  {
+    print("call no player to measure distances from\n");
+    return;
+  }
 
+  // In permanent space, so that it is compiled to bytecode
+  char const *prog = "(defun headless:callbench () "
+    "(+ (x) (y) (xvel) (yvel) (xacel) (yacel) (fx) (fy) (fxvel) (fyvel) "
+    "(aitype) (state) (otype) (facing) (direction) (hp) (state_time) "
+    "(current_frame) (total_objects) (total_lights) (distx) (disty) "
+    "(toward) (away) (bg_x) (bg_y) (if (gravity) 1 0) "
+    "(if (isa_player) 1 0) (if (blocked_left 1) 1 0)))";
+  LSpace *sp = LSpace::Current;
+  LSpace::Current = &LSpace::Perm;
+  LObject::Compile(prog)->Eval();
+  LSpace::Current = sp;
+  LSymbol *fun = LSymbol::FindOrCreate("headless:callbench");
+
+  int objects = 0;
+  for (game_object *o = current_level->first_object(); o; o = o->next)
+    objects++;
+
+  game_object *old_object = current_object;
+  int old_natives = lisp_natives;
+  float ms[2];
+  long sum[2];
+  for (int m = 0; m < 2; m++)
+  {
+    lisp_natives = !m;
+    sum[m] = 0;
+    Timer t;
+    for (int r = 0; r < rounds; r++)
+      for (game_object *o = current_level->first_object(); o; o = o->next)
+      {
+        current_object = o;
+        sum[m] += lnumber_value(fun->EvalFunction(NULL));
+      }
+    ms[m] = t.GetMs();
+  }
+  lisp_natives = old_natives;
+  current_object = old_object;
+
+  for (int m = 0; m < 2; m++)
+    print("call %-8s %d objects x %d, %.1f ms, "
+          "%.3f us/object%s\n", names[m], objects, rounds, ms[m],
+          objects ? ms[m] * 1000.f / rounds / objects : 0.f,
+          m && sum[0] != sum[1] ? " (MISMATCH)" : "");
+}
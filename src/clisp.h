@@ -11,6 +11,8 @@
 #ifndef __CLISP_HPP_
 
 int get_lprop_number(void *sybol, int def);  // returns def if symbol undefined or not number type
+// time AI calls through the native table and through c_caller(), for -callbench
+void call_bench(int rounds, void (*print)(char const *format, ...));
 
 
 // variables for the status bar
@@ -171,10 +171,26 @@ void level::check_collisions()
     subject->picture_space(sx1,sy1,sx2,sy2);
     rec=NULL;
 
+    // only look at the targets bucketed around the subject if we can, they
+    // come back in active list order which is also target list order
+    GridQuery q;
+    int use_grid=grid.IsValid(),total=target_total;
+    if (use_grid)
+    {
+      grid.Query(q,sx1,sy1,sx2,sy2);
+      total=q.total;
+    }
 
-    for (int j=0; j<target_total && !rec; j++)
+    for (int j=0; j<total && !rec; j++)
     {
-      target=target_list[j];
+      if (use_grid)
+      {
+        target=q.list[j];
+        if (target->target_index>=target_total || target_list[target->target_index]!=target)
+          continue;
+      }
+      else
+        target=target_list[j];
       target->picture_space(tx1,ty1,tx2,ty2);
       if (!(sx2<tx1 || sy2<ty1 || sx1>tx2 || sy1>ty2))  // check to see if picture spaces collide
       {
@@ -235,6 +251,8 @@ void level::check_collisions()
     {
       rec->do_damage((int)subject->current_figure()->hit_damage,subject,hitx,hity,0,0);
       subject->note_attack(rec);
+      grid.Update(rec);
+      grid.Update(subject);
     }
   }
 }
@@ -185,6 +185,7 @@ void *top_ai()
 
     o->x=q->x;
     o->y=q->y+29-q->picture()->Size().y;
+    current_level->update_grid(o);
 
     rand_on+=o->lvars[point_angle];
     o->current_frame=best_num;
@@ -220,6 +221,7 @@ static int player_fire_weapon(game_object *o, int type, game_object *target, int
 //  current_level->foreground_intersect(other->x,other->y,x2,y2);      // find first location we can actuall "see"
 //  current_level->all_boundary_setback(o,other->x,other->y,x2,y2);       // to make we don't fire through walls
   other->y=y2;
+  current_level->update_grid(other);
 
   if (other->y==firey)             // now try to move out to end of gun if we were not blocked above
   {
@@ -227,6 +229,7 @@ static int player_fire_weapon(game_object *o, int type, game_object *target, int
     current_level->foreground_intersect(other->x,other->y,x2,y2);      // find first location we can actuall "see"
     current_level->all_boundary_setback(other,other->x,other->y,x2,y2);       // to make we don't fire through walls
     o->x=x2;
+    current_level->update_grid(o);
   }
 
   void *list=NULL;
@@ -242,6 +245,7 @@ static int player_fire_weapon(game_object *o, int type, game_object *target, int
   other->lvars[just_fired]=1;
   other->x=ox;
   other->y=oy;
+  current_level->update_grid(other);
 
   return 1;
 }
@@ -655,6 +659,7 @@ void *cop_mover(int xm, int ym, int but)
     ret=player_move(o,xm,ym,but);
     top->x=o->x;
     top->y=o->y+29-top->picture()->Size().y;
+    current_level->update_grid(top);
 
     if ((but&2) && !o->lvars[is_teleporting] && o->state!=S_climbing && o->state!=S_climb_off)
     {
@@ -755,6 +760,7 @@ void *top_draw()
       if (bot->direction<0)
         o->x+=4;
       o->y=bot->y+29-bot->picture()->Size().y;
+      current_level->update_grid(o);
 
       void *ret=NULL;
       PtrRef r1(ret);
@@ -775,6 +781,7 @@ void *top_draw()
       o->y=oldy;
       if (bot->direction<0)
         o->x-=4;
+      current_level->update_grid(o);
     }
   }
   return NULL;
@@ -961,6 +968,7 @@ void *mover_ai()
 
       obj->x=d->x-(d->x-o->x)*o->aistate()/o->aitype();
       obj->y=d->y-(d->y-o->y)*o->aistate()/o->aitype();
+      current_level->update_grid(obj);
     }
   }
   return true_symbol;
@@ -0,0 +1,218 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "delta.h"
+
+#define MIN_MATCH 4
+#define MAX_VARINT 10
+#define HASH_LEN 8   // bytes hashed to find copies away from where we are
+#define MAX_TRIES 16 // earlier places with the same hash to try
+#define GOOD_MATCH 32
+
+static inline size_t put_varint(uint8_t *dst, size_t x)
+{
+    size_t n = 0;
+    for (; x >= 0x80; x >>= 7)
+        dst[n++] = (uint8_t)(x | 0x80);
+    dst[n++] = (uint8_t)x;
+    return n;
+}
+
+static inline size_t varint_size(size_t x)
+{
+    size_t n = 1;
+    for (; x >= 0x80; x >>= 7)
+        n++;
+    return n;
+}
+
+static inline bool get_varint(uint8_t const *&p, uint8_t const *end,
+                              size_t &x)
+{
+    x = 0;
+    for (int shift = 0; p < end && shift < 7 * MAX_VARINT; shift += 7)
+    {
+        uint8_t c = *p++;
+        x |= (size_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Where a copy starts, relative to where the last operation left off
+static inline size_t zigzag(size_t from, size_t expect)
+{
+    return from >= expect ? (from - expect) * 2 : (expect - from - 1) * 2 + 1;
+}
+
+static inline uint32_t hash(uint8_t const *p, int bits)
+{
+    uint32_t a, b;
+    memcpy(&a, p, 4);
+    memcpy(&b, p + 4, 4);
+    return (a * 2654435761u ^ b * 2246822519u) >> (32 - bits);
+}
+
+static inline size_t match_length(uint8_t const *a, uint8_t const *b,
+                                  size_t max)
+{
+    size_t n = 0;
+    while (n < max && a[n] == b[n])
+        n++;
+    return n;
+}
+
+static size_t put_literals(uint8_t *dst, uint8_t const *src, size_t len)
+{
+    if (!len)
+        return 0;
+    size_t n = put_varint(dst, len * 2);
+    memcpy(dst + n, src, len);
+    return n + len;
+}
+
+size_t delta_bound(size_t size)
+{
+    // every copy may cut a run of new bytes in two, adding a length
+    return size + (size / MIN_MATCH + 1) * MAX_VARINT;
+}
+
+// Greedy: keep copying from the same place in the old data while it
+// matches, which is what unchanged parts of a column do, and only look
+// the current bytes up in a hash table of the old data when it does not
+size_t delta_make(void const *old, size_t old_size, void const *src,
+                  size_t size, void *dst)
+{
+    uint8_t const *a = (uint8_t const *)old, *b = (uint8_t const *)src;
+    uint8_t *out = (uint8_t *)dst;
+    int *head = NULL, *chain = NULL;
+    int bits = 8;
+
+    size_t op = 0, ip = 0, lit = 0, expect = 0;
+    while (ip < size)
+    {
+        size_t best = 0, from = expect;
+        if (expect < old_size)
+            best = match_length(a + expect, b + ip,
+                                old_size - expect < size - ip
+                                    ? old_size - expect : size - ip);
+
+        if (best < GOOD_MATCH && ip + HASH_LEN <= size
+             && old_size >= HASH_LEN)
+        {
+            if (!head)
+            {
+                while (bits < 16 && ((size_t)1 << bits) < old_size)
+                    bits++;
+                head = (int *)malloc(sizeof(int) << bits);
+                chain = (int *)malloc(sizeof(int) * old_size);
+                memset(head, 0xff, sizeof(int) << bits);
+                for (size_t i = 0; i + HASH_LEN <= old_size; i++)
+                {
+                    uint32_t h = hash(a + i, bits);
+                    chain[i] = head[h];
+                    head[h] = (int)i;
+                }
+            }
+
+            int tries = MAX_TRIES;
+            for (int c = head[hash(b + ip, bits)]; c >= 0 && tries--;
+                 c = chain[c])
+            {
+                size_t len = match_length(a + c, b + ip,
+                                          old_size - c < size - ip
+                                              ? old_size - c : size - ip);
+                if (len > best)
+                {
+                    best = len;
+                    from = c;
+                }
+            }
+        }
+
+        size_t cost = varint_size(best * 2 + 1)
+                       + varint_size(zigzag(from, expect));
+        if (best >= MIN_MATCH && cost < best)
+        {
+            op += put_literals(out + op, b + lit, ip - lit);
+            op += put_varint(out + op, best * 2 + 1);
+            op += put_varint(out + op, zigzag(from, expect));
+            ip += best;
+            expect = from + best;
+            lit = ip;
+        }
+        else
+        {
+            ip++;
+            expect++;
+        }
+    }
+    op += put_literals(out + op, b + lit, ip - lit);
+
+    free(head);
+    free(chain);
+    return op;
+}
+
+bool delta_apply(void const *old, size_t old_size, void const *patch,
+                 size_t patch_size, void *dst, size_t size)
+{
+    uint8_t const *a = (uint8_t const *)old;
+    uint8_t const *p = (uint8_t const *)patch, *end = p + patch_size;
+    uint8_t *out = (uint8_t *)dst;
+
+    size_t op = 0, expect = 0;
+    while (p < end)
+    {
+        size_t x;
+        if (!get_varint(p, end, x))
+            return false;
+        size_t len = x >> 1;
+        if (len > size - op)
+            return false;
+
+        if (x & 1)
+        {
+            size_t z, from;
+            if (!get_varint(p, end, z))
+                return false;
+            if (z & 1)
+            {
+                if ((z >> 1) >= expect)
+                    return false;
+                from = expect - (z >> 1) - 1;
+            }
+            else
+                from = expect + (z >> 1);
+            if (from > old_size || len > old_size - from)
+                return false;
+            memcpy(out + op, a + from, len);
+            expect = from + len;
+        }
+        else
+        {
+            if (len > (size_t)(end - p))
+                return false;
+            memcpy(out + op, p, len);
+            p += len;
+            expect += len;
+        }
+        op += len;
+    }
+    return op == size;
+}
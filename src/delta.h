@@ -0,0 +1,40 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __DELTA_H__
+#define __DELTA_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Patches that turn one version of some data into another, for savegames
+// that only keep what changed since their level was loaded. A patch is a
+// list of operations, each starting with a varint of its length times two,
+// plus one for a copy. A copy is followed by a zigzag varint of where in
+// the old data to copy from, relative to where the last operation left
+// off; a run of new bytes is followed by the bytes. Copies from anywhere
+// in the old data keep objects that moved up or down a column cheap.
+//
+
+// Most bytes delta_make() can turn size bytes into
+size_t delta_bound(size_t size);
+
+// Write the patch from old to src, which are old_size and size bytes, to
+// dst, which has room for delta_bound(size) bytes, and return its size
+size_t delta_make(void const *old, size_t old_size, void const *src,
+                  size_t size, void *dst);
+
+// Apply a patch of patch_size bytes to old, writing exactly size bytes to
+// dst; false if the patch is damaged or does not fit
+bool delta_apply(void const *old, size_t old_size, void const *patch,
+                 size_t patch_size, void *dst, size_t size);
+
+#endif // __DELTA_H__
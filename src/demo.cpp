@@ -25,6 +25,11 @@
 #include "lisp.h"
 #include "clisp.h"
 #include "netface.h"
+#include "level.h"
+#include "view.h"
+#include "loader2.h"
+#include "status.h"
+#include "lz.h"
 
 
 demo_manager demo_man;
@@ -63,6 +68,21 @@ int event_waiting()
 { return wm->IsPending(); }
 
 
+demo_manager::demo_manager()
+{
+  state=NORMAL;
+  skip_next=0;
+  sync_errors=0;
+  first_bad_tick=-1;
+  version=3;
+  demo_tick=0;
+  last_size=0;
+  memset(last_packet,0,sizeof(last_packet));
+  key_ticks=key_offsets=NULL;
+  total_keys=max_keys=0;
+  total_ticks=0;
+}
+
 int demo_manager::start_recording(char *filename)
 {
   if (!current_level) return 0;
@@ -74,7 +94,7 @@ int demo_manager::start_recording(char *filename)
   strcpy(name,current_level->name());
 
   the_game->load_level(name);
-  record_file->write((void *)"DEMO,VERSION:2",14);
+  record_file->write((void *)"DEMO,VERSION:3",14);
   record_file->write_uint8(strlen(name)+1);
   record_file->write(name,strlen(name)+1);
 
@@ -89,6 +109,11 @@ int demo_manager::start_recording(char *filename)
 
 
   state=RECORDING;
+  version=3;
+  demo_tick=0;
+  last_size=0;
+  memset(last_packet,0,sizeof(last_packet));
+  total_keys=0;
 
   reset_game();
 
@@ -158,12 +183,22 @@ int demo_manager::start_playing(char *filename)
   if (record_file->open_failure()) { delete record_file; return 0; }
   char name[100],nsize,diff;
   if (record_file->read(sig,14)!=14        ||
-      memcmp(sig,"DEMO,VERSION:2",14)!=0   ||
+      memcmp(sig,"DEMO,VERSION:",13)!=0    ||
+      (sig[13]!='2' && sig[13]!='3')       ||
       record_file->read(&nsize,1)!=1       ||
       record_file->read(name,nsize)!=nsize ||
       record_file->read(&diff,1)!=1)
   { delete record_file; return 0; }
 
+  version=sig[13]-'0';
+  demo_tick=0;
+  last_size=0;
+  memset(last_packet,0,sizeof(last_packet));
+  total_keys=0;
+  total_ticks=0;
+  if (version>=3 && !read_index())
+    dprintf("demo %s has no index, it can only be played from the start\n",filename);
+
   char tname[100],*c;
   strcpy(tname,name);
   c=tname;
@@ -185,8 +220,14 @@ int demo_manager::start_playing(char *filename)
   }
 
   state=PLAYING;
+  sync_errors=0;
+  first_bad_tick=-1;
   reset_game();
 
+  // The snapshot taken as recording started has what the game held over
+  // from before it, such as the Lisp globals, so start from there
+  if (total_keys && !key_ticks[0] && !seek(0))
+    return 0;
 
 
   return 1;
@@ -199,7 +240,10 @@ int demo_manager::set_state(demo_state new_state, char *filename)
   switch (state)
   {
     case RECORDING :
-    { delete record_file; } break;
+    {
+      finish_recording();
+      delete record_file;
+    } break;
     case PLAYING :
     {
 /*
@@ -239,17 +283,30 @@ int demo_manager::set_state(demo_state new_state, char *filename)
   return 1;
 }
 
-int demo_manager::save_packet(void *packet, int packet_size)   // returns non 0 if actually saved
+void demo_manager::sync_error(int32_t tick, uint16_t recorded, uint16_t computed)
+{
+  if (!sync_errors++)
+  {
+    first_bad_tick=tick;
+    bad_recorded=recorded;
+    bad_computed=computed;
+  }
+}
+
+int demo_manager::save_packet(void *packet, int packet_size, int at_tick)   // returns non 0 if actually saved
 {
   if (state==RECORDING)
   {
-    uint16_t ps=lstl(packet_size);
-    if (record_file->write(&ps,2)!=2 ||
-    record_file->write(packet,packet_size)!=packet_size)
+    // A snapshot is due, unless the game is ahead of the input, in which
+    // case the next tick that comes at the right time gets it
+    if (at_tick && demo_tick>=total_keys*DEMO_KEYFRAME_TICKS && current_level)
+      write_keyframe();
+    if (!write_delta((uint8_t *)packet,packet_size))
     {
       set_state(NORMAL);
       return 0;
     }
+    demo_tick++;
     return 1;
   } else return 0;
 }
@@ -258,6 +315,21 @@ int demo_manager::get_packet(void *packet, int &packet_size)   // returns non 0
 {
   if (state==PLAYING)
   {
+    if (version>=3)
+    {
+      uint8_t tag=0;
+      while (record_file->read(&tag,1)==1 && tag=='K')
+        if (!read_keyframe(0))
+          break;
+      if (tag!='T' || !read_delta((uint8_t *)packet,packet_size))
+      {
+        set_state(NORMAL);
+        return 0;
+      }
+      demo_tick++;
+      return 1;
+    }
+
     uint16_t ps;
     if (record_file->read(&ps,2)!=2)
     {
@@ -273,8 +345,296 @@ int demo_manager::get_packet(void *packet, int &packet_size)   // returns non 0
     }
 
     packet_size=ps;
+    demo_tick++;
     return 1;
   }
   return 0;
 }
 
+// 'T', the packet size, then runs of up to 128 bytes: a byte of 0 to 127
+// for that many bytes plus one kept from the previous packet, or of 128 to
+// 255 followed by that many bytes minus 127 that are new
+int demo_manager::write_delta(uint8_t const *packet, int packet_size)
+{
+  uint8_t buf[PACKET_MAX_SIZE*2+3];
+  int n=0,i=0;
+  buf[n++]='T';
+  buf[n++]=packet_size&0xff;
+  buf[n++]=packet_size>>8;
+  while (i<packet_size)
+  {
+    int run=0;
+    while (i+run<packet_size && run<128 && packet[i+run]==last_packet[i+run])
+      run++;
+    if (run)
+      buf[n++]=run-1;
+    else
+    {
+      while (i+run<packet_size && run<128 && packet[i+run]!=last_packet[i+run])
+        run++;
+      buf[n++]=0x80|(run-1);
+      memcpy(buf+n,packet+i,run);
+      n+=run;
+    }
+    i+=run;
+  }
+
+  if (last_size>packet_size)
+    memset(last_packet+packet_size,0,last_size-packet_size);
+  memcpy(last_packet,packet,packet_size);
+  last_size=packet_size;
+
+  return record_file->write(buf,n)==n;
+}
+
+int demo_manager::read_delta(uint8_t *packet, int &packet_size)
+{
+  uint8_t hdr[2];
+  if (record_file->read(hdr,2)!=2)
+    return 0;
+  int size=hdr[0]|(hdr[1]<<8),i=0;
+  if (size>PACKET_MAX_SIZE)
+    return 0;
+
+  while (i<size)
+  {
+    uint8_t run;
+    if (record_file->read(&run,1)!=1)
+      return 0;
+    int n=(run&0x7f)+1;
+    if (i+n>size)
+      return 0;
+    if ((run&0x80) && record_file->read(last_packet+i,n)!=n)
+      return 0;
+    i+=n;
+  }
+
+  if (last_size>size)
+    memset(last_packet+size,0,last_size-size);
+  last_size=size;
+  memcpy(packet,last_packet,size);
+  packet_size=size;
+  return 1;
+}
+
+// 'K', the tick, the level name, the key maps of the views, then the game
+// as level::save_state() gives it followed by the Lisp globals, packed
+// together with lz_pack()
+void demo_manager::write_keyframe()
+{
+  mFILE *fp=current_level->save_state();
+  if (!fp)
+    return;
+  // Rollback keeps them for the same reason: game scripts store state
+  // there, not only in the objects of the level
+  mFILE globals;
+  Lisp::WriteGlobals(&globals);
+
+  if (total_keys==max_keys)
+  {
+    max_keys=max_keys ? max_keys*2 : 64;
+    key_ticks=(int32_t *)realloc(key_ticks,sizeof(int32_t)*max_keys);
+    key_offsets=(int32_t *)realloc(key_offsets,sizeof(int32_t)*max_keys);
+  }
+  key_ticks[total_keys]=demo_tick;
+  key_offsets[total_keys]=record_file->tell();
+  total_keys++;
+
+  long size=fp->file_size(),gsize=globals.file_size();
+  uint8_t *data=(uint8_t *)malloc(size+gsize+1);
+  size=fp->read(data,size);
+  delete fp;
+  globals.seek(0,SEEK_SET);
+  gsize=globals.read(data+size,gsize);
+  uint8_t *packed=(uint8_t *)malloc(lz_bound(size+gsize));
+  long psize=lz_pack(data,size+gsize,packed);
+  free(data);
+
+  char const *name=current_level->name();
+  int views=0;
+  for (view *v=player_list; v; v=v->next)
+    views++;
+
+  record_file->write_uint8('K');
+  record_file->write_uint32(demo_tick);
+  record_file->write_uint8(strlen(name)+1);
+  record_file->write(name,strlen(name)+1);
+  record_file->write_uint8(views);
+  for (view *v=player_list; v; v=v->next)
+  {
+    uint8_t keys[VIEW_KEYMAP_SIZE];
+    v->get_keymap(keys);
+    record_file->write(keys,VIEW_KEYMAP_SIZE);
+  }
+  record_file->write_uint32(size);
+  record_file->write_uint32(gsize);
+  record_file->write_uint32(psize);
+  record_file->write(packed,psize);
+  free(packed);
+
+  // What comes after can be read starting from here
+  memset(last_packet,0,sizeof(last_packet));
+  last_size=0;
+}
+
+// Read a snapshot after its tag, and make it the game if restore is set
+int demo_manager::read_keyframe(int restore)
+{
+  uint8_t nsize,views;
+  char name[256];
+  int32_t tick=record_file->read_uint32();
+  if (record_file->read(&nsize,1)!=1 || record_file->read(name,nsize)!=nsize
+      || record_file->read(&views,1)!=1)
+    return 0;
+  name[nsize ? nsize-1 : 0]=0;
+
+  uint8_t *keys=(uint8_t *)malloc(views*VIEW_KEYMAP_SIZE+1);
+  if (record_file->read(keys,views*VIEW_KEYMAP_SIZE)!=views*VIEW_KEYMAP_SIZE)
+  {
+    free(keys);
+    return 0;
+  }
+  long size=record_file->read_uint32(),gsize=record_file->read_uint32(),
+       psize=record_file->read_uint32();
+
+  if (!restore)
+  {
+    free(keys);
+    // bFILE::seek() always says it worked, so see where it went
+    long next=record_file->tell()+psize;
+    if (next>record_file->file_size())
+      return 0;
+    record_file->seek(next,SEEK_SET);
+    return record_file->tell()==next;
+  }
+
+  uint8_t *packed=(uint8_t *)malloc(psize+1),
+          *data=(uint8_t *)malloc(size+gsize+1);
+  if (record_file->read(packed,psize)!=psize
+      || !lz_unpack(packed,psize,data,size+gsize))
+  {
+    free(keys);
+    free(packed);
+    free(data);
+    return 0;
+  }
+  free(packed);
+
+  quiet_status quiet;
+  status_manager *old_stat=stat_man;
+  stat_man=&quiet;
+
+  delete current_level;
+  current_level=NULL;
+  mFILE fp(data,size,0);
+  spec_directory sd(&fp);
+  current_level=new level(&sd,&fp,name);
+
+  stat_man=old_stat;
+
+  mFILE globals(data+size,gsize,0);
+  int ok=Lisp::ReadGlobals(&globals);
+  free(data);
+
+  int i=0;
+  for (view *v=player_list; v && i<views; v=v->next,i++)
+    v->set_keymap(keys+i*VIEW_KEYMAP_SIZE);
+  free(keys);
+
+  demo_tick=tick;
+  memset(last_packet,0,sizeof(last_packet));
+  last_size=0;
+  return ok;
+}
+
+// 'E', the number of ticks and the snapshots with their tick and offset,
+// then where that index starts as the last 4 bytes of the file
+void demo_manager::finish_recording()
+{
+  record_file->write_uint8('E');
+  int32_t start=record_file->tell();
+  record_file->write_uint32(demo_tick);
+  record_file->write_uint32(total_keys);
+  for (int i=0; i<total_keys; i++)
+  {
+    record_file->write_uint32(key_ticks[i]);
+    record_file->write_uint32(key_offsets[i]);
+  }
+  record_file->write_uint32(start);
+}
+
+int demo_manager::read_index()
+{
+  int32_t data_start=record_file->tell();
+  int32_t end=record_file->file_size();
+  total_keys=0;
+  total_ticks=0;
+
+  int ok=0;
+  if (end>=data_start+12)
+  {
+    record_file->seek(end-4,SEEK_SET);
+    int32_t start=record_file->read_uint32();
+    if (start>=data_start && start<=end-12)
+    {
+      record_file->seek(start,SEEK_SET);
+      int32_t ticks=record_file->read_uint32(),keys=record_file->read_uint32();
+      if (keys>=0 && keys<=(end-start-12)/8)
+      {
+        if (keys>max_keys)
+        {
+          max_keys=keys;
+          key_ticks=(int32_t *)realloc(key_ticks,sizeof(int32_t)*max_keys);
+          key_offsets=(int32_t *)realloc(key_offsets,sizeof(int32_t)*max_keys);
+        }
+        for (int i=0; i<keys; i++)
+        {
+          key_ticks[i]=record_file->read_uint32();
+          key_offsets[i]=record_file->read_uint32();
+        }
+        total_keys=keys;
+        total_ticks=ticks;
+        ok=1;
+      }
+    }
+  }
+
+  record_file->seek(data_start,SEEK_SET);
+  return ok;
+}
+
+int demo_manager::seek(int32_t tick)
+{
+  if (state!=PLAYING || !total_keys || tick<0 || tick>total_ticks)
+    return 0;
+
+  // Snapshots are taken every DEMO_KEYFRAME_TICKS ticks, or a little later
+  int k=Min(tick/DEMO_KEYFRAME_TICKS,total_keys-1);
+  while (k>0 && key_ticks[k]>tick)
+    k--;
+
+  uint8_t tag;
+  record_file->seek(key_offsets[k],SEEK_SET);
+  if (record_file->tell()!=key_offsets[k]
+      || record_file->read(&tag,1)!=1 || tag!='K' || !read_keyframe(1))
+  {
+    set_state(NORMAL);
+    return 0;
+  }
+
+  // Run up to tick without making the sounds of the ticks skipped
+  int sound=sound_avail;
+  sound_avail&=~SFX_INITIALIZED;
+  while (demo_tick<tick)
+  {
+    uint8_t buf[PACKET_MAX_SIZE+1];
+    int size;
+    if (!get_packet(buf,size))
+      break;
+    process_packet_commands(buf,size);
+    the_game->resim_step();
+  }
+  sound_avail=sound;
+
+  return state==PLAYING && demo_tick==tick;
+}
@@ -13,6 +13,17 @@
 
 #include "lisp.h"
 #include "jwindow.h"
+#include "netface.h"
+
+// Demos are recorded in version 3 of the format. Each tick's input packet
+// is stored as runs of bytes that are the same as in the previous packet
+// and runs of new bytes. Every DEMO_KEYFRAME_TICKS ticks or so, a snapshot
+// of the whole game, its level and the Lisp globals, comes first, from
+// which the packets after it can be read back on their own. An index of
+// the snapshots ends the file, so that playing can go to any tick by
+// loading the snapshot before it and running the ticks in between. Version 2 files, with every packet stored as is,
+// can still be played but not sought in.
+#define DEMO_KEYFRAME_TICKS 256
 
 class demo_manager
 {
@@ -20,21 +31,50 @@ class demo_manager
   bFILE *record_file;
   int skip_next;
 
+  int version;                          // of the demo being played
+  int32_t demo_tick;                    // packets read or written so far
+  uint8_t last_packet[PACKET_MAX_SIZE]; // zeroes after last_size
+  int last_size;
+  int32_t *key_ticks, *key_offsets;     // the snapshot index
+  int total_keys, max_keys;
+  int32_t total_ticks;                  // in the demo, if it has an index
+
+  void write_keyframe();
+  int read_keyframe(int restore);
+  int write_delta(uint8_t const *packet, int packet_size);
+  int read_delta(uint8_t *packet, int &packet_size);
+  void finish_recording();
+  int read_index();
+
   public :
   enum demo_state { NORMAL,
             RECORDING,
             PLAYING    } state;
   int set_state(demo_state new_state, char *filename=NULL);
   demo_state current_state() { return state; }
-  int save_packet(void *packet, int packet_size);   // returns non 0 if actually saved
+  // at_tick is 0 if the game already ran past the tick the packet is for,
+  // when no snapshot can be taken
+  int save_packet(void *packet, int packet_size, int at_tick=1);   // returns non 0 if actually saved
   int get_packet(void *packet, int &packet_size);   // returns non 0 if actually loaded
 
   int start_playing(char *filename);
   int start_recording(char *filename);
   void reset_game();
   int demo_skip() { if (skip_next) { skip_next--; return 1; } else return 0; }
-  demo_manager() { state=NORMAL; skip_next=0; }
+  demo_manager();
   void do_inputs();
+
+  // Go to the start of tick in the demo being played; 0 if there is no
+  // index or the demo ended first
+  int seek(int32_t tick);
+  int32_t demo_ticks() { return total_ticks; }  // 0 if not known
+
+  // Ticks of the demo being played whose sync value did not match the
+  // recorded one, and what the first of them was
+  int sync_errors;
+  int32_t first_bad_tick;
+  uint16_t bad_recorded, bad_computed;
+  void sync_error(int32_t tick, uint16_t recorded, uint16_t computed);
 } ;
 
 extern demo_manager demo_man;
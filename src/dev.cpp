@@ -22,6 +22,7 @@
 #include "objects.h"
 #include "id.h"
 #include "lisp.h"
+#include "lisp_prof.h"
 #include "light.h"
 #include "devsel.h"
 #include "dprint.h"
@@ -1177,6 +1178,36 @@ void dev_controll::do_command(char const *command, Event &ev)
     }
   }
 
+  if (!strcmp(fword,"spawn"))
+  {
+    // stress test: "spawn <type> <count>" fills a square around the mouse
+    char oname[100];
+    int count=0,t=-1;
+    if (sscanf(command,"%s%s%d",fword,oname,&count)==3)
+      for (x=0; x<total_objects; x++)
+        if (!strcmp(object_names[x],oname))
+          t=x;
+
+    if (t>=0 && count>0)
+    {
+      int side=1;
+      while (side*side<count) side++;
+      ivec2 pos = the_game->MouseToGame(dlast);
+      for (i=0; i<count; i++)
+        current_level->add_object(create(t, pos.x+(i%side-side/2)*20,
+                                         pos.y+(i/side-side/2)*20));
+      dprintf("spawned %d %s\n",count,oname);
+      the_game->need_refresh();
+    } else
+      dprintf("usage : spawn <object type> <count>\n");
+  }
+
+  if (!strcmp(fword,"grid"))
+  {
+    use_object_grid=!use_object_grid;
+    dprintf("object grid is now %s\n",use_object_grid ? "on" : "off");
+  }
+
   if (!strcmp(fword,"move"))
   {
     if (selected_object)
@@ -1244,6 +1275,27 @@ void dev_controll::do_command(char const *command, Event &ev)
     }
   }
 
+  if (!strcmp(fword,"lprofile"))
+  {
+    // Toggle the Lisp profiler, or write what it recorded so far
+    char name[256];
+    if (sscanf(st,"%200s",name)==1)
+    {
+      if (!LProfiler::WriteReport(name))
+        dprintf("unable to write %s\n",name);
+      strcat(name,".folded");
+      if (!LProfiler::WriteFolded(name))
+        dprintf("unable to write %s\n",name);
+    }
+    else
+    {
+      lisp_profile=!lisp_profile;
+      if (lisp_profile)
+        LProfiler::Reset();
+      the_game->show_help(lisp_profile ? "Lisp profiler on" : "Lisp profiler off");
+    }
+  }
+
   if (!strcmp(fword,"restart"))
   {
     current_level->restart();
@@ -0,0 +1,233 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+
+#include "common.h"
+
+#include "drawpool.h"
+#include "transimage.h"
+
+DrawPool draw_pool;
+
+TileList::TileList()
+{
+    m_tiles = NULL;
+    m_total = m_size = 0;
+}
+
+TileList::~TileList()
+{
+    free(m_tiles);
+}
+
+void TileList::AddBg(image *im, ivec2 pos)
+{
+    if (m_total >= m_size)
+    {
+        m_size = m_size ? m_size * 2 : 256;
+        m_tiles = (Tile *)realloc(m_tiles, sizeof(Tile) * m_size);
+    }
+    m_tiles[m_total].bg = im;
+    m_tiles[m_total].fg = NULL;
+    m_tiles[m_total].pos = pos;
+    m_total++;
+}
+
+void TileList::AddFg(TransImage *im, ivec2 pos)
+{
+    AddBg(NULL, pos);
+    m_tiles[m_total - 1].fg = im;
+}
+
+void TileList::Draw(image *screen)
+{
+    ivec2 caa, cbb;
+    screen->GetClip(caa, cbb);
+
+    for (int i = 0; i < m_total; i++)
+    {
+        Tile &t = m_tiles[i];
+        if (t.fg)
+        {
+            t.fg->PutImage(screen, t.pos);
+            continue;
+        }
+
+        // Same as image::PutImage(), but without locking the tile, which
+        // other bands may be drawing at the same time
+        ivec2 aa = Max(caa - t.pos, ivec2(0));
+        ivec2 bb = Min(t.bg->Size(), cbb - t.pos);
+        if (!(aa < bb))
+            continue;
+        for (int y = aa.y; y < bb.y; y++)
+            memcpy(screen->scan_line(t.pos.y + y) + t.pos.x + aa.x,
+                   t.bg->scan_line(y) + aa.x, bb.x - aa.x);
+    }
+}
+
+DrawPool::DrawPool()
+{
+    m_count = 1;
+    m_workers = NULL;
+    m_done = NULL;
+    m_quit = false;
+    m_bands = NULL;
+    m_used = NULL;
+    m_data = NULL;
+    m_size = ivec2(0);
+    m_fn = NULL;
+    m_fn_data = NULL;
+}
+
+DrawPool::~DrawPool()
+{
+    Stop();
+}
+
+void DrawPool::SetThreads(int count)
+{
+    if (count <= 0)
+        count = SDL_GetCPUCount();
+    count = Max(count, 1);
+    if (count == m_count)
+        return;
+
+    Stop();
+    m_count = count;
+    Alloc();
+    if (m_count == 1)
+        return;
+
+    m_quit = false;
+    m_done = SDL_CreateSemaphore(0);
+    m_workers = (Worker *)calloc(m_count - 1, sizeof(Worker));
+    for (int i = 0; i < m_count - 1; i++)
+    {
+        m_workers[i].pool = this;
+        m_workers[i].band = i + 1; // the caller draws band 0
+        m_workers[i].start = SDL_CreateSemaphore(0);
+        m_workers[i].thread = SDL_CreateThread(WorkerMain, "draw",
+                                               m_workers + i);
+    }
+}
+
+void DrawPool::Alloc()
+{
+    m_bands = (image **)calloc(m_count, sizeof(image *));
+    m_used = (bool *)calloc(m_count, sizeof(bool));
+}
+
+void DrawPool::Stop()
+{
+    if (m_workers)
+    {
+        m_quit = true;
+        for (int i = 0; i < m_count - 1; i++)
+            SDL_SemPost(m_workers[i].start);
+        for (int i = 0; i < m_count - 1; i++)
+        {
+            SDL_WaitThread(m_workers[i].thread, NULL);
+            SDL_DestroySemaphore(m_workers[i].start);
+        }
+        free(m_workers);
+        m_workers = NULL;
+        SDL_DestroySemaphore(m_done);
+        m_done = NULL;
+    }
+
+    if (m_bands)
+    {
+        for (int i = 0; i < m_count; i++)
+            delete m_bands[i];
+        free(m_bands);
+        free(m_used);
+        m_bands = NULL;
+        m_used = NULL;
+    }
+    m_data = NULL;
+    m_count = 1;
+}
+
+int DrawPool::WorkerMain(void *data)
+{
+    Worker *w = (Worker *)data;
+    for (;;)
+    {
+        SDL_SemWait(w->start);
+        if (w->pool->m_quit)
+            return 0;
+        w->pool->RunBand(w->band);
+        SDL_SemPost(w->pool->m_done);
+    }
+}
+
+void DrawPool::RunBand(int band)
+{
+    if (m_used[band])
+        m_fn(m_bands[band], band, m_fn_data);
+}
+
+// First row at or after y where a band may start
+int DrawPool::BandStart(int y, int origin)
+{
+    int r = (y - origin) % DRAW_BAND_ALIGN;
+    return r ? y + (r < 0 ? -r : DRAW_BAND_ALIGN - r) : y;
+}
+
+void DrawPool::Run(image *screen, ivec2 aa, ivec2 bb, int origin,
+                   void (*fn)(image *band, int index, void *data), void *data)
+{
+    if (!m_bands)
+        Alloc();
+
+    // Band images share the screen's pixels, so remake them if it changed
+    uint8_t *pixels = screen->scan_line(0);
+    if (pixels != m_data || screen->Size() != m_size)
+    {
+        for (int i = 0; i < m_count; i++)
+        {
+            delete m_bands[i];
+            m_bands[i] = NULL;
+        }
+        m_data = pixels;
+        m_size = screen->Size();
+    }
+
+    int rows = (bb.y - aa.y + m_count - 1) / m_count;
+
+    for (int i = 0, y1 = aa.y; i < m_count; i++)
+    {
+        int y2 = Min(BandStart(aa.y + (i + 1) * rows, origin), bb.y);
+        m_used[i] = y1 < y2;
+        if (!m_used[i])
+            continue;
+
+        if (!m_bands[i])
+            m_bands[i] = new image(m_size, m_data, 0);
+        m_bands[i]->SetClip(ivec2(aa.x, y1), ivec2(bb.x, y2));
+        y1 = y2;
+    }
+
+    m_fn = fn;
+    m_fn_data = data;
+    for (int i = 0; i < m_count - 1; i++)
+        SDL_SemPost(m_workers[i].start);
+    RunBand(0);
+    for (int i = 0; i < m_count - 1; i++)
+        SDL_SemWait(m_done);
+}
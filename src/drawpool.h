@@ -0,0 +1,109 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __DRAWPOOL_H__
+#define __DRAWPOOL_H__
+
+#include "image.h"
+
+class TransImage;
+struct SDL_Thread;
+struct SDL_semaphore;
+
+// Bands are split on multiples of this many rows, so that lighting, which
+// works on 4 row blocks, never has to split a block
+#define DRAW_BAND_ALIGN 4
+
+//
+// Tiles of a view, gathered on the main thread because the cache is not
+// thread safe, then drawn band by band.
+//
+class TileList
+{
+public:
+    TileList();
+    ~TileList();
+
+    void Clear() { m_total = 0; }
+    void AddBg(image *im, ivec2 pos);
+    void AddFg(TransImage *im, ivec2 pos);
+
+    // Draw every tile, in order, clipped to the screen's clip rectangle
+    void Draw(image *screen);
+
+private:
+    struct Tile
+    {
+        image *bg;
+        TransImage *fg;
+        ivec2 pos;
+    };
+
+    Tile *m_tiles;
+    int m_total, m_size;
+};
+
+//
+// Worker threads drawing horizontal bands of a view in parallel. Each band
+// is an image sharing the screen's pixels, with its own clip rectangle, so
+// that the usual drawing code can run on it unchanged.
+//
+class DrawPool
+{
+public:
+    DrawPool();
+    ~DrawPool();
+
+    // Use this many threads, the caller's included. 1 draws everything on
+    // the calling thread and 0 uses one thread per CPU core.
+    void SetThreads(int count);
+    int GetThreads() const { return m_count; }
+
+    // Split the rows of the screen area aa-bb into bands, between rows y
+    // where y - origin is a multiple of DRAW_BAND_ALIGN, then call fn on
+    // every non-empty band and wait for all of them to be done. The band
+    // index, below GetThreads(), lets fn keep per thread scratch memory.
+    void Run(image *screen, ivec2 aa, ivec2 bb, int origin,
+             void (*fn)(image *band, int index, void *data), void *data);
+
+    // Stop the workers and free the band images, before image_uninit()
+    void Stop();
+
+private:
+    struct Worker
+    {
+        DrawPool *pool;
+        int band;
+        SDL_Thread *thread;
+        SDL_semaphore *start;
+    };
+
+    static int WorkerMain(void *data);
+    static int BandStart(int y, int origin);
+    void RunBand(int band);
+    void Alloc();
+
+    int m_count;
+    Worker *m_workers;
+    SDL_semaphore *m_done;
+    bool m_quit;
+
+    image **m_bands;
+    bool *m_used; // whether a band has rows this time
+    uint8_t *m_data; // pixels the band images were made for
+    ivec2 m_size;
+
+    void (*m_fn)(image *band, int index, void *data);
+    void *m_fn_data;
+};
+
+extern DrawPool draw_pool;
+
+#endif // __DRAWPOOL_H__
@@ -45,6 +45,8 @@
 #include "ability.h"
 #include "cache.h"
 #include "lisp.h"
+#include "lisp_vm.h"
+#include "lisp_prof.h"
 #include "jrand.h"
 #include "configuration.h"
 #include "light.h"
@@ -68,6 +70,10 @@
 #include "chat.h"
 #include "demo.h"
 #include "netcfg.h"
+#include "headless.h"
+#include "drawpool.h"
+#include "rollback.h"
+#include "savewriter.h"
 
 #define SHIFT_RIGHT_DEFAULT 0
 #define SHIFT_DOWN_DEFAULT 30
@@ -90,6 +96,7 @@ char **start_argv;
 int start_argc;
 int has_joystick = 0;
 char req_name[100];
+static char const *lprofile_name = NULL; // -lprofile
 
 extern uint8_t chatting_enabled;
 
@@ -517,12 +524,30 @@ void Game::set_level(level *nl)
 
 void Game::load_level(char const *name)
 {
+    // Scripts should only grow permanent space while a level loads, so
+    // report what the level that is going away added to it
+    static size_t perm_allocated = 0, perm_promoted = 0;
+    LGcStats &perm = LSpace::Perm.m_stats;
+    if(current_level)
+      dprintf("Lisp: %s: %d bytes allocated in permanent space, "
+              "%d promoted from temporary space\n", current_level->name(),
+              (int)(perm.allocated - perm_allocated),
+              (int)(perm.promoted - perm_promoted));
+
     if(current_level)
       delete current_level;
 
-    bFILE *fp = open_file(name, "rb");
+    bFILE *fp = open_level_file(name);
 
-    if(fp->open_failure())
+    if(!fp)
+    {
+        current_level = new level(100, 100, name);
+        char msg[200];
+        snprintf(msg, sizeof(msg), "%s: the level it was saved from has "
+                 "changed or is missing", name);
+        show_help(msg);
+    }
+    else if(fp->open_failure())
     {
         delete fp;
         current_level = new level(100, 100, name);
@@ -541,6 +566,9 @@ void Game::load_level(char const *name)
 
     current_level->level_loaded_notify();
     the_game->help_text_frames = 0;
+
+    perm_allocated = perm.allocated;
+    perm_promoted = perm.promoted;
 }
 
 int Game::done()
@@ -650,6 +678,13 @@ static void post_render()
   }
 }
 
+static TileList tiles;
+
+static void draw_tile_band(image *band, int index, void *data)
+{
+  ((TileList *)data)->Draw(band);
+}
+
 void Game::draw_map(view *v, int interpolate)
 {
   backtile *bt;
@@ -745,6 +780,9 @@ void Game::draw_map(view *v, int interpolate)
 
   int xinc, yinc, draw_x, draw_y;
 
+  // Tiles are looked up here, since the cache is not thread safe, and
+  // drawn in bands once both layers are known
+  tiles.Clear();
 
   if(!(dev & MAP_MODE) && (dev & DRAW_BG_LAYER))
   {
@@ -769,7 +807,7 @@ void Game::draw_map(view *v, int interpolate)
     }
     else bt = get_bg(0);
 
-        main_screen->PutImage(bt->im, ivec2(draw_x, draw_y));
+        tiles.AddBg(bt->im, ivec2(draw_x, draw_y));
 //        if(!(dev & EDIT_MODE) && bt->next)
 //      current_level->put_bg(x, y, bt->next);
       }
@@ -891,7 +929,7 @@ void Game::draw_map(view *v, int interpolate)
           int fort_num = fgvalue(*cl);
           if(fort_num != BLACK)
           {
-            get_fg(fort_num)->im->PutImage(main_screen, ivec2(draw_x, draw_y));
+            tiles.AddFg(get_fg(fort_num)->im, ivec2(draw_x, draw_y));
 
         if(!(dev & EDIT_MODE))
             *cl|=0x8000;      // mark as has - been - seen
@@ -903,6 +941,10 @@ void Game::draw_map(view *v, int interpolate)
     }
   }
 
+  ivec2 vaa, vbb;
+  main_screen->GetClip(vaa, vbb);
+  draw_pool.Run(main_screen, vaa, vbb, vaa.y, draw_tile_band, &tiles);
+
   int32_t ro = rand_on;
   if(dev & DRAW_PEOPLE_LAYER)
   {
@@ -1293,6 +1335,43 @@ Game::Game(int argc, char **argv)
       no_delay = 1;
       dprintf("Frame delay off (-nodelay)\n");
     }
+    else if(!strcmp(argv[i], "-nogrid"))
+    {
+      use_object_grid = 0;
+      dprintf("Object grid off (-nogrid)\n");
+    }
+    else if(!strcmp(argv[i], "-nobytecode"))
+    {
+      lisp_bytecode = 0;
+      dprintf("Lisp bytecode off (-nobytecode)\n");
+    }
+    else if(!strcmp(argv[i], "-nonatives"))
+    {
+      lisp_natives = 0;
+      dprintf("Native C function table off (-nonatives)\n");
+    }
+    else if(!strcmp(argv[i], "-nogenerations"))
+    {
+      lisp_generations = 0;
+      dprintf("Lisp generational collection off (-nogenerations)\n");
+    }
+    else if(!strcmp(argv[i], "-lprofile") && i + 1 < argc)
+    {
+      lisp_profile = 1;
+      lprofile_name = argv[++i];
+      dprintf("Lisp profile goes to %s (-lprofile)\n", lprofile_name);
+    }
+    else if(!strcmp(argv[i], "-drawthreads") && i + 1 < argc)
+    {
+      draw_pool.SetThreads(atoi(argv[++i]));
+      dprintf("Drawing with %d threads (-drawthreads)\n",
+              draw_pool.GetThreads());
+    }
+    else if(!strcmp(argv[i], "-noprefetch"))
+    {
+      cache_prefetch = 0;
+      dprintf("Cache prefetching off (-noprefetch)\n");
+    }
 
 
   image_init();
@@ -1390,6 +1469,7 @@ Game::Game(int argc, char **argv)
   if(!wm->has_mouse())
   {
     close_graphics();
+    draw_pool.Stop();
     image_uninit();
     printf("No mouse driver detected, please rectify.\n");
     exit(0);
@@ -1397,12 +1477,13 @@ Game::Game(int argc, char **argv)
 
   // load_data loaded the mouse cursor, use it in case gamma_correct needs to show UI
   wm->SetMouseShape(cache.img(c_normal)->copy(), ivec2(1));
-  gamma_correct(pal);
+  if(!headless)
+    gamma_correct(pal);
 
   if(main_net_cfg == NULL || (main_net_cfg->state != net_configuration::SERVER &&
                  main_net_cfg->state != net_configuration::CLIENT))
   {
-    if(!start_edit && !net_start())
+    if(!start_edit && !net_start() && !headless)
       do_title();
   } else if(main_net_cfg && main_net_cfg->state == net_configuration::SERVER)
   {
@@ -1854,8 +1935,20 @@ void net_send(int force = 0)
       p->get_input();
 
 
-      base->packet.write_uint8(SCMD_SYNC);
-      base->packet.write_uint16(make_sync());
+      uint8_t sync_tick;
+      uint16_t sync;
+      if(!net_pipelined)
+      {
+        base->packet.write_uint8(SCMD_SYNC);
+        base->packet.write_uint16(make_sync());
+      }
+      else if(rollback.LastSync(sync_tick, sync))
+      {
+        // our input is for a later tick, so say which one this is about
+        base->packet.write_uint8(SCMD_SYNC_AT);
+        base->packet.write_uint8(sync_tick);
+        base->packet.write_uint16(sync);
+      }
 
       if(base->join_list)
       base->packet.write_uint8(SCMD_RELOAD);
@@ -1880,6 +1973,10 @@ void net_receive()
         size = 0;
       base->packet.packet_reset();
       base->mem_lock = 0;
+    } else if(net_pipelined)
+    {
+      rollback.Receive();
+      return;
     } else
     {
       size = get_inputs_from_server(buf);
@@ -1891,11 +1988,62 @@ void net_receive()
   }
 }
 
-void Game::step()
+// Have the cache read ahead the tiles and the current animations of
+// objects around the area x1,y1-x2,y2, which will be on screen soon.
+// This walks every object of the level, so it is only done again once the
+// area has moved by a whole tile.
+void Game::prefetch_area(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
+{
+  if (!cache_prefetch)
+    return;
+
+  static level *last_level = NULL;
+  static int32_t last_tiles[4] = { -1, -1, -1, -1 };
+  int32_t tiles[4] = { x1 / ftile_width(), y1 / ftile_height(),
+                       x2 / ftile_width(), y2 / ftile_height() };
+  if (current_level == last_level && !memcmp(tiles, last_tiles, sizeof(tiles)))
+    return;
+  last_level = current_level;
+  memcpy(last_tiles, tiles, sizeof(tiles));
+
+  int fw = current_level->foreground_width(), fh = current_level->foreground_height();
+  for (int y = Max(tiles[1], 0); y <= Min(tiles[3], fh - 1); y++)
+  {
+    uint16_t *fl = current_level->get_fgline(y);
+    for (int x = Max(tiles[0], 0); x <= Min(tiles[2], fw - 1); x++)
+    {
+      int t = fgvalue(fl[x]);
+      if (t < nforetiles && foretiles[t] >= 0)
+        cache.prefetch(foretiles[t]);
+    }
+  }
+
+  int bw = current_level->background_width(), bh = current_level->background_height();
+  int32_t bx1 = x1 * bg_xmul / bg_xdiv, by1 = y1 * bg_ymul / bg_ydiv,
+          bx2 = x2 * bg_xmul / bg_xdiv, by2 = y2 * bg_ymul / bg_ydiv;
+  for (int y = Max(by1 / btile_height(), 0); y <= Min(by2 / btile_height(), bh - 1); y++)
+  {
+    uint16_t *bl = current_level->get_bgline(y);
+    for (int x = Max(bx1 / btile_width(), 0); x <= Min(bx2 / btile_width(), bw - 1); x++)
+    {
+      int t = bgvalue(bl[x]);
+      if (t < nbacktiles && backtiles[t] >= 0)
+        cache.prefetch(backtiles[t]);
+    }
+  }
+
+  for (game_object *o = current_level->first_object(); o; o = o->next)
+    if (o->x >= x1 && o->x <= x2 && o->y >= y1 && o->y <= y2
+         && o->has_sequence(o->state))
+      figures[o->otype]->get_sequence(o->state)->prefetch();
+}
+
+// Gather the objects around every view into the active list
+void Game::activate_views()
 {
-  LSpace::Tmp.Clear();
   if(current_level)
   {
+    headless_mark();
     current_level->unactivate_all();
     total_active = 0;
     for(view *f = first_view; f; f = f->next)
@@ -1911,9 +2059,29 @@ void Game::step()
     h = (f->m_bb.y - f->m_aa.y + 1);
         total_active += current_level->add_actives(f->xoff()-w / 4, f->yoff()-h / 4,
                          f->xoff()+w + w / 4, f->yoff()+h + h / 4);
+        prefetch_area(f->xoff() - w / 2, f->yoff() - h / 2,
+                      f->xoff() + w + w / 2, f->yoff() + h + h / 2);
       }
     }
+    headless_phase(PHASE_ACTIVATE);
   }
+}
+
+void Game::tick_level()
+{
+  ambient_ramp = 0;
+  for(view *v = first_view; v; v = v->next)
+    v->update_scroll();
+
+  cache.prof_poll_start();
+  current_level->tick();
+  sbar.step();
+}
+
+void Game::step()
+{
+  LSpace::Tmp.Clear();
+  activate_views();
 
   if(state == RUN_STATE)
   {
@@ -1933,14 +2101,7 @@ void Game::step()
     set_state(MENU_STATE);
     set_key_down(JK_ESC, 0);
       }
-      ambient_ramp = 0;
-      view *v;
-      for(v = first_view; v; v = v->next)
-        v->update_scroll();
-
-      cache.prof_poll_start();
-      current_level->tick();
-      sbar.step();
+      tick_level();
     } else
       dev_scroll();
   } else if(state == JOY_CALB_STATE)
@@ -1956,6 +2117,16 @@ void Game::step()
     finished = true;
 }
 
+// Run a tick over again after a rollback, without anything step() does for
+// the local player only, like opening the menu
+void Game::resim_step()
+{
+  LSpace::Tmp.Clear();
+  activate_views();
+  if(state == RUN_STATE && !(dev & EDIT_MODE) && current_level)
+    tick_level();
+}
+
 extern void *current_demo;
 
 Game::~Game()
@@ -2033,6 +2204,7 @@ Game::~Game()
     free(help_screens);
 
   close_graphics();
+  draw_pool.Stop();
   image_uninit();
 }
 
@@ -2264,7 +2436,7 @@ void game_net_init(int argc, char **argv)
     dprintf("No network driver, or network driver returned failure\n");
   else
   {
-    set_file_opener(open_nfs_file);
+    set_file_opener(open_nfs_file, nfs_remote_file);
     if(main_net_cfg && main_net_cfg->state == net_configuration::CLIENT)
     {
       if(set_file_server(net_server))
@@ -2287,6 +2459,7 @@ void game_net_init(int argc, char **argv)
 
 int main(int argc, char *argv[])
 {
+    int exit_status = 0;
     start_argc = argc;
     start_argv = argv;
 
@@ -2356,7 +2529,16 @@ int main(int argc, char *argv[])
     jrand_init();
     jrand(); // so compiler doesn't complain
 
-    set_spec_main_file("abuse.spe");
+    // A bundle made with "abuse-tool pack" takes the place of abuse.spe and
+    // is read before any loose files; these still supply what it lacks
+    char const *bundle = NULL;
+    for (int i = 1; i + 1 < argc; i++)
+        if (!strcmp(argv[i], "-bundle"))
+            bundle = argv[++i];
+    if (bundle)
+        set_spec_main_file(bundle, SPEC_SEARCH_INSIDE_OUTSIDE);
+    else
+        set_spec_main_file("abuse.spe");
     check_for_lisp(argc, argv);
 
     do
@@ -2395,6 +2577,9 @@ int main(int argc, char *argv[])
         if (main_net_cfg)
             wait_min_players();
 
+        if (headless_run(g, argc, argv))
+            exit_status = 1;
+
         net_send(1);
         if (net_start())
         {
@@ -2442,12 +2627,14 @@ int main(int argc, char *argv[])
             g->step();
             server_check();
             g->calc_speed();
+            save_writer.Poll();
 
             // see if a request for a level load was made during the last tick
             if (!req_name[0])
                 g->update_screen(); // redraw the screen with any changes
         }
 
+        save_writer.Stop();
         net_uninit();
 
         if (net_crcs)
@@ -2489,6 +2676,15 @@ int main(int argc, char *argv[])
                 printf("%s\n", lstring_value(end_msg->GetValue()));
         }
 
+        if (lprofile_name)
+        {
+            char name[256];
+            snprintf(name, sizeof(name), "%s.folded", lprofile_name);
+            if (!LProfiler::WriteReport(lprofile_name)
+                 || !LProfiler::WriteFolded(name))
+                dprintf("Unable to write Lisp profile %s\n", lprofile_name);
+        }
+
         Lisp::Uninit();
 
         base->packet.packet_reset();
@@ -2500,8 +2696,9 @@ int main(int argc, char *argv[])
 
     set_filename_prefix(NULL);  // dealloc this mem if there was any
     set_save_filename_prefix(NULL);
+    unmap_files();
 
     sound_uninit();
 
-    return 0;
+    return exit_status;
 }
@@ -93,6 +93,7 @@ public :
   int state,zoom;
 
   void step();
+  void resim_step();
   void show_help(char const *st);
   void draw_value(image *screen, int x, int y, int w, int h, int val, int max);
   unsigned char get_color(int x) { return x; }
@@ -127,6 +128,9 @@ public :
     void PutFg(ivec2 pos, int type);
     void PutBg(ivec2 pos, int type);
   void draw_map(view *v, int interpolate=0);
+  void prefetch_area(int32_t x1, int32_t y1, int32_t x2, int32_t y2);
+  void activate_views();
+  void tick_level();
   void dev_scroll();
 
   int in_area(Event &ev, int x1, int y1, int x2, int y2);
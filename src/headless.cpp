@@ -0,0 +1,375 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "common.h"
+
+#include "game.h"
+#include "cache.h"
+#include "demo.h"
+#include "keys.h"
+#include "lisp.h"
+#include "lisp_prof.h"
+#include "light.h"
+#include "view.h"
+#include "level.h"
+#include "clisp.h"
+#include "specs.h"
+#include "netcfg.h"
+#include "nfserver.h"
+#include "rollback.h"
+#include "net/loopback.h"
+#include "net/netbot.h"
+#include "headless.h"
+#include "replay.h"
+
+extern char level_file[100];
+extern char req_name[100];
+extern int idle_ticks;
+extern void net_receive();
+extern void net_send(int force);
+
+// set by -headless, before SDL is initialised
+int headless = 0;
+
+static Timer *phase_timer = NULL; // only exists during headless_run()
+static double phase_ms[PHASE_TOTAL];
+
+static char const *phase_names[PHASE_TOTAL] =
+{
+    "activate",
+    "objects",
+    "collide",
+};
+
+void headless_mark()
+{
+    if (phase_timer)
+        phase_timer->GetMs();
+}
+
+void headless_phase(int phase)
+{
+    if (phase_timer)
+        phase_ms[phase] += phase_timer->GetMs();
+}
+
+// printf() for reports from elsewhere, marked like the ones from here
+static void headless_printf(char const *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    printf("headless: ");
+    vprintf(format, ap);
+    va_end(ap);
+}
+
+// Same as the "spawn" console command, but around the player: fills a
+// square of count objects of the named type, 20 pixels apart
+static int spawn_crowd(Game *g, char const *name, int count)
+{
+    int t = -1;
+    for (int i = 0; i < total_objects; i++)
+        if (!strcmp(object_names[i], name))
+            t = i;
+    if (t < 0 || !g->first_view || !g->first_view->m_focus)
+        return 0;
+
+    game_object *p = g->first_view->m_focus;
+    int side = 1;
+    while (side * side < count)
+        side++;
+    for (int i = 0; i < count; i++)
+        current_level->add_object(create(t, p->x + (i % side - side / 2) * 20,
+                                         p->y + (i / side - side / 2) * 20));
+    return 1;
+}
+
+// Keys a bot player holds down in a headless net game or recording: a
+// few ticks of running one way or the other, jumping now and then, from a
+// sequence that differs per client so that remote input is hard to predict
+static void bot_keys(Game *g, uint32_t &seed)
+{
+    static int const keys[] = { JK_LEFT, JK_RIGHT, JK_UP };
+    static int hold = 0, dir = 0;
+
+    if (--hold <= 0)
+    {
+        seed = seed * 1103515245 + 12345;
+        hold = 1 + (seed >> 16) % 24;
+        dir = (seed >> 8) % 3;
+    }
+    for (int i = 0; i < 3; i++)
+        g->set_key_down(keys[i], i == dir || (i == 2 && hold % 7 == 0));
+}
+
+int headless_run(Game *g, int argc, char **argv)
+{
+    if (!headless)
+        return 0;
+
+    int ticks = 1000, light_frames = 0, spec_rounds = 0, save_rounds = 0;
+    int load_rounds = 0, blit_rounds = 0, call_rounds = 0, seek_tick = -1;
+    int gc_rounds = 0;
+    char *replay = NULL, *record = NULL, *spawn_name = NULL;
+    int spawn_count = 0;
+
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (!strcmp(argv[i], "-ticks"))
+            ticks = Max(atoi(argv[++i]), 0);
+        else if (!strcmp(argv[i], "-replay"))
+            replay = argv[++i];
+        else if (!strcmp(argv[i], "-record"))
+            record = argv[++i];
+        else if (!strcmp(argv[i], "-seek"))
+            seek_tick = Max(atoi(argv[++i]), 0);
+        else if (!strcmp(argv[i], "-lightbench"))
+            light_frames = Max(atoi(argv[++i]), 1);
+        else if (!strcmp(argv[i], "-specbench"))
+            spec_rounds = Max(atoi(argv[++i]), 1);
+        else if (!strcmp(argv[i], "-savebench"))
+            save_rounds = Max(atoi(argv[++i]), 1);
+        else if (!strcmp(argv[i], "-loadbench"))
+            load_rounds = Max(atoi(argv[++i]), 1);
+        else if (!strcmp(argv[i], "-blitbench"))
+            blit_rounds = Max(atoi(argv[++i]), 1);
+        else if (!strcmp(argv[i], "-callbench"))
+            call_rounds = Max(atoi(argv[++i]), 1);
+        else if (!strcmp(argv[i], "-gcbench"))
+            gc_rounds = Max(atoi(argv[++i]), 1);
+        else if (!strcmp(argv[i], "-spawn") && i + 2 < argc)
+        {
+            spawn_name = argv[++i];
+            spawn_count = Max(atoi(argv[++i]), 1);
+        }
+    }
+
+    // A server has its level loaded already and a client got it from the
+    // server, who steps it along with everyone else
+    bool net = main_net_cfg
+                && (main_net_cfg->state == net_configuration::SERVER
+                     || main_net_cfg->state == net_configuration::CLIENT);
+    uint32_t seed = client_number() + 1;
+
+    if (net)
+    {
+        replay = record = NULL;
+        if (current_level)
+            g->set_state(RUN_STATE);
+    }
+    else if (replay)
+    {
+        record = NULL;
+        if (!demo_man.set_state(demo_manager::PLAYING, replay))
+        {
+            printf("headless: unable to play demo '%s'\n", replay);
+            g->end_session();
+            return 1;
+        }
+        if (seek_tick >= 0)
+        {
+            Timer t;
+            int ok = demo_man.seek(seek_tick);
+            float ms = t.GetMs();
+            if (!ok)
+            {
+                printf("headless: unable to seek to tick %d of %d in '%s'\n",
+                       seek_tick, (int)demo_man.demo_ticks(), replay);
+                g->end_session();
+                return 1;
+            }
+            printf("headless: sought to tick %d of %d in %.1f ms\n",
+                   seek_tick, (int)demo_man.demo_ticks(), ms);
+        }
+    }
+    else
+    {
+        g->load_level(level_file);
+        // Start from a known state, exactly like a demo does
+        if (!record)
+            demo_man.reset_game();
+        else if (!current_level
+                  || !demo_man.set_state(demo_manager::RECORDING, record))
+        {
+            printf("headless: unable to record demo '%s'\n", record);
+            g->end_session();
+            return 1;
+        }
+    }
+
+    if (!current_level)
+    {
+        printf("headless: no level loaded\n");
+        g->end_session();
+        return 1;
+    }
+
+    // A demo or a net game has to see the level as it was recorded
+    if (spawn_name && !net && !replay)
+    {
+        if (!spawn_crowd(g, spawn_name, spawn_count))
+        {
+            printf("headless: no object type '%s' to spawn\n", spawn_name);
+            g->end_session();
+            return 1;
+        }
+        printf("headless: spawned %d %s\n", spawn_count, spawn_name);
+    }
+
+    printf("headless: %s, %d ticks%s\n", replay ? replay : level_file, ticks,
+           net ? ", net game" : record ? ", recording a bot" : "");
+
+    // Profile the ticks, not the level loading
+    LProfiler::Reset();
+    LGcStats perm_start = LSpace::Perm.m_stats;
+    memset(phase_ms, 0, sizeof(phase_ms));
+    phase_timer = new Timer();
+    Timer total;
+    int done = 0;
+
+    if (net)
+        net_send(1);
+
+    while (done < ticks && !g->done())
+    {
+        if (replay && demo_man.current_state() != demo_manager::PLAYING)
+            break; // demo ran out
+
+        if (net)
+            net_receive();
+
+        if (req_name[0])
+        {
+            g->load_level(req_name);
+            req_name[0] = 0;
+        }
+
+        if (replay)
+            demo_man.do_inputs();
+        else if (record)
+        {
+            bot_keys(g, seed);
+            demo_man.do_inputs();
+        }
+        else if (net)
+        {
+            bot_keys(g, seed);
+            net_send(0);
+            service_net_request();
+        }
+
+        idle_ticks = 0;
+        g->step();
+        if (net)
+            server_check();
+        done++;
+    }
+
+    float ms = total.GetMs();
+    delete phase_timer; phase_timer = NULL;
+
+    printf("headless: %d ticks in %.1f ms, %.1f ticks/sec\n", done, ms,
+           ms > 0.f ? done * 1000.f / ms : 0.f);
+    for (int i = 0; i < PHASE_TOTAL; i++)
+        printf("headless:   %-10s %9.1f ms  %7.3f ms/tick\n", phase_names[i],
+               phase_ms[i], done ? phase_ms[i] / done : 0.);
+    Lisp::PrintGcStats(headless_printf);
+    printf("headless: %d bytes allocated in permanent space, %d promoted "
+           "from temporary space\n",
+           (int)(LSpace::Perm.m_stats.allocated - perm_start.allocated),
+           (int)(LSpace::Perm.m_stats.promoted - perm_start.promoted));
+    if (lisp_profile)
+        LProfiler::PrintTop(10, headless_printf);
+    int queued, hits, misses, stalls;
+    float stall_ms;
+    cache.prefetch_stats(queued, hits, misses, stalls, stall_ms);
+    printf("headless: cache %d prefetched, %d hits, %d misses, "
+           "%d stalls (%.1f ms)\n", queued, hits, misses, stalls, stall_ms);
+    if (net)
+    {
+        int confirmed, predicted, rollbacks, resimulated, desyncs;
+        rollback.GetStats(confirmed, predicted, rollbacks, resimulated,
+                          desyncs);
+        printf("headless: net delay %d, rollback %d, lag %d ms\n",
+               net_delay, net_rollback, net_lag);
+        printf("headless: net %d ticks confirmed, %d predicted, "
+               "%d rollbacks, %d ticks run again, %d sync errors\n",
+               confirmed, predicted, rollbacks, resimulated, desyncs);
+        int snapshots;
+        float snapshot_ms;
+        int64_t snapshot_bytes;
+        rollback.GetSnapshotStats(snapshots, snapshot_ms, snapshot_bytes);
+        printf("headless: net %d snapshots, %.3f ms and %.1f KB each, "
+               "%.3f ms/tick\n", snapshots,
+               snapshots ? snapshot_ms / snapshots : 0.f,
+               snapshots ? snapshot_bytes / 1024.f / snapshots : 0.f,
+               done ? snapshot_ms / done : 0.f);
+        int stalls;
+        float stall_ms;
+        net_stall_stats(stalls, stall_ms);
+        printf("headless: net %d stalls, %.1f ms waiting for input, "
+               "%.3f ms/tick\n", stalls, stall_ms,
+               done ? stall_ms / done : 0.f);
+        if (loopback.enabled)
+        {
+            int sent, lost, bots, bot_ticks, resends;
+            int64_t bytes;
+            loopback.get_stats(sent, lost, bytes);
+            net_bot::get_stats(bots, bot_ticks, resends);
+            printf("headless: loopback jitter %d ms, loss %d%%, bandwidth "
+                   "%d KB/s\n", net_jitter, net_loss, net_bandwidth);
+            printf("headless: loopback %d packets, %d lost, %.1f KB, "
+                   "%d bots playing, %d bot ticks, %d resent\n", sent, lost,
+                   bytes / 1024.f, bots, bot_ticks, resends);
+        }
+    }
+    if (light_frames && current_level)
+        light_bench(g->first_view ? g->first_view->xoff() : 0,
+                    g->first_view ? g->first_view->yoff() : 0,
+                    light_frames, headless_printf);
+    if (spec_rounds)
+    {
+        // every data file the game loaded
+        int files = crc_manager.total_filenames();
+        char const **names = (char const **)malloc(sizeof(char const *)
+                                                   * Max(files, 1));
+        for (int f = 0; f < files; f++)
+            names[f] = crc_manager.get_filename(f);
+        spec_bench(names, files, spec_rounds, headless_printf);
+        free(names);
+    }
+    if (blit_rounds)
+        blit_bench(blit_rounds, headless_printf);
+    if (current_level)
+        printf("headless: state crc %08x at tick %d\n",
+               current_level->state_crc(), (int)current_level->tick_counter());
+    if (call_rounds && current_level)
+        call_bench(call_rounds, headless_printf);
+    if (gc_rounds)
+        Lisp::GcBench(gc_rounds, headless_printf);
+    if (save_rounds && current_level && !net)
+        save_bench(save_rounds, headless_printf);
+    if (load_rounds && current_level && !net)
+        load_bench(level_file, load_rounds, headless_printf);
+    int diverged = net ? 0 : replay_run(g, argc, argv);
+
+    demo_man.set_state(demo_manager::NORMAL);
+    g->end_session();
+    return diverged ? 1 : 0;
+}
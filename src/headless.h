@@ -0,0 +1,37 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __HEADLESS_H__
+#define __HEADLESS_H__
+
+class Game;
+
+// Simulation phases timed while running headless
+enum
+{
+    PHASE_ACTIVATE, // rebuilding the active list around each view
+    PHASE_OBJECTS,  // object decide/move and palette animation
+    PHASE_COLLIDE,  // attacker/target collision checks
+    PHASE_TOTAL
+};
+
+extern int headless;
+
+// Start timing a new phase, then charge the elapsed time to a phase
+void headless_mark();
+void headless_phase(int phase);
+
+// Run the requested number of ticks without drawing or throttling, print
+// statistics and end the session. Does nothing unless -headless was given.
+// Returns non zero if the run failed, such as when a demo could not be
+// played or went out of sync, to be the exit status of the game.
+int headless_run(Game *g, int argc, char **argv);
+
+#endif // __HEADLESS_H__
@@ -0,0 +1,216 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <string.h>
+
+#include "lz.h"
+
+#define MIN_MATCH 4
+#define HASH_BITS 12
+
+static inline uint32_t read32(uint8_t const *p)
+{
+    uint32_t x;
+    memcpy(&x, p, 4);
+    return x;
+}
+
+// Write a length that did not fit in its 4 bits of the token
+static inline size_t put_length(uint8_t *dst, size_t len)
+{
+    size_t n = 0;
+    for (; len >= 255; len -= 255)
+        dst[n++] = 255;
+    dst[n++] = (uint8_t)len;
+    return n;
+}
+
+// Emit lit literals from src, then a match of len bytes at offset back,
+// or no match if len is 0; false if that does not fit in room bytes
+static bool put_sequence(uint8_t *dst, size_t &op, size_t room,
+                         uint8_t const *src, size_t lit, size_t offset,
+                         size_t len)
+{
+    // token, lengths, literals and offset at their worst
+    if (op + 1 + lit / 255 + 1 + lit + 2 + len / 255 + 1 > room)
+        return false;
+
+    uint8_t *token = dst + op++;
+    *token = (uint8_t)((lit < 15 ? lit : 15) << 4);
+    if (lit >= 15)
+        op += put_length(dst + op, lit - 15);
+    memcpy(dst + op, src, lit);
+    op += lit;
+
+    if (!len)
+        return true;
+
+    dst[op++] = (uint8_t)offset;
+    dst[op++] = (uint8_t)(offset >> 8);
+    len -= MIN_MATCH;
+    *token |= (uint8_t)(len < 15 ? len : 15);
+    if (len >= 15)
+        op += put_length(dst + op, len - 15);
+    return true;
+}
+
+// Greedy matching through a hash table of the last place each 4 byte
+// sequence was seen; returns 0 if the block does not pack into less than
+// room bytes
+static size_t pack_block(uint8_t const *src, size_t size, uint8_t *dst,
+                         size_t room)
+{
+    uint16_t table[1 << HASH_BITS]; // position + 1, or 0 for none
+    memset(table, 0, sizeof(table));
+
+    size_t ip = 0, anchor = 0, op = 0;
+    while (ip + MIN_MATCH <= size)
+    {
+        uint32_t seq = read32(src + ip);
+        uint32_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+        size_t ref = table[h];
+        table[h] = (uint16_t)(ip + 1);
+        if (!ref || read32(src + ref - 1) != seq)
+        {
+            ip++;
+            continue;
+        }
+        ref--;
+
+        size_t len = MIN_MATCH;
+        while (ip + len < size && src[ref + len] == src[ip + len])
+            len++;
+        if (!put_sequence(dst, op, room, src + anchor, ip - anchor,
+                          ip - ref, len))
+            return 0;
+        ip += len;
+        anchor = ip;
+    }
+
+    if (anchor < size
+         && !put_sequence(dst, op, room, src + anchor, size - anchor, 0, 0))
+        return 0;
+    return op < room ? op : 0;
+}
+
+size_t lz_bound(size_t size)
+{
+    return size + (size + LZ_BLOCK - 1) / LZ_BLOCK * LZ_HEADER;
+}
+
+size_t lz_pack(void const *src, size_t size, void *dst)
+{
+    uint8_t const *s = (uint8_t const *)src;
+    uint8_t *d = (uint8_t *)dst;
+    size_t op = 0;
+
+    for (size_t ip = 0; ip < size; )
+    {
+        size_t raw = size - ip < LZ_BLOCK ? size - ip : LZ_BLOCK;
+        size_t packed = pack_block(s + ip, raw, d + op + LZ_HEADER, raw);
+        d[op] = (uint8_t)raw;
+        d[op + 1] = (uint8_t)(raw >> 8);
+        d[op + 2] = (uint8_t)packed;
+        d[op + 3] = (uint8_t)(packed >> 8);
+        op += LZ_HEADER;
+        if (!packed)
+        {
+            memcpy(d + op, s + ip, raw);
+            packed = raw;
+        }
+        op += packed;
+        ip += raw;
+    }
+    return op;
+}
+
+// Read the rest of a length that did not fit in its 4 bits of the token
+static inline bool get_length(uint8_t const *src, size_t &ip, size_t packed,
+                              size_t &len)
+{
+    uint8_t b;
+    do
+    {
+        if (ip >= packed)
+            return false;
+        b = src[ip++];
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+bool lz_unpack_block(uint8_t const *src, size_t packed, uint8_t *dst,
+                     size_t size)
+{
+    size_t ip = 0, op = 0;
+    while (ip < packed)
+    {
+        uint8_t token = src[ip++];
+        size_t lit = token >> 4;
+        if (lit == 15 && !get_length(src, ip, packed, lit))
+            return false;
+        if (ip + lit > packed || op + lit > size)
+            return false;
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+
+        if (ip == packed)
+            break; // the last sequence has no match
+
+        if (ip + 2 > packed)
+            return false;
+        size_t offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        size_t len = token & 15;
+        if (len == 15 && !get_length(src, ip, packed, len))
+            return false;
+        len += MIN_MATCH;
+        if (!offset || offset > op || op + len > size)
+            return false;
+
+        // byte by byte, since a match may overlap what it copies
+        uint8_t *from = dst + op - offset;
+        for (size_t i = 0; i < len; i++)
+            dst[op + i] = from[i];
+        op += len;
+    }
+    return op == size;
+}
+
+bool lz_unpack(void const *src, size_t packed, void *dst, size_t size)
+{
+    uint8_t const *s = (uint8_t const *)src;
+    uint8_t *d = (uint8_t *)dst;
+    size_t ip = 0, op = 0;
+
+    while (op < size)
+    {
+        if (packed - ip < LZ_HEADER)
+            return false;
+        size_t raw = s[ip] | (s[ip + 1] << 8);
+        size_t zsize = s[ip + 2] | (s[ip + 3] << 8);
+        size_t stored = zsize ? zsize : raw;
+        ip += LZ_HEADER;
+        if (!raw || raw > size - op || stored > packed - ip)
+            return false;
+        if (!zsize)
+            memcpy(d + op, s + ip, raw);
+        else if (!lz_unpack_block(s + ip, zsize, d + op, raw))
+            return false;
+        ip += stored;
+        op += raw;
+    }
+    return ip == packed;
+}
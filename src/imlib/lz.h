@@ -0,0 +1,45 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __LZ_H__
+#define __LZ_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// The codec of compressed SPEC entries (SPEC_FLAG_COMPRESSED). The data is
+// cut into blocks of at most LZ_BLOCK bytes, so that it can be unpacked a
+// block at a time while it is read. Each block starts with its unpacked
+// and packed sizes, 16 bits each, little endian; a packed size of 0 means
+// the block is stored as is. Packed blocks are LZ77 sequences in the style
+// of LZ4: a token with the literal count and match length, the literals,
+// then the match offset, with matches only inside the block.
+//
+#define LZ_BLOCK 32768
+#define LZ_HEADER 4
+
+// Most bytes lz_pack() can turn size bytes into
+size_t lz_bound(size_t size);
+
+// Pack size bytes of src into dst, which has room for lz_bound(size)
+// bytes, and return how many bytes that took
+size_t lz_pack(void const *src, size_t size, void *dst);
+
+// Unpack one block of packed bytes into exactly size bytes of dst; false
+// if the data is damaged
+bool lz_unpack_block(uint8_t const *src, size_t packed, uint8_t *dst,
+                     size_t size);
+
+// Unpack all of what lz_pack() made of exactly size bytes, blocks and
+// their headers, into dst; false if the data is damaged
+bool lz_unpack(void const *src, size_t packed, void *dst, size_t size);
+
+#endif // __LZ_H__
@@ -0,0 +1,161 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <string.h>
+
+#include "common.h"
+
+#include "specs.h"
+
+// Look up every entry of dir by name and type, the way CacheList::reg()
+// does, through the name index or with a plain scan; returns how many
+// lookups found the wrong entry
+static int spec_lookups(spec_directory &dir, bool hashed)
+{
+    int wrong = 0;
+    for (int i = 0; i < dir.total; i++)
+    {
+        spec_entry *se = dir.entries[i], *found = NULL;
+        if (hashed)
+            found = dir.find(se->name, se->type);
+        else
+            for (int j = 0; j < dir.total && !found; j++)
+                if (!strcmp(dir.entries[j]->name, se->name)
+                     && dir.entries[j]->type == se->type)
+                    found = dir.entries[j];
+        // names may repeat, in which case the first one is right
+        wrong += !found || strcmp(found->name, se->name)
+                   || found->type != se->type;
+    }
+    return wrong;
+}
+
+// Start reading each entry of dir, then seek to the next one and read all
+// of it; a compressed entry being unpacked covers the offsets of the ones
+// after it, and must not take such a seek for one inside itself. Returns
+// how many entries read differently than from a fresh seek.
+static int spec_seeks(bFILE *fp, spec_directory &dir)
+{
+    int wrong = 0;
+    for (int i = 0; i + 1 < dir.total; i++)
+    {
+        spec_entry *a = dir.entries[i], *b = dir.entries[i + 1];
+        uint8_t first[256], again[256];
+        int n = Min((int)sizeof(first), (int)b->size);
+        fp->seek(b->offset, SEEK_SET);
+        int got = fp->read(first, n);
+        fp->seek(a->offset, SEEK_SET);
+        fp->read(again, Min((int)sizeof(again), (int)a->size) / 2);
+        fp->seek(b->offset, SEEK_SET);
+        wrong += fp->read(again, n) != got || memcmp(first, again, got);
+    }
+    return wrong;
+}
+
+// Read every entry of the given data files, once through
+// jFILE and once through the file mappings, the way the cache does, then
+// time looking all the entries up by name
+void spec_bench(char const * const *names, int files, int rounds,
+                void (*print)(char const *format, ...))
+{
+    static char const *const ways[] = { "read", "mapped" };
+    uint32_t sum[2] = { 0, 0 };
+    double bytes[2] = { 0, 0 }, disk = 0;
+    float ms[2];
+
+    for (int m = 0; m < 2; m++)
+    {
+        Timer t;
+        for (int r = 0; r < rounds; r++)
+            for (int f = 0; f < files; f++)
+            {
+                bFILE *fp = m ? open_mapped_file(names[f]) : NULL;
+                if (!fp)
+                    fp = new jFILE(names[f], "rb");
+                if (fp->open_failure())
+                {
+                    delete fp;
+                    continue;
+                }
+
+                spec_directory dir(fp);
+                uint8_t buf[4096];
+                for (int i = 0; i < dir.total; i++)
+                {
+                    spec_entry *se = dir.entries[i];
+                    if (!m)
+                        disk += se->disk_size();
+                    fp->seek(se->offset, SEEK_SET);
+                    for (unsigned long n = 0; n < se->size; )
+                    {
+                        int got = fp->read(buf, Min((int)sizeof(buf),
+                                                    (int)(se->size - n)));
+                        if (got <= 0)
+                            break;
+                        for (int j = 0; j < got; j += 64)
+                            sum[m] += buf[j];
+                        n += got;
+                        bytes[m] += got;
+                    }
+                }
+                delete fp;
+            }
+        ms[m] = t.GetMs();
+    }
+
+    print("spec %.1f MB unpacked, %.1f MB in the files\n",
+          bytes[0] / 1048576.0, disk / 1048576.0);
+    for (int m = 0; m < 2; m++)
+        print("spec %-6s %d files x %d, %.1f MB in %.1f ms, "
+              "%.1f MB/s%s\n", ways[m], files, rounds,
+              bytes[m] / 1048576.0, ms[m],
+              ms[m] > 0.f ? bytes[m] / 1048.576 / ms[m] : 0.,
+              m && (sum[0] != sum[1] || bytes[0] != bytes[1])
+                  ? " (MISMATCH)" : "");
+
+    int entries = 0, wrong = 0;
+    for (int m = 0; m < 2; m++)
+    {
+        Timer t;
+        for (int f = 0; f < files; f++)
+        {
+            jFILE fp(names[f], "rb");
+            if (fp.open_failure())
+                continue;
+            spec_directory dir(&fp);
+            if (!m)
+                entries += dir.total;
+            for (int r = 0; r < rounds; r++)
+                wrong += spec_lookups(dir, m == 0);
+        }
+        ms[m] = t.GetMs();
+    }
+    print("spec lookups %d names x %d, hashed %.1f ms, "
+          "linear %.1f ms%s\n", entries, rounds, ms[0], ms[1],
+          wrong ? " (MISMATCH)" : "");
+
+    int seeks = 0;
+    wrong = 0;
+    for (int f = 0; f < files; f++)
+    {
+        jFILE fp(names[f], "rb");
+        if (fp.open_failure())
+            continue;
+        spec_directory dir(&fp);
+        seeks += Max(dir.total - 1, 0);
+        wrong += spec_seeks(&fp, dir);
+    }
+    print("spec seeks %d from one entry into the next%s\n",
+          seeks, wrong ? " (MISMATCH)" : "");
+}
@@ -26,6 +26,9 @@
 #ifdef WIN32
 # include <io.h>
 #endif
+#if defined HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 
 #ifndef O_BINARY
 // Assume we don't have a binary flag on this platform.
@@ -38,6 +41,7 @@
 #include "image.h"
 #include "palette.h"
 #include "specs.h"
+#include "lz.h"
 #include "dprint.h"
 
 char const *spec_types[] =
@@ -149,8 +153,22 @@ void set_no_space_handler(void (*handle_fun)())
 }
 
 
+struct spec_unpacker
+{
+  spec_zentry e;
+  unsigned long pos;                   // unpacked bytes of e handed out
+  unsigned long zpos;                  // packed bytes of e read
+  long block_len, block_pos;
+  uint8_t block[LZ_BLOCK];
+  uint8_t packed[LZ_HEADER+LZ_BLOCK];  // a block with its header
+};
+
 bFILE::bFILE()
 {
+  zentries=NULL;
+  zcount=0;
+  unpack=NULL;
+
   rbuf_size=8192;
   rbuf=(unsigned char *)malloc(rbuf_size);
   rbuf_start=rbuf_end=0;
@@ -162,6 +180,8 @@ bFILE::bFILE()
 
 bFILE::~bFILE()
 {
+  free(zentries);
+  free(unpack);
   if (rbuf) free(rbuf);
   flush_writes();
   if (wbuf) free(wbuf);
@@ -182,6 +202,13 @@ int bFILE::flush_writes()
 }
 
 int bFILE::read(void *buf, size_t count)       // returns number of bytes read, calls unbuffer_read
+{
+  if (unpack)
+    return unpack_read(buf,count);
+  return raw_read(buf,count);
+}
+
+int bFILE::raw_read(void *buf, size_t count)
 {
   if (!allow_read_buffering())
     return unbuffered_read(buf,count);
@@ -240,11 +267,136 @@ int bFILE::write(void const *buf, size_t count)      // returns number of bytes
     unsigned long ret=unbuffered_write(buf,count);
     if (ret!=count && no_space_handle_fun)
       no_space_handle_fun();
+    return ret;
   }
-  return 0;
+}
+
+static int zentry_compare(void const *a, void const *b)
+{
+  unsigned long x=((spec_zentry const *)a)->offset,y=((spec_zentry const *)b)->offset;
+  return x<y ? -1 : x>y;
+}
+
+void bFILE::set_compressed(spec_zentry const *z, int count)
+{
+  stop_unpacking();
+  free(zentries);
+  zentries=NULL;
+  zcount=count;
+  if (!count)
+    return;
+  zentries=(spec_zentry *)malloc(sizeof(spec_zentry)*count);
+  memcpy(zentries,z,sizeof(spec_zentry)*count);
+  qsort(zentries,count,sizeof(spec_zentry),zentry_compare);
+}
+
+void bFILE::stop_unpacking()
+{
+  free(unpack);
+  unpack=NULL;
+}
+
+// Read and unpack the next block of the entry, 0 if it is damaged
+int bFILE::next_block()
+{
+  spec_unpacker *u=unpack;
+  uint8_t *hdr=u->packed;
+  if (u->zpos+LZ_HEADER>u->e.zsize || raw_read(hdr,LZ_HEADER)!=LZ_HEADER)
+    return 0;
+  long raw=hdr[0]|(hdr[1]<<8),packed=hdr[2]|(hdr[3]<<8);
+  long stored=packed ? packed : raw;
+  u->zpos+=LZ_HEADER+stored;
+  if (!raw || raw>LZ_BLOCK || stored>LZ_BLOCK || u->zpos>u->e.zsize
+      || u->pos+raw>u->e.size)
+    return 0;
+
+  if (raw_read(u->packed+LZ_HEADER,stored)!=stored
+      || !lz_unpack(u->packed,LZ_HEADER+stored,u->block,raw))
+    return 0;
+
+  u->block_len=raw;
+  u->block_pos=0;
+  return 1;
+}
+
+int bFILE::unpack_read(void *buf, size_t count)
+{
+  spec_unpacker *u=unpack;
+  int total_read=0;
+  while (count && u->pos<u->e.size)
+  {
+    if (u->block_pos==u->block_len && !next_block())
+    {
+      u->e.size=u->pos;                // damaged, so stop here
+      break;
+    }
+    size_t n=u->block_len-u->block_pos;
+    if (n>count) n=count;
+    if (buf)
+    {
+      memcpy(buf,u->block+u->block_pos,n);
+      buf=(void *)(((unsigned char *)buf)+n);
+    }
+    u->block_pos+=n;
+    u->pos+=n;
+    count-=n;
+    total_read+=n;
+  }
+
+  // all of it read, so go on from the end of the entry like a raw one
+  if (u->pos==u->e.size)
+  {
+    long end=u->e.offset+u->e.zsize;
+    stop_unpacking();
+    raw_seek(end,SEEK_SET);
+  }
+  return total_read;
 }
 
 int bFILE::seek(long offset, int whence) // whence=SEEK_SET, SEEK_CUR, SEEK_END, ret=0=success
+{
+  if (unpack)
+  {
+    // Only a relative seek stays in the entry we are reading: where it is
+    // unpacked to overlaps the entries after it, so an offset from the
+    // start of the file always means one in the file. Going back starts
+    // the entry again, and both ways cost unpacking.
+    long to=(long)unpack->pos+offset;
+    if (whence==SEEK_CUR && to>=0 && to<=(long)unpack->e.size)
+    {
+      if (offset<0)
+        seek(unpack->e.offset,SEEK_SET);
+      if (to>(long)unpack->pos)
+        unpack_read(NULL,to-unpack->pos);
+      return 1;
+    }
+    if (whence==SEEK_CUR)
+    {
+      offset+=unpack->e.offset+unpack->pos;
+      whence=SEEK_SET;
+    }
+    stop_unpacking();
+  }
+
+  if (whence==SEEK_SET && zcount)
+  {
+    spec_zentry key;
+    key.offset=offset;
+    spec_zentry *z=(spec_zentry *)bsearch(&key,zentries,zcount,sizeof(spec_zentry),zentry_compare);
+    if (z)
+    {
+      raw_seek(offset,SEEK_SET);
+      unpack=(spec_unpacker *)malloc(sizeof(spec_unpacker));
+      unpack->e=*z;
+      unpack->pos=unpack->zpos=0;
+      unpack->block_len=unpack->block_pos=0;
+      return 1;
+    }
+  }
+  return raw_seek(offset,whence);
+}
+
+int bFILE::raw_seek(long offset, int whence)
 {
 //    rbuf_start=rbuf_end=0;
 //    unbuffered_seek(offset,SEEK_SET);
@@ -264,6 +416,13 @@ int bFILE::seek(long offset, int whence) // whence=SEEK_SET, SEEK_CUR, SEEK_END,
 }
 
 int bFILE::tell()
+{
+  if (unpack)
+    return unpack->e.offset+unpack->pos;
+  return raw_tell();
+}
+
+int bFILE::raw_tell()
 {
   return unbuffered_tell()-rbuf_end+rbuf_start+
          wbuf_end;    // if this a write file, add on how much we've written
@@ -294,10 +453,8 @@ jFILE::jFILE(FILE *file_pointer)                       // assumes fp is at begin
   flags=JFILE_CLONED;
 }
 
-void jFILE::open_external(char const *filename, char const *mode, int flags)
+static void external_name(char const *filename, char *tmp_name)
 {
-  int skip_size=0;
-  char tmp_name[200];
 #ifdef WIN32
   // Need to make sure it's not an absolute Windows path
   if (spec_prefix && filename[0] != '/' && (filename[0] != '\0' && filename[1] != ':'))
@@ -311,6 +468,13 @@ void jFILE::open_external(char const *filename, char const *mode, int flags)
   {
     strcpy(tmp_name,filename);
   }
+}
+
+void jFILE::open_external(char const *filename, char const *mode, int flags)
+{
+  int skip_size=0;
+  char tmp_name[200];
+  external_name(filename,tmp_name);
 
 //  int old_mask=umask(S_IRWXU | S_IRWXG | S_IRWXO);
   if (flags&O_WRONLY)
@@ -353,6 +517,86 @@ void jFILE::open_external(char const *filename, char const *mode, int flags)
 }
 
 
+mFILE::mFILE(void *Data, long Size, int Owned)
+{
+  data=(unsigned char *)Data;
+  size=Size;
+  current_offset=alloced=0;
+  owned=Owned;
+
+  // everything is in memory already, so the buffers are of no use
+  free(rbuf); rbuf=NULL;
+  free(wbuf); wbuf=NULL;
+  rbuf_size=wbuf_size=0;
+}
+
+mFILE::mFILE()
+{
+  alloced=0x10000;
+  data=(unsigned char *)malloc(alloced);
+  size=current_offset=0;
+  owned=1;
+
+  free(rbuf); rbuf=NULL;
+  free(wbuf); wbuf=NULL;
+  rbuf_size=wbuf_size=0;
+}
+
+mFILE::~mFILE()
+{
+  if (owned)
+    free(data);
+}
+
+int mFILE::unbuffered_read(void *buf, size_t count)
+{
+  if (count>(size_t)(size-current_offset))
+    count=size-current_offset;
+  memcpy(buf,data+current_offset,count);
+  current_offset+=count;
+  return count;
+}
+
+int mFILE::unbuffered_write(void const *buf, size_t count)
+{
+  if (!alloced)
+    return 0;
+  if (current_offset+(long)count>alloced)
+  {
+    while (current_offset+(long)count>alloced)
+      alloced*=2;
+    data=(unsigned char *)realloc(data,alloced);
+  }
+  memcpy(data+current_offset,buf,count);
+  current_offset+=count;
+  if (current_offset>size)
+    size=current_offset;
+  return count;
+}
+
+uint8_t const *mFILE::in_memory(long offset, long count)
+{
+  if (!data || offset<0 || count<0 || offset+count>size)
+    return NULL;
+  return data+offset;
+}
+
+int mFILE::unbuffered_seek(long offset, int whence)
+{
+  switch (whence)
+  {
+    case SEEK_SET : break;
+    case SEEK_CUR : offset+=current_offset; break;
+    case SEEK_END : offset=size-offset; break;
+    default : return -1;
+  }
+  if (offset<0 || offset>size)
+    return -1;
+  current_offset=offset;
+  return offset;
+}
+
+
 class null_file : public bFILE     // this file type will use virtual opens inside of a spe
 {
   public :
@@ -368,23 +612,178 @@ class null_file : public bFILE     // this file type will use virtual opens insi
 
 
 static bFILE *(*open_file_fun)(char const *,char const *)=NULL;
+static int (*remote_file_fun)(char const *)=NULL;
 int (*verify_file_fun)(char const *,char const *)=NULL;
 
-void set_file_opener(bFILE *(*open_fun)(char const *, char const *))
+void set_file_opener(bFILE *(*open_fun)(char const *, char const *),
+                     int (*remote_fun)(char const *))
 {
   open_file_fun=open_fun;
+  remote_file_fun=remote_fun;
+}
+
+// Whether filename is read from a plain file of ours, which open_file()
+// can read without the file opener
+static int local_file(char const *filename)
+{
+  return !open_file_fun || (remote_file_fun && !remote_file_fun(filename));
+}
+
+int spec_mmap=1;
+
+#if defined HAVE_SYS_MMAN_H
+struct file_map
+{
+  char *name;
+  void *data;
+  long size;
+  time_t mtime;
+  file_map *next;
+};
+
+// A file that changed gets mapped again, but its old mapping stays until
+// unmap_files() since files opened before may still be reading it
+static file_map *file_maps=NULL;
+
+static file_map *map_file(char const *name, struct stat *st)
+{
+  file_map *m;
+  for (m=file_maps; m; m=m->next)
+    if (!strcmp(m->name,name) && m->size==st->st_size && m->mtime==st->st_mtime)
+      return m;
+
+  int fd=open(name,O_RDONLY);
+  if (fd<0)
+    return NULL;
+  void *data=mmap(NULL,st->st_size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if (data==MAP_FAILED)
+    return NULL;
+
+  m=(file_map *)malloc(sizeof(file_map));
+  m->name=strdup(name);
+  m->data=data;
+  m->size=st->st_size;
+  m->mtime=st->st_mtime;
+  m->next=file_maps;
+  file_maps=m;
+  return m;
+}
+#endif
+
+// A file inside the main spec file; compressed ones cannot be seeked in
+// like a file of their own, so they do not count
+static spec_entry *main_entry(char const *filename)
+{
+  spec_entry *se=spec_main_sd.find(filename);
+  return se && !se->zsize ? se : NULL;
+}
+
+int in_spec_main_file(char const *filename)
+{
+  if (spec_main_fd<0 || !local_file(filename) || !main_entry(filename))
+    return 0;
+  if (search_order!=SPEC_SEARCH_OUTSIDE_INSIDE)
+    return 1;
+
+  char name[200];
+  struct stat st;
+  external_name(filename,name);
+  return stat(name,&st)!=0;
+}
+
+void write_file_name(char const *filename, char *buf)
+{
+  external_name(filename,buf);
+}
+
+int locate_file(char const *filename, char *buf, long &offset, long &size)
+{
+  if (!local_file(filename))
+    return 0;
+  if (in_spec_main_file(filename))
+  {
+    spec_entry *se=main_entry(filename);
+    external_name(spec_main_file,buf);
+    offset=se->offset;
+    size=se->size;
+    return 1;
+  }
+  if (search_order==SPEC_SEARCH_INSIDE_ONLY)
+    return 0;
+  external_name(filename,buf);
+  offset=0;
+  size=-1;
+  return 1;
+}
+
+bFILE *open_mapped_file(char const *filename)
+{
+#if defined HAVE_SYS_MMAN_H
+  if (!spec_mmap || !local_file(filename))
+    return NULL;
+
+  char name[200];
+  struct stat st;
+
+  // look where jFILE would, the main spec file or a file of its own
+  if (in_spec_main_file(filename))
+  {
+    spec_entry *se=main_entry(filename);
+    external_name(spec_main_file,name);
+    if (stat(name,&st) || (long)(se->offset+se->size)>(long)st.st_size)
+      return NULL;
+    file_map *m=map_file(name,&st);
+    return m ? new mapFILE((uint8_t *)m->data+se->offset,se->size) : NULL;
+  }
+  if (search_order==SPEC_SEARCH_INSIDE_ONLY)
+    return NULL;
+
+  external_name(filename,name);
+
+  // saved games and settings get rewritten while we play
+  if (save_spec_prefix && !strncmp(name,save_spec_prefix,strlen(save_spec_prefix)))
+    return NULL;
+
+  if (stat(name,&st) || !S_ISREG(st.st_mode) || st.st_size<=0)
+    return NULL;
+  file_map *m=map_file(name,&st);
+  return m ? new mapFILE(m->data,m->size) : NULL;
+#else
+  return NULL;
+#endif
+}
+
+void unmap_files()
+{
+#if defined HAVE_SYS_MMAN_H
+  while (file_maps)
+  {
+    file_map *m=file_maps;
+    file_maps=m->next;
+    munmap(m->data,m->size);
+    free(m->name);
+    free(m);
+  }
+#endif
 }
 
 bFILE *open_file(char const *filename, char const *mode)
 {
   if (!verify_file_fun || verify_file_fun(filename,mode))
   {
-    if (open_file_fun)
+    if (!local_file(filename))
     {
       return open_file_fun(filename,mode);
     }
     else
     {
+      if (!strpbrk(mode,"wWaA+"))
+      {
+        bFILE *fp=open_mapped_file(filename);
+        if (fp)
+          return fp;
+      }
       return new jFILE(filename,mode);
     }
   }
@@ -409,7 +808,7 @@ void jFILE::open_internal(char const *filename, char const *mode, int flags)
     if (fd>=0)                    // if we were able to open the main file, see if it's in there
     {
       start_offset=0;
-      spec_entry *se=spec_main_sd.find(filename);
+      spec_entry *se=main_entry(filename);
       if (se)
       {
     start_offset=se->offset;
@@ -603,6 +1002,82 @@ spec_directory::~spec_directory()
     free(data);
     free(entries);
   }
+  free(index);
+}
+
+// FNV-1a, the same as the Lisp symbol table
+uint32_t spec_directory::Hash(char const *name)
+{
+    uint32_t h = 2166136261u;
+    while (*name)
+        h = (h ^ (uint8_t)*name++) * 16777619u;
+    return h;
+}
+
+// Return the first slot at or after from (or the start of the probe
+// sequence if from is NULL) that holds an entry with that name, or NULL
+spec_directory::index_slot *spec_directory::Lookup(char const *name,
+                                                   uint32_t hash,
+                                                   index_slot *from)
+{
+    if (!index)
+        return NULL;
+
+    size_t mask = index_size - 1;
+    for (size_t i = from ? (from - index + 1) & mask : hash & mask; ;
+         i = (i + 1) & mask)
+    {
+        index_slot *s = index + i;
+        if (s->num < 0)
+            return NULL;
+        if (s->hash == hash && !strcmp(name, entries[s->num]->name))
+            return s;
+    }
+}
+
+void spec_directory::AddToIndex(int num)
+{
+    if ((size_t)(num + 1) * 2 > index_size)
+    {
+        Reindex();
+        return;
+    }
+
+    uint32_t hash = Hash(entries[num]->name);
+    size_t mask = index_size - 1;
+    size_t i = hash & mask;
+    while (index[i].num >= 0)
+        i = (i + 1) & mask;
+    index[i].hash = hash;
+    index[i].num = num;
+}
+
+void spec_directory::Reindex()
+{
+    free(index);
+    index = NULL;
+    index_size = 0;
+    if (!total)
+        return;
+
+    index_size = 16;
+    while (index_size < (size_t)total * 2)
+        index_size *= 2;
+    index = (index_slot *)malloc(sizeof(index_slot) * index_size);
+    for (size_t i = 0; i < index_size; i++)
+        index[i].num = -1;
+
+    // In directory order, so that duplicate names are probed the same way
+    size_t mask = index_size - 1;
+    for (int n = 0; n < total; n++)
+    {
+        uint32_t hash = Hash(entries[n]->name);
+        size_t i = hash & mask;
+        while (index[i].num >= 0)
+            i = (i + 1) & mask;
+        index[i].hash = hash;
+        index[i].num = n;
+    }
 }
 
 void spec_directory::FullyLoad(bFILE *fp)
@@ -625,9 +1100,24 @@ spec_entry::spec_entry(uint8_t spec_type, char const *object_name,
     name = strdup(object_name);
     data = NULL;
     size = data_size;
+    zsize = 0;
     offset = data_offset;
 }
 
+void *spec_pack(spec_entry *se)
+{
+    uint8_t *packed = (uint8_t *)malloc(lz_bound(se->size));
+    size_t len = lz_pack(se->data, se->size, packed);
+    if (len >= se->size)
+    {
+        free(packed);
+        se->zsize = 0;
+        return NULL;
+    }
+    se->zsize = len;
+    return packed;
+}
+
 spec_entry::~spec_entry()
 {
     free(name);
@@ -645,44 +1135,36 @@ void spec_directory::calc_offsets()
 
     // calculate the size of directory info
     for (int i = 0; i < total; i++)
-        o += 1 + 1 + strlen(entries[i]->name) + 1 + 1 + 8;
+        o += 1 + 1 + strlen(entries[i]->name) + 1 + 1 + 8
+               + (entries[i]->zsize ? 4 : 0);
 
     // calculate offset for each entry
     for (int i = 0; i < total; i++)
     {
         entries[i]->offset = o;
-        o += entries[i]->size;
+        o += entries[i]->disk_size();
     }
 }
 
 spec_entry *spec_directory::find(char const *name, int type)
 {
-  int i;
-  spec_entry **e;
-  for (i=0,e=entries; i<total; i++,e++)
-    if (!strcmp((*e)->name,name) && (*e)->type==type)
-      return (*e);
+  uint32_t hash=Hash(name);
+  for (index_slot *s=Lookup(name,hash,NULL); s; s=Lookup(name,hash,s))
+    if (entries[s->num]->type==type)
+      return entries[s->num];
   return NULL;
 }
 
 spec_entry *spec_directory::find(char const *name)
 {
-  int i;
-  spec_entry **e;
-  for (i=0,e=entries; i<total; i++,e++)
-    if (!strcmp((*e)->name,name))
-      return (*e);
-  return NULL;
+  index_slot *s=Lookup(name,Hash(name),NULL);
+  return s ? entries[s->num] : NULL;
 }
 
 long spec_directory::find_number(char const *name)
 {
-  int i;
-  spec_entry **e;
-  for (i=0,e=entries; i<total; i++,e++)
-    if (!strcmp((*e)->name,name))
-      return i;
-  return -1;
+  index_slot *s=Lookup(name,Hash(name),NULL);
+  return s ? s->num : -1;
 }
 
 spec_entry *spec_directory::find(int type)
@@ -726,6 +1208,12 @@ void spec_directory::print()
 
 void spec_directory::startup(bFILE *fp)
 {
+  // a directory read from inside a compressed entry is not about this file
+  int own_file=!fp->unpacking();
+  if (own_file)
+    fp->set_compressed(NULL,0);
+
+  int zcount=0;
   char buf[256];
   memset(buf,0,256);
   fp->read(buf,8);
@@ -745,6 +1233,11 @@ void spec_directory::startup(bFILE *fp)
       entry_size=(entry_size+3)&(~3);
       fp->read(buf,(unsigned char)buf[1]);
       fp->read(buf,9);
+      if (buf[0]&SPEC_FLAG_COMPRESSED)
+      {
+        fp->read(buf,4);
+        zcount++;
+      }
 
       size+=entry_size;
     }
@@ -767,8 +1260,30 @@ void spec_directory::startup(bFILE *fp)
 
       se->size=fp->read_uint32();
       se->offset=fp->read_uint32();
+      se->zsize=0;
+      if (flags&SPEC_FLAG_COMPRESSED)
+      {
+        se->zsize=se->size;
+        se->size=fp->read_uint32();
+      }
       dp+=((sizeof(spec_entry)+len)+3)&(~3);
     }
+
+    if (zcount && own_file)
+    {
+      spec_zentry *z=(spec_zentry *)malloc(sizeof(spec_zentry)*zcount);
+      int n=0;
+      for (i=0; i<total; i++)
+        if (entries[i]->zsize)
+        {
+          z[n].offset=entries[i]->offset;
+          z[n].zsize=entries[i]->zsize;
+          z[n].size=entries[i]->size;
+          n++;
+        }
+      fp->set_compressed(z,n);
+      free(z);
+    }
   }
   else
   {
@@ -776,6 +1291,8 @@ void spec_directory::startup(bFILE *fp)
     data=NULL;
     entries=NULL;
   }
+  index=NULL;
+  Reindex();
 }
 
 
@@ -794,6 +1311,8 @@ spec_directory::spec_directory()
   total=0;
   data=NULL;
   entries=NULL;
+  index=NULL;
+  index_size=0;
 }
 
 /*
@@ -839,7 +1358,7 @@ long spec_directory::data_end_offset()
   spec_entry **e;
   long i;
   for (i=total-1,e=entries; i>=0; i--,e++)
-    return (*e)->offset+(*e)->size;
+    return (*e)->offset+(*e)->disk_size();
 
   return SPEC_SIG_SIZE+2;
 }
@@ -862,13 +1381,18 @@ int spec_directory::write(bFILE *fp)
   {
     if (fp->write(&(*e)->type,1)!=1)                 return 0;
     if (!write_string(fp,(*e)->name))                return 0;
-    flags=0;
+    flags=(*e)->zsize ? SPEC_FLAG_COMPRESSED : 0;
     if (fp->write(&flags,1)!=1)                     return 0;
 
-    data_size=lltl((*e)->size);
+    data_size=lltl((*e)->disk_size());
     if (fp->write((char *)&data_size,4)!=4)              return 0;
     offset=lltl((*e)->offset);
     if (fp->write((char *)&offset,4)!=4)                  return 0;
+    if (flags&SPEC_FLAG_COMPRESSED)
+    {
+      data_size=lltl((*e)->size);
+      if (fp->write((char *)&data_size,4)!=4)            return 0;
+    }
 
   }
   return 1;
@@ -927,6 +1451,7 @@ void spec_directory::remove(spec_entry *e)
     for (; i<total; i++)                               // compact the pointer array
       entries[i]=entries[i+1];
     entries=(spec_entry **)realloc(entries,sizeof(spec_entry *)*total);
+    Reindex();                                         // the numbers moved
   }
   else
     printf("Spec_directory::remove bad entry pointer\n");
@@ -939,6 +1464,7 @@ void spec_directory::add_by_hand(spec_entry *e)
   total++;
   entries=(spec_entry **)realloc(entries,sizeof(spec_entry *)*total);
   entries[total-1]=e;
+  AddToIndex(total-1);
 }
 
 void spec_directory::delete_entries()   // if the directory was created by hand instead of by file
@@ -53,6 +53,7 @@ enum
 #define SPEC_SIG_SIZE     8
 
 #define SPEC_FLAG_LINK    1
+#define SPEC_FLAG_COMPRESSED 2   // packed with lz.h; the unpacked size follows the offset
 
 #define SPEC_SEARCH_INSIDE_OUTSIDE 1
 #define SPEC_SEARCH_OUTSIDE_INSIDE 2
@@ -83,6 +84,8 @@ enum
  */
 
 void set_spec_main_file(char const *filename, int search_order=SPEC_SEARCH_OUTSIDE_INSIDE);
+// Whether jFILE would read filename from inside the main spec file
+int in_spec_main_file(char const *filename);
 
 void set_filename_prefix(char const *prefix);
 char *get_filename_prefix();
@@ -90,8 +93,27 @@ void set_save_filename_prefix(char const *prefix);
 char *get_save_filename_prefix();
 #define JFILE_CLONED 1
 
+// Where a compressed entry is in a file, see bFILE::set_compressed()
+struct spec_zentry
+{
+  unsigned long offset, zsize, size;  // size is unpacked, zsize on disk
+};
+
+struct spec_unpacker;
+
 class bFILE     // base file type which other files should be derived from (jFILE & NFS for now)
 {
+  spec_zentry *zentries;               // sorted by offset
+  int zcount;
+  spec_unpacker *unpack;               // reading a compressed entry, or NULL
+
+  int raw_read(void *buf, size_t count);
+  int raw_seek(long offset, int whence);
+  int raw_tell();
+  int unpack_read(void *buf, size_t count);  // skips count bytes if buf is NULL
+  int next_block();
+  void stop_unpacking();
+
   protected :
   unsigned char *rbuf,*wbuf;
   unsigned long rbuf_start,rbuf_end,rbuf_size,
@@ -112,7 +134,16 @@ class bFILE     // base file type which other files should be derived from (jFIL
   int write(void const *buf, size_t count); // returns number of bytes written
   int seek(long offset, int whence);        // whence=SEEK_SET, SEEK_CUR, SEEK_END, ret=0=success
   int tell();
+  // Seeking to the offset of one of these entries reads it unpacked from
+  // there on, with tell() counting unpacked bytes, until the next seek
+  // elsewhere; spec_directory sets them up for the file it was read from
+  void set_compressed(spec_zentry const *z, int count);
+  int unpacking() { return unpack!=NULL; }
   virtual int file_size() = 0;
+  // The raw bytes offset..offset+size, for reading in place if the file
+  // is already all in memory, else NULL. The pointer is good as long as
+  // the file is open.
+  virtual uint8_t const *in_memory(long offset, long size) { return NULL; }
 
   virtual ~bFILE();
 
@@ -155,6 +186,36 @@ public :
   virtual ~jFILE();
 } ;
 
+class mFILE : public bFILE     // reads from memory, e.g. a spec entry that was read ahead
+{
+protected :
+  unsigned char *data;
+  long size,current_offset,alloced;  // alloced is 0 unless the file is writable
+  int owned;                   // free data along with the file
+
+protected :
+  virtual int allow_read_buffering() { return 0; }
+  virtual int allow_write_buffering() { return 0; }
+
+public :
+  mFILE(void *Data, long Size, int Owned);
+  mFILE();                     // empty and writable, grows as needed
+  virtual int open_failure() { return data==NULL; }
+  virtual int unbuffered_read(void *buf, size_t count);
+  virtual int unbuffered_write(void const *buf, size_t count);
+  virtual int unbuffered_seek(long offset, int whence);
+  virtual int unbuffered_tell() { return current_offset; }
+  virtual int file_size() { return size; }
+  virtual uint8_t const *in_memory(long offset, long size);
+  virtual ~mFILE();
+} ;
+
+class mapFILE : public mFILE   // reads from a mapping of a file, see open_mapped_file()
+{
+public :
+  mapFILE(void *Data, long Size) : mFILE(Data,Size,0) { ; }
+} ;
+
 class spec_entry
 {
 public:
@@ -165,9 +226,13 @@ public:
 
     void Print();
 
+    // Bytes the entry takes in the file
+    unsigned long disk_size() const { return zsize ? zsize : size; }
+
     char *name;
     void *data;
     unsigned long size, offset;
+    unsigned long zsize; // packed size if SPEC_FLAG_COMPRESSED, else 0
     uint8_t type;
 };
 
@@ -199,11 +264,31 @@ public :
   int    write(bFILE *fp);
   void print();
   void delete_entries();   // if the directory was created by hand instead of by file
+    // Rebuild the name index; needed after changing entries, total or the
+    // names directly instead of through add_by_hand() and remove()
+    void Reindex();
 
     int total;
     spec_entry **entries;
     void *data;
     size_t size;
+
+private:
+    // Open addressing hash table of entry numbers by name, with linear
+    // probing and never more than half full. Entries with the same name
+    // are probed in directory order, so find() returns the first one.
+    struct index_slot
+    {
+        uint32_t hash;
+        int num; // -1 if the slot is empty
+    };
+
+    static uint32_t Hash(char const *name);
+    index_slot *Lookup(char const *name, uint32_t hash, index_slot *from);
+    void AddToIndex(int num);
+
+    index_slot *index;
+    size_t index_size;
 };
 
 /*jFILE *add_directory_entry(char *filename,
@@ -221,8 +306,33 @@ void write_uint32(FILE *fp, uint32_t x);
 void write_uint8(FILE *fp, uint8_t x);
 
 void set_spec_main_file(char *filename, int Search_order);
-void set_file_opener(bFILE *(*open_fun)(char const *, char const *));
+// open_fun opens every file from now on, or only those remote_fun says do
+// not come from a plain file of ours
+void set_file_opener(bFILE *(*open_fun)(char const *, char const *),
+                     int (*remote_fun)(char const *) = NULL);
 void set_no_space_handler(void (*handle_fun)());
 bFILE *open_file(char const *filename, char const *mode);
+// Pack the data of an entry so it can be written as SPEC_FLAG_COMPRESSED:
+// returns the malloc()ed packed data and sets zsize, or returns NULL if it
+// does not get any smaller
+void *spec_pack(spec_entry *se);
+// Read-only opens of plain files share one mapping of the whole file, which
+// they read without system calls; -nommap turns this off
+extern int spec_mmap;
+// A file reading straight from the mapping of filename, or NULL if it
+// cannot be mapped and should be opened the usual way
+bFILE *open_mapped_file(char const *filename);
+void unmap_files();
+// Time reading, looking up and seeking in the given files, for -specbench
+void spec_bench(char const * const *names, int files, int rounds,
+                void (*print)(char const *format, ...));
+// Put in buf (200 bytes) the plain file that open_file() would read
+// filename from, and where in it filename is: size is -1 for all of it.
+// Nothing is read, so that another thread can read it on its own; 0 if
+// it is not in a plain file, e.g. for net clients
+int locate_file(char const *filename, char *buf, long &offset, long &size);
+// Put in buf (200 bytes) the plain file open_file() creates when filename
+// is opened for writing, for writing it without a jFILE
+void write_file_name(char const *filename, char *buf);
 #endif
 
@@ -41,6 +41,16 @@ class text_status_manager : public status_manager
 
 extern status_manager *stat_man;
 
+// Shows nothing, for loading a snapshot without popping up a loading
+// window every time
+class quiet_status : public status_manager
+{
+  public :
+  virtual void push(char const *name, visual_object *show) { ; }
+  virtual void update(int percentage) { ; }
+  virtual void pop() { ; }
+} ;
+
 class stack_stat  // something you can declare on the stact that is sure to get cleaned up
 {
   public :
@@ -13,11 +13,16 @@
 #endif
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
 #include "common.h"
 
 #include "transimage.h"
+#include "specs.h"
+#include "jdir.h"
+
+int trans_spans = 1;
 
 TransImage::TransImage(image *im, char const *name)
 {
@@ -90,11 +95,70 @@ TransImage::TransImage(image *im, char const *name)
         }
     }
     im->Unlock();
+
+    Compile();
 }
 
 TransImage::~TransImage()
 {
     free(m_data);
+    free(m_spans);
+    free(m_lines);
+    free(m_pixels);
+}
+
+// Turn the run-length data into spans, with the pixels of each run starting
+// on an 8-byte boundary so that they can be copied a word at a time
+void TransImage::Compile()
+{
+    int spans = 0;
+    size_t bytes = 0;
+    uint8_t *parser = m_data;
+    for (int y = 0; y < m_size.y; y++)
+    {
+        for (int x = 0; x < m_size.x; )
+        {
+            x += *parser++;
+            if (x >= m_size.x)
+                break;
+
+            int len = *parser++;
+            spans++;
+            bytes += (len + 7) & ~7;
+            parser += len;
+            x += len;
+        }
+    }
+
+    m_spans = (Span *)malloc(sizeof(Span) * (spans + 1));
+    m_lines = (int *)malloc(sizeof(int) * (m_size.y + 1));
+    m_pixels = (uint8_t *)malloc(bytes + 8);
+
+    Span *s = m_spans;
+    uint32_t offset = 0;
+    parser = m_data;
+    for (int y = 0; y < m_size.y; y++)
+    {
+        m_lines[y] = s - m_spans;
+        for (int x = 0; x < m_size.x; )
+        {
+            x += *parser++;
+            if (x >= m_size.x)
+                break;
+
+            int len = *parser++;
+            s->x = x;
+            s->len = len;
+            s->offset = offset;
+            memcpy(m_pixels + offset, parser, len);
+            memset(m_pixels + offset + len, 0, ((len + 7) & ~7) - len);
+            offset += (len + 7) & ~7;
+            s++;
+            parser += len;
+            x += len;
+        }
+    }
+    m_lines[m_size.y] = s - m_spans;
 }
 
 image *TransImage::ToImage()
@@ -274,23 +338,112 @@ void TransImage::PutImageGeneric(image *screen, ivec2 pos, uint8_t color,
     screen->Unlock();
 }
 
+template<int N>
+inline void TransImage::PutRun(uint8_t *dst, uint8_t const *src, int len,
+                               uint8_t *map, uint8_t *map2)
+{
+    if (N == NORMAL)
+    {
+        if (len >= 32)
+        {
+            memcpy(dst, src, len);
+            return;
+        }
+        // Most runs are short; their source starts on an 8-byte boundary
+        for (; len >= 8; len -= 8, dst += 8, src += 8)
+            memcpy(dst, src, 8);
+        while (len--)
+            *dst++ = *src++;
+    }
+    else if (N == REMAP)
+    {
+        while (len--)
+            *dst++ = map[*src++];
+    }
+    else if (N == REMAP2)
+    {
+        while (len--)
+            *dst++ = map2[map[*src++]];
+    }
+}
+
+// Draw from the spans. When the image is all inside the clip rectangle,
+// which it is for most sprites, the runs are drawn without checking them.
+template<int N>
+void TransImage::PutSpans(image *screen, ivec2 pos, uint8_t *map,
+                          uint8_t *map2)
+{
+    ivec2 pos1, pos2;
+    screen->GetClip(pos1, pos2);
+
+    // check to see if it is totally clipped out first
+    if (pos.y + m_size.y <= pos1.y || pos.y >= pos2.y
+         || pos.x >= pos2.x || pos.x + m_size.x <= pos1.x)
+        return;
+
+    // What is left of the image once clipped, relative to its corner
+    int x1 = Max(pos1.x - pos.x, 0), x2 = Min(pos2.x - pos.x, m_size.x);
+    int y1 = Max(pos1.y - pos.y, 0), y2 = Min(pos2.y - pos.y, m_size.y);
+
+    screen->AddDirty(pos + ivec2(x1, y1), pos + ivec2(x2, y2));
+    screen->Lock();
+
+    int sw = screen->Size().x;
+    uint8_t *screen_line = screen->scan_line(pos.y + y1) + pos.x;
+
+    if (x1 == 0 && x2 == m_size.x)
+    {
+        for (int y = y1; y < y2; y++, screen_line += sw)
+        {
+            Span *s = m_spans + m_lines[y], *end = m_spans + m_lines[y + 1];
+            for (; s < end; s++)
+                PutRun<N>(screen_line + s->x, m_pixels + s->offset, s->len,
+                          map, map2);
+        }
+    }
+    else
+    {
+        for (int y = y1; y < y2; y++, screen_line += sw)
+        {
+            Span *s = m_spans + m_lines[y], *end = m_spans + m_lines[y + 1];
+            for (; s < end; s++)
+            {
+                int a = Max((int)s->x, x1), b = Min(s->x + s->len, x2);
+                if (a < b)
+                    PutRun<N>(screen_line + a, m_pixels + s->offset + a - s->x,
+                              b - a, map, map2);
+            }
+        }
+    }
+    screen->Unlock();
+}
+
 void TransImage::PutImage(image *screen, ivec2 pos)
 {
-    PutImageGeneric<NORMAL>(screen, pos, 0, NULL, 0, NULL, NULL,
-                            0, 1, NULL, NULL, NULL);
+    if (trans_spans)
+        PutSpans<NORMAL>(screen, pos, NULL, NULL);
+    else
+        PutImageGeneric<NORMAL>(screen, pos, 0, NULL, 0, NULL, NULL,
+                                0, 1, NULL, NULL, NULL);
 }
 
 void TransImage::PutRemap(image *screen, ivec2 pos, uint8_t *map)
 {
-    PutImageGeneric<REMAP>(screen, pos, 0, NULL, 0, map, NULL,
-                           0, 1, NULL, NULL, NULL);
+    if (trans_spans)
+        PutSpans<REMAP>(screen, pos, map, NULL);
+    else
+        PutImageGeneric<REMAP>(screen, pos, 0, NULL, 0, map, NULL,
+                               0, 1, NULL, NULL, NULL);
 }
 
 void TransImage::PutDoubleRemap(image *screen, ivec2 pos,
                             uint8_t *map, uint8_t *map2)
 {
-    PutImageGeneric<REMAP2>(screen, pos, 0, NULL, 0, map, map2,
-                            0, 1, NULL, NULL, NULL);
+    if (trans_spans)
+        PutSpans<REMAP2>(screen, pos, map, map2);
+    else
+        PutImageGeneric<REMAP2>(screen, pos, 0, NULL, 0, map, map2,
+                                0, 1, NULL, NULL, NULL);
 }
 
 // Used when eg. the player teleports, or in rocket trails
@@ -361,3 +514,107 @@ size_t TransImage::DiskUsage()
     return ret + sizeof(void *) + sizeof(ivec2);
 }
 
+// Draw every figure in art/*.spe rounds times, from the compiled spans and
+// then from the run-length data: unclipped in the middle of a screen-sized
+// image, clipped across two of its corners, and remapped. Both ways have
+// to leave the same pixels behind.
+void blit_bench(int rounds, void (*print)(char const *format, ...))
+{
+    static char const *const names[] = { "spans", "rle" };
+    static char const *const kinds[] = { "unclipped", "clipped", "remap" };
+    TransImage **figs = NULL;
+    int total = 0;
+
+    char path[256];
+    sprintf(path, "%sart", get_filename_prefix() ? get_filename_prefix() : "");
+    char **files, **dirs;
+    int tfiles, tdirs;
+    get_directory(path, files, tfiles, dirs, tdirs);
+    for (int f = 0; f < tfiles; f++)
+    {
+        int len = strlen(files[f]);
+        if (len > 4 && !strcmp(files[f] + len - 4, ".spe"))
+        {
+            char name[256];
+            sprintf(name, "art/%s", files[f]);
+            jFILE fp(name, "rb");
+            spec_directory dir(&fp);
+            for (int i = 0; i < dir.total; i++)
+            {
+                spec_entry *se = dir.entries[i];
+                if (se->type != SPEC_CHARACTER && se->type != SPEC_CHARACTER2)
+                    continue;
+                image im(&fp, se);
+                figs = (TransImage **)realloc(figs, sizeof(TransImage *)
+                                                        * (total + 1));
+                figs[total++] = new TransImage(&im, "blitbench");
+            }
+        }
+        free(files[f]);
+    }
+    for (int d = 0; d < tdirs; d++)
+        free(dirs[d]);
+    free(files);
+    free(dirs);
+
+    if (!total)
+    {
+        print("blit no figures in %s\n", path);
+        return;
+    }
+
+    uint8_t map[256];
+    for (int i = 0; i < 256; i++)
+        map[i] = 255 - i;
+
+    int old_spans = trans_spans;
+    image *screen[2];
+    float ms[2][3];
+    for (int m = 0; m < 2; m++)
+    {
+        trans_spans = !m;
+        screen[m] = new image(ivec2(320, 200));
+        screen[m]->clear();
+        ivec2 size = screen[m]->Size();
+        for (int k = 0; k < 3; k++)
+        {
+            Timer t;
+            for (int r = 0; r < rounds; r++)
+                for (int i = 0; i < total; i++)
+                {
+                    ivec2 s = figs[i]->Size();
+                    if (k == 0)
+                        figs[i]->PutImage(screen[m], (size - s) / 2);
+                    else if (k == 1)
+                    {
+                        figs[i]->PutImage(screen[m], -s / ivec2(2, 3));
+                        figs[i]->PutImage(screen[m], size - s / ivec2(3, 2));
+                    }
+                    else
+                        figs[i]->PutRemap(screen[m], (size - s) / 2
+                                              + ivec2(i % 7, i % 5), map);
+                }
+            ms[m][k] = t.GetMs();
+        }
+    }
+    trans_spans = old_spans;
+
+    bool same = true;
+    for (int y = 0; y < screen[0]->Size().y; y++)
+        same &= !memcmp(screen[0]->scan_line(y), screen[1]->scan_line(y),
+                        screen[0]->Size().x);
+
+    for (int m = 0; m < 2; m++)
+        for (int k = 0; k < 3; k++)
+            print("blit %-5s %-9s %d figures x %d, %.1f ms, "
+                  "%.3f us/figure%s\n", names[m], kinds[k], total, rounds,
+                  ms[m][k], ms[m][k] * 1000.f / rounds / total
+                                / (k == 1 ? 2 : 1),
+                  m && !same ? " (MISMATCH)" : "");
+
+    for (int m = 0; m < 2; m++)
+        delete screen[m];
+    for (int i = 0; i < total; i++)
+        delete figs[i];
+    free(figs);
+}
@@ -22,8 +22,16 @@
  *   uint8_t data[size]; // solid pixel values
  *   ...
  *   (no scan line wraps allowed, there can be a last skip value)
+ *
+ *  Each image is also compiled into a list of spans, the runs of solid
+ *  pixels of every line with their pixels copied to 8-byte boundaries,
+ *  which PutImage(), PutRemap() and PutDoubleRemap() draw from without
+ *  going through the data above a byte at a time.
  */
 
+// 0 to draw from the run-length data instead of the spans, for -blitbench
+extern int trans_spans;
+
 class TransImage
 {
 public:
@@ -52,6 +60,8 @@ public:
     size_t DiskUsage();
 
 private:
+    void Compile();
+
     uint8_t *ClipToLine(image *screen, ivec2 pos1, ivec2 pos2,
                         ivec2 &posy, int &ysteps);
 
@@ -63,10 +73,27 @@ private:
                          uint8_t *map1, uint8_t *map2, int amount,
                          int nframes, uint8_t *tint,
                          ColorFilter *f, palette *pal);
+    template<int N>
+    void PutSpans(image *screen, ivec2 pos, uint8_t *map, uint8_t *map2);
+    template<int N>
+    static void PutRun(uint8_t *dst, uint8_t const *src, int len,
+                       uint8_t *map, uint8_t *map2);
+
+    struct Span
+    {
+        uint16_t x, len;  // where on the line the run starts, and its length
+        uint32_t offset;  // where its pixels are in m_pixels
+    };
 
     ivec2 m_size;
     uint8_t *m_data;
+    Span *m_spans;
+    int *m_lines;         // first span of each line, then the total
+    uint8_t *m_pixels;
 };
 
+// Time drawing every figure in art/ both ways, for -blitbench
+void blit_bench(int rounds, void (*print)(char const *format, ...));
+
 #endif
 
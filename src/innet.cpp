@@ -31,8 +31,11 @@
 #include "net/ghandler.h"
 #include "net/gserver.h"
 #include "net/gclient.h"
+#include "net/loopback.h"
+#include "net/netbot.h"
 #include "dprint.h"
 #include "netcfg.h"
+#include "rollback.h"
 
 /*
 
@@ -55,6 +58,13 @@ game_handler *game_face = NULL;
 extern char lsf[256];
 int local_client_number=0;        // 0 is the server
 join_struct *join_array=NULL;      // points to an array of possible joining clients
+int net_delay=-1,net_rollback=-1;  // -netdelay, -rollback; clients use the server's unless given
+int net_pipelined=0;               // input is sent ahead and collected by tick stamp
+int net_lag=0;                     // -netlag, milliseconds added to each udp packet
+int net_jitter=0,net_loss=0,net_bandwidth=0;  // -netjitter, -netloss, -netbandwidth, for -loopback
+int net_bots=0;                    // -netbots, loopback clients joining the server
+static int net_stalls=0;           // times the engine waited for input, and for how long
+static double net_stall_ms=0;
 extern char const *get_login();
 extern void set_login(char const *name);
 
@@ -115,6 +125,62 @@ int net_init(int argc, char **argv)
         {
             main_net_cfg->state = net_configuration::SERVER;
         }
+        else if (!strcmp(argv[i],"-netdelay") || !strcmp(argv[i],"-rollback"))
+        {
+            if (i==argc-1 || !sscanf(argv[i+1],"%d",&x) || x<0 || x>8)
+            {
+                fprintf(stderr,"Net: Bad value following %s, use 0..8\n",argv[i]);
+                return 0;
+            }
+            if (!strcmp(argv[i],"-netdelay"))
+                net_delay = x;
+            else
+                net_rollback = x;
+            i++;
+        }
+        else if (!strcmp(argv[i],"-netlag"))
+        {
+            if (i==argc-1 || !sscanf(argv[i+1],"%d",&x) || x<0 || x>2000)
+            {
+                fprintf(stderr,"Net: Bad value following -netlag, use 0..2000\n");
+                return 0;
+            }
+            net_lag = x;
+            i++;
+        }
+        else if (!strcmp(argv[i],"-netjitter") || !strcmp(argv[i],"-netloss")
+                 || !strcmp(argv[i],"-netbandwidth"))
+        {
+            int most=!strcmp(argv[i],"-netjitter") ? 1000 :
+                     !strcmp(argv[i],"-netloss") ? 100 : 1000000;
+            if (i==argc-1 || !sscanf(argv[i+1],"%d",&x) || x<0 || x>most)
+            {
+                fprintf(stderr,"Net: Bad value following %s, use 0..%d\n",argv[i],most);
+                return 0;
+            }
+            if (!strcmp(argv[i],"-netjitter"))
+                net_jitter = x;
+            else if (!strcmp(argv[i],"-netloss"))
+                net_loss = x;
+            else
+                net_bandwidth = x;
+            i++;
+        }
+        else if (!strcmp(argv[i],"-loopback"))
+        {
+            loopback.enabled = 1;
+        }
+        else if (!strcmp(argv[i],"-netbots"))
+        {
+            if (i==argc-1 || !sscanf(argv[i+1],"%d",&x) || x<1 || x>7)
+            {
+                fprintf(stderr,"Net: Bad value following -netbots, use 1..7\n");
+                return 0;
+            }
+            net_bots = x;
+            loopback.enabled = 1;
+            i++;
+        }
         else if( !strcmp( argv[i], "-min_players" ) )
         {
             i++;
@@ -139,7 +205,8 @@ int net_init(int argc, char **argv)
         if( n->installed() )
         {
             total_usable++;
-            usable=n;
+            if( usable != &loopback ) // -loopback wins over real networks
+                usable=n;
         }
     }
 
@@ -193,6 +260,7 @@ int net_start()  // is the game starting up off the net? (i.e. -net hostname)
 
 int kill_net()
 {
+  net_bot::stop_all();
   if (game_face) delete game_face;  game_face=NULL;
   if (join_array) free(join_array);  join_array=NULL;
   if (game_sock) { delete game_sock; game_sock=NULL; }
@@ -201,6 +269,11 @@ int kill_net()
   delete fman;  fman=NULL;
 #endif
   if (net_server) { delete net_server; net_server=NULL; }
+  if (net_pipelined)
+  {
+    net_pipelined=0;
+    rollback.Reset(0);
+  }
   if (prot)
   {
     prot->cleanup();
@@ -300,6 +373,7 @@ void service_net_request()
 #if HAVE_NETWORK
   if (prot)
   {
+    net_bot::service_all();
     if (prot->select(0))  // anything happening net-wise?
     {
       if (comm_sock && comm_sock->ready_to_read())  // new connection?
@@ -440,16 +514,22 @@ int request_server_entry()
     else strcpy(uname,"unknown");
     uint8_t len=strlen(uname)+1;
     short nkills;
+    uint8_t pipe[2];
 
     if (sock->write(&len,1)!=1 ||
                 sock->write(uname,len)!=len ||
                 sock->write(&port,2)!=2  ||            // send server out game port
                 sock->read(&port,2)!=2   ||            // read server's game port
                 sock->read(&nkills,2)!=2 ||
-                sock->read(&cnum,2)!=2   || cnum==0    // read player number (cannot be 0 because 0 is server)
+                sock->read(&cnum,2)!=2   || cnum==0 || // read player number (cannot be 0 because 0 is server)
+                sock->read(pipe,2)!=2                  // read server's input delay and rollback
                 )
     { delete sock; return 0; }
 
+    if (net_delay<0) net_delay=pipe[0];
+    if (net_rollback<0) net_rollback=pipe[1];
+    net_pipelined=net_delay>0 || net_rollback>0;
+
     nkills=lstl(nkills);
     port=lstl(port);
     cnum=lstl(cnum);
@@ -468,6 +548,28 @@ int request_server_entry()
   return 0;
 }
 
+// Pipelined games: forget all input and start over at tick, with empty input
+// for the first net_delay ticks, which is when our next input will be for
+void net_pipe_start(uint8_t tick)
+{
+  if (!net_pipelined)
+    return;
+
+  base->next_tick=tick;
+  base->sent.clear();
+  base->merged.clear();
+  base->packet.packet_reset();
+  base->input_state=INPUT_COLLECTING;
+  game_face->pipe_reset();
+  rollback.Reset(tick);
+
+  for (int i=0; i<net_delay; i++)
+  {
+    base->current_tick=(uint8_t)(tick+i);
+    game_face->add_engine_input();
+  }
+}
+
 int reload_start()
 {
   if (prot)
@@ -491,6 +593,7 @@ void net_reload()
     {
       if (current_level)
         delete current_level;
+      current_level=NULL;
       bFILE *fp;
 
       if (!reload_start()) return ;
@@ -518,6 +621,7 @@ void net_reload()
       base->current_tick=(current_level->tick_counter()&0xff);
 
       reload_end();
+      net_pipe_start(base->reload_tick);
     } else if (current_level)
     {
 
@@ -554,7 +658,10 @@ void net_reload()
                 join_list = join_list->next;
       }
       base->join_list=NULL;
+      int old_delta=delta_saves;
+      delta_saves=0;    // whole, clients load it without the level it came from
       current_level->save(NET_STARTFILE,1);
+      delta_saves=old_delta;
       base->mem_lock=0;
 
 
@@ -598,7 +705,7 @@ void net_reload()
       the_game->reset_keymap();
 
       base->input_state=INPUT_COLLECTING;
-
+      net_pipe_start(base->reload_tick);
     }
   }
 }
@@ -611,7 +718,17 @@ void send_local_request()
 {
   if (prot)
   {
-    if (current_level)
+    if (net_pipelined)
+    {
+      base->current_tick=rollback.SendTick();
+      // after a rollback we may be going over ticks we already sent input for
+      if (base->sent.find(base->current_tick))
+      {
+        base->packet.packet_reset();
+        return;
+      }
+    }
+    else if (current_level)
       base->current_tick=(current_level->tick_counter()&0xff);
     game_face->add_engine_input();
   } else base->input_state=INPUT_PROCESSING;
@@ -631,73 +748,108 @@ void kill_slackers()
   }
 }
 
-int get_inputs_from_server(unsigned char *buf)
+// Whether the input we are waiting on is here, the lockstep packet or, in
+// pipelined games, the merged packet for tick
+static int input_arrived(int tick)
 {
-  if (prot && base->input_state!=INPUT_PROCESSING)      // if input is not here, wait on it
-  {
-    time_marker start;
+  if (tick<0)
+    return base->input_state==INPUT_PROCESSING;
+  return base->merged.find(tick)!=NULL;
+}
 
-    int total_retry=0;
-    Jwindow *abort=NULL;
+// Service the net until the input arrives, asking for it again if it takes
+// too long and letting the player drop the slow clients after a while
+static void wait_for_input(int tick)
+{
+  if (!prot || input_arrived(tick))
+    return;
 
-    while (base->input_state!=INPUT_PROCESSING)
-    {
-      if (!prot)
-      {
-    base->input_state=INPUT_PROCESSING;
-    return 1;
-      }
-      service_net_request();
+  time_marker start,stall;
 
-      time_marker now;                   // if this is taking to long, the packet was probably lost, ask for it to be resent
+  int total_retry=0;
+  Jwindow *abort=NULL;
 
-      if (now.diff_time(&start)>0.05)
-      {
-    if (prot->debug_level(net_protocol::DB_IMPORTANT_EVENT))
-      fprintf(stderr,"(missed packet)");
+  while (!input_arrived(tick))
+  {
+    if (!prot)
+    {
+      base->input_state=INPUT_PROCESSING;
+      break;
+    }
+    service_net_request();
 
+    // what the loopback network has on its way gets there at a known
+    // time, so sleep until then rather than poll
+    if (prot==&loopback && !input_arrived(tick))
+      prot->select(1);
 
-    game_face->input_missing();
-    start.get_time();
+    time_marker now;                   // if this is taking to long, the packet was probably lost, ask for it to be resent
 
-    total_retry++;
-    if (total_retry==12000)    // 2 minutes and nothing
+    if (now.diff_time(&start)>0.05)
     {
-      abort=wm->CreateWindow(ivec2(0, yres / 2), ivec2(-1, wm->font()->Size().y*4),
-                   new info_field(0, 0, 0, symbol_str("waiting"),
-                          new button(0, wm->font()->Size().y + 5, ID_NET_DISCONNECT,
-                             symbol_str("slack"),NULL)),symbol_str("Error"));
-      wm->flush_screen();
-    }
-      }
-      if (abort)
+      if (prot->debug_level(net_protocol::DB_IMPORTANT_EVENT))
+        fprintf(stderr,"(missed packet)");
+
+
+      game_face->input_missing();
+      start.get_time();
+
+      total_retry++;
+      if (total_retry==12000)    // 2 minutes and nothing
       {
-    if (wm->IsPending())
+        abort=wm->CreateWindow(ivec2(0, yres / 2), ivec2(-1, wm->font()->Size().y*4),
+                     new info_field(0, 0, 0, symbol_str("waiting"),
+                            new button(0, wm->font()->Size().y + 5, ID_NET_DISCONNECT,
+                               symbol_str("slack"),NULL)),symbol_str("Error"));
+        wm->flush_screen();
+      }
+    }
+    if (abort)
     {
-      Event ev;
-      do
+      if (wm->IsPending())
       {
-        wm->get_event(ev);
-        if (ev.type==EV_MESSAGE && ev.message.id==ID_NET_DISCONNECT)
+        Event ev;
+        do
         {
-          kill_slackers();
-          base->input_state=INPUT_PROCESSING;
-        }
-      } while (wm->IsPending());
-
-      wm->flush_screen();
-    }
+          wm->get_event(ev);
+          if (ev.type==EV_MESSAGE && ev.message.id==ID_NET_DISCONNECT)
+          {
+            kill_slackers();
+            base->input_state=INPUT_PROCESSING;
+          }
+        } while (wm->IsPending());
+
+        wm->flush_screen();
       }
     }
+  }
 
-    if (abort)
-    {
-      wm->close_window(abort);
-      the_game->reset_keymap();
-
-    }
+  if (abort)
+  {
+    wm->close_window(abort);
+    the_game->reset_keymap();
   }
 
+  time_marker now;
+  net_stalls++;
+  net_stall_ms+=now.diff_time(&stall)*1000.0;
+}
+
+void net_stall_stats(int &stalls, float &ms)
+{
+  stalls=net_stalls;
+  ms=(float)net_stall_ms;
+}
+
+int net_wait_tick(uint8_t tick)
+{
+  wait_for_input(tick);
+  return prot!=NULL;
+}
+
+int get_inputs_from_server(unsigned char *buf)
+{
+  wait_for_input(-1);
 
   memcpy(base->last_packet.data,base->packet.data,base->packet.packet_size()+base->packet.packet_prefix_size());
 
@@ -729,6 +881,17 @@ int become_server(char *name)
 
     game_face=new game_server;
     local_client_number=0;
+
+    net_delay=Max(net_delay,0);
+    net_rollback=Max(net_rollback,0);
+    net_pipelined=net_delay>0 || net_rollback>0;
+    net_pipe_start(0);
+
+    if (net_bots && prot==&loopback)
+    {
+      main_net_cfg->min_players=Max(main_net_cfg->min_players,net_bots+1);
+      net_bot::start(net_bots,main_net_cfg->port);
+    }
     return 1;
   }
   return 0;
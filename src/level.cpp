@@ -44,8 +44,20 @@
 #include "cop.h"
 #include "nfserver.h"
 #include "lisp_gc.h"
+#include "headless.h"
+#include "crc.h"
+#include "delta.h"
+#include "savewriter.h"
 
 level *current_level;
+int delta_saves=1;
+int async_saves=1;
+int bulk_loads=1;
+
+// How the "delta" entry of a savegame says to get each entry back
+enum { DELTA_COPY,    // the same as in the base level
+       DELTA_RAW,     // the next data entry of the savegame
+       DELTA_PATCH }; // the next data entry, patched onto the base level's
 
 game_object *level::attacker(game_object *who)
 {
@@ -88,6 +100,7 @@ void level::load_fail()
   if (Name)      free(Name);     Name=NULL;
 
   first_active=NULL;
+  grid.Invalidate();
   view *f=player_list;
   for (; f; f=f->next)
     if (f->m_focus)
@@ -123,6 +136,7 @@ level::~level()
   if (block_list) free(block_list);
   if (all_block_list) free(all_block_list);
   if (first_name) free(first_name);
+  if (base_name) free(base_name);
 }
 
 void level::restart()
@@ -190,6 +204,32 @@ void level::unactivate_all()
 
   for (; o; o=o->next)
     o->active=0;
+
+  if (the_game)
+    grid.Clear(fg_width*the_game->ftile_width(),fg_height*the_game->ftile_height(),
+               the_game->ftile_width(),the_game->ftile_height());
+  else
+    grid.Invalidate();
+}
+
+void level::grid_actives(game_object *from)
+{
+  for (game_object *o=from; o; o=o->next_active)
+    grid.Insert(o);
+}
+
+// fills q with the active objects whose picture may touch the given area,
+// in active list order
+void level::find_actives(GridQuery &q, int32_t x1, int32_t y1, int32_t x2, int32_t y2)
+{
+  if (grid.IsValid())
+    grid.Query(q,x1,y1,x2,y2);
+  else
+  {
+    q.total=0;
+    for (game_object *o=first_active; o; o=o->next_active)
+      q.Add(o);
+  }
 }
 
 
@@ -223,6 +263,7 @@ int level::add_actives(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
   game_object *last_active=NULL;
   if (first_active)
     for (last_active=first_active; last_active->next_active; last_active=last_active->next_active);
+  game_object *old_last=last_active;
 
   game_object *o=first;
   for (; o; o=o->next)
@@ -257,6 +298,8 @@ int level::add_actives(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
   }
   if (last_active)
     last_active->next_active=NULL;
+
+  grid_actives(old_last ? old_last->next_active : first_active);
   return t;
 }
 
@@ -264,6 +307,7 @@ int level::add_actives(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
 int level::add_drawables(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
 {
   int t=0,ft=0;
+  grid.Invalidate();    // the drawing list is not what the grid holds
   game_object *last_active=NULL;
   if (first_active)
   {
@@ -367,6 +411,7 @@ void level::wall_push()
       o->x+=xv;
     }
       }
+      grid.Update(o);
     }
   }
 }
@@ -393,6 +438,9 @@ void level::try_pushback(game_object *subject,game_object *target)
       yv=0;
       target->try_move(target->x,target->y,xv2,yv,3);
       target->x+=xv2;
+
+      grid.Update(subject);
+      grid.Update(target);
     }
   }
 }
@@ -482,12 +530,28 @@ game_object *level::boundary_setback(game_object *subject, int32_t x1, int32_t y
 {
   game_object *l=NULL;
   int32_t tx1,ty1,tx2,ty2,t_centerx;
-  game_object *target=first_active;
-  game_object **blist=block_list;
-  int t=block_total;
-  for (; t; t--,blist++)
+  game_object *target;
+
+  // x2,y2 only ever move back towards x1,y1, so nothing outside the first
+  // box can be hit. The grid gives the blockers in it in list order.
+  GridQuery q;
+  int use_grid=grid.IsValid(),total=block_total;
+  if (use_grid)
   {
-    target=*blist;
+    grid.Query(q,Min(x1,x2),Min(y1,y2),Max(x1,x2),Max(y1,y2));
+    total=q.total;
+  }
+
+  for (int k=0; k<total; k++)
+  {
+    if (use_grid)
+    {
+      target=q.list[k];
+      if (target->block_index>=block_total || block_list[target->block_index]!=target)
+        continue;
+    }
+    else
+      target=block_list[k];
     if (target!=subject && (target->total_objects()==0 || target->get_object(0)!=subject))
     {
       target->picture_space(tx1,ty1,tx2,ty2);
@@ -534,12 +598,27 @@ game_object *level::all_boundary_setback(game_object *subject, int32_t x1, int32
 {
   game_object *l=NULL;
   int32_t tx1,ty1,tx2,ty2,t_centerx;
-  game_object *target=first_active;
-  game_object **blist=all_block_list;
-  int t=all_block_total;
-  for (; t; t--,blist++)
+  game_object *target;
+
+  // as in boundary_setback()
+  GridQuery q;
+  int use_grid=grid.IsValid(),total=all_block_total;
+  if (use_grid)
   {
-    target=*blist;
+    grid.Query(q,Min(x1,x2),Min(y1,y2),Max(x1,x2),Max(y1,y2));
+    total=q.total;
+  }
+
+  for (int k=0; k<total; k++)
+  {
+    if (use_grid)
+    {
+      target=q.list[k];
+      if (target->all_block_index>=all_block_total || all_block_list[target->all_block_index]!=target)
+        continue;
+    }
+    else
+      target=all_block_list[k];
     if (target!=subject && (target->total_objects()==0 || target->get_object(0)!=subject))
     {
       target->picture_space(tx1,ty1,tx2,ty2);
@@ -619,6 +698,7 @@ int level::tick()
               *cur;        // cur is current object, NULL if object deletes it's self
   int ret=1;
 
+  headless_mark();
   if (profiling())
     profile_reset();
 
@@ -748,6 +828,8 @@ int level::tick()
 
     if (cur)
     {
+      grid.Update(cur);
+
       point_list *p=cur->current_figure()->hit;  // see if this character is on an attack frame
       if (p && p->tot)
         add_attacker(cur);               // if so add him to attack list for later collision detect
@@ -759,8 +841,10 @@ int level::tick()
 
   }
   tick_panims();
+  headless_phase(PHASE_OBJECTS);
 
   check_collisions();
+  headless_phase(PHASE_COLLIDE);
 //  wall_push();
 
   set_tick_counter(tick_counter()+1);
@@ -1010,6 +1094,169 @@ void level::old_load_objects(spec_directory *sd, bFILE *fp)
 
 
 // load objects assumes current objects have already been disposed of
+// The values of an entry of a level file, for the object columns and link
+// tables, which hold lots of them. The whole entry is read in one go, in
+// place if the file is in memory or mapped, or, without bulk_loads, a
+// field at a time from the file like it used to be.
+class EntryReader
+{
+public:
+  EntryReader(bFILE *fp, spec_entry *se)
+  {
+    m_fp=fp;
+    m_pos=0;
+    m_owned=NULL;
+    m_data=NULL;
+    m_size=0;
+    fp->seek(se->offset,0);
+    if (!bulk_loads)
+      return;
+    if (!se->zsize)
+      m_data=fp->in_memory(se->offset,se->size);
+    if (m_data)
+      m_size=se->size;
+    else
+    {
+      m_data=m_owned=(uint8_t *)malloc(se->size+1);
+      m_size=m_fp->read(m_owned,se->size);
+    }
+  }
+  ~EntryReader() { free(m_owned); }
+
+  // The next RC_8, RC_16 or RC_32 value, 0 past the end of the entry
+  uint32_t Get(int type)
+  {
+    if (!m_data)
+    {
+      switch (type)
+      {
+        case RC_8 : return m_fp->read_uint8();
+        case RC_16 : return m_fp->read_uint16();
+        default : return m_fp->read_uint32();
+      }
+    }
+
+    uint8_t const *p=m_data+m_pos;
+    switch (type)
+    {
+      case RC_8 :
+        if (m_pos+1>m_size) return 0;
+        m_pos+=1;
+        return p[0];
+      case RC_16 :
+        if (m_pos+2>m_size) { m_pos=m_size; return 0; }
+        m_pos+=2;
+        return p[0]|(p[1]<<8);
+      default :
+        if (m_pos+4>m_size) { m_pos=m_size; return 0; }
+        m_pos+=4;
+        return p[0]|(p[1]<<8)|(p[2]<<16)|((uint32_t)p[3]<<24);
+    }
+  }
+
+private:
+  bFILE *m_fp;
+  uint8_t const *m_data;
+  uint8_t *m_owned;  // m_data when it had to be read
+  long m_size,m_pos;
+};
+
+// The other way round, for saving: values are gathered in memory and
+// written to the file in one go once the writer goes away
+class EntryWriter
+{
+public:
+  EntryWriter(bFILE *fp)
+  {
+    m_fp=fp;
+    m_size=0;
+    m_alloced=0x1000;
+    m_data=(uint8_t *)malloc(m_alloced);
+  }
+  ~EntryWriter()
+  {
+    m_fp->write(m_data,m_size);
+    free(m_data);
+  }
+
+  // Add an RC_8, RC_16 or RC_32 value
+  void Put(int type, uint32_t x)
+  {
+    if (m_size+4>m_alloced)
+    {
+      m_alloced*=2;
+      m_data=(uint8_t *)realloc(m_data,m_alloced);
+    }
+    uint8_t *p=m_data+m_size;
+    p[0]=x;
+    if (type==RC_8)
+    {
+      m_size+=1;
+      return;
+    }
+    p[1]=x>>8;
+    if (type==RC_16)
+    {
+      m_size+=2;
+      return;
+    }
+    p[2]=x>>16;
+    p[3]=x>>24;
+    m_size+=4;
+  }
+
+private:
+  bFILE *m_fp;
+  uint8_t *m_data;
+  long m_size,m_alloced;
+};
+
+// Read a column of the object records, the type of its values and then
+// one value for each of count objects, widened into vals. Returns 0 if
+// the column is missing or does not hold values of type.
+static int read_column(bFILE *fp, spec_entry *se, int type, int32_t *vals, int count)
+{
+  if (!se)
+    return 0;
+  EntryReader r(fp,se);
+  if ((int)r.Get(RC_8)!=type)
+    return 0;
+  for (int i=0; i<count; i++)
+    vals[i]=r.Get(type);
+  return 1;
+}
+
+// Read the local variables of every object, which are saved with how many
+// each has and moved to where they are now by v_remap
+static void load_lvars(bFILE *fp, spec_entry *se, game_object *first,
+                       int16_t **v_remap, uint16_t *o_backmap)
+{
+  EntryReader r(fp,se);
+  int abort=0;
+  game_object *o=first;
+  for (; o && !abort; o=o->next)
+  {
+    int16_t ot=r.Get(RC_16);
+    int k=0;
+    for (; k<ot; k++)
+    {
+      if (r.Get(RC_8)!=RC_32) abort=1;
+      else
+      {
+        int32_t v=r.Get(RC_32);
+        if (o->otype!=0xffff)     // non-exstant object
+        {
+          int remap=*(v_remap[o_backmap[o->otype]]+k);
+          if (remap!=-1 && figures[o->otype]->tiv>=k)
+          {
+            o->lvars[remap]=v;
+          }
+        }
+      }
+    }
+  }
+}
+
 void level::load_objects(spec_directory *sd, bFILE *fp)
 {
   spec_entry *se=sd->find("object_descripitions");
@@ -1130,121 +1377,82 @@ void level::load_objects(spec_directory *sd, bFILE *fp)
     {
       total_objs=fp->read_uint32();
 
-      se=sd->find("type");
-      if (se)
-      {
-    fp->seek(se->offset,0);
-    last=NULL;
-    if (fp->read_uint8()==RC_16)    //  read type array, this should be type RC_16
-    {
-      int i=0;
-      for (; i<total_objs; i++)
-      {
-        uint16_t t=fp->read_uint16();
-        game_object *p=new game_object(o_remap[t],1);
-        LSpace::Tmp.Clear();
-        if (!first) first=p; else last->next=p;
-        last=p; p->next=NULL;
-      }
+      // Every column is staged first, then the objects are made from it
+      int32_t *types=(int32_t *)malloc(sizeof(int32_t)*(total_objs+1));
+      int32_t *states=(int32_t *)malloc(sizeof(int32_t)*(total_objs+1));
+      int32_t *vars[TOTAL_OBJECT_VARS];
+      memset(vars,0,sizeof(vars));
 
-      se=sd->find("state");
-      if (se)
+      //  read type array, this should be type RC_16
+      if (read_column(fp,sd->find("type"),RC_16,types,total_objs))
       {
-        fp->seek(se->offset,0);
-        if (fp->read_uint8()==RC_16)    //  read state array, this should be type RC_16
-        {
-          game_object *l=first;
-          for (i=0; i<total_objs; i++,l=l->next)
-          {
-        int st=fp->read_uint16();
-        if (l->otype==0xffff)
-          l->state=stopped;
-        else
-        {
-          character_state s=(character_state)(*(s_remap[o_backmap[l->otype]]+st));
-          if (l->has_sequence((character_state)s))
-                l->state=s;
-          else l->state=stopped;
-          l->current_frame=0;
-        }
-          }
-        }
-      }
+    int has_states=read_column(fp,sd->find("state"),RC_16,states,total_objs);
 
-      se=sd->find("lvars");
-      if (se && load_vars)
+    for (j=0; j<default_simple.total_vars(); j++)
+    {
+      spec_entry *se=sd->find(object_descriptions[j].name);
+      if (!se)
+        dprintf("Warning : load level -> no previous var %s\n",default_simple.var_name(j));
+      else
       {
-        fp->seek(se->offset,0);
-        int abort=0;
-        game_object *o=first;
-        for (; o && !abort; o=o->next)
-        {
-          int16_t ot=fp->read_uint16();
-          int k=0;
-          for (; k<ot; k++)
-          {
-        if (fp->read_uint8()!=RC_32) abort=1;
-        else
+        vars[j]=(int32_t *)malloc(sizeof(int32_t)*(total_objs+1));
+        if (!read_column(fp,se,object_descriptions[j].type,vars[j],total_objs))
         {
-          int32_t v=fp->read_uint32();
-          if (o->otype!=0xffff)     // non-exstant object
-          {
-            int remap=*(v_remap[o_backmap[o->otype]]+k);
-            if (remap!=-1 && figures[o->otype]->tiv>=k)
-            {
-              o->lvars[remap]=v;
-            }
-          }
-        }
-          }
+          dprintf("Warning : load level -> var '%s' size changed\n",object_descriptions[j].name);
+          free(vars[j]);
+          vars[j]=NULL;
         }
       }
+    }
 
-      int frame_var=0;
-      for (i=0; i<TOTAL_OBJECT_VARS; i++)
-        if (!strcmp(object_descriptions[i].name,"cur_frame"))
-          frame_var=i;
+    int frame_var=0;
+    for (i=0; i<TOTAL_OBJECT_VARS; i++)
+      if (!strcmp(object_descriptions[i].name,"cur_frame"))
+        frame_var=i;
 
+    last=NULL;
+    for (i=0; i<total_objs; i++)
+    {
+      game_object *p=new game_object(o_remap[(uint16_t)types[i]],1);
+      LSpace::Tmp.Clear();
+      if (!first) first=p; else last->next=p;
+      last=p; p->next=NULL;
 
-      int j=0;
-      for (; j<default_simple.total_vars(); j++)
+      if (has_states)
       {
-        spec_entry *se=sd->find(object_descriptions[j].name);
-        if (se)
-        {
-          fp->seek(se->offset,0);
-          int t=object_descriptions[j].type;
-          if (fp->read_uint8()!=t)
-            dprintf("Warning : load level -> var '%s' size changed\n");
-          else
-          {
-        game_object *f=first;
-        for (; f; f=f->next)
+        int st=(uint16_t)states[i];
+        if (p->otype==0xffff)
+          p->state=stopped;
+        else
         {
-          switch (t)
-          {
-            case RC_8 :
-            { f->set_var(j,fp->read_uint8()); } break;
-            case RC_16 :
-            { f->set_var(j,fp->read_uint16()); } break;
-            case RC_32 :
-            { f->set_var(j,fp->read_uint32()); } break;
-          }
-
-          // check to make sure the frame number is not out of bounds from the time
-          // it was last saved
-          if (j==frame_var)
-          {
-            if (f->otype!=0xffff && f->current_frame>=
-            figures[f->otype]->get_sequence(f->state)->length())
-            f->current_frame=0;
-          }
+          character_state s=(character_state)(*(s_remap[o_backmap[p->otype]]+st));
+          if (p->has_sequence((character_state)s))
+            p->state=s;
+          else p->state=stopped;
+          p->current_frame=0;
         }
-          }
-        } else dprintf("Warning : load level -> no previous var %s\n",default_simple.var_name(j));
       }
+
+      for (j=0; j<default_simple.total_vars(); j++)
+        if (vars[j])
+          p->set_var(j,vars[j][i]);
+
+      // check to make sure the frame number is not out of bounds from the time
+      // it was last saved
+      if (vars[frame_var] && p->otype!=0xffff && p->current_frame>=
+          figures[p->otype]->get_sequence(p->state)->length())
+        p->current_frame=0;
     }
+
+    se=sd->find("lvars");
+    if (se && load_vars)
+      load_lvars(fp,se,first,v_remap,o_backmap);
       }
+
+      for (j=0; j<TOTAL_OBJECT_VARS; j++)
+        free(vars[j]);
+      free(states);
+      free(types);
     }
 
     int k=0;
@@ -1307,6 +1515,18 @@ level::level(spec_directory *sd, bFILE *fp, char const *lev_name)
     first_name = strdup(Name);
   }
 
+  e=sd->find("base level");
+  if (e)
+  {
+    fp->seek(e->offset,0);
+    int len=fp->read_uint8();
+    base_name=(char *)malloc(len);
+    fp->read(base_name,len);
+  } else if (!sd->find("player_info"))
+    base_name=strdup(Name);       // a level file, not a savegame
+  else
+    base_name=NULL;
+
   e=sd->find("fgmap");
   int no_fg=0,no_bg=0;
 
@@ -1514,13 +1734,17 @@ void level::level_loaded_notify()
 }
 
 
+// Write the directory of a level file, to filename or, if given, to the
+// already open file to, in which case there is no thumb nail
 bFILE *level::create_dir(char *filename, int save_all,
-             object_node *save_list, object_node *exclude_list)
+             object_node *save_list, object_node *exclude_list, bFILE *to)
 {
   spec_directory sd;
   sd.add_by_hand(new spec_entry(SPEC_DATA_ARRAY,"Copyright 1995 Crack dot Com, All Rights reserved",NULL,0,0));
   if (first_name)
     sd.add_by_hand(new spec_entry(SPEC_DATA_ARRAY,"first name",NULL,strlen(first_name)+2,0));
+  if (save_all && base_name)
+    sd.add_by_hand(new spec_entry(SPEC_DATA_ARRAY,"base level",NULL,strlen(base_name)+2,0));
 
 
 
@@ -1624,11 +1848,14 @@ bFILE *level::create_dir(char *filename, int save_all,
       name_len+=strlen(v->name)+2;
     sd.add_by_hand(new spec_entry(SPEC_DATA_ARRAY,"player_names",NULL,name_len,0));
 
-    sd.add_by_hand(new spec_entry(SPEC_IMAGE,"thumb nail",NULL,4+160*(100+wm->font()->Size().y*2),0));
+    if (!to)
+      sd.add_by_hand(new spec_entry(SPEC_IMAGE,"thumb nail",NULL,4+160*(100+wm->font()->Size().y*2),0));
   }
 
   sd.calc_offsets();
 
+  if (to)
+    return sd.write(to) ? to : NULL;
   return sd.write(filename);
 }
 
@@ -1833,9 +2060,9 @@ int level::load_player_info(bFILE *fp, spec_directory *sd, object_node *save_lis
     if (f->m_focus)
     {
       current_object = f->m_focus;
-      void *m = LSpace::Tmp.Mark();
+      LTmpScope scope;
       fun->EvalFunction(NULL);
-      LSpace::Tmp.Restore(m);
+      scope.End();
     }
       }
       current_object=o;
@@ -1915,39 +2142,34 @@ void level::write_objects(bFILE *fp, object_node *save_list)
   for (; o; o=o->next) t++;
   fp->write_uint32(t);
 
+  // The columns hold a value for each object, so they are written a
+  // column at a time rather than a field at a time
+  {
+    EntryWriter w(fp);
+    w.Put(RC_8,RC_16);                                       // save type info for each record
+    for (o=save_list; o; o=o->next) w.Put(RC_16,o->me->type());
 
-  fp->write_uint8(RC_16);                                    // save type info for each record
-  for (o=save_list; o; o=o->next) fp->write_uint16(o->me->type());
-
-  fp->write_uint8(RC_16);                                    // save state info for each record
-  for (o=save_list; o; o=o->next) fp->write_uint16(o->me->reduced_state());
+    w.Put(RC_8,RC_16);                                       // save state info for each record
+    for (o=save_list; o; o=o->next) w.Put(RC_16,o->me->reduced_state());
 
-  for (o=save_list; o; o=o->next)                            // save lvars
-  {
-    fp->write_uint16(figures[o->me->otype]->tv);
-    for (i=0; i<figures[o->me->otype]->tv; i++)
+    for (o=save_list; o; o=o->next)                          // save lvars
     {
-      fp->write_uint8(RC_32);                           // for now the only type allowed is int32_t
-      fp->write_uint32(o->me->lvars[i]);
+      w.Put(RC_16,figures[o->me->otype]->tv);
+      for (i=0; i<figures[o->me->otype]->tv; i++)
+      {
+        w.Put(RC_8,RC_32);                                // for now the only type allowed is int32_t
+        w.Put(RC_32,o->me->lvars[i]);
+      }
     }
   }
 
   for (i=0; i<default_simple.total_vars(); i++)
   {
+    EntryWriter w(fp);
     int t=object_descriptions[i].type;
-    fp->write_uint8(t);
+    w.Put(RC_8,t);
     for (o=save_list; o; o=o->next)
-    {
-      switch (t)
-      {
-    case RC_8 :
-    { fp->write_uint8(o->me->get_var(i)); } break;
-    case RC_16 :
-    { fp->write_uint16(o->me->get_var(i)); } break;
-    case RC_32 :
-    { fp->write_uint32(o->me->get_var(i)); } break;
-      }
-    }
+      w.Put(t,o->me->get_var(i));
   }
 }
 
@@ -1968,44 +2190,122 @@ int32_t level::total_light_links(object_node *list)
   return tl;
 }
 
-void level::write_links(bFILE *fp, object_node *save_list, object_node *exclude_list)
+// Numbers of things in a list, counting from 1, found by their address
+// in a sorted copy instead of walking the list for each of them
+class ListNumbers
 {
-  fp->write_uint8(RC_32);
-  fp->write_uint32(total_object_links(save_list));
+public:
+  ListNumbers() { m_list=NULL; m_total=m_alloced=0; }
+  ~ListNumbers() { free(m_list); }
 
-  int x=1;
-  object_node *o=save_list;
+  void Add(void *p)
+  {
+    if (m_total==m_alloced)
+    {
+      m_alloced=m_alloced ? m_alloced*2 : 256;
+      m_list=(Number *)realloc(m_list,sizeof(Number)*m_alloced);
+    }
+    m_list[m_total].p=p;
+    m_list[m_total].x=m_total+1;
+    m_total++;
+  }
+  void Sort() { qsort(m_list,m_total,sizeof(Number),Compare); }
 
-  for (; o; o=o->next,x++)
+  // The number of p, or 0 if it is not in the list
+  int32_t Find(void *p)
   {
-    int i=0;
-    for (; i<o->me->total_objects(); i++)
+    Number key={ p, 0 };
+    Number *n=(Number *)bsearch(&key,m_list,m_total,sizeof(Number),Compare);
+    return n ? n->x : 0;
+  }
+
+private:
+  struct Number { void *p; int32_t x; };
+  static int Compare(void const *a, void const *b)
+  {
+    uintptr_t pa=(uintptr_t)((Number const *)a)->p,
+              pb=(uintptr_t)((Number const *)b)->p;
+    return pa<pb ? -1 : pa>pb;
+  }
+
+  Number *m_list;
+  int32_t m_total,m_alloced;
+};
+
+void level::write_links(bFILE *fp, object_node *save_list, object_node *exclude_list)
+{
+  // as object_to_number_in_list() and light_to_number() would number them
+  ListNumbers objects,lights;
+  object_node *o;
+  for (o=save_list; o; o=o->next)
+    objects.Add(o->me);
+  objects.Sort();
+  for (light_source *l=first_light_source; l; l=l->next)
+    lights.Add(l);
+  lights.Sort();
+
+  {
+    EntryWriter w(fp);
+    w.Put(RC_8,RC_32);
+    w.Put(RC_32,total_object_links(save_list));
+
+    int x=1;
+    for (o=save_list; o; o=o->next,x++)
     {
-      fp->write_uint32(x);
-      int32_t x=object_to_number_in_list(o->me->get_object(i),save_list);
-      if (x)
-        fp->write_uint32(x);
-      else                            // save links to excluded items as negative
-        fp->write_uint32((int32_t)(-(object_to_number_in_list(o->me,exclude_list))));
+      int i=0;
+      for (; i<o->me->total_objects(); i++)
+      {
+        w.Put(RC_32,x);
+        int32_t x=objects.Find(o->me->get_object(i));
+        if (x)
+          w.Put(RC_32,x);
+        else                            // save links to excluded items as negative
+          w.Put(RC_32,(int32_t)(-(object_to_number_in_list(o->me,exclude_list))));
+      }
     }
   }
 
-  fp->write_uint8(RC_32);
-  fp->write_uint32(total_light_links(save_list));
+  EntryWriter w(fp);
+  w.Put(RC_8,RC_32);
+  w.Put(RC_32,total_light_links(save_list));
 
-  x=1;
+  int x=1;
   for (o=save_list; o; o=o->next,x++)
   {
     int i=0;
     for (; i<o->me->total_lights(); i++)
     {
-      fp->write_uint32(x);
-      fp->write_uint32(light_to_number(o->me->get_light(i)));
+      w.Put(RC_32,x);
+      w.Put(RC_32,lights.Find(o->me->get_light(i)));
     }
   }
+}
+
 
+// The objects of list in an array, so that links can be looked up by
+// number without walking the list for each of them; NULL without bulk_loads
+static game_object **object_array(object_node *list, int32_t &total)
+{
+  total=0;
+  if (!bulk_loads)
+    return NULL;
+  for (object_node *o=list; o; o=o->next)
+    total++;
+  game_object **ret=(game_object **)malloc(sizeof(game_object *)*(total+1));
+  total=0;
+  for (object_node *o=list; o; o=o->next)
+    ret[total++]=o->me;
+  return ret;
 }
 
+// The x'th object of list, counting from 1, like number_to_object_in_list()
+static game_object *nth_object(int32_t x, object_node *list,
+                               game_object **array, int32_t total)
+{
+  if (!array)
+    return number_to_object_in_list(x,list);
+  return x>0 && x<=total ? array[x-1] : NULL;
+}
 
 void level::load_links(bFILE *fp, spec_directory *sd,
                object_node *save_list, object_node *exclude_list)
@@ -2013,45 +2313,73 @@ void level::load_links(bFILE *fp, spec_directory *sd,
   spec_entry *se=sd->find("object_links");
   if (se)
   {
-    fp->seek(se->offset,0);
-    if (fp->read_uint8()==RC_32)
+    EntryReader r(fp,se);
+    if (r.Get(RC_8)==RC_32)
     {
-      int32_t t=fp->read_uint32();
+      int32_t saved,excluded;
+      game_object **saved_array=object_array(save_list,saved);
+      game_object **excluded_array=object_array(exclude_list,excluded);
+
+      int32_t t=r.Get(RC_32);
       while (t)
       {
-    int32_t x1=fp->read_uint32();
+    int32_t x1=r.Get(RC_32);
     CONDITION(x1>=0,"expected x1 for object link to be > 0\n");
-    int32_t x2=fp->read_uint32();
-    game_object *p,*q=number_to_object_in_list(x1,save_list);
+    int32_t x2=r.Get(RC_32);
+    game_object *p,*q=nth_object(x1,save_list,saved_array,saved);
     if (x2>0)
-      p=number_to_object_in_list(x2,save_list);
-    else p=number_to_object_in_list(-x2,exclude_list);
+      p=nth_object(x2,save_list,saved_array,saved);
+    else p=nth_object(-x2,exclude_list,excluded_array,excluded);
     if (q)
       q->add_object(p);
     else dprintf("bad object link\n");
 
     t--;
       }
+      free(saved_array);
+      free(excluded_array);
     }
   }
 
   se=sd->find("light_links");
   if (se)
   {
-    fp->seek(se->offset,0);
-    if (fp->read_uint8()==RC_32)
+    EntryReader r(fp,se);
+    if (r.Get(RC_8)==RC_32)
     {
-      int32_t t=fp->read_uint32();
+      int32_t saved;
+      game_object **saved_array=object_array(save_list,saved);
+
+      // and the lights, which number_to_light() walks through the same way
+      int32_t lights=0;
+      light_source **light_array=NULL;
+      if (bulk_loads)
+      {
+        for (light_source *l=first_light_source; l; l=l->next)
+          lights++;
+        light_array=(light_source **)malloc(sizeof(light_source *)*(lights+1));
+        lights=0;
+        for (light_source *l=first_light_source; l; l=l->next)
+          light_array[lights++]=l;
+      }
+
+      int32_t t=r.Get(RC_32);
       while (t)
       {
-    int32_t x1=fp->read_uint32();
-    int32_t x2=fp->read_uint32();
-    game_object *p=number_to_object_in_list(x1,save_list);
+    int32_t x1=r.Get(RC_32);
+    int32_t x2=r.Get(RC_32);
+    game_object *p=nth_object(x1,save_list,saved_array,saved);
+    light_source *l;
+    if (!light_array)
+      l=number_to_light(x2);
+    else l=x2>0 && x2<=lights ? light_array[x2-1] : NULL;
     if (p)
-      p->add_light(number_to_light(x2));
+      p->add_light(l);
     else dprintf("bad object/light link\n");
     t--;
       }
+      free(saved_array);
+      free(light_array);
     }
   }
 
@@ -2193,13 +2521,107 @@ void level::load_cache_info(spec_directory *sd, bFILE *fp)
 }
 
 
+// Everything after the directory, in the order create_dir() laid it out
+void level::write_contents(bFILE *fp, int save_all, object_node *objs,
+                           object_node *players, int thumb_nail)
+{
+    if( first_name )
+    {
+        fp->write_uint8( strlen( first_name ) + 1 );
+        fp->write( first_name, strlen( first_name ) + 1 );
+    }
+    else
+    {
+        fp->write_uint8( 1 );
+        fp->write_uint8( 0 );
+    }
+
+    if( save_all && base_name )
+    {
+        fp->write_uint8( strlen( base_name ) + 1 );
+        fp->write( base_name, strlen( base_name ) + 1 );
+    }
+
+    fp->write_uint32( fg_width );
+    fp->write_uint32( fg_height );
+
+    int t  = fg_width * fg_height;
+    uint16_t *rm = map_fg;
+    for (; t; t--,rm++)
+    {
+        uint16_t x = *rm;
+        x = lstl(x);            // convert to intel endianess
+        *rm = x;
+    }
+
+    fp->write( (char *)map_fg, 2 * fg_width * fg_height );
+    t = fg_width * fg_height;
+    rm = map_fg;
+    for (; t; t--,rm++)
+    {
+        uint16_t x = *rm;
+        x = lstl( x );            // convert to intel endianess
+        *rm = x;
+    }
+
+    fp->write_uint32( bg_width );
+    fp->write_uint32( bg_height );
+    t = bg_width * bg_height;
+    rm = map_bg;
+
+    for (; t; t--,rm++)
+    {
+        uint16_t x=*rm;
+        x = lstl( x );        // convert to intel endianess
+        *rm = x;
+    }
+
+    fp->write( (char *)map_bg, 2 * bg_width * bg_height );
+    rm = map_bg;
+    t = bg_width*bg_height;
+
+    for (; t; t--,rm++)
+    {
+        uint16_t x = *rm;
+        x = lstl( x );        // convert to intel endianess
+        *rm = x;
+    }
+
+    write_options( fp );
+    write_objects( fp, objs );
+    write_lights( fp );
+    write_links( fp, objs, players );
+    if( save_all )
+    {
+        write_player_info( fp, objs );
+        if( thumb_nail )
+            write_thumb_nail( fp,main_screen );
+    }
+}
+
 int level::save(char const *filename, int save_all)
 {
     char name[255], bkname[255];
 
+    if( save_all )
+    {
+        SaveJob *job = snapshot( filename );
+        int ok = job->Write();
+        if( ok )
+            write_cache_prof_info();
+        else
+        {
+            the_game->show_help( "Unable to open file for saving.\n" );
+            printf( "\nFailed to save game.\n" );
+            printf( "I was trying to save to: '%s'\n\tPath: '%s'\n\tFile: '%s'\n", job->name, get_save_filename_prefix(), filename );
+        }
+        delete job;
+        return ok;
+    }
+
     sprintf( name, "%s%s", get_save_filename_prefix(), filename );
     sprintf( bkname, "%slevsave.bak", get_save_filename_prefix() );
-    if( !save_all && DEFINEDP( symbol_value( l_keep_backup ) ) &&
+    if( DEFINEDP( symbol_value( l_keep_backup ) ) &&
         symbol_value( l_keep_backup ) )   // make a backup
     {
         bFILE *fp = open_file( name, "rb" );    // does file already exist?
@@ -2230,92 +2652,23 @@ int level::save(char const *filename, int save_all)
         delete fp;
     }
 
-    // if we are not doing a savegame then change the first_name to this name
-    if( !save_all )
-    {
-        if( first_name )
-            free(first_name);
-        first_name = strdup(name);
-    }
-
-    object_node *players, *objs;
-    if( save_all )
-        players = NULL;
-    else
-        players = make_player_onodes();
+    // we are not doing a savegame, so change the first_name to this name
+    if( first_name )
+        free(first_name);
+    first_name = strdup(name);
+    if( base_name )
+        free(base_name);
+    base_name = strdup(name);
 
-    objs = make_not_list(players);     // negate the above list
+    object_node *players = make_player_onodes();
+    object_node *objs = make_not_list(players);     // negate the above list
 
-    bFILE *fp = create_dir( name, save_all, objs, players);
+    bFILE *fp = create_dir( name, 0, objs, players);
     if( fp != NULL )
     {
         if( !fp->open_failure() )
         {
-            if( first_name )
-            {
-                fp->write_uint8( strlen( first_name ) + 1 );
-                fp->write( first_name, strlen( first_name ) + 1 );
-            }
-            else
-            {
-                fp->write_uint8( 1 );
-                fp->write_uint8( 0 );
-            }
-
-            fp->write_uint32( fg_width );
-            fp->write_uint32( fg_height );
-
-            int t  = fg_width * fg_height;
-            uint16_t *rm = map_fg;
-            for (; t; t--,rm++)
-            {
-                uint16_t x = *rm;
-                x = lstl(x);            // convert to intel endianess
-                *rm = x;
-            }
-
-            fp->write( (char *)map_fg, 2 * fg_width * fg_height );
-            t = fg_width * fg_height;
-            rm = map_fg;
-            for (; t; t--,rm++)
-            {
-                uint16_t x = *rm;
-                x = lstl( x );            // convert to intel endianess
-                *rm = x;
-            }
-
-            fp->write_uint32( bg_width );
-            fp->write_uint32( bg_height );
-            t = bg_width * bg_height;
-            rm = map_bg;
-
-            for (; t; t--,rm++)
-            {
-                uint16_t x=*rm;
-                x = lstl( x );        // convert to intel endianess
-                *rm = x;
-            }
-
-            fp->write( (char *)map_bg, 2 * bg_width * bg_height );
-            rm = map_bg;
-            t = bg_width*bg_height;
-
-            for (; t; t--,rm++)
-            {
-                uint16_t x = *rm;
-                x = lstl( x );        // convert to intel endianess
-                *rm = x;
-            }
-
-            write_options( fp );
-            write_objects( fp, objs );
-            write_lights( fp );
-            write_links( fp, objs, players );
-            if( save_all )
-            {
-                write_player_info( fp, objs );
-                write_thumb_nail( fp,main_screen );
-            }
+            write_contents( fp, 0, objs, players, 1 );
 
             delete fp;
 #if (defined(__MACH__) || !defined(__APPLE__)) && (!defined(WIN32))
@@ -2345,6 +2698,512 @@ int level::save(char const *filename, int save_all)
     return 1;
 }
 
+// Snapshot the whole game state, like a savegame, for rolling back to later
+mFILE *level::save_state()
+{
+    object_node *objs = make_not_list(NULL);
+    mFILE *fp = new mFILE();
+
+    if( create_dir( NULL, 1, objs, NULL, fp ) )
+        write_contents( fp, 1, objs, NULL, 0 );
+    else
+    {
+        delete fp;
+        fp = NULL;
+    }
+
+    delete_object_list(objs);
+    if( fp )
+        fp->seek( 0, SEEK_SET );
+    return fp;
+}
+
+// The whole of a file in memory, or NULL if it cannot be opened
+static mFILE *read_whole_file(char const *filename)
+{
+    bFILE *fp = open_file( filename, "rb" );
+    if( fp->open_failure() )
+    {
+        delete fp;
+        return NULL;
+    }
+    long size = fp->file_size();
+    uint8_t *data = (uint8_t *)malloc( size + 1 );
+    size = fp->read( data, size );
+    delete fp;
+    return new mFILE( data, size, 1 );
+}
+
+static uint8_t *read_entry( bFILE *fp, spec_entry *e )
+{
+    uint8_t *data = (uint8_t *)malloc( e->size + 1 );
+    fp->seek( e->offset, SEEK_SET );
+    if( fp->read( data, e->size ) != (int)e->size )
+        memset( data, 0, e->size );
+    return data;
+}
+
+// Write the whole of from to the end of fp
+static void append_file( bFILE *fp, bFILE *from )
+{
+    long size = from->file_size();
+    uint8_t *data = (uint8_t *)malloc( size + 1 );
+    from->seek( 0, SEEK_SET );
+    size = from->read( data, size );
+    fp->write( data, size );
+    free( data );
+}
+
+// Lay out everything save(filename,1) writes in memory, for a SaveJob to
+// write to disk later. This is all that has to happen between two ticks;
+// comparing with the base level and writing can go on while the game runs.
+SaveJob *level::snapshot(char const *filename)
+{
+    SaveJob *job = new SaveJob( filename );
+    job->state = save_state();
+    job->thumb = new mFILE();
+    write_thumb_nail( job->thumb, main_screen );
+    // Only find the base level here, the save thread reads it
+    char path[200];
+    if( delta_saves && base_name
+         && locate_file( base_name, path, job->base_offset, job->base_size ) )
+    {
+        job->base_name = strdup( base_name );
+        job->base_path = strdup( path );
+    }
+    return job;
+}
+
+void level::save_async(char const *filename,
+                       void (*done)(char const *name, int ok))
+{
+    SaveJob *job = snapshot( filename );
+    job->done = done;
+    write_cache_prof_info();
+    if( async_saves )
+    {
+        save_writer.Queue( job );
+        return;
+    }
+    job->Write();
+    if( done )
+        done( job->name, job->ok );
+    delete job;
+}
+
+SaveJob::SaveJob(char const *filename)
+{
+    char tmp[255], path[200];
+    snprintf( tmp, sizeof(tmp), "%s%s", get_save_filename_prefix(), filename );
+    write_file_name( tmp, path );
+    name = strdup( path );
+    base_name = base_path = NULL;
+    base_offset = base_size = 0;
+    state = base = thumb = NULL;
+    done = NULL;
+    ok = 0;
+    next = NULL;
+}
+
+SaveJob::~SaveJob()
+{
+    free( name );
+    free( base_name );
+    free( base_path );
+    delete state;
+    delete base;
+    delete thumb;
+}
+
+// Only touches the job, not the level or anything else the game is using,
+// so it can run on the save thread. Files are read and written with stdio,
+// since jFILEs share state with the main thread.
+int SaveJob::Write()
+{
+    ok = 0;
+    if( state && thumb )
+    {
+        ok = ReadBase() && WriteDelta();
+        if( !ok )
+            ok = WriteWhole();
+    }
+#if (defined(__MACH__) || !defined(__APPLE__)) && (!defined(WIN32))
+    if( ok )
+        chmod( name, S_IRWXU | S_IRWXG | S_IRWXO );
+#endif
+    return ok;
+}
+
+// Read base_name into base with a file of its own, since the ones the game
+// reads with share their position in the main spec file
+int SaveJob::ReadBase()
+{
+    if( !base_path )
+        return 0;
+    FILE *fp = fopen( base_path, "rb" );
+    if( !fp )
+        return 0;
+    long size = base_size;
+    if( size < 0 && !fseek( fp, 0, SEEK_END ) )
+        size = ftell( fp );
+    uint8_t *data = (uint8_t *)malloc( Max( size, 0L ) + 1 );
+    if( size < 0 || fseek( fp, base_offset, SEEK_SET )
+         || fread( data, 1, size, fp ) != (size_t)size )
+    {
+        free( data );
+        fclose( fp );
+        return 0;
+    }
+    fclose( fp );
+    delete base;
+    base = new mFILE( data, size, 1 );
+    return 1;
+}
+
+// Write the whole of data to the file name
+static int write_whole_file(char const *name, mFILE *data)
+{
+    FILE *fp = fopen( name, "wb" );
+    if( !fp )
+        return 0;
+    long size = data->file_size();
+    uint8_t *buf = (uint8_t *)malloc( size + 1 );
+    data->seek( 0, SEEK_SET );
+    int ok = data->read( buf, size ) == size
+              && fwrite( buf, 1, size, fp ) == (size_t)size;
+    free( buf );
+    return !fclose( fp ) && ok;
+}
+
+// Write the whole savegame: the entries of the state, then the thumb nail
+int SaveJob::WriteWhole()
+{
+    spec_directory ssd( state );
+    spec_directory sd;
+    for( int i = 0; i < ssd.total; i++ )
+    {
+        spec_entry *e = ssd.entries[i];
+        sd.add_by_hand( new spec_entry( e->type, e->name, NULL, e->size, 0 ) );
+    }
+    sd.add_by_hand( new spec_entry( SPEC_IMAGE, "thumb nail", NULL,
+                                    thumb->file_size(), 0 ) );
+    sd.calc_offsets();
+
+    mFILE fp;
+    int ok = sd.write( &fp );
+    if( ok )
+    {
+        for( int i = 0; i < ssd.total; i++ )
+        {
+            uint8_t *data = read_entry( state, ssd.entries[i] );
+            fp.write( data, ssd.entries[i]->size );
+            free( data );
+        }
+        append_file( &fp, thumb );
+        ok = write_whole_file( name, &fp );
+    }
+
+    for( int i = 0; i < sd.total; i++ )
+        delete sd.entries[i];
+    return ok;
+}
+
+// Where a copy of the level a delta savegame was saved from is kept: next
+// to the savegame, named after the level's crc so all savegames of the same
+// level share it
+static void base_copy_name(char *buf, size_t len, char const *savegame,
+                           uint32_t crc)
+{
+    char const *slash = strrchr( savegame, '/' );
+    int dir = slash ? (int)( slash - savegame + 1 ) : 0;
+    snprintf( buf, len, "%.*sbase%08x.spe", dir, savegame, (unsigned)crc );
+}
+
+// Make sure there is a copy of base next to the savegame, so the savegame
+// can still be loaded once the level it was saved from changes. Written to
+// a temporary file first so a copy is never found half written.
+int SaveJob::KeepBase(uint32_t crc)
+{
+    char path[512], tmp[520];
+    base_copy_name( path, sizeof(path), name, crc );
+    long size = base->file_size();
+
+    FILE *fp = fopen( path, "rb" );
+    if( fp )
+    {
+        int same = !fseek( fp, 0, SEEK_END ) && ftell( fp ) == size;
+        fclose( fp );
+        if( same )
+            return 1;
+    }
+
+    snprintf( tmp, sizeof(tmp), "%s.tmp", path );
+    fp = fopen( tmp, "wb" );
+    if( !fp )
+        return 0;
+    uint8_t *data = (uint8_t *)malloc( size + 1 );
+    base->seek( 0, SEEK_SET );
+    int ok = base->read( data, size ) == size
+              && fwrite( data, 1, size, fp ) == (size_t)size;
+    free( data );
+    ok = !fclose( fp ) && ok;
+    if( ok )
+        ok = !rename( tmp, path );
+    if( !ok )
+        remove( tmp );
+    return ok;
+}
+
+// Write a savegame that only has what changed since the level was loaded
+// from base_name. Each entry of the state that is not the same as in the
+// base level is kept as a patch against it, or as is if that is no
+// smaller. A "delta" entry first lists them all with the base level's size
+// and crc, for open_level_file() to put the savegame back together.
+// Returns 0, for the whole savegame to be written instead, if there is
+// nothing to compare to or no copy of the base level can be kept.
+int SaveJob::WriteDelta()
+{
+    uint32_t base_crc = crc_file( base );
+    spec_directory bsd( base );
+    if( bsd.find( "delta" ) || !bsd.find( "fgmap" ) )
+        return 0;
+    if( !KeepBase( base_crc ) )
+        return 0;
+
+    spec_directory fsd( state );
+
+    int total = fsd.total;
+    uint8_t *how = (uint8_t *)malloc( total + 1 );
+    uint8_t **data = (uint8_t **)malloc( sizeof(uint8_t *) * ( total + 1 ) );
+    size_t *size = (size_t *)malloc( sizeof(size_t) * ( total + 1 ) );
+
+    spec_directory sd;
+    long list_size = 1 + strlen( base_name ) + 1 + 4 + 4 + 2;
+    for( int i = 0; i < total; i++ )
+        list_size += 1 + 1 + strlen( fsd.entries[i]->name ) + 1 + 1 + 4;
+    sd.add_by_hand( new spec_entry( SPEC_DATA_ARRAY, "delta", NULL, list_size, 0 ) );
+
+    for( int i = 0; i < total; i++ )
+    {
+        spec_entry *e = fsd.entries[i];
+        // a name used twice can only be found once in the base level
+        spec_entry *b = fsd.find( e->name ) == e ? bsd.find( e->name ) : NULL;
+
+        how[i] = DELTA_RAW;
+        data[i] = read_entry( state, e );
+        size[i] = e->size;
+        if( b )
+        {
+            uint8_t *old = read_entry( base, b );
+            if( b->size == e->size && !memcmp( old, data[i], e->size ) )
+            {
+                how[i] = DELTA_COPY;
+                free( data[i] );
+                data[i] = NULL;
+            }
+            else
+            {
+                uint8_t *patch = (uint8_t *)malloc( delta_bound( e->size ) );
+                size_t patch_size = delta_make( old, b->size, data[i],
+                                                e->size, patch );
+                if( patch_size < e->size )
+                {
+                    how[i] = DELTA_PATCH;
+                    free( data[i] );
+                    data[i] = patch;
+                    size[i] = patch_size;
+                }
+                else
+                    free( patch );
+            }
+            free( old );
+        }
+
+        if( how[i] != DELTA_COPY )
+            sd.add_by_hand( new spec_entry( how[i] == DELTA_RAW ? (int)e->type
+                                                : (int)SPEC_DATA_ARRAY,
+                                            e->name, NULL, size[i], 0 ) );
+    }
+    sd.add_by_hand( new spec_entry( SPEC_IMAGE, "thumb nail", NULL,
+                                    thumb->file_size(), 0 ) );
+    sd.calc_offsets();
+
+    mFILE fp;
+    int ok = sd.write( &fp );
+    if( ok )
+    {
+        fp.write_uint8( strlen( base_name ) + 1 );
+        fp.write( base_name, strlen( base_name ) + 1 );
+        fp.write_uint32( base->file_size() );
+        fp.write_uint32( base_crc );
+        fp.write_uint16( total );
+        for( int i = 0; i < total; i++ )
+        {
+            spec_entry *e = fsd.entries[i];
+            fp.write_uint8( e->type );
+            fp.write_uint8( strlen( e->name ) + 1 );
+            fp.write( e->name, strlen( e->name ) + 1 );
+            fp.write_uint8( how[i] );
+            fp.write_uint32( e->size );
+        }
+        for( int i = 0; i < total; i++ )
+            if( how[i] != DELTA_COPY )
+                fp.write( data[i], size[i] );
+        append_file( &fp, thumb );
+        ok = write_whole_file( name, &fp );
+    }
+
+    for( int i = 0; i < total; i++ )
+        free( data[i] );
+    free( data );
+    free( size );
+    free( how );
+    for( int i = 0; i < sd.total; i++ )
+        delete sd.entries[i];
+    return ok;
+}
+
+// The whole of filename if it has the given size and crc, or NULL
+static mFILE *read_base(char const *filename, uint32_t size, uint32_t crc)
+{
+    mFILE *base = read_whole_file( filename );
+    if( base && ( (uint32_t)base->file_size() != size
+                   || crc_file( base ) != crc ) )
+    {
+        delete base;
+        base = NULL;
+    }
+    return base;
+}
+
+// Put a savegame written by SaveJob::WriteDelta() back together, from the
+// level it was saved from or, if that has changed since, the copy kept next
+// to the savegame. Returns NULL if neither is there.
+static mFILE *apply_delta(char const *filename, spec_directory *sd,
+                          bFILE *fp, spec_entry *list)
+{
+    char base_name[256];
+    fp->seek( list->offset, SEEK_SET );
+    int len = fp->read_uint8();
+    fp->read( base_name, len );
+    base_name[len] = 0;
+    uint32_t base_size = fp->read_uint32();
+    uint32_t base_crc = fp->read_uint32();
+    int total = fp->read_uint16();
+
+    mFILE *base = read_base( base_name, base_size, base_crc );
+    if( !base )
+    {
+        char copy[512];
+        base_copy_name( copy, sizeof(copy), filename, base_crc );
+        base = read_base( copy, base_size, base_crc );
+        if( !base )
+        {
+            dprintf( "%s was saved from %s, which is missing or has changed\n",
+                     filename, base_name );
+            return NULL;
+        }
+        dprintf( "%s: %s has changed, using %s\n", filename, base_name, copy );
+    }
+    spec_directory bsd( base );
+
+    spec_directory out;
+    uint8_t *how = (uint8_t *)malloc( total + 1 );
+    for( int i = 0; i < total; i++ )
+    {
+        char name[256];
+        int type = fp->read_uint8();
+        len = fp->read_uint8();
+        fp->read( name, len );
+        name[len] = 0;
+        how[i] = fp->read_uint8();
+        uint32_t size = fp->read_uint32();
+        out.add_by_hand( new spec_entry( type, name, NULL, size, 0 ) );
+    }
+    out.calc_offsets();
+
+    mFILE *ret = new mFILE();
+    int ok = out.write( ret );
+    int next = sd->find_number( "delta" ) + 1;  // where the data entries start
+    for( int i = 0; ok && i < total; i++ )
+    {
+        spec_entry *e = out.entries[i];
+        spec_entry *b = bsd.find( e->name );
+        spec_entry *d = how[i] == DELTA_COPY || next >= sd->total
+                        ? NULL : sd->entries[next++];
+        uint8_t *data = NULL;
+
+        switch( how[i] )
+        {
+        case DELTA_COPY:
+            if( b && b->size == e->size )
+                data = read_entry( base, b );
+            break;
+        case DELTA_RAW:
+            if( d && d->size == e->size )
+                data = read_entry( fp, d );
+            break;
+        case DELTA_PATCH:
+            if( b && d )
+            {
+                uint8_t *old = read_entry( base, b );
+                uint8_t *patch = read_entry( fp, d );
+                data = (uint8_t *)malloc( e->size + 1 );
+                if( !delta_apply( old, b->size, patch, d->size, data, e->size ) )
+                {
+                    free( data );
+                    data = NULL;
+                }
+                free( patch );
+                free( old );
+            }
+            break;
+        }
+
+        if( data )
+            ret->write( data, e->size );
+        else
+        {
+            dprintf( "%s: entry '%s' does not fit %s\n", filename, e->name,
+                     base_name );
+            ok = 0;
+        }
+        free( data );
+    }
+
+    for( int i = 0; i < out.total; i++ )
+        delete out.entries[i];
+    free( how );
+    delete base;
+    if( !ok )
+    {
+        delete ret;
+        return NULL;
+    }
+    ret->seek( 0, SEEK_SET );
+    return ret;
+}
+
+bFILE *open_level_file(char const *filename)
+{
+    save_writer.Wait();  // it may be a savegame still being written
+    bFILE *fp = open_file( filename, "rb" );
+    if( fp->open_failure() )
+        return fp;
+
+    spec_directory sd( fp );
+    spec_entry *list = sd.find( "delta" );
+    if( !list )
+    {
+        fp->seek( 0, SEEK_SET );
+        return fp;
+    }
+
+    mFILE *ret = apply_delta( filename, &sd, fp, list );
+    delete fp;
+    return ret;
+}
+
 level::level(int width, int height, char const *name)
 {
   the_game->need_refresh();
@@ -2365,6 +3224,7 @@ level::level(int width, int height, char const *name)
 
   Name=NULL;
   first_name=NULL;
+  base_name=NULL;
 
   set_name(name);
   first=first_active=NULL;
@@ -2450,7 +3310,10 @@ void level::remove_block(game_object *who)
       block_total--;    // squish the block list in
       o++;
       for (j=i; j<block_total; j++)
+      {
         block_list[j]=block_list[j+1];
+        block_list[j]->block_index=j;
+      }
     } else o++;
   }
 }
@@ -2468,7 +3331,10 @@ void level::remove_all_block(game_object *who)
       all_block_total--;    // squish the block list in
       o++;
       for (j=i; j<all_block_total; j++)
+      {
         all_block_list[j]=all_block_list[j+1];
+        all_block_list[j]->all_block_index=j;
+      }
     } else o++;
   }
 }
@@ -2496,6 +3362,7 @@ void level::remove_object(game_object *who)
   }
   total_objs--;
 
+  grid.Remove(who);
 
   if (first_active==who)
     first_active=who->next_active;
@@ -2545,6 +3412,7 @@ void level::to_front(game_object *o)  // move to end of list, so we are drawn la
 {
   if (o==last) return ;
   first_active=NULL;     // make sure nothing goes screwy with the active list
+  grid.Invalidate();
 
   if (o==first)
     first=first->next;
@@ -2565,6 +3433,7 @@ void level::to_back(game_object *o)   // to make the character drawn in back, pu
 {
   if (o==first) return;
   first_active=NULL;     // make sure nothing goes screwy with the active list
+  grid.Invalidate();
 
   game_object *w=first;
   for (; w && w->next!=o; w=w->next);
@@ -2820,6 +3689,7 @@ int level::platform_push(game_object *by_who, int xamount, int yamount)
     {
       o->x+=tvx;
       o->y+=tvy;
+      grid.Update(o);
     }
       }
 
@@ -2846,6 +3716,7 @@ int level::platform_push(game_object *by_who, int xamount, int yamount)
     o->x+=xv;
     o->y+=yv;
     by_who->x=-by_who->x;
+    grid.Update(o);
       }
     }
   }
@@ -2873,6 +3744,7 @@ int level::push_characters(game_object *by_who, int xamount, int yamount)
     o->try_move(o->x,o->y,xv,yv,3);
     o->x+=xv;
     o->y+=yv;
+    grid.Update(o);
     if (xv!=xamount-tvx || yv!=yamount-tvy)
       failed=1;
       }
@@ -2885,9 +3757,11 @@ game_object *level::find_xrange(int x, int y, int type, int xd)
 {
   int32_t find_ydist=100000;
   game_object *find=NULL;
-  game_object *o=first_active;
-  for (; o; o=o->next_active)
+  GridQuery q;
+  find_actives(q,x-xd,y-find_ydist,x+xd,y+find_ydist);
+  for (int i=0; i<q.total; i++)
   {
+    game_object *o=q.list[i];
     if (o->otype==type)
     {
       int x_dist=abs(x-o->x);
@@ -2938,9 +3812,11 @@ game_object *level::find_closest(int x, int y, int type, game_object *who)
 {
   int32_t find_dist=100000;
   game_object *find=NULL;
-  game_object *o=first_active;
-  for (; o; o=o->next_active)
+  GridQuery q;
+  find_actives(q,x-317,y-317,x+317,y+317);   // 317*317 > find_dist
+  for (int i=0; i<q.total; i++)
   {
+    game_object *o=q.list[i];
     if (o->otype==type && o!=who)
     {
       int d=(x-o->x)*(x-o->x)+(y-o->y)*(y-o->y);
@@ -2995,9 +3871,11 @@ void level::hurt_radius(int32_t x, int32_t y,int32_t r, int32_t m, game_object *
             int max_push)
 {
   if (r<1) return ;   // avoid dev vy zero
-  game_object *o=first_active;
-  for (; o; o=o->next_active)
+  GridQuery q;
+  find_actives(q,x-r,y-r,x+r,y+r);
+  for (int i=0; i<q.total; i++)
   {
+    game_object *o=q.list[i];
     if (o!=exclude && o->hurtable())
     {
       int32_t y1=o->y,y2=o->y-o->picture()->Size().y;
@@ -3125,6 +4003,7 @@ void level::add_target(game_object *who)
     target_list=(game_object **)realloc(target_list,sizeof(game_object *)*target_list_size);
   }
   target_list[target_total]=who;
+  who->target_index=target_total;
   target_total++;
 }
 
@@ -3138,6 +4017,7 @@ void level::add_block(game_object *who)
     block_list=(game_object **)realloc(block_list,sizeof(game_object *)*block_list_size);
   }
   block_list[block_total]=who;
+  who->block_index=block_total;
   block_total++;
 }
 
@@ -3150,6 +4030,7 @@ void level::add_all_block(game_object *who)
     all_block_list=(game_object **)realloc(all_block_list,sizeof(game_object *)*all_block_list_size);
   }
   all_block_list[all_block_total]=who;
+  who->all_block_index=all_block_total;
   all_block_total++;
 }
 
@@ -3159,9 +4040,11 @@ game_object *level::find_object_in_area(int32_t x, int32_t y, int32_t x1, int32_
 {
   game_object *closest=NULL;
   int32_t closest_distance=0xfffffff,distance,xo,yo;
-  game_object *o=first_active;
-  for (; o; o=o->next_active)
+  GridQuery q;
+  find_actives(q,x1,y1,x2,y2);
+  for (int i=0; i<q.total; i++)
   {
+    game_object *o=q.list[i];
     int32_t xp1,yp1,xp2,yp2;
     o->picture_space(xp1,yp1,xp2,yp2);
 
@@ -3270,3 +4153,157 @@ area_controller::area_controller(int32_t X, int32_t Y, int32_t W, int32_t H, are
   view_xoff_speed=4;
   view_yoff_speed=4;
 }
+
+// Same running sums as crc_file(), fed incrementally
+struct running_crc
+{
+  uint8_t c1, c2, c3, c4;
+
+  running_crc() : c1(0), c2(0), c3(0), c4(0) { }
+
+  void add(int32_t v)
+  {
+    uint8_t buf[4] = { (uint8_t)v, (uint8_t)(v >> 8),
+                       (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    for (int i = 0; i < 4; i++)
+    {
+      c1 += buf[i];
+      c2 += c1;
+      c3 += c2;
+      c4 += c3;
+    }
+  }
+
+  uint32_t get() { return c1 | (c2 << 8) | (c3 << 16) | ((uint32_t)c4 << 24); }
+};
+
+// Checksum everything a deterministic run must reproduce
+uint32_t level::state_crc()
+{
+  running_crc crc;
+
+  crc.add(rand_on);
+  crc.add(ctick);
+
+  for (game_object *o = first; o; o = o->next)
+  {
+    crc.add(o->otype);
+    crc.add(o->state);
+    for (int i = 0; i < o->total_vars(); i++)
+      crc.add(o->get_var(i));
+    for (int i = 0; i < figures[o->otype]->tv; i++)
+      crc.add(o->lvars[i]);
+  }
+
+  return crc.get();
+}
+
+// Save the game rounds times whole and as many times with only what
+// changed since the level was loaded, then as many times again through the
+// save thread, timing how long the game is held up and how much of that is
+// laying the game out in memory. Then load the savegames
+// back and check that they are the same game. Loading replaces the level,
+// so this and load_bench() have to come last.
+void save_bench(int rounds, void (*print)(char const *format, ...))
+{
+  static char const *const names[] = { "whole", "changes" };
+  static char const *const files[] = { "savebench.spe", "savebenchd.spe" };
+  char level_name[255];
+  long size[2];
+  float ms[2], snapshot_ms, queued_ms, written_ms;
+  uint32_t crc[2];
+
+  strncpy(level_name, current_level->name(), sizeof(level_name) - 1);
+  level_name[sizeof(level_name) - 1] = 0;
+
+  int old_delta = delta_saves;
+  for (int m = 0; m < 2; m++)
+  {
+    delta_saves = m;
+    Timer t;
+    for (int r = 0; r < rounds; r++)
+      current_level->save(files[m], 1);
+    ms[m] = t.GetMs();
+  }
+  delta_saves = old_delta;
+
+  // The savegame with changes only gets written again, and then checked
+  // Laying the game out in memory is what has to happen between two ticks
+  {
+    Timer t;
+    for (int r = 0; r < rounds; r++)
+      delete current_level->snapshot(files[1]);
+    snapshot_ms = t.GetMs();
+  }
+
+  {
+    // only the calls hold up the game, not the thread writing meanwhile
+    Timer t;
+    queued_ms = 0.f;
+    for (int r = 0; r < rounds; r++)
+    {
+      Timer call;
+      current_level->save_async(files[1], NULL);
+      queued_ms += call.GetMs();
+    }
+    save_writer.Wait();
+    save_writer.Poll();
+    written_ms = t.GetMs();
+  }
+
+  for (int m = 0; m < 2; m++)
+  {
+    char name[255];
+    sprintf(name, "%s%s", get_save_filename_prefix(), files[m]);
+    bFILE *fp = open_file(name, "rb");
+    size[m] = fp->open_failure() ? 0 : fp->file_size();
+    delete fp;
+    the_game->load_level(name);
+    crc[m] = current_level && !current_level->load_failed()
+             ? current_level->state_crc() : 0;
+    unlink(name);
+  }
+
+  for (int m = 0; m < 2; m++)
+    print("save %-7s %s x %d, %.1f KB, %.2f ms/save%s\n",
+          names[m], level_name, rounds, size[m] / 1024.f,
+          ms[m] / rounds,
+          m && (crc[0] != crc[1] || !crc[1]) ? " (MISMATCH)" : "");
+  print("save queued  %s x %d, %.2f ms/save laid out in memory, "
+        "%.2f ms/save holding up the game, %.2f ms/save until written\n",
+        level_name, rounds, snapshot_ms / rounds, queued_ms / rounds,
+        written_ms / rounds);
+}
+
+// Load the level file name rounds times reading each column of object
+// records and each link table in one go, and as many times a field at a
+// time, and check that both give the same game
+void load_bench(char const *name, int rounds,
+                void (*print)(char const *format, ...))
+{
+  static char const *const names[] = { "bulk", "fields" };
+  float ms[2];
+  uint32_t crc[2];
+  int objects = 0;
+
+  int old_bulk = bulk_loads;
+  for (int m = 0; m < 2; m++)
+  {
+    bulk_loads = !m;
+    Timer t;
+    for (int r = 0; r < rounds; r++)
+      the_game->load_level(name);
+    ms[m] = t.GetMs();
+    crc[m] = current_level && !current_level->load_failed()
+             ? current_level->state_crc() : 0;
+  }
+  bulk_loads = old_bulk;
+
+  if (current_level)
+    for (game_object *o = current_level->first_object(); o; o = o->next)
+      objects++;
+  for (int m = 0; m < 2; m++)
+    print("load %-6s %s x %d, %d objects, %.2f ms/load%s\n",
+          names[m], name, rounds, objects, ms[m] / rounds,
+          m && (crc[0] != crc[1] || !crc[1]) ? " (MISMATCH)" : "");
+}
@@ -16,6 +16,7 @@
 #include "objects.h"
 #include "view.h"
 #include "id.h"
+#include "objgrid.h"
 
 #include <stdlib.h>
 #define ASPECT 4             // foreground scrolls 4 times faster than background
@@ -44,6 +45,49 @@ class area_controller
 
 extern int32_t last_tile_hit_x,last_tile_hit_y;
 extern int dev;
+extern int delta_saves;    // cleared by -fullsaves
+extern int async_saves;    // 0 (-syncsaves) to write savegames before save_game returns
+extern int bulk_loads;     // 0 to read objects and links a field at a time, for -loadbench
+
+// Open a level or savegame for loading, putting a savegame that only has
+// what changed since its level was loaded back together in memory first.
+// Returns NULL for a savegame whose level can no longer be found.
+bFILE *open_level_file(char const *name);
+
+// Time saving the current level and loading the level file name, for
+// -savebench and -loadbench. Both leave another copy of the level loaded,
+// so they come last.
+void save_bench(int rounds, void (*print)(char const *format, ...));
+void load_bench(char const *name, int rounds,
+                void (*print)(char const *format, ...));
+
+// A savegame laid out in memory by level::snapshot(), which can be written
+// without looking at the level again, by the save thread or right away
+class SaveJob
+{
+public:
+    SaveJob(char const *filename);
+    ~SaveJob();
+    int Write();           // sets and returns ok
+
+    char *name;            // file to write, with the savegame prefix
+    char *base_name;       // level to only keep what changed since, or NULL
+    char *base_path;       // the plain file base_name is read from
+    long base_offset, base_size;  // where in it, as locate_file() gives
+    mFILE *state;          // what level::save_state() gives
+    mFILE *base;           // the whole of base_name, read by Write()
+    mFILE *thumb;          // the thumb nail, the last entry
+    void (*done)(char const *name, int ok);  // called between frames once written
+    int ok;                // 1 = success
+    SaveJob *next;
+
+private:
+    int ReadBase();
+    int KeepBase(uint32_t crc);
+    int WriteWhole();
+    int WriteDelta();
+};
+
 class level        // contain map info and objects
 {
   uint16_t *map_fg,        // just big 2d arrays
@@ -51,6 +95,7 @@ class level        // contain map info and objects
        bg_width,bg_height,
        fg_width,fg_height;
   char *Name,*first_name;
+  char *base_name;         // level file this one was loaded from, savegames only keep what changed since
   int32_t total_objs;
   game_object *first,*first_active,*last;
 
@@ -74,13 +119,18 @@ class level        // contain map info and objects
   void add_all_block(game_object *who);
   uint32_t ctick;
 
+  ObjectGrid grid;                         // buckets the active list for spatial queries
+  void grid_actives(game_object *from);
+
 public :
   char *original_name() { if (first_name) return first_name; else return Name; }
   uint32_t tick_counter() { return ctick; }
+  uint32_t state_crc();    // of everything a deterministic run must reproduce
   void set_tick_counter(uint32_t x);
   area_controller *area_list;
 
-  void clear_active_list() { first_active=NULL; }
+  void clear_active_list() { first_active=NULL; grid.Invalidate(); }
+  void update_grid(game_object *o) { grid.Update(o); }
   char *name() { return Name; }
   game_object *attacker(game_object *who);
   int is_attacker(game_object *who);
@@ -97,6 +147,9 @@ public :
   void load_fail();
   level(int width, int height, char const *name);
   int save(char const *filename, int save_all);  // save_all includes player and view information (1 = success)
+  mFILE *save_state();                   // everything save(...,1) writes, in memory and without a thumb nail
+  SaveJob *snapshot(char const *filename);  // everything save(filename,1) writes, to be written later
+  void save_async(char const *filename, void (*done)(char const *name, int ok));  // save(filename,1) on the save thread
   void set_name(char const *name) { Name=strcpy((char *)realloc(Name,strlen(name)+1),name); }
   void set_size(int w, int h);
   void remove_light(light_source *which);
@@ -154,6 +207,7 @@ public :
   int add_drawables(int32_t x1, int32_t y1, int32_t x2, int32_t y2);  //returns total added
 
   game_object *find_object(int32_t x, int32_t y);
+  void find_actives(GridQuery &q, int32_t x1, int32_t y1, int32_t x2, int32_t y2);
 
   game_object *damage_intersect(int32_t x1, int32_t y1, int32_t &x2, int32_t &y2, game_object *exclude);
   game_object *boundary_setback(game_object *subject, int32_t x1, int32_t y1, int32_t &x2, int32_t &y2);
@@ -188,7 +242,9 @@ public :
 //  game_object *find_enemy(game_object *exclude1, game_object *exclude2);
 
   bFILE *create_dir(char *filename, int save_all,
-            object_node *save_list, object_node *exclude_list);
+            object_node *save_list, object_node *exclude_list, bFILE *to=NULL);
+  void write_contents(bFILE *fp, int save_all, object_node *objs,
+                      object_node *players, int thumb_nail);
   view *make_view_list(int nplayers);
   int32_t total_light_links(object_node *list);
   int32_t total_object_links(object_node *save_list);
@@ -13,6 +13,12 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <new>
+#if defined __SSE2__
+#   include <emmintrin.h>
+#endif
 
 #include "common.h"
 
@@ -26,6 +32,8 @@
 #include "filter.h"
 #include "status.h"
 #include "dev.h"
+#include "drawpool.h"
+#include "arena.h"
 
 light_source *first_light_source=NULL;
 uint8_t *white_light,*white_light_initial,*green_light,*trans_table;
@@ -35,6 +43,56 @@ extern char disable_autolight;   // defined in dev.h
 
 int light_detail=MEDIUM_DETAIL;
 
+// Patches of the lights that do not move are kept across frames, in world
+// coordinates, in a grid of cells around those lights.  A cell is only
+// rebuilt when a light covering it is added, removed or changed.
+#define LIGHT_CELL_BITS 9
+#define LIGHT_CELL (1<<LIGHT_CELL_BITS)
+
+struct light_cell
+{
+  light_patch *patches;
+  Arena arena;   // holds the patches, emptied when the cell is rebuilt
+  int dirty;
+};
+
+static light_cell *cells=NULL;
+static int32_t cell_x,cell_y,cell_w,cell_h;  // grid position and size, in cells
+static int grid_changed=1,order_changed=1;
+
+static light_cell *cell_at(int32_t cx, int32_t cy)
+{
+  if (cx<cell_x || cy<cell_y || cx>=cell_x+cell_w || cy>=cell_y+cell_h)
+    return NULL;
+  return cells+(cy-cell_y)*cell_w+cx-cell_x;
+}
+
+// the light list changed, and so did static lights in x1,y1-x2,y2 if static
+static void lights_changed(int statics, int32_t x1, int32_t y1, int32_t x2, int32_t y2)
+{
+  order_changed=1;
+  if (!statics || grid_changed || x1>x2 || y1>y2)
+    return ;
+
+  int32_t cx1=x1>>LIGHT_CELL_BITS,cy1=y1>>LIGHT_CELL_BITS,
+      cx2=x2>>LIGHT_CELL_BITS,cy2=y2>>LIGHT_CELL_BITS;
+  if (!cell_at(cx1,cy1) || !cell_at(cx2,cy2))
+  {
+    grid_changed=1;   // outside of the grid, which has to grow
+    return ;
+  }
+  for (int32_t cy=cy1; cy<=cy2; cy++)
+    for (int32_t cx=cx1; cx<=cx2; cx++)
+      cell_at(cx,cy)->dirty=1;
+}
+
+static void free_cells()
+{
+  delete [] cells;
+  cells=NULL;
+  cell_w=cell_h=0;
+}
+
 int32_t light_to_number(light_source *l)
 {
 
@@ -58,6 +116,7 @@ light_source *number_to_light(int32_t x)
 light_source *light_source::copy()
 {
   next=new light_source(type,x,y,inner_radius,outer_radius,xshift,yshift,next);
+  lights_changed(1,x1,y1,x2,y2);
   return next;
 }
 
@@ -72,6 +131,8 @@ void delete_all_lights()
     first_light_source=first_light_source->next;
     delete p;
   }
+  free_cells();
+  grid_changed=order_changed=1;
 }
 
 void delete_light(light_source *which)
@@ -79,6 +140,7 @@ void delete_light(light_source *which)
   if (dev_cont)
     dev_cont->notify_deleted_light(which);
 
+  lights_changed(!which->dynamic,which->x1,which->y1,which->x2,which->y2);
   if (which==first_light_source)
   {
     first_light_source=first_light_source->next;
@@ -96,7 +158,18 @@ void delete_light(light_source *which)
   }
 }
 
+// called whenever a light is changed after being made
 void light_source::calc_range()
+{
+  if (!dynamic)   // it will probably move again, so stop caching it
+  {
+    lights_changed(1,x1,y1,x2,y2);
+    dynamic=1;
+  }
+  calc_bounds();
+}
+
+void light_source::calc_bounds()
 {
   switch (type)
   {
@@ -161,7 +234,9 @@ light_source::light_source(char Type, int32_t X, int32_t Y, int32_t Inner_radius
   known=0;
   xshift=Xshift;
   yshift=Yshift;
-  calc_range();
+  dynamic=0;
+  order=0;
+  calc_bounds();
 }
 
 
@@ -174,9 +249,13 @@ int count_lights()
 }
 
 light_source *add_light_source(char type, int32_t x, int32_t y,
-                   int32_t inner, int32_t outer, int32_t xshift, int32_t yshift)
+                   int32_t inner, int32_t outer, int32_t xshift, int32_t yshift,
+                   int dynamic)
 {
   first_light_source=new light_source(type,x,y,inner,outer,xshift,yshift,first_light_source);
+  first_light_source->dynamic=dynamic;
+  lights_changed(!dynamic,first_light_source->x1,first_light_source->y1,
+                 first_light_source->x2,first_light_source->y2);
   return first_light_source;
 }
 
@@ -373,13 +452,19 @@ void calc_light_table(palette *pal)
 }
 
 
-light_patch *light_patch::copy(light_patch *Next)
+static light_patch *new_patch(Arena *arena, int32_t x1, int32_t y1, int32_t x2, int32_t y2,
+                              light_patch *next)
+{
+  return new (arena->Alloc(sizeof(light_patch))) light_patch(x1,y1,x2,y2,next);
+}
+
+light_patch *light_patch::copy(Arena *arena, light_patch *Next)
 {
-  light_patch *p=new light_patch(x1,y1,x2,y2,Next);
-  p->total=total;
+  light_patch *p=new_patch(arena,x1,y1,x2,y2,Next);
+  p->total=p->room=total;
   if (total)
   {
-    p->lights=(light_source **)malloc(total*sizeof(light_source *));
+    p->lights=(light_source **)arena->Alloc(total*sizeof(light_source *));
     memcpy(p->lights,lights,total*(sizeof(light_source *)));
   }
   else
@@ -387,6 +472,20 @@ light_patch *light_patch::copy(light_patch *Next)
   return p;
 }
 
+void light_patch::add(Arena *arena, light_source *who)
+{
+  // the arena never frees, so grow by doubling to keep the copies linear
+  if (total==room)
+  {
+    room=room ? room*2 : 4;
+    light_source **l=(light_source **)arena->Alloc(room*sizeof(light_source *));
+    if (total)
+      memcpy(l,lights,total*sizeof(light_source *));
+    lights=l;
+  }
+  lights[total++]=who;
+}
+
 #define MAX_LP 6
 
 // insert light into list make sure the are sorted by y1
@@ -407,8 +506,10 @@ void insert_light(light_patch *&first, light_patch *l)
   }
 }
 
-void add_light(light_patch *&first, int32_t x1, int32_t y1, int32_t x2, int32_t y2,
-                light_source *who)
+// add who to the patches covering x1,y1-x2,y2, which must all exist, splitting
+// them as needed. Patches already holding max_lights lights are left alone.
+void add_light(Arena *arena, light_patch *&first, int32_t x1, int32_t y1, int32_t x2, int32_t y2,
+                light_source *who, int max_lights)
 {
   light_patch *next;
   light_patch *p=first;
@@ -418,23 +519,23 @@ void add_light(light_patch *&first, int32_t x1, int32_t y1, int32_t x2, int32_t
     // first see if light patch we are adding is enclosed entirely by another patch
     if (x1>=p->x1 && y1>=p->y1 && x2<=p->x2 && y2<=p->y2)
     {
-      if (p->total==MAX_LP) return ;
+      if (p->total>=max_lights) return ;
 
       if (x1>p->x1)
       {
-    light_patch *l=p->copy(NULL);
+    light_patch *l=p->copy(arena,NULL);
     l->x2=x1-1;
     insert_light(first,l);
       }
       if (x2<p->x2)
       {
-    light_patch *l=p->copy(NULL);
+    light_patch *l=p->copy(arena,NULL);
     l->x1=x2+1;
     insert_light(first,l);
       }
       if (y1>p->y1)
       {
-    light_patch *l=p->copy(NULL);
+    light_patch *l=p->copy(arena,NULL);
     l->x1=x1;
     l->x2=x2;
     l->y2=y1-1;
@@ -442,7 +543,7 @@ void add_light(light_patch *&first, int32_t x1, int32_t y1, int32_t x2, int32_t
       }
       if (y2<p->y2)
       {
-    light_patch *l=p->copy(NULL);
+    light_patch *l=p->copy(arena,NULL);
     l->x1=x1;
     l->x2=x2;
     l->y1=y2+1;
@@ -462,9 +563,7 @@ void add_light(light_patch *&first, int32_t x1, int32_t y1, int32_t x2, int32_t
       insert_light(first,p);
 
 
-      p->total++;
-      p->lights=(light_source **)realloc(p->lights,sizeof(light_source *)*p->total);
-      p->lights[p->total-1]=who;
+      p->add(arena,who);
       return ;
     }
 
@@ -472,17 +571,15 @@ void add_light(light_patch *&first, int32_t x1, int32_t y1, int32_t x2, int32_t
     if (x1<=p->x1 && y1<=p->y1 && x2>=p->x2 && y2>=p->y2)
     {
       if (x1<p->x1)
-        add_light(first,x1,y1,p->x1-1,y2,who);
+        add_light(arena,first,x1,y1,p->x1-1,y2,who,max_lights);
       if (x2>p->x2)
-        add_light(first,p->x2+1,y1,x2,y2,who);
+        add_light(arena,first,p->x2+1,y1,x2,y2,who,max_lights);
       if (y1<p->y1)
-        add_light(first,p->x1,y1,p->x2,p->y1-1,who);
+        add_light(arena,first,p->x1,y1,p->x2,p->y1-1,who,max_lights);
       if (y2>p->y2)
-        add_light(first,p->x1,p->y2+1,p->x2,y2,who);
-      if (p->total==MAX_LP)  return ;
-      p->total++;
-      p->lights=(light_source **)realloc(p->lights,sizeof(light_source *)*p->total);
-      p->lights[p->total-1]=who;
+        add_light(arena,first,p->x1,p->y2+1,p->x2,y2,who,max_lights);
+      if (p->total>=max_lights)  return ;
+      p->add(arena,who);
       return ;
     }
 
@@ -492,14 +589,14 @@ void add_light(light_patch *&first, int32_t x1, int32_t y1, int32_t x2, int32_t
       int ax1,ay1,ax2,ay2;
       if (x1<p->x1)
       {
-        add_light(first,x1,Max(y1,p->y1),p->x1-1,Min(y2,p->y2),who);
+        add_light(arena,first,x1,Max(y1,p->y1),p->x1-1,Min(y2,p->y2),who,max_lights);
     ax1=p->x1;
       } else
     ax1=x1;
 
       if (x2>p->x2)
       {
-        add_light(first,p->x2+1,Max(y1,p->y1),x2,Min(y2,p->y2),who);
+        add_light(arena,first,p->x2+1,Max(y1,p->y1),x2,Min(y2,p->y2),who,max_lights);
     ax2=p->x2;
       }
       else
@@ -507,20 +604,20 @@ void add_light(light_patch *&first, int32_t x1, int32_t y1, int32_t x2, int32_t
 
       if (y1<p->y1)
       {
-        add_light(first,x1,y1,x2,p->y1-1,who);
+        add_light(arena,first,x1,y1,x2,p->y1-1,who,max_lights);
     ay1=p->y1;
       } else
     ay1=y1;
 
       if (y2>p->y2)
       {
-        add_light(first,x1,p->y2+1,x2,y2,who);
+        add_light(arena,first,x1,p->y2+1,x2,y2,who,max_lights);
     ay2=p->y2;
       } else
     ay2=y2;
 
 
-      add_light(first,ax1,ay1,ax2,ay2,who);
+      add_light(arena,first,ax1,ay1,ax2,ay2,who,max_lights);
 
       return ;
     }
@@ -579,9 +676,153 @@ void reduce_patches(light_patch *f)   // find constant valued patches
 
 }
 
-light_patch *make_patch_list(int width, int height, int32_t screenx, int32_t screeny)
+// set to 0 to add every light to the patches of every frame
+int light_cache=1;
+
+static int patch_y1_cmp(const void *a, const void *b)
 {
-  light_patch *first=new light_patch(0,0,width-1,height-1,NULL);
+  return (*(light_patch **)a)->y1-(*(light_patch **)b)->y1;
+}
+
+// Renumber the lights and rebuild the cells of static patches seen by the
+// x1,y1-x2,y2 window if they changed.  This must happen on the main thread,
+// before any band calls make_patch_list().
+static void update_light_cache(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
+{
+  light_source *f;
+
+  if (order_changed)
+  {
+    int32_t n=0;
+    for (f=first_light_source; f; f=f->next)
+      f->order=n++;
+    order_changed=0;
+  }
+
+  if (grid_changed)
+  {
+    free_cells();
+    int32_t bx1=0,by1=0,bx2=-1,by2=-1;
+    for (f=first_light_source; f; f=f->next)
+    {
+      if (f->dynamic || f->x1>f->x2 || f->y1>f->y2)
+        continue;
+      if (bx1>bx2)
+      { bx1=f->x1; by1=f->y1; bx2=f->x2; by2=f->y2; }
+      else
+      {
+        bx1=Min(bx1,f->x1); by1=Min(by1,f->y1);
+        bx2=Max(bx2,f->x2); by2=Max(by2,f->y2);
+      }
+    }
+    if (bx1<=bx2)
+    {
+      cell_x=bx1>>LIGHT_CELL_BITS; cell_w=(bx2>>LIGHT_CELL_BITS)-cell_x+1;
+      cell_y=by1>>LIGHT_CELL_BITS; cell_h=(by2>>LIGHT_CELL_BITS)-cell_y+1;
+      cells=new light_cell[cell_w*cell_h];
+      for (int32_t i=0; i<cell_w*cell_h; i++)
+      {
+        cells[i].patches=NULL;
+        cells[i].dirty=1;
+      }
+    }
+    grid_changed=0;
+  }
+
+  for (int32_t cy=y1>>LIGHT_CELL_BITS; cy<=(y2>>LIGHT_CELL_BITS); cy++)
+    for (int32_t cx=x1>>LIGHT_CELL_BITS; cx<=(x2>>LIGHT_CELL_BITS); cx++)
+    {
+      light_cell *c=cell_at(cx,cy);
+      if (!c || !c->dirty)
+        continue;
+
+      // no limit on lights per patch here, moving lights may come first
+      int32_t px1=cx*LIGHT_CELL,py1=cy*LIGHT_CELL,
+          px2=px1+LIGHT_CELL-1,py2=py1+LIGHT_CELL-1;
+      c->arena.Reset();
+      c->patches=new_patch(&c->arena,px1,py1,px2,py2,NULL);
+      for (f=first_light_source; f; f=f->next)
+      {
+        int32_t lx1=Max(f->x1,px1),ly1=Max(f->y1,py1),
+            lx2=Min(f->x2,px2),ly2=Min(f->y2,py2);
+        if (!f->dynamic && lx1<=lx2 && ly1<=ly2)
+          add_light(&c->arena,c->patches,lx1,ly1,lx2,ly2,f,INT_MAX);
+      }
+      c->dirty=0;
+    }
+}
+
+light_patch *make_patch_list(Arena *arena, int width, int height, int32_t screenx, int32_t screeny)
+{
+  if (light_cache)
+  {
+    int32_t sx2=screenx+width-1,sy2=screeny+height-1;
+    light_patch *first=NULL;
+    int total=0;
+
+    // clip the static patches of every cell in view, or the cell itself if
+    // it is outside the grid and has no static lights
+    for (int32_t cy=screeny>>LIGHT_CELL_BITS; cy<=(sy2>>LIGHT_CELL_BITS); cy++)
+      for (int32_t cx=screenx>>LIGHT_CELL_BITS; cx<=(sx2>>LIGHT_CELL_BITS); cx++)
+      {
+        light_cell *c=cell_at(cx,cy);
+        light_patch empty(cx*LIGHT_CELL,cy*LIGHT_CELL,
+                          cx*LIGHT_CELL+LIGHT_CELL-1,cy*LIGHT_CELL+LIGHT_CELL-1,NULL);
+        for (light_patch *p=c ? c->patches : &empty; p; p=p->next)
+        {
+          if (p->y2<screeny || p->y1>sy2 || p->x2<screenx || p->x1>sx2)
+            continue;
+          first=p->copy(arena,first);
+          first->x1=Max(p->x1,screenx)-screenx; first->y1=Max(p->y1,screeny)-screeny;
+          first->x2=Min(p->x2,sx2)-screenx;     first->y2=Min(p->y2,sy2)-screeny;
+          total++;
+        }
+      }
+
+    // keep the list sorted by y1, like add_light() does
+    light_patch **sorted=(light_patch **)arena->Alloc(total*sizeof(light_patch *));
+    light_patch *p=first;
+    for (int i=0; i<total; i++,p=p->next)
+      sorted[i]=p;
+    qsort(sorted,total,sizeof(light_patch *),patch_y1_cmp);
+    for (int i=0; i<total; i++)
+      sorted[i]->next=i+1<total ? sorted[i+1] : NULL;
+    first=sorted[0];
+
+    int moving=0;
+    for (light_source *f=first_light_source; f; f=f->next)
+    {
+      if (!f->dynamic)
+        continue;
+      int32_t x1=Max(f->x1,screenx)-screenx,y1=Max(f->y1,screeny)-screeny,
+          x2=Min(f->x2,sx2)-screenx,y2=Min(f->y2,sy2)-screeny;
+      if (x1<=x2 && y1<=y2)
+      {
+        add_light(arena,first,x1,y1,x2,y2,f,INT_MAX);
+        moving=1;
+      }
+    }
+
+    // keep the first MAX_LP lights of each patch in list order, which is
+    // what adding every light in order with a limit would have done
+    for (p=first; p; p=p->next)
+    {
+      if (moving)
+        for (int i=1; i<p->total; i++)
+        {
+          light_source *l=p->lights[i];
+          int j=i;
+          for (; j>0 && p->lights[j-1]->order>l->order; j--)
+            p->lights[j]=p->lights[j-1];
+          p->lights[j]=l;
+        }
+      if (p->total>MAX_LP)
+        p->total=MAX_LP;
+    }
+    return first;
+  }
+
+  light_patch *first=new_patch(arena,0,0,width-1,height-1,NULL);
 
   for (light_source *f=first_light_source; f; f=f->next)   // determine which lights will have effect
   {
@@ -593,24 +834,13 @@ light_patch *make_patch_list(int width, int height, int32_t screenx, int32_t scr
     if (y2>=height) y2=height-1;
 
     if (x1<=x2 && y1<=y2)
-      add_light(first,x1,y1,x2,y2,f);
+      add_light(arena,first,x1,y1,x2,y2,f,MAX_LP);
   }
   reduce_patches(first);
 
   return first;
 }
 
-
-void delete_patch_list(light_patch *first)
-{
-  while (first)
-  {
-    light_patch *p=first;
-    first=first->next;
-    delete p;
-  }
-}
-
 inline void MAP_PUT(uint8_t * screen_addr, uint8_t * remap, int w)
 {
   register int cx=w;
@@ -637,9 +867,10 @@ uint16_t min_light_level;
 // calculate the light value for this block.  sum up all contritors
 inline int calc_light_value(light_patch *lp,   // light patch to look at
                 int32_t sx,           // screen x & y
-                int32_t sy)
+                int32_t sy,
+                int min_light)        // ambient light level
 {
-  int lv=min_light_level,r2,light_count;
+  int lv=min_light,r2,light_count;
   register int dx,dy;           // x and y distances
 
   light_source **lon_p=lp->lights;
@@ -683,6 +914,131 @@ inline int calc_light_value(light_patch *lp,   // light patch to look at
 }
 
 
+// set to 0 to compute light values one block at a time
+int light_batch=1;
+
+#define LIGHT_RUN 64  // blocks computed together by calc_light_run()
+
+// Same as calc_light_value() for n blocks of the same patch, 8 pixels
+// apart, starting at screen position sx.  Lights are applied to the whole
+// run one at a time, which keeps the inner loop free of branches.
+static void calc_light_run(light_patch *lp, int32_t sx, int32_t sy, int min_light,
+                           int n, uint8_t *out)
+{
+  light_source **lights=lp->lights;
+  int i,k;
+
+  // a solid rectangle overrides everything else
+  for (i=0; i<lp->total; i++)
+    if (lights[i]->type==9)
+    {
+      memset(out,lights[i]->inner_radius,n);
+      return ;
+    }
+
+  for (; n>0; n-=LIGHT_RUN, sx+=8*LIGHT_RUN, out+=LIGHT_RUN)
+  {
+    int run=Min(n,LIGHT_RUN);
+    int32_t lv[LIGHT_RUN];
+    for (k=0; k<run; k++)
+      lv[k]=min_light;
+
+    for (i=0; i<lp->total; i++)
+    {
+      light_source *fn=lights[i];
+      int32_t dy=abs(fn->y-sy)<<fn->yshift;
+      if (dy>=fn->outer_radius)  // every block of the run is out of reach
+        continue;
+
+      k=0;
+#if defined __SSE2__
+      __m128i vfx=_mm_set1_epi32(fn->x);
+      __m128i vdy=_mm_set1_epi32(dy);
+      __m128i vouter=_mm_set1_epi32(fn->outer_radius);
+      __m128i vmul=_mm_set1_epi32(fn->mul_div);
+      __m128i vshift=_mm_cvtsi32_si128(fn->xshift);
+      __m128i vx=_mm_setr_epi32(sx,sx+8,sx+16,sx+24);
+      __m128i vstep=_mm_set1_epi32(32);
+      for (; k+4<=run; k+=4, vx=_mm_add_epi32(vx,vstep))
+      {
+        __m128i dx=_mm_sub_epi32(vfx,vx);
+        __m128i sign=_mm_srai_epi32(dx,31);
+        dx=_mm_sll_epi32(_mm_sub_epi32(_mm_xor_si128(dx,sign),sign),vshift);
+
+        // r2 = dx + dy - min(dx, dy) / 2
+        __m128i lt=_mm_cmplt_epi32(dx,vdy);
+        __m128i mn=_mm_or_si128(_mm_and_si128(lt,dx),_mm_andnot_si128(lt,vdy));
+        __m128i r2=_mm_sub_epi32(_mm_add_epi32(dx,vdy),_mm_srai_epi32(mn,1));
+
+        // lv += (outer - r2) * mul_div >> 16 where r2 < outer; there is no
+        // 32-bit multiply in SSE2, so do even and odd lanes separately
+        __m128i v=_mm_sub_epi32(vouter,r2);
+        __m128i in=_mm_cmpgt_epi32(v,_mm_setzero_si128());
+        __m128i even=_mm_mul_epu32(v,vmul);
+        __m128i odd=_mm_mul_epu32(_mm_srli_epi64(v,32),_mm_srli_epi64(vmul,32));
+        __m128i prod=_mm_unpacklo_epi32(_mm_shuffle_epi32(even,_MM_SHUFFLE(0,0,2,0)),
+                                        _mm_shuffle_epi32(odd,_MM_SHUFFLE(0,0,2,0)));
+        __m128i add=_mm_and_si128(_mm_srai_epi32(prod,16),in);
+
+        __m128i acc=_mm_loadu_si128((__m128i *)(lv+k));
+        _mm_storeu_si128((__m128i *)(lv+k),_mm_add_epi32(acc,add));
+      }
+#endif
+      for (; k<run; k++)
+      {
+        int32_t dx=abs(fn->x-(sx+8*k))<<fn->xshift;
+        int32_t r2=dx+dy-((dx<dy ? dx : dy)>>1);
+        if (r2<fn->outer_radius)
+          lv[k]+=(fn->outer_radius-r2)*fn->mul_div>>16;
+      }
+    }
+
+    for (k=0; k<run; k++)
+      out[k]=lv[k]>63 ? 63 : lv[k];
+  }
+}
+
+// Gather the patches crossing line y into row, from left to right.  The
+// list is sorted by y1 and patches do not overlap, so this is cheap.
+static void patches_on_line(light_patch *first, int32_t y, light_patch **row)
+{
+  int n=0;
+  for (light_patch *p=first; p && p->y1<=y; p=p->next)
+    if (p->y2>=y)
+    {
+      int i=n++;
+      for (; i>0 && row[i-1]->x1>p->x1; i--)
+        row[i]=row[i-1];
+      row[i]=p;
+    }
+}
+
+// Fill rem with the light values of count blocks starting at x on a line
+// whose patches are in row, as seen by a screen at screenx.
+static void calc_light_line(light_patch **row, int32_t x, int count,
+                            int32_t screenx, int32_t calcy, int min_light, uint8_t *rem)
+{
+  while (count>0)
+  {
+    while ((*row)->x2<x)
+      row++;
+    light_patch *lp=*row;
+
+    if (!light_batch)
+    {
+      *(rem++)=calc_light_value(lp,x+screenx,calcy,min_light);
+      x+=8; count--;
+      continue;
+    }
+
+    // patches do not overlap, so every block up to x2 uses this one
+    int n=Min(count,(int)(lp->x2-x)/8+1);
+    calc_light_run(lp,x+screenx,calcy,min_light,n,rem);
+    rem+=n; x+=8*n; count-=n;
+  }
+}
+
+
 void remap_line_asm2(uint8_t *addr,uint8_t *light_lookup,uint8_t *remap_line,int count)
 //inline void remap_line_asm2(uint8_t *addr,uint8_t *light_lookup,uint8_t *remap_line,int count)
 {
@@ -749,35 +1105,104 @@ inline void put_8line(uint8_t *in_line, uint8_t *out_line, uint8_t *remap, uint8
 }
 
 
-void light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *light_lookup, uint16_t ambient)
+// one arena per band, emptied at the start of every frame
+static Arena *band_arenas=NULL;
+static int band_arena_count=0;
+
+static void alloc_band_arenas(int count)
 {
-  int lx_run=0,ly_run;                     // light block x & y run size in pixels ==  (1<<lx_run)
+  if (count>band_arena_count)
+  {
+    delete [] band_arenas;
+    band_arenas=new Arena[count];
+    band_arena_count=count;
+  }
+}
 
-  if (shutdown_lighting && !disable_autolight)
-    ambient=shutdown_lighting_value;
+void light_alloc_stats(size_t &allocs, size_t &blocks)
+{
+  allocs=blocks=0;
+  for (int i=0; i<band_arena_count; i++)
+  {
+    allocs+=band_arenas[i].GetAllocs();
+    blocks+=band_arenas[i].GetBlocks();
+  }
+}
 
-  switch (light_detail)
+// Time light_screen() one block at a time, batched without the cached
+// patches, and batched with them, on a small and a large view of the
+// current level seen from sx,sy, and check that all of them agree
+void light_bench(int32_t sx, int32_t sy, int frames,
+                 void (*print)(char const *format, ...))
+{
+  static int const sizes[][2] = { { 320, 200 }, { 1280, 720 } };
+  static int const modes[][2] = { { 0, 1 }, { 1, 0 }, { 1, 1 } };
+  int old_batch = light_batch, old_cache = light_cache;
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); s++)
   {
-    case HIGH_DETAIL :
-    { lx_run=2; ly_run=1; } break;       // 4 x 2 patches
-    case MEDIUM_DETAIL :
-    { lx_run=3; ly_run=2; } break;       // 8 x 4 patches  (default)
-    case LOW_DETAIL :
-    { lx_run=4; ly_run=3; } break;       // 16 x 8 patches
-    case POOR_DETAIL :                   // poor detail is no lighting
-    return ;
+    ivec2 size(sizes[s][0], sizes[s][1]);
+    image *im[3];
+    float ms[3];
+
+    for (int b = 0; b < 3; b++)
+    {
+      im[b] = new image(size);
+      for (int y = 0; y < size.y; y++)
+        for (int x = 0; x < size.x; x++)
+          im[b]->scan_line(y)[x] = (x * 7 + y * 13) & 0xff;
+
+      light_batch = modes[b][0];
+      light_cache = modes[b][1];
+      Timer t;
+      for (int i = 0; i < frames; i++)
+        light_screen(im[b], sx, sy, white_light, 0);
+      ms[b] = t.GetMs() / Max(frames, 1);
+    }
+
+    bool same = true;
+    for (int b = 1; b < 3; b++)
+      for (int y = 0; y < size.y; y++)
+        same &= !memcmp(im[0]->scan_line(y), im[b]->scan_line(y),
+                        size.x);
+
+    print("light %4dx%-4d per block %.3f ms, uncached %.3f ms, "
+          "cached %.3f ms, %d threads%s\n", size.x, size.y, ms[0], ms[1],
+          ms[2], draw_pool.GetThreads(), same ? "" : " (MISMATCH)");
+    size_t allocs, blocks;
+    light_alloc_stats(allocs, blocks);
+    print("light %4dx%-4d %d arena allocations per frame, "
+          "%d heap blocks in total\n", size.x, size.y, (int)allocs,
+          (int)blocks);
+    for (int b = 0; b < 3; b++)
+      delete im[b];
   }
-  if ((int)ambient+ambient_ramp<0)
-    min_light_level=0;
-  else if ((int)ambient+ambient_ramp>63)
-    min_light_level=63;
-  else min_light_level=(int)ambient+ambient_ramp;
 
-  if (ambient==63) return ;
+  light_batch = old_batch;
+  light_cache = old_cache;
+}
+
+struct light_args
+{
+  int32_t screenx,screeny,top;   // top is the first row of the whole view
+  uint8_t *light_lookup;
+  int lx_run,min_light;
+};
+
+// light the clip area of sc, which may be a band of the whole view
+static void light_area(image *sc, light_args *a, Arena *arena)
+{
   ivec2 caa, cbb;
   sc->GetClip(caa, cbb);
+  arena->Reset();
+
+  int32_t screenx=a->screenx,screeny=a->screeny;
+  uint8_t *light_lookup=a->light_lookup;
+  int lx_run=a->lx_run,min_light=a->min_light;
 
-  light_patch *first = make_patch_list(cbb.x - caa.x, cbb.y - caa.y, screenx, screeny);
+  // patches are relative to the top of the band, light values to the view
+  light_patch *first = make_patch_list(arena, cbb.x - caa.x, cbb.y - caa.y, screenx,
+                                       screeny + caa.y - a->top);
 
   int prefix_x=(screenx&7);
   int prefix=screenx&7;
@@ -789,18 +1214,22 @@ void light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *light_lo
 
   int32_t remap_size=((cbb.x - caa.x - prefix - suffix)>>lx_run);
 
-  uint8_t *remap_line=(uint8_t *)malloc(remap_size);
+  uint8_t *remap_line=(uint8_t *)arena->Alloc(remap_size);
 
   light_patch *f=first;
+  int patches=0;
+  for (light_patch *p=first; p; p=p->next)
+    patches++;
+  light_patch **row=(light_patch **)arena->Alloc(patches*sizeof(light_patch *));
 
-  main_screen->Lock();
+  sc->Lock();
 
-  int scr_w=main_screen->Size().x;
-  uint8_t *screen_line=main_screen->scan_line(caa.y)+caa.x;
+  int scr_w=sc->Size().x;
+  uint8_t *screen_line=sc->scan_line(caa.y)+caa.x;
 
   for (int y = caa.y; y < cbb.y; )
   {
-    int x,count;
+    int count;
 //    while (f->next && f->y2<y)
 //      f=f->next;
     uint8_t *rem=remap_line;
@@ -809,7 +1238,7 @@ void light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *light_lo
     if (y + todoy >= cbb.y)
       todoy = cbb.y - y;
 
-    int calcy=((y+screeny)&(~3))-caa.y;
+    int calcy=((y+screeny)&(~3))-a->top;
 
 
     if (suffix)
@@ -818,7 +1247,7 @@ void light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *light_lo
       for (; (lp->y1>y-caa.y || lp->y2<y-caa.y ||
                   lp->x1>suffix_x || lp->x2<suffix_x); lp=lp->next);
       uint8_t * caddr=(uint8_t *)screen_line + cbb.x - caa.x - suffix;
-      uint8_t *r=light_lookup+(((int32_t)calc_light_value(lp,suffix_x+screenx,calcy)<<8));
+      uint8_t *r=light_lookup+(((int32_t)calc_light_value(lp,suffix_x+screenx,calcy,min_light)<<8));
       switch (todoy)
       {
     case 4 :
@@ -842,7 +1271,7 @@ void light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *light_lo
       for (; (lp->y1>y-caa.y || lp->y2<y-caa.y ||
                   lp->x1>prefix_x || lp->x2<prefix_x); lp=lp->next);
 
-      uint8_t *r=light_lookup+(((int32_t)calc_light_value(lp,prefix_x+screenx,calcy)<<8));
+      uint8_t *r=light_lookup+(((int32_t)calc_light_value(lp,prefix_x+screenx,calcy,min_light)<<8));
       uint8_t * caddr=(uint8_t *)screen_line;
       switch (todoy)
       {
@@ -864,12 +1293,9 @@ void light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *light_lo
 
 
 
-    for (x=prefix,count=0; count<remap_size; count++,x+=8,rem++)
-    {
-      light_patch *lp=f;
-      for (; (lp->y1>y-caa.y || lp->y2<y-caa.y || lp->x1>x || lp->x2<x); lp=lp->next);
-      *rem=calc_light_value(lp,x+screenx,calcy);
-    }
+    count=remap_size;
+    patches_on_line(f,y-caa.y,row);
+    calc_light_line(row,prefix,count,screenx,calcy,min_light,rem);
 
     switch (todoy)
     {
@@ -886,15 +1312,55 @@ void light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *light_lo
 
     screen_line-=prefix;
   }
-  main_screen->Unlock();
+  sc->Unlock();
+}
+
+static void light_band(image *band, int index, void *data)
+{
+  light_area(band,(light_args *)data,band_arenas+index);
+}
+
+void light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *light_lookup, uint16_t ambient)
+{
+  int lx_run=0,ly_run;                     // light block x & y run size in pixels ==  (1<<lx_run)
 
-  while (first)
+  if (shutdown_lighting && !disable_autolight)
+    ambient=shutdown_lighting_value;
+
+  switch (light_detail)
   {
-    light_patch *p=first;
-    first=first->next;
-    delete p;
+    case HIGH_DETAIL :
+    { lx_run=2; ly_run=1; } break;       // 4 x 2 patches
+    case MEDIUM_DETAIL :
+    { lx_run=3; ly_run=2; } break;       // 8 x 4 patches  (default)
+    case LOW_DETAIL :
+    { lx_run=4; ly_run=3; } break;       // 16 x 8 patches
+    case POOR_DETAIL :                   // poor detail is no lighting
+    return ;
   }
-  free(remap_line);
+  if ((int)ambient+ambient_ramp<0)
+    min_light_level=0;
+  else if ((int)ambient+ambient_ramp>63)
+    min_light_level=63;
+  else min_light_level=(int)ambient+ambient_ramp;
+
+  if (ambient==63) return ;
+  ivec2 caa, cbb;
+  sc->GetClip(caa, cbb);
+
+  if (light_cache)
+    update_light_cache(screenx,screeny,screenx+cbb.x-caa.x-1,screeny+cbb.y-caa.y-1);
+
+  light_args a;
+  a.screenx=screenx; a.screeny=screeny; a.top=caa.y;
+  a.light_lookup=light_lookup;
+  a.lx_run=lx_run; a.min_light=min_light_level;
+
+  alloc_band_arenas(draw_pool.GetThreads());
+  if (draw_pool.GetThreads()>1)
+    draw_pool.Run(sc,caa,cbb,-screeny,light_band,&a);  // split between 4 row blocks
+  else
+    light_area(sc,&a,band_arenas);
 }
 
 
@@ -951,7 +1417,12 @@ void double_light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *l
     return ;
   }
 
-  light_patch *first = make_patch_list(cbb.x - caa.x, cbb.y - caa.y, screenx, screeny);
+  if (light_cache)
+    update_light_cache(screenx,screeny,screenx+cbb.x-caa.x-1,screeny+cbb.y-caa.y-1);
+  alloc_band_arenas(1);
+  Arena *arena=band_arenas;
+  arena->Reset();
+  light_patch *first = make_patch_list(arena, cbb.x - caa.x, cbb.y - caa.y, screenx, screeny);
 
   int scr_w=sc->Size().x;
   int dscr_w=out->Size().x;
@@ -966,16 +1437,21 @@ void double_light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *l
 
   int32_t remap_size = ((cbb.x - caa.x - prefix - suffix)>>lx_run);
 
-  uint8_t *remap_line=(uint8_t *)malloc(remap_size);
+  uint8_t *remap_line=(uint8_t *)arena->Alloc(remap_size);
 
   light_patch *f=first;
+  int patches=0;
+  for (light_patch *p=first; p; p=p->next)
+    patches++;
+  light_patch **row=(light_patch **)arena->Alloc(patches*sizeof(light_patch *));
+
   uint8_t *in_line=sc->scan_line(caa.y)+caa.x;
   uint8_t *out_line=out->scan_line(caa.y*2+out_y)+caa.x*2+out_x;
 
 
   for (int y = caa.y; y < cbb.y; )
   {
-    int x,count;
+    int count;
 //    while (f->next && f->y2<y)
 //      f=f->next;
     uint8_t *rem=remap_line;
@@ -995,7 +1471,7 @@ void double_light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *l
       uint8_t * caddr=(uint8_t *)in_line + cbb.x - caa.x - suffix;
       uint8_t * daddr=(uint8_t *)out_line+(cbb.x - caa.x - suffix)*2;
 
-      uint8_t *r=light_lookup+(((int32_t)calc_light_value(lp,suffix_x+screenx,calcy)<<8));
+      uint8_t *r=light_lookup+(((int32_t)calc_light_value(lp,suffix_x+screenx,calcy,min_light_level)<<8));
       switch (todoy)
       {
     case 4 :
@@ -1027,7 +1503,7 @@ void double_light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *l
       for (; (lp->y1>y-caa.y || lp->y2<y-caa.y ||
                   lp->x1>prefix_x || lp->x2<prefix_x); lp=lp->next);
 
-      uint8_t *r=light_lookup+(((int32_t)calc_light_value(lp,prefix_x+screenx,calcy)<<8));
+      uint8_t *r=light_lookup+(((int32_t)calc_light_value(lp,prefix_x+screenx,calcy,min_light_level)<<8));
       uint8_t * caddr=(uint8_t *)in_line;
       uint8_t * daddr=(uint8_t *)out_line;
       switch (todoy)
@@ -1060,12 +1536,9 @@ void double_light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *l
 
 
 
-    for (x=prefix,count=0; count<remap_size; count++,x+=8,rem++)
-    {
-      light_patch *lp=f;
-      for (; (lp->y1>y-caa.y || lp->y2<y-caa.y || lp->x1>x || lp->x2<x); lp=lp->next);
-      *rem=calc_light_value(lp,x+screenx,calcy);
-    }
+    count=remap_size;
+    patches_on_line(f,y-caa.y,row);
+    calc_light_line(row,prefix,count,screenx,calcy,min_light_level,rem);
 
     rem=remap_line;
 
@@ -1097,15 +1570,6 @@ void double_light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *l
     in_line-=prefix;
     out_line-=prefix*2;
   }
-
-
-  while (first)
-  {
-    light_patch *p=first;
-    first=first->next;
-    delete p;
-  }
-  free(remap_line);
 }
 
 
@@ -1168,4 +1632,5 @@ void read_lights(spec_directory *sd, bFILE *fp, char const *level_name)
       last=p;
     }
   }
+  grid_changed=order_changed=1;
 }
@@ -16,6 +16,8 @@
 #include "configuration.h"
 #include "crc.h"
 
+class Arena;
+
 #define TTINTS 9
 extern uint8_t *tints[TTINTS];
 extern uint8_t *white_light,*white_light_initial,*green_light,*trans_table;
@@ -33,8 +35,11 @@ class light_source
   int32_t x1,y1,x2,y2;
   char known;
   light_source *next;
+  char dynamic;    // has moved since it was made, so it is not in the cached patches
+  int32_t order;   // position in the light list, kept up to date by light_screen()
 
   void calc_range();
+  void calc_bounds();
   light_source(char Type, int32_t X, int32_t Y, int32_t Inner_radius, int32_t Outer_radius,
            int32_t Xshift, int32_t Yshift,
            light_source *Next);
@@ -44,32 +49,33 @@ class light_source
 class light_patch
 {
   public :
-  int32_t total,x1,y1,x2,y2;
+  int32_t total,room,x1,y1,x2,y2;   // room is how many lights fit
   light_source **lights;
   light_patch *next;
   light_patch(int32_t X1, int32_t Y1, int32_t X2, int32_t Y2, light_patch *Next)
   {
     x1=X1; y1=Y1; x2=X2; y2=Y2;
     next=Next;
-    total=0;
+    total=room=0;
     lights=NULL;
   }
   void add_light(int32_t X1, int32_t Y1, int32_t X2, int32_t Y2, light_source *who);
-  light_patch *copy(light_patch *Next);
-  ~light_patch() { if (total) free(lights); }
+  // patches and their light arrays live in an Arena, which frees them
+  light_patch *copy(Arena *arena, light_patch *Next);
+  void add(Arena *arena, light_source *who);
 } ;
 
 void delete_all_lights();
 void delete_light(light_source *which);
 light_source *add_light_source(char type, int32_t x, int32_t y,
-                   int32_t inner, int32_t outer, int32_t xshift, int32_t yshift);
+                   int32_t inner, int32_t outer, int32_t xshift, int32_t yshift,
+                   int dynamic=0);
 
 void add_light_spec(spec_directory *sd, char const *level_name);
 void write_lights(bFILE *fp);
 void read_lights(spec_directory *sd, bFILE *fp, char const *level_name);
 
 
-void delete_patch_list(light_patch *first);
 light_patch *find_patch(int screenx, int screeny, light_patch *list);
 int calc_light_value(int32_t x, int32_t y, light_patch *which);
 void light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *light_lookup, uint16_t ambient);
@@ -79,6 +85,16 @@ void double_light_screen(image *sc, int32_t screenx, int32_t screeny, uint8_t *l
 void calc_light_table(palette *pal);
 extern light_source *first_light_source;
 extern int light_detail;
+extern int light_batch;
+extern int light_cache;
+
+// Arena allocations made for the patches and lines of the last frame, and
+// blocks the arenas took from the heap since the start
+void light_alloc_stats(size_t &allocs, size_t &blocks);
+
+// Time each way of lighting the level seen from sx,sy, for -lightbench
+void light_bench(int32_t sx, int32_t sy, int frames,
+                 void (*print)(char const *format, ...));
 
 extern int32_t light_to_number(light_source *l);
 extern light_source *number_to_light(int32_t x);
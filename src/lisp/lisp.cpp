@@ -24,6 +24,8 @@
 
 #include "lisp.h"
 #include "lisp_gc.h"
+#include "lisp_vm.h"
+#include "lisp_prof.h"
 #include "symbols.h"
 
 #include "status.h"
@@ -44,8 +46,11 @@ LSpace *LSpace::Current;
 
 bFILE *current_print_file = NULL;
 
-LSymbol *LSymbol::root = NULL;
+LSymbol *LSymbol::first = NULL;
+LSymbol *LSymbol::last = NULL;
 size_t LSymbol::count = 0;
+LSymbol **LSymbol::table = NULL;
+size_t LSymbol::table_size = 0;
 
 int print_level = 0, trace_level = 0, trace_print_level = 1000;
 int total_user_functions;
@@ -162,14 +167,68 @@ void need_perm_space(char const *why)
   }
 }
 
-void *LSpace::Mark()
+LTmpScope *LTmpScope::current = NULL;
+LObject **LTmpScope::escapes = NULL;
+size_t LTmpScope::escape_count = 0;
+size_t LTmpScope::escape_max = 0;
+bool LTmpScope::pending = false;
+
+LTmpScope::LTmpScope()
+{
+    m_mark = LSpace::Tmp.m_free - LSpace::Tmp.m_data;
+    m_bottom = current ? current->m_bottom : m_mark;
+    m_first = escape_count;
+    m_ended = false;
+    m_outer = current;
+    current = this;
+}
+
+void LTmpScope::End()
+{
+    if (m_ended)
+        return;
+    m_ended = true;
+
+    if (escape_count > m_first)
+        Lisp::Promote(LSpace::Tmp.m_data + m_mark, escapes + m_first,
+                      escape_count - m_first);
+    // The outer scopes still need the containers holding their values
+    if (!m_outer && !pending)
+        escape_count = 0;
+
+    current = m_outer;
+    LSpace::Tmp.m_free = LSpace::Tmp.m_data + m_mark;
+}
+
+void LTmpScope::Record(LObject *container, LObject *value)
+{
+    if ((uint8_t *)value < LSpace::Tmp.m_data + current->m_bottom)
+        pending = true;
+    if (escape_count == escape_max)
+    {
+        escape_max = escape_max ? escape_max * 2 : 64;
+        escapes = (LObject **)realloc(escapes, sizeof(LObject *) * escape_max);
+    }
+    escapes[escape_count++] = container;
+}
+
+void LTmpScope::Collected()
 {
-    return m_free;
+    // What survived is treated as allocated before all the scopes, so the
+    // values that escaped so far are promoted when Tmp is cleared rather
+    // than when their scope ends
+    for (LTmpScope *s = current; s; s = s->m_outer)
+        s->m_mark = s->m_bottom = LSpace::Tmp.m_free - LSpace::Tmp.m_data;
+    if (escape_count)
+        pending = true;
 }
 
-void LSpace::Restore(void *val)
+void LTmpScope::Flush()
 {
-    m_free = (uint8_t *)val;
+    if (escape_count)
+        Lisp::Promote(LSpace::Tmp.m_data, escapes, escape_count);
+    escape_count = 0;
+    pending = false;
 }
 
 size_t LSpace::GetFree()
@@ -183,6 +242,22 @@ void *LSpace::Alloc(size_t size)
     // Align allocation
     size = (size + sizeof(intptr_t) - 1) & ~(sizeof(intptr_t) - 1);
 
+    // Large objects would fill the nursery only to be copied out of it, so
+    // they go straight to the old generation when there is room. They are
+    // filled in afterwards, hence remembered.
+    if (this == &LSpace::Perm && m_young != m_data
+         && size > (size_t)(m_data + m_size - m_young) / 4
+         && size <= (size_t)(m_young - m_old))
+    {
+        void *ret = m_old;
+        m_old += size;
+        m_stats.allocated += size;
+        if (lisp_profile)
+            LProfiler::Alloc(size);
+        Lisp::Remember((LObject *)ret);
+        return ret;
+    }
+
     // Collect garbage if necessary
     if (size > GetFree())
     {
@@ -201,6 +276,9 @@ void *LSpace::Alloc(size_t size)
 
     void *ret = m_free;
     m_free += size;
+    m_stats.allocated += size;
+    if (lisp_profile)
+        LProfiler::Alloc(size);
     return ret;
 }
 
@@ -349,6 +427,8 @@ LUserFunction *new_lisp_user_function(LList *arg_list, LList *block_list)
     lu->m_type = L_USER_FUNCTION;
     lu->arg_list = arg_list;
     lu->block_list = block_list;
+    lu->consts = NULL;
+    lu->code = NULL;
     return lu;
 }
 
@@ -399,9 +479,7 @@ LSymbol *new_lisp_symbol(char *name)
     s->m_name = LString::Create(name);
     s->m_value = l_undefined;
     s->m_function = l_undefined;
-#ifdef L_PROFILE
-    s->time_taken = 0;
-#endif
+    s->m_prof = NULL;
     return s;
 }
 
@@ -781,31 +859,61 @@ LSymbol *make_find_symbol(char const *name)    // find a symbol, if it doesn't e
 
 */
 
-LSymbol *LSymbol::Find(char const *name)
+// FNV-1a, good enough for identifiers and cheap to compute
+uint32_t LSymbol::Hash(char const *name)
 {
-    LSymbol *p = root;
-    while (p)
+    uint32_t h = 2166136261u;
+    while (*name)
+        h = (h ^ (uint8_t)*name++) * 16777619u;
+    return h;
+}
+
+// Return the slot holding the named symbol, or the empty slot where it
+// belongs. Compare hashes first so that strcmp() is rarely called twice.
+LSymbol **LSymbol::Lookup(char const *name, uint32_t hash)
+{
+    size_t mask = table_size - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask)
     {
-        int cmp = strcmp(name, p->m_name->GetString());
-        if (cmp == 0)
-            return p;
-        p = (cmp < 0) ? p->m_left : p->m_right;
+        LSymbol *p = table[i];
+        if (!p || (p->m_hash == hash
+                    && !strcmp(name, p->m_name->GetString())))
+            return table + i;
     }
-    return NULL;
 }
 
-LSymbol *LSymbol::FindOrCreate(char const *name)
+void LSymbol::Grow()
 {
-    LSymbol *p = root;
-    LSymbol **parent = &root;
-    while (p)
+    free(table);
+    table_size = table_size ? table_size * 2 : 1024;
+    table = (LSymbol **)calloc(table_size, sizeof(LSymbol *));
+
+    size_t mask = table_size - 1;
+    for (LSymbol *p = first; p; p = p->m_next)
     {
-        int cmp = strcmp(name, p->m_name->GetString());
-        if (cmp == 0)
-            return p;
-        parent = (cmp < 0) ? &p->m_left : &p->m_right;
-        p = *parent;
+        size_t i = p->m_hash & mask;
+        while (table[i])
+            i = (i + 1) & mask;
+        table[i] = p;
     }
+}
+
+LSymbol *LSymbol::Find(char const *name)
+{
+    if (!table)
+        return NULL;
+    return *Lookup(name, Hash(name));
+}
+
+LSymbol *LSymbol::FindOrCreate(char const *name)
+{
+    if ((count + 1) * 2 > table_size)
+        Grow();
+
+    uint32_t hash = Hash(name);
+    LSymbol **slot = Lookup(name, hash);
+    if (*slot)
+        return *slot;
 
     // Make sure all symbols get defined in permanant space
     LSpace *sp = LSpace::Current;
@@ -813,32 +921,42 @@ LSymbol *LSymbol::FindOrCreate(char const *name)
         LSpace::Current = &LSpace::Perm;
 
     // These permanent objects cannot be GCed, so malloc() them
-    p = (LSymbol *)malloc(sizeof(LSymbol));
+    LSymbol *p = (LSymbol *)malloc(sizeof(LSymbol));
     p->m_type = L_SYMBOL;
     p->m_name = LString::Create(name);
 
     // If constant, set the value to ourself
     p->m_value = (name[0] == ':') ? p : l_undefined;
     p->m_function = l_undefined;
-#ifdef L_PROFILE
-    p->time_taken = 0;
-#endif
-    p->m_left = p->m_right = NULL;
-    *parent = p;
+    p->m_prof = NULL;
+    p->m_hash = hash;
+    p->m_next = NULL;
+    if (last)
+        last->m_next = p;
+    else
+        first = p;
+    last = p;
+    *slot = p;
     count++;
 
     LSpace::Current = sp;
     return p;
 }
 
-static void DeleteAllSymbols(LSymbol *root)
+void LSymbol::DeleteAll()
 {
-    if (root)
+    while (first)
     {
-        DeleteAllSymbols(root->m_left);
-        DeleteAllSymbols(root->m_right);
-        free(root);
+        LSymbol *p = first;
+        first = p->m_next;
+        free(p);
     }
+    last = NULL;
+    count = 0;
+
+    free(table);
+    table = NULL;
+    table_size = 0;
 }
 
 LList *LList::Assoc(LObject *item)
@@ -978,6 +1096,59 @@ LSymbol *add_c_bool_fun(char const *name, short min_args, short max_args, short
   return s;
 }
 
+int lisp_natives = 1;
+int lisp_generations = 1;
+LNative LNative::table[LNative::MAX_NATIVES];
+
+void LNative::Register(int number, char const *types, LNativeFun fun)
+{
+    int n = strlen(types);
+    if (number < 0 || number >= MAX_NATIVES || n > MAX_NATIVE_ARGS)
+    {
+        lbreak("native function %d cannot be registered\n", number);
+        exit(0);
+    }
+    table[number].m_fun = fun;
+    table[number].m_types = types;
+    table[number].m_nargs = n;
+}
+
+long LNative::Call(void *arg_list) const
+{
+    LArg args[MAX_NATIVE_ARGS];
+    int n = 0;
+    for (; arg_list; arg_list = CDR(arg_list), n++)
+    {
+        if (n == m_nargs)
+            BadArgs(n + 1);
+        Unpack(CAR(arg_list), n, args);
+    }
+    if (n != m_nargs)
+        BadArgs(n);
+    return m_fun(args);
+}
+
+void LNative::BadArgs(int n) const
+{
+    lbreak("C function %d takes %d arguments, not %d\n",
+           (int)(this - table), m_nargs, n);
+    exit(0);
+}
+
+LSymbol *add_c_native(char const *name, short number, char const *types,
+                      LNativeFun fun)
+{
+    LNative::Register(number, types, fun);
+    return add_c_function(name, strlen(types), strlen(types), number);
+}
+
+LSymbol *add_c_bool_native(char const *name, short number, char const *types,
+                           LNativeFun fun)
+{
+    LNative::Register(number, types, fun);
+    return add_c_bool_fun(name, strlen(types), strlen(types), number);
+}
+
 
 LSymbol *add_lisp_function(char const *name, short min_args, short max_args, short number)
 {
@@ -1442,25 +1613,57 @@ LObject *LSymbol::EvalFunction(void *arg_list)
     }
 #endif
 
-#ifdef L_PROFILE
-    time_marker start;
-#endif
-
     LObject *ret = NULL;
 
     switch (t)
     {
     case L_SYS_FUNCTION:
+    {
+        LProfScope prof(this);
         ret = ((LSysFunction *)fun)->EvalFunction((LList *)arg_list);
         break;
+    }
     case L_L_FUNCTION:
+    {
+        LProfScope prof(this);
         ret = (LObject *)l_caller(((LSysFunction *)fun)->fun_number, arg_list);
         break;
+    }
     case L_USER_FUNCTION:
         return EvalUserFunction((LList *)arg_list);
     case L_C_FUNCTION:
     case L_C_BOOL:
     {
+        LNative const *nat = lisp_natives
+            ? LNative::Find(((LSysFunction *)fun)->fun_number) : NULL;
+        if (nat)
+        {
+            // Evaluating an argument may collect and move Lisp objects, so
+            // each value is unpacked to plain C data (a number, or the
+            // address an LPointer holds) at once, before the next one is
+            // evaluated; arg_list itself is kept current by ref3
+            LArg args[MAX_NATIVE_ARGS];
+            int n = 0;
+            for (; arg_list; arg_list = lcdr(arg_list), n++)
+            {
+                if (n == nat->m_nargs)
+                    nat->BadArgs(n + 1);
+                nat->Unpack(CAR(arg_list)->Eval(), n, args);
+            }
+            if (n != nat->m_nargs)
+                nat->BadArgs(n);
+            long r;
+            {
+                LProfScope prof(this);
+                r = nat->m_fun(args);
+            }
+            if (t == L_C_FUNCTION)
+                ret = LNumber::Create(r);
+            else
+                ret = r ? true_symbol : NULL;
+            break;
+        }
+
         LList *first = NULL, *cur = NULL;
         PtrRef r1(first), r2(cur), r3(arg_list);
         while (arg_list)
@@ -1476,49 +1679,25 @@ LObject *LSymbol::EvalFunction(void *arg_list)
             ((LList *)cur)->m_car = val;
             arg_list = lcdr(arg_list);
         }
+        long r;
+        {
+            // Time the function itself, as the bytecode calls do
+            LProfScope prof(this);
+            r = c_caller(((LSysFunction *)fun)->fun_number, first);
+        }
         if (t == L_C_FUNCTION)
-            ret = LNumber::Create(c_caller(((LSysFunction *)fun)->fun_number, first));
-        else if (c_caller(((LSysFunction *)fun)->fun_number, first))
-            ret = true_symbol;
+            ret = LNumber::Create(r);
         else
-            ret = NULL;
+            ret = r ? true_symbol : NULL;
         break;
     }
     default:
         fprintf(stderr, "not a fun, shouldn't happen\n");
     }
 
-#ifdef L_PROFILE
-    time_marker end;
-    time_taken += end.diff_time(&start);
-#endif
-
     return ret;
 }
 
-#ifdef L_PROFILE
-void pro_print(bFILE *out, LSymbol *p)
-{
-  if (p)
-  {
-    pro_print(out, p->m_right);
-    {
-      char st[100];
-      sprintf(st, "%20s %f\n", lstring_value(p->GetName()), p->time_taken);
-      out->write(st, strlen(st));
-    }
-    pro_print(out, p->m_left);
-  }
-}
-
-void preport(char *fn)
-{
-  bFILE *fp=open_file("preport.out", "wb");
-  pro_print(fp, LSymbol::root);
-  delete fp;
-}
-#endif
-
 void *mapcar(void *arg_list)
 {
   PtrRef ref1(arg_list);
@@ -1921,25 +2100,10 @@ LObject *LSysFunction::EvalFunction(LList *arg_list)
         PtrRef r1(set_to), r2(i);
         i = CAR(arg_list);
 
-        ltype x = item_type(set_to);
         switch (item_type(i))
         {
         case L_SYMBOL:
-            switch (item_type(((LSymbol *)i)->m_value))
-            {
-            case L_NUMBER:
-                if (x == L_NUMBER && ((LSymbol *)i)->m_value != l_undefined)
-                    ((LSymbol *)i)->SetNumber(lnumber_value(set_to));
-                else
-                    ((LSymbol *)i)->SetValue((LNumber *)set_to);
-                break;
-            case L_OBJECT_VAR:
-                l_obj_set(((LObjectVar *)(((LSymbol *)i)->m_value))->m_index, set_to);
-                break;
-            default:
-                ((LSymbol *)i)->SetValue((LObject *)set_to);
-            }
-            ret = ((LSymbol *)i)->m_value;
+            ret = ((LSymbol *)i)->Setq(set_to);
             break;
         case L_CONS_CELL:   // this better be an 'aref'
         {
@@ -1955,6 +2119,8 @@ LObject *LSysFunction::EvalFunction(LList *arg_list)
                     exit(0);
                 }
                 ((LList *)car)->m_car = set_to;
+                LTmpScope::Escape(car, set_to);
+                Lisp::Store(car, set_to);
             }
             else if (car == cdr_symbol)
             {
@@ -1966,6 +2132,8 @@ LObject *LSysFunction::EvalFunction(LList *arg_list)
                     exit(0);
                 }
                 ((LList *)car)->m_cdr = set_to;
+                LTmpScope::Escape(car, set_to);
+                Lisp::Store(car, set_to);
             }
             else if (car != aref_symbol)
             {
@@ -1994,6 +2162,8 @@ LObject *LSysFunction::EvalFunction(LList *arg_list)
                 }
 #endif
                 a->GetData()[num] = set_to;
+                LTmpScope::Escape(a, set_to);
+                Lisp::Store(a, set_to);
 #ifdef TYPE_CHECKING
             }
 #endif
@@ -2393,11 +2563,11 @@ LObject *LSysFunction::EvalFunction(LList *arg_list)
                 if (stat_man)
                     stat_man->update((cs - s) * 100 / l);
 #endif
-                void *m = LSpace::Tmp.Mark();
+                LTmpScope scope;
                 compiled_form = LObject::Compile(cs);
                 compiled_form->Eval();
                 compiled_form = NULL;
-                LSpace::Tmp.Restore(m);
+                scope.End();
             }
 #ifndef NO_LIBS
             if (stat_man)
@@ -2527,23 +2697,13 @@ LObject *LSysFunction::EvalFunction(LList *arg_list)
         ret = LNumber::Create(x % y);
         break;
     }
-#if 0
     case SYS_FUNC_WRITE_PROFILE:
     {
         char *fn = lstring_value(CAR(arg_list)->Eval());
-        FILE *fp = fopen(fn, "wb");
-        if (!fp)
+        if (!LProfiler::WriteFolded(fn))
             lbreak("could not open %s for writing", fn);
-        else
-        {
-            for (void *s = symbol_list; s; s = CDR(s))
-                fprintf(fp, "%8d  %s\n", ((LSymbol *)(CAR(s)))->call_counter,
-                        lstring_value(((LSymbol *)(CAR(s)))->m_name));
-            fclose(fp);
-        }
         break;
     }
-#endif
     case SYS_FUNC_FOR:
     {
         LSymbol *bind_var = (LSymbol *)CAR(arg_list);
@@ -2692,10 +2852,9 @@ LObject *LSysFunction::EvalFunction(LList *arg_list)
     }
     case SYS_FUNC_PREPORT:
     {
-#ifdef L_PROFILE
-        char *s = lstring_value(CAR(arg_list)->Eval());
-        preport(s);
-#endif
+        char *fn = lstring_value(CAR(arg_list)->Eval());
+        if (!LProfiler::WriteReport(fn))
+            lbreak("could not open %s for writing", fn);
         break;
     }
     case SYS_FUNC_SEARCH:
@@ -2858,6 +3017,7 @@ LObject *LSysFunction::EvalFunction(LList *arg_list)
             }
             LObject *tmp = CAR(arg_list)->Eval();
             ((LList *)l1)->m_cdr = tmp;
+            Lisp::Store(l1, tmp);
             arg_list = (LList *)CDR(arg_list);
         } while (arg_list);
         ret = first;
@@ -2923,6 +3083,7 @@ LObject *LSysFunction::EvalFunction(LList *arg_list)
             while (r && CDR(r))
                 r = CDR(r);
             CDR(r) = q;
+            Lisp::Store(r, q);
             arg_list = (LList *)CDR(arg_list);
         }
         ret = rstart;
@@ -2960,11 +3121,8 @@ LObject *LSymbol::EvalUserFunction(LList *arg_list)
         exit(0);
     }
 #endif
-#ifdef L_PROFILE
-    time_marker start;
-#endif
-
     LUserFunction *fun = (LUserFunction *)m_function;
+    PtrRef r11(fun);
 
 #ifdef TYPE_CHECKING
     if (item_type(fun) != L_USER_FUNCTION)
@@ -2975,8 +3133,7 @@ LObject *LSymbol::EvalUserFunction(LList *arg_list)
 #endif
 
     LList *fun_arg_list = fun->arg_list;
-    LList *block_list = fun->block_list;
-    PtrRef r9(block_list), r10(fun_arg_list);
+    PtrRef r10(fun_arg_list);
 
     // mark the start start, so we can restore when done
     long stack_start = l_user_stack.m_size;
@@ -3024,10 +3181,9 @@ LObject *LSymbol::EvalUserFunction(LList *arg_list)
     }
 
     // now evaluate the function block
-    while (block_list)
     {
-        ret = CAR(block_list)->Eval();
-        block_list = (LList *)CDR(block_list);
+        LProfScope prof(this);
+        ret = LBytecode::Run(fun);
     }
 
     long cur_stack = stack_start;
@@ -3036,11 +3192,6 @@ LObject *LSymbol::EvalUserFunction(LList *arg_list)
 
     l_user_stack.m_size = stack_start;
 
-#ifdef L_PROFILE
-    time_marker end;
-    sym->time_taken += end.diff_time(&start);
-#endif
-
     return ret;
 }
 
@@ -3123,19 +3274,27 @@ LObject *LObject::Eval()
 
 void Lisp::Init()
 {
-    LSymbol::root = NULL;
+    LSymbol::first = LSymbol::last = NULL;
     total_user_functions = 0;
 
     LSpace::Tmp.m_free = LSpace::Tmp.m_data = (uint8_t *)malloc(0x1000);
+    LSpace::Tmp.m_old = LSpace::Tmp.m_young = LSpace::Tmp.m_data;
     LSpace::Tmp.m_size = 0x1000;
     LSpace::Tmp.m_name = "temporary space";
 
+    // All nursery until the first collection lays out the generations
     LSpace::Perm.m_free = LSpace::Perm.m_data = (uint8_t *)malloc(0x1000);
+    LSpace::Perm.m_old = LSpace::Perm.m_young = LSpace::Perm.m_data;
     LSpace::Perm.m_size = 0x1000;
     LSpace::Perm.m_name = "permanent space";
 
     LSpace::Gc.m_name = "garbage space";
 
+    memset(&LSpace::Tmp.m_stats, 0, sizeof(LGcStats));
+    memset(&LSpace::Perm.m_stats, 0, sizeof(LGcStats));
+    memset(&LSpace::Tmp.m_minor, 0, sizeof(LGcStats));
+    memset(&LSpace::Perm.m_minor, 0, sizeof(LGcStats));
+
     LSpace::Current = &LSpace::Perm;
 
     InitConstants();
@@ -3152,15 +3311,301 @@ void Lisp::Init()
 
 void Lisp::Uninit()
 {
+    LProfiler::Uninit();
+    LBytecode::Uninit();
     free(LSpace::Tmp.m_data);
     free(LSpace::Perm.m_data);
-    DeleteAllSymbols(LSymbol::root);
-    LSymbol::root = NULL;
-    LSymbol::count = 0;
+    LSymbol::DeleteAll();
+}
+
+// Two slots per symbol, in creation order: its value, then a copy of it
+// if it is a number or an array. Symbols created later keep their values.
+LArray *Lisp::SaveGlobals()
+{
+    LSpace *sp = LSpace::Current;
+    LSpace::Current = &LSpace::Perm;
+
+    LArray *saved = LArray::Create(LSymbol::count * 2, NULL);
+    PtrRef r1(saved);
+    size_t i = 0;
+    for (LSymbol *p = LSymbol::first; p && i < saved->m_len; p = p->m_next)
+    {
+        LObject *copy = NULL;
+        if (item_type(p->m_value) == L_NUMBER)
+            copy = LNumber::Create(((LNumber *)p->m_value)->m_num);
+        else if (item_type(p->m_value) == L_1D_ARRAY)
+        {
+            size_t len = ((LArray *)p->m_value)->m_len;
+            copy = LArray::Create(len, NULL);
+            // the array may have moved while allocating its copy
+            memcpy(((LArray *)copy)->GetData(),
+                   ((LArray *)p->m_value)->GetData(), len * sizeof(LObject *));
+        }
+        saved->GetData()[i++] = p->m_value;
+        saved->GetData()[i++] = copy;
+    }
+
+    LSpace::Current = sp;
+    return saved;
+}
+
+void Lisp::RestoreGlobals(LArray *saved)
+{
+    LObject **data = saved->GetData();
+    size_t i = 0;
+    for (LSymbol *p = LSymbol::first; p && i < saved->m_len; p = p->m_next)
+    {
+        LObject *value = data[i++], *copy = data[i++];
+        p->m_value = value;
+        if (item_type(copy) == L_NUMBER)
+            ((LNumber *)value)->m_num = ((LNumber *)copy)->m_num;
+        else if (item_type(copy) == L_1D_ARRAY
+                  && ((LArray *)value)->m_len == ((LArray *)copy)->m_len)
+        {
+            memcpy(((LArray *)value)->GetData(), ((LArray *)copy)->GetData(),
+                   ((LArray *)copy)->m_len * sizeof(LObject *));
+            Lisp::Remember(value);
+        }
+    }
+}
+
+// Values deeper than this, or longer lists, are not worth writing out
+#define GLOBALS_MAX_DEPTH 32
+#define GLOBALS_MAX_LENGTH 65536
+
+// Whether WriteGlobal() can write x so that ReadGlobal() gives it back
+static bool Storable(LObject *x, int depth)
+{
+    if (!x)
+        return true;
+    if (depth > GLOBALS_MAX_DEPTH)
+        return false;
+
+    switch (item_type(x))
+    {
+    case L_NUMBER:
+    case L_CHARACTER:
+    case L_STRING:
+    case L_FIXED_POINT:
+        return true;
+    case L_SYMBOL:
+        // Symbols are written by name, which only finds interned ones
+        return LSymbol::Find(lstring_value(((LSymbol *)x)->GetName())) == x;
+    case L_CONS_CELL:
+        {
+            size_t count = 0;
+            for (; x && item_type(x) == L_CONS_CELL; x = CDR(x))
+                if (++count > GLOBALS_MAX_LENGTH
+                     || !Storable(CAR(x), depth + 1))
+                    return false;
+            return Storable(x, depth + 1);
+        }
+    case L_1D_ARRAY:
+        {
+            LArray *a = (LArray *)x;
+            if (a->m_len > GLOBALS_MAX_LENGTH)
+                return false;
+            for (size_t i = 0; i < a->m_len; i++)
+                if (!Storable(a->GetData()[i], depth + 1))
+                    return false;
+            return true;
+        }
+    }
+    return false;
+}
+
+// The type, then what makes up the value; NULL is an empty list and a
+// list with something else than NULL at its end has a negative length
+static void WriteGlobal(bFILE *fp, LObject *x)
+{
+    int type = item_type(x);
+    fp->write_uint8(type);
+
+    switch (type)
+    {
+    case L_NUMBER:
+        fp->write_uint32(((LNumber *)x)->m_num);
+        break;
+    case L_CHARACTER:
+        fp->write_uint16(((LChar *)x)->GetValue());
+        break;
+    case L_FIXED_POINT:
+        fp->write_uint32(((LFixedPoint *)x)->m_fixed);
+        break;
+    case L_STRING:
+    case L_SYMBOL:
+        {
+            char const *s = type == L_STRING ? lstring_value(x)
+                          : lstring_value(((LSymbol *)x)->GetName());
+            uint32_t len = strlen(s);
+            fp->write_uint32(len);
+            fp->write(s, len);
+        }
+        break;
+    case L_CONS_CELL:
+        {
+            int32_t count = 0;
+            LObject *b = x;
+            for (; b && item_type(b) == L_CONS_CELL; b = CDR(b))
+                count++;
+            fp->write_uint32(b ? -count : count);
+            for (b = x; b && item_type(b) == L_CONS_CELL; b = CDR(b))
+                WriteGlobal(fp, CAR(b));
+            if (b)
+                WriteGlobal(fp, b);
+        }
+        break;
+    case L_1D_ARRAY:
+        {
+            LArray *a = (LArray *)x;
+            fp->write_uint32(a->m_len);
+            for (size_t i = 0; i < a->m_len; i++)
+                WriteGlobal(fp, a->GetData()[i]);
+        }
+        break;
+    }
+}
+
+// Allocates, so what is read is held by the caller's PtrRefs as it goes
+static LObject *ReadGlobal(bFILE *fp, int depth, bool &ok)
+{
+    uint8_t type;
+    if (!ok || depth > GLOBALS_MAX_DEPTH || fp->read(&type, 1) != 1)
+    {
+        ok = false;
+        return NULL;
+    }
+
+    switch (type)
+    {
+    case L_NUMBER:
+        return LNumber::Create((int32_t)fp->read_uint32());
+    case L_CHARACTER:
+        return LChar::Create(fp->read_uint16());
+    case L_FIXED_POINT:
+        return LFixedPoint::Create(fp->read_uint32());
+    case L_STRING:
+    case L_SYMBOL:
+        {
+            uint32_t len = fp->read_uint32();
+            if (len > (uint32_t)fp->file_size())
+                break;
+            char *s = (char *)malloc(len + 1);
+            ok = fp->read(s, len) == (int)len;
+            s[len] = 0;
+            LObject *ret = NULL;
+            if (ok)
+                ret = type == L_STRING ? (LObject *)LString::Create(s)
+                                       : (LObject *)LSymbol::FindOrCreate(s);
+            free(s);
+            return ret;
+        }
+    case L_CONS_CELL:
+        {
+            int32_t count = (int32_t)fp->read_uint32();
+            if (count < -GLOBALS_MAX_LENGTH || count > GLOBALS_MAX_LENGTH)
+                break;
+            LList *first = NULL, *last = NULL;
+            PtrRef r1(first), r2(last);
+            for (int32_t i = 0; ok && i < abs(count); i++)
+            {
+                LList *c = LList::Create();
+                if (last)
+                    last->m_cdr = c;
+                else
+                    first = c;
+                last = c;
+                LObject *car = ReadGlobal(fp, depth + 1, ok);
+                last->m_car = car;
+            }
+            if (ok && count < 0)
+            {
+                LObject *cdr = ReadGlobal(fp, depth + 1, ok);
+                last->m_cdr = cdr;
+            }
+            return first;
+        }
+    case L_1D_ARRAY:
+        {
+            uint32_t len = fp->read_uint32();
+            if (len > GLOBALS_MAX_LENGTH)
+                break;
+            LArray *a = LArray::Create(len, NULL);
+            PtrRef r1(a);
+            for (uint32_t i = 0; ok && i < len; i++)
+            {
+                LObject *x = ReadGlobal(fp, depth + 1, ok);
+                a->GetData()[i] = x;
+            }
+            return a;
+        }
+    }
+
+    ok = false;
+    return NULL;
+}
+
+// The number of symbols, then the value of each in creation order, or
+// L_BAD_CELL for those whose value is not written
+void Lisp::WriteGlobals(bFILE *fp)
+{
+    fp->write_uint32(LSymbol::count);
+    for (LSymbol *p = LSymbol::first; p; p = p->m_next)
+    {
+        if (Storable(p->m_value, 0))
+            WriteGlobal(fp, p->m_value);
+        else
+            fp->write_uint8(L_BAD_CELL);
+    }
+}
+
+int Lisp::ReadGlobals(bFILE *fp)
+{
+    LSpace *sp = LSpace::Current;
+    LSpace::Current = &LSpace::Perm;
+
+    uint32_t count = fp->read_uint32();
+    bool ok = true;
+    LSymbol *p = LSymbol::first;
+    for (uint32_t i = 0; ok && p && i < count; i++, p = p->m_next)
+    {
+        uint8_t type;
+        if (fp->read(&type, 1) != 1)
+            ok = false;
+        else if (type != L_BAD_CELL)
+        {
+            fp->seek(-1, SEEK_CUR);
+            LObject *value = ReadGlobal(fp, 0, ok);
+            if (!ok)
+                break;
+
+            // Numbers and arrays change in place, so the same ones are
+            // kept in case something else refers to them
+            LObject *old = p->m_value;
+            if (item_type(value) == L_NUMBER && item_type(old) == L_NUMBER)
+                ((LNumber *)old)->m_num = ((LNumber *)value)->m_num;
+            else if (item_type(value) == L_1D_ARRAY
+                      && item_type(old) == L_1D_ARRAY
+                      && ((LArray *)old)->m_len == ((LArray *)value)->m_len)
+            {
+                memcpy(((LArray *)old)->GetData(),
+                       ((LArray *)value)->GetData(),
+                       ((LArray *)old)->m_len * sizeof(LObject *));
+                Lisp::Remember(old);
+            }
+            else
+                p->m_value = value;
+        }
+    }
+
+    LSpace::Current = sp;
+    return ok;
 }
 
 void LSpace::Clear()
 {
+    if (this == &LSpace::Tmp)
+        LTmpScope::Flush();
     m_free = m_data;
 }
 
@@ -3206,6 +3651,33 @@ void LSymbol::SetValue(LObject *val)
     m_value = val;
 }
 
+/* Assign like setq does: numbers are updated in place and object
+ * variables are forwarded to the current object. */
+LObject *LSymbol::Setq(LObject *value)
+{
+    PtrRef r1(value);
+
+    switch (item_type(m_value))
+    {
+    case L_NUMBER:
+        if (item_type(value) == L_NUMBER && m_value != l_undefined)
+            SetNumber(lnumber_value(value));
+        else
+        {
+            SetValue(value);
+            LTmpScope::Escape(this, value);
+        }
+        break;
+    case L_OBJECT_VAR:
+        l_obj_set(((LObjectVar *)m_value)->m_index, value);
+        break;
+    default:
+        SetValue(value);
+        LTmpScope::Escape(this, value);
+    }
+    return m_value;
+}
+
 LObject *LSymbol::GetFunction()
 {
 #ifdef TYPE_CHECKING
@@ -14,10 +14,6 @@
 #include <cstdlib>
 #include <stdint.h>
 
-#ifdef L_PROFILE
-#include "timing.h"
-#endif
-
 #define Cell void
 #define MAX_LISP_TOKEN_LEN 200
 
@@ -53,13 +49,29 @@ enum
 // FIXME: switch this to uint8_t one day? it still breaks stuff
 typedef uint8_t ltype;
 
+// Garbage collection statistics for one space
+struct LGcStats
+{
+    int count;               // number of collections
+    size_t collected;        // total bytes reclaimed
+    size_t live;             // bytes surviving the last collection
+    float total_ms, max_ms; // pause times
+    size_t allocated;        // total bytes handed out
+    size_t promoted;         // bytes copied here when LTmpScopes ended
+};
+
+// Permanent space is split in two generations: the old one at the start,
+// growing into the room left after it, and a nursery at the end, which is
+// where m_free allocates. Most of what is allocated there dies young, so
+// a minor collection only copies what survives in the nursery to the end
+// of the old generation, looking into the old one only where a store made
+// it point into the nursery. Other spaces, and permanent space with
+// -nogenerations, are all nursery and only collected whole.
 struct LSpace
 {
     size_t GetFree();
     void *Alloc(size_t size);
 
-    void *Mark();
-    void Restore(void *val);
     void Clear();
 
     static LSpace Tmp, Perm, Gc;
@@ -67,8 +79,12 @@ struct LSpace
 
     uint8_t *m_data;
     uint8_t *m_free;
+    uint8_t *m_old;   // end of the old generation
+    uint8_t *m_young; // start of the nursery
     char const *m_name;
     size_t m_size;
+    LGcStats m_stats;
+    LGcStats m_minor; // minor collections, promoted is what they kept
 };
 
 struct LObject
@@ -84,6 +100,56 @@ struct LObject
     ltype m_type;
 };
 
+// Checkpoint in temporary space around a call from C into Lisp, such as
+// an object's AI or draw function: what the call allocates there is
+// dropped when the scope ends. Values that setq stored into symbols, or
+// into conses and arrays from before the scope, would be left dangling, so
+// they are copied to permanent space first. Scopes must end in reverse
+// order of creation.
+class LTmpScope
+{
+public:
+    LTmpScope();
+    ~LTmpScope() { End(); }
+    void End();
+
+    // Called by setq after storing value into container
+    static inline void Escape(LObject *container, LObject *value)
+    {
+        uint8_t *data = LSpace::Tmp.m_data, *end = LSpace::Tmp.m_free;
+        if (current && (uint8_t *)value >= data && (uint8_t *)value < end
+             && ((uint8_t *)container < data + current->m_mark
+                  || (uint8_t *)container >= end)
+             && (!escape_count || escapes[escape_count - 1] != container))
+            Record(container, value);
+    }
+
+    // Temporary space was collected, so the marks no longer tell what was
+    // allocated before each scope
+    static void Collected();
+    // Temporary space is about to be cleared
+    static void Flush();
+
+private:
+    static void Record(LObject *container, LObject *value);
+
+    size_t m_mark;   // offsets rather than pointers, Tmp moves when collected
+    size_t m_bottom; // mark of the outermost scope
+    size_t m_first;  // escapes recorded before this scope
+    bool m_ended;
+    LTmpScope *m_outer;
+
+    static LTmpScope *current;
+    // Containers that may hold values from the scopes, seen by the GC
+    static LObject **escapes;
+    static size_t escape_count, escape_max;
+    // Some escaped values are older than every scope, so they are only
+    // promoted when Tmp is cleared
+    static bool pending;
+
+    friend class Lisp;
+};
+
 struct LObjectVar : LObject
 {
     /* Factories */
@@ -141,6 +207,7 @@ struct LSymbol : LObject
     /* Factories */
     static LSymbol *Find(char const *name);
     static LSymbol *FindOrCreate(char const *name);
+    static void DeleteAll();
 
     /* Methods */
     LObject *EvalFunction(void *arg_list);
@@ -153,19 +220,29 @@ struct LSymbol : LObject
     void SetFunction(LObject *fun);
     void SetValue(LObject *value);
     void SetNumber(long num);
+    LObject *Setq(LObject *value);
 
     /* Members */
-#ifdef L_PROFILE
-    float time_taken;
-#endif
     LObject *m_value;
     LObject *m_function;
     LString *m_name;
-    LSymbol *m_left, *m_right; // tree structure
+    struct LProfile *m_prof; // call statistics, see lisp_prof.h
+    uint32_t m_hash; // hash of the name, never changes
+    LSymbol *m_next; // next symbol in creation order
 
     /* Static members */
-    static LSymbol *root;
+    static LSymbol *first, *last; // all symbols, in creation order
     static size_t count;
+
+private:
+    static uint32_t Hash(char const *name);
+    static LSymbol **Lookup(char const *name, uint32_t hash);
+    static void Grow();
+
+    // Open addressing hash table with linear probing, never more than
+    // half full so that lookups stay short
+    static LSymbol **table;
+    static size_t table_size;
 };
 
 struct LSysFunction : LObject
@@ -181,6 +258,8 @@ struct LSysFunction : LObject
 struct LUserFunction : LObject
 {
     LList *arg_list, *block_list;
+    struct LArray *consts; // objects referenced by code, collected with us
+    struct LCode *code;    // compiled block_list, see lisp_vm.cpp
 };
 
 struct LArray : LObject
@@ -237,15 +316,58 @@ public:
 
     static void InitConstants();
 
-    // Collect temporary or permanent spaces
+    // Collect temporary or permanent spaces, only the nursery of
+    // permanent space when that is enough and grow is not set
     static void CollectSpace(LSpace *which_space, int grow);
+    // Minor collection of permanent space, false if it cannot be done
+    static bool CollectYoung();
+    // With dprintf, or whatever else a report is printed with
+    static void PrintGcStats(void (*print)(char const *format, ...));
+    // Time collections of a permanent space holding live data, for -gcbench
+    static void GcBench(int rounds, void (*print)(char const *format, ...));
+
+    // Copy what escapes points to from temporary space above start
+    static void Promote(uint8_t *start, LObject **escapes, size_t count);
+
+    // Keep the object *ptr points to, which no symbol or stack holds,
+    // alive and *ptr pointing to it across collections
+    static void Register(void **ptr);
+    static void Unregister(void **ptr);
+
+    // Write barrier, called after storing value into container: the next
+    // minor collection has to look into old objects pointing into the
+    // nursery. Objects filled in right after being allocated need none,
+    // nor do those the C stacks hold across a collection.
+    static inline void Store(LObject *container, LObject *value)
+    {
+        LSpace &p = LSpace::Perm;
+        if ((uint8_t *)value >= p.m_young && (uint8_t *)value < p.m_free
+             && (uint8_t *)container >= p.m_data
+             && (uint8_t *)container < p.m_old)
+            Remember(container);
+    }
+    // The same for an old container whose contents were copied wholesale
+    static void Remember(LObject *container);
+
+    // Copy the values of all symbols into permanent space, with the
+    // numbers and arrays among them since those change in place, and put
+    // such a copy back
+    static LArray *SaveGlobals();
+    static void RestoreGlobals(LArray *saved);
+    // The same in a file, for demos. Only values made of numbers,
+    // characters, strings, symbols, conses and arrays are written; the
+    // symbols holding anything else keep their values when read back
+    static void WriteGlobals(bFILE *fp);
+    static int ReadGlobals(bFILE *fp);
 
 private:
     static LArray *CollectArray(LArray *x);
     static LList *CollectList(LList *x);
     static LObject *CollectObject(LObject *x);
-    static void CollectSymbols(LSymbol *root);
+    static void CollectSymbols();
     static void CollectStacks();
+    static void CollectFields(LObject *x);
+    static void RememberStacks();
 };
 
 static inline LObject *&CAR(void *x) { return ((LList *)x)->m_car; }
@@ -287,10 +409,62 @@ void *eval_block(void *list);
 void resize_tmp(size_t new_size);
 void resize_perm(size_t new_size);
 
+// Argument of a native C function, unpacked from the evaluated Lisp object
+// according to its letter in the function's types: 'n' number, 'f' fixed
+// point, 'p' pointer
+union LArg
+{
+    long n;
+    void *p;
+};
+
+#define MAX_NATIVE_ARGS 8
+
+typedef long (*LNativeFun)(LArg const *args);
+
+// C function called straight from a flat table indexed by its number,
+// rather than through the c_caller() switch, with its arguments in an
+// array instead of a freshly consed list
+struct LNative
+{
+    static inline LNative const *Find(int number)
+    {
+        return (unsigned)number < MAX_NATIVES && table[number].m_fun
+                ? &table[number] : NULL;
+    }
+    static void Register(int number, char const *types, LNativeFun fun);
+
+    inline void Unpack(LObject *arg, int i, LArg *args) const
+    {
+        switch (m_types[i])
+        {
+        case 'n': args[i].n = lnumber_value(arg); break;
+        case 'f': args[i].n = lfixed_point_value(arg); break;
+        default: args[i].p = lpointer_value(arg); break;
+        }
+    }
+    long Call(void *arg_list) const; // already evaluated, for c_caller()
+    void BadArgs(int n) const;
+
+    LNativeFun m_fun;
+    char const *m_types;
+    int m_nargs;
+
+    enum { MAX_NATIVES = 1024 };
+    static LNative table[MAX_NATIVES];
+};
+
+// Set to 0 (-nonatives) to call every C function through c_caller()
+extern int lisp_natives;
+// Set to 0 (-nogenerations) to always collect permanent space whole
+extern int lisp_generations;
+
 void push_onto_list(void *object, void *&list);
 LSymbol *add_c_object(void *symbol, int index);
 LSymbol *add_c_function(char const *name, short min_args, short max_args, short number);
 LSymbol *add_c_bool_fun(char const *name, short min_args, short max_args, short number);
+LSymbol *add_c_native(char const *name, short number, char const *types, LNativeFun fun);
+LSymbol *add_c_bool_native(char const *name, short number, char const *types, LNativeFun fun);
 LSymbol *add_lisp_function(char const *name, short min_args, short max_args, short number);
 int read_ltoken(char *&s, char *buffer);
 void print_trace_stack(int max_levels);
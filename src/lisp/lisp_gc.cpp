@@ -19,6 +19,8 @@
 
 #include "lisp.h"
 #include "lisp_gc.h"
+#include "dprint.h"
+#include "timing.h"
 
 #include "stack.h"
 
@@ -31,8 +33,9 @@
       stack
 */
 
-// Stack where user programs can push data and have it GCed
-GrowStack<void> l_user_stack(150);
+// Stack where user programs can push data and have it GCed. The bytecode
+// interpreter also keeps its operands here, hence the size.
+GrowStack<void> l_user_stack(1024);
 
 // Stack of user pointers
 GrowStack<void *> PtrRef::stack(1500);
@@ -43,6 +46,17 @@ static void ***reg_ptr_list = NULL;
 static uint8_t *cstart, *cend, *collected_start, *collected_end;
 static int gcdepth, maxgcdepth;
 
+// The old generation, which a minor collection leaves where it is
+static uint8_t *old_start, *old_end;
+
+// Old objects of permanent space that may point into its nursery
+static LObject **remembered = NULL;
+static size_t remembered_count = 0, remembered_max = 0;
+
+// Collections that are only worth a minor one leave this much room to
+// allocate in permanent space, which bounds how much each one copies
+#define NURSERY_SIZE 0x10000
+
 LArray *Lisp::CollectArray(LArray *x)
 {
     size_t s = x->m_len;
@@ -59,7 +73,10 @@ LList *Lisp::CollectList(LList *x)
 {
     LList *prev = NULL, *first = NULL;
 
-    for (; x && item_type(x) == L_CONS_CELL; )
+    // The tail may be in another space, or old when only the nursery is
+    // collected: that part is left to CollectObject()
+    for (; x && item_type(x) == L_CONS_CELL
+            && (uint8_t *)x >= cstart && (uint8_t *)x < cend; )
     {
         LList *p = LList::Create();
         LObject *old_car = x->m_car;
@@ -108,7 +125,11 @@ LObject *Lisp::CollectObject(LObject *x)
             LUserFunction *fun = (LUserFunction *)x;
             LList *arg = (LList *)CollectObject(fun->arg_list);
             LList *block = (LList *)CollectObject(fun->block_list);
-            ret = new_lisp_user_function(arg, block);
+            LArray *consts = (LArray *)CollectObject(fun->consts);
+            LUserFunction *copy = new_lisp_user_function(arg, block);
+            copy->consts = consts;
+            copy->code = fun->code;
+            ret = copy;
             break;
         }
         case L_STRING:
@@ -157,7 +178,8 @@ LObject *Lisp::CollectObject(LObject *x)
         ((LRedirect *)x)->m_type = L_COLLECTED_OBJECT;
         ((LRedirect *)x)->m_ref = ret;
     }
-    else if ((uint8_t *)x < collected_start || (uint8_t *)x >= collected_end)
+    else if (((uint8_t *)x < collected_start || (uint8_t *)x >= collected_end)
+              && ((uint8_t *)x < old_start || (uint8_t *)x >= old_end))
     {
         // Still need to remap cons_cells lying outside of space, for
         // instance on the stack.
@@ -177,16 +199,18 @@ LObject *Lisp::CollectObject(LObject *x)
     return ret;
 }
 
-void Lisp::CollectSymbols(LSymbol *root)
+void Lisp::CollectSymbols()
 {
-    if (!root)
-        return;
-
-    root->m_value = CollectObject(root->m_value);
-    root->m_function = CollectObject(root->m_function);
-    root->m_name = (LString *)CollectObject(root->m_name);
-    CollectSymbols(root->m_left);
-    CollectSymbols(root->m_right);
+    // Symbols are visited in creation order, not in the order of the old
+    // name tree, so survivors are laid out in a different order than they
+    // used to be. Nothing compares or hashes Lisp objects by address, so
+    // only the layout changes, not behaviour
+    for (LSymbol *p = LSymbol::first; p; p = p->m_next)
+    {
+        p->m_value = CollectObject(p->m_value);
+        p->m_function = CollectObject(p->m_function);
+        p->m_name = (LString *)CollectObject(p->m_name);
+    }
 }
 
 void Lisp::CollectStacks()
@@ -208,22 +232,182 @@ void Lisp::CollectStacks()
         void **ptr = *d3;
         *ptr = CollectObject((LObject *)*ptr);
     }
+
+    // Arrays outside the collected space are not looked into otherwise
+    LObject **d4 = LTmpScope::escapes;
+    for (size_t i = 0; i < LTmpScope::escape_count; i++, d4++)
+    {
+        if (item_type(*d4) == L_1D_ARRAY
+             && ((uint8_t *)*d4 < cstart || (uint8_t *)*d4 >= cend))
+        {
+            LObject **data = ((LArray *)*d4)->GetData();
+            for (size_t j = 0; j < ((LArray *)*d4)->m_len; j++)
+                data[j] = CollectObject(data[j]);
+        }
+        else
+            *d4 = CollectObject(*d4);
+    }
+}
+
+void Lisp::CollectFields(LObject *x)
+{
+    switch (item_type(x))
+    {
+    case L_SYMBOL:
+        ((LSymbol *)x)->m_value = CollectObject(((LSymbol *)x)->m_value);
+        break;
+    case L_CONS_CELL:
+        ((LList *)x)->m_car = CollectObject(((LList *)x)->m_car);
+        ((LList *)x)->m_cdr = CollectObject(((LList *)x)->m_cdr);
+        break;
+    case L_1D_ARRAY:
+    {
+        LObject **data = ((LArray *)x)->GetData();
+        for (size_t j = 0; j < ((LArray *)x)->m_len; j++)
+            data[j] = CollectObject(data[j]);
+        break;
+    }
+    case L_USER_FUNCTION:
+    {
+        LUserFunction *fun = (LUserFunction *)x;
+        fun->arg_list = (LList *)CollectObject(fun->arg_list);
+        fun->block_list = (LList *)CollectObject(fun->block_list);
+        fun->consts = (LArray *)CollectObject(fun->consts);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void Lisp::Remember(LObject *container)
+{
+    if ((uint8_t *)container < LSpace::Perm.m_data
+         || (uint8_t *)container >= LSpace::Perm.m_old
+         || (remembered_count && remembered[remembered_count - 1] == container))
+        return;
+    if (remembered_count == remembered_max)
+    {
+        remembered_max = remembered_max ? remembered_max * 2 : 256;
+        remembered = (LObject **)realloc(remembered,
+                                         sizeof(LObject *) * remembered_max);
+    }
+    remembered[remembered_count++] = container;
+}
+
+// C code holding an object across a collection may still be filling it
+// in, without a write barrier, so whatever the stacks point to that is now
+// old is looked into by the next minor collection
+void Lisp::RememberStacks()
+{
+    remembered_count = 0;
+    if (LSpace::Perm.m_young == LSpace::Perm.m_data)
+        return;
+
+    for (size_t i = 0; i < l_user_stack.m_size; i++)
+        Remember((LObject *)l_user_stack.sdata[i]);
+    for (size_t i = 0; i < PtrRef::stack.m_size; i++)
+        Remember((LObject *)*PtrRef::stack.sdata[i]);
+    for (size_t i = 0; i < reg_ptr_total; i++)
+        Remember((LObject *)*reg_ptr_list[i]);
+}
+
+bool Lisp::CollectYoung()
+{
+    LSpace &perm = LSpace::Perm;
+    size_t used = perm.m_free - perm.m_young;
+
+    // Copies are never larger than the originals, so the survivors fit
+    // after the old generation if there is that much room left
+    if (!lisp_generations || perm.m_young == perm.m_data
+         || (size_t)(perm.m_young - perm.m_old) < used)
+        return false;
+
+    LSpace *sp = LSpace::Current;
+
+    maxgcdepth = gcdepth = 0;
+
+    time_marker start;
+
+    cstart = perm.m_young;
+    cend = perm.m_free;
+    old_start = perm.m_data;
+    old_end = perm.m_old;
+    collected_start = perm.m_old;
+    collected_end = perm.m_young;
+
+    LSpace::Current = &LSpace::Gc;
+    LSpace::Gc.m_free = LSpace::Gc.m_data = perm.m_old;
+    LSpace::Gc.m_size = perm.m_young - perm.m_old;
+
+    CollectSymbols();
+    CollectStacks();
+    for (size_t i = 0; i < remembered_count; i++)
+        CollectFields(remembered[i]);
+
+    size_t live = LSpace::Gc.m_free - perm.m_old;
+    perm.m_old = LSpace::Gc.m_free;
+    perm.m_free = perm.m_young;
+    old_start = old_end = NULL;
+    RememberStacks();
+
+    LGcStats &stats = perm.m_minor;
+    time_marker end;
+    float ms = (float)(end.diff_time(&start) * 1000.0);
+    stats.count++;
+    stats.collected += used - live;
+    stats.live = live;
+    stats.promoted += live;
+    stats.total_ms += ms;
+    stats.max_ms = Max(stats.max_ms, ms);
+
+    LSpace::Current = sp;
+    return true;
 }
 
 void Lisp::CollectSpace(LSpace *which_space, int grow)
 {
+    if (which_space == &LSpace::Perm && !grow && CollectYoung())
+        return;
+
     LSpace *sp = LSpace::Current;
+    bool generations = which_space == &LSpace::Perm && lisp_generations;
+    size_t nursery = which_space->m_data + which_space->m_size
+                      - which_space->m_young;
+    size_t used = (which_space->m_old - which_space->m_data)
+                   + (which_space->m_free - which_space->m_young);
 
     maxgcdepth = gcdepth = 0;
 
+    time_marker start;
+
     cstart = which_space->m_data;
     cend = which_space->m_free;
-    LSpace::Gc.m_size = which_space->m_size;
-    if (grow)
+
+    if (generations)
+    {
+        // Everything in use, garbage included, could survive. Leave at
+        // least as much room again for what minor collections promote,
+        // then the nursery, so that the space shrinks back when less of
+        // it is in use
+        nursery = Max(grow ? nursery * 2 : nursery, (size_t)NURSERY_SIZE);
+        size_t room = Max(used, nursery);
+        if (grow)
+            room += room >> 1;
+        LSpace::Gc.m_size = used + room + nursery;
+    }
+    else
     {
-        LSpace::Gc.m_size += which_space->m_size >> 1;
-        LSpace::Gc.m_size -= (LSpace::Gc.m_size & 7);
+        // What survived the last collection is a good estimate of what
+        // will survive this one. Keep at least as much room again,
+        // otherwise a space full of long-lived data gets collected again
+        // after every few allocations.
+        LSpace::Gc.m_size = Max(which_space->m_size,
+                                which_space->m_stats.live * 2);
+        if (grow)
+            LSpace::Gc.m_size += LSpace::Gc.m_size >> 1;
     }
+    LSpace::Gc.m_size -= (LSpace::Gc.m_size & 7);
     uint8_t *new_data = (uint8_t *)malloc(LSpace::Gc.m_size);
     LSpace::Current = &LSpace::Gc;
     LSpace::Gc.m_free = LSpace::Gc.m_data = new_data;
@@ -231,14 +415,231 @@ void Lisp::CollectSpace(LSpace *which_space, int grow)
     collected_start = new_data;
     collected_end = new_data + LSpace::Gc.m_size;
 
-    CollectSymbols(LSymbol::root);
+    CollectSymbols();
     CollectStacks();
 
     free(which_space->m_data);
     which_space->m_data = new_data;
     which_space->m_size = LSpace::Gc.m_size;
-    which_space->m_free = new_data + (LSpace::Gc.m_free - LSpace::Gc.m_data);
+    which_space->m_old = LSpace::Gc.m_free;
+    if (generations)
+    {
+        // Everything that survived is old
+        which_space->m_young = new_data + LSpace::Gc.m_size - nursery;
+        which_space->m_free = which_space->m_young;
+    }
+    else
+    {
+        which_space->m_young = which_space->m_old = new_data;
+        which_space->m_free = LSpace::Gc.m_free;
+    }
+
+    LGcStats &stats = which_space->m_stats;
+    size_t live = LSpace::Gc.m_free - LSpace::Gc.m_data;
+    time_marker end;
+    float ms = (float)(end.diff_time(&start) * 1000.0);
+    stats.count++;
+    stats.collected += used - live;
+    stats.live = live;
+    stats.total_ms += ms;
+    stats.max_ms = Max(stats.max_ms, ms);
+
+    LSpace::Current = sp;
+
+    if (which_space == &LSpace::Perm)
+        RememberStacks();
+    if (which_space == &LSpace::Tmp)
+        LTmpScope::Collected();
+}
+
+void Lisp::Promote(uint8_t *start, LObject **list, size_t count)
+{
+    uint8_t *end = LSpace::Tmp.m_free;
+
+    // Copies are never larger than the originals, and collecting Perm
+    // halfway through would reuse the static collection bounds
+    if (LSpace::Perm.GetFree() < (size_t)(end - start))
+        CollectSpace(&LSpace::Perm, 0);
+    while (LSpace::Perm.GetFree() < (size_t)(end - start))
+        CollectSpace(&LSpace::Perm, 1);
+
+    LSpace *sp = LSpace::Current;
+    uint8_t *perm_free = LSpace::Perm.m_free;
 
+    maxgcdepth = gcdepth = 0;
+    cstart = start;
+    cend = end;
+    collected_start = LSpace::Perm.m_data;
+    collected_end = LSpace::Perm.m_data + LSpace::Perm.m_size;
+    LSpace::Current = &LSpace::Perm;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        LObject *x = list[i];
+        if ((uint8_t *)x >= start && (uint8_t *)x < end)
+            continue; // goes away too, unless another container holds it
+
+        CollectFields(x);
+        // What it now points to is in the nursery
+        Remember(x);
+    }
+
+    LSpace::Perm.m_stats.promoted += LSpace::Perm.m_free - perm_free;
     LSpace::Current = sp;
 }
 
+void Lisp::Register(void **ptr)
+{
+    reg_ptr_list = (void ***)realloc(reg_ptr_list,
+                                     sizeof(void **) * (reg_ptr_total + 1));
+    reg_ptr_list[reg_ptr_total++] = ptr;
+}
+
+void Lisp::Unregister(void **ptr)
+{
+    for (size_t i = 0; i < reg_ptr_total; i++)
+        if (reg_ptr_list[i] == ptr)
+        {
+            reg_ptr_list[i] = reg_ptr_list[--reg_ptr_total];
+            return;
+        }
+}
+
+void Lisp::PrintGcStats(void (*print)(char const *format, ...))
+{
+    LSpace *spaces[] = { &LSpace::Tmp, &LSpace::Perm };
+
+    for (size_t i = 0; i < sizeof(spaces) / sizeof(*spaces); i++)
+    {
+        LGcStats &stats = spaces[i]->m_stats;
+        print("Lisp: %s: %d collections, %d bytes reclaimed, "
+              "%d live of %d, pauses %.2f ms total %.2f ms max\n",
+              spaces[i]->m_name, stats.count, (int)stats.collected,
+              (int)stats.live, (int)spaces[i]->m_size,
+              stats.total_ms, stats.max_ms);
+        print("Lisp: %s: %d bytes allocated, %d promoted from "
+              "temporary space\n", spaces[i]->m_name,
+              (int)stats.allocated, (int)stats.promoted);
+        LGcStats &minor = spaces[i]->m_minor;
+        if (minor.count)
+            print("Lisp: %s: %d minor collections, %d bytes reclaimed, "
+                  "%d kept, pauses %.2f ms total %.2f ms max\n",
+                  spaces[i]->m_name, minor.count, (int)minor.collected,
+                  (int)minor.promoted, minor.total_ms, minor.max_ms);
+    }
+}
+
+// Sum of the numbers in a tree of conses and arrays
+static long GcSum(LObject *x)
+{
+    long sum = 0;
+    for (; x; x = CDR(x))
+    {
+        if (item_type(x) == L_NUMBER)
+            return sum + lnumber_value(x);
+        if (item_type(x) == L_1D_ARRAY)
+        {
+            for (size_t i = 0; i < ((LArray *)x)->m_len; i++)
+                sum += GcSum(((LArray *)x)->GetData()[i]);
+            return sum;
+        }
+        if (item_type(x) != L_CONS_CELL)
+            return sum;
+        sum += GcSum(CAR(x));
+    }
+    return sum;
+}
+
+// Allocate in permanent space with generations, then collecting the whole
+// space every time, and check that both keep the same data. First keep a
+// list of live conses while allocating rounds short lists that die at
+// once, the pattern that used to make every allocation near a full space
+// collect it again. Then run a Lisp function that, rounds times, stores a
+// new list into an array that has grown old, reads back an older one and
+// now and then extends an old list in place, which only works if the
+// write barrier catches those stores.
+void Lisp::GcBench(int rounds, void (*print)(char const *format, ...))
+{
+    static int const live_total = 20000;
+    static char const *const names[] = { "generations", "whole" };
+    LSpace *sp = LSpace::Current;
+    LSpace::Current = &LSpace::Perm;
+
+    // setq changes a number in place, literals in the body included, so
+    // the loop counts the argument down and stores copies of it
+    char const *prog = "(defun gcbench:stress (n) "
+        "(let ((keep (make-array 64 :initial-element (list 0 0))) "
+        "(log (list 0)) (sum (- n n))) "
+        "(do ((i n (setq i (- i 1)))) ((eq0 i) nil) (progn "
+        "(setf (aref keep (mod i 64)) (list (+ i 0) (* i 2))) "
+        "(setq sum (+ sum (mod (car (aref keep (mod (* i 7) 64))) 1000))) "
+        "(if (eq0 (mod i 64)) (nconc log (list (+ i 0)))))) "
+        "(list sum log keep)))";
+    LObject::Compile(prog)->Eval();
+    LSymbol *fun = LSymbol::FindOrCreate("gcbench:stress");
+
+    int old_generations = lisp_generations;
+    long sums[2][2];
+    for (int m = 0; m < 2; m++)
+    {
+        lisp_generations = !m;
+        CollectSpace(&LSpace::Perm, 0);
+
+        LGcStats before = LSpace::Perm.m_stats;
+        LGcStats minor_before = LSpace::Perm.m_minor;
+        LSpace::Perm.m_stats.max_ms = LSpace::Perm.m_minor.max_ms = 0.f;
+
+        Timer t;
+        LList *live = NULL;
+        PtrRef r1(live);
+        for (int i = 0; i < live_total; i++)
+        {
+            LList *c = LList::Create();
+            c->m_cdr = live;
+            live = c;
+            // the number may collect the space, which moves live
+            LObject *n = LNumber::Create(i);
+            live->m_car = n;
+        }
+        for (int r = 0; r < rounds; r++)
+        {
+            LList *dead = NULL;
+            PtrRef r2(dead);
+            for (int i = 0; i < 4; i++)
+            {
+                LList *c = LList::Create();
+                c->m_cdr = dead;
+                dead = c;
+            }
+        }
+        float ms = t.GetMs();
+        sums[m][0] = GcSum(live);
+
+        LList *args = LList::Create();
+        PtrRef r3(args);
+        LObject *n = LNumber::Create(rounds);
+        args->m_car = n;
+        Timer t2;
+        sums[m][1] = GcSum(fun->EvalFunction(args));
+        float stress_ms = t2.GetMs();
+
+        LGcStats &after = LSpace::Perm.m_stats;
+        LGcStats &minor = LSpace::Perm.m_minor;
+        print("gc %-11s %d live conses, %d short lists in %.1f ms, "
+              "Lisp %d rounds in %.1f ms%s\n", names[m], live_total,
+              rounds, ms, rounds, stress_ms,
+              sums[m][0] != (long)live_total * (live_total - 1) / 2
+               || (m && sums[0][1] != sums[1][1]) ? " (MISMATCH)" : "");
+        print("gc %-11s %d minor collections, pauses %.2f ms total "
+              "%.2f ms max, %d whole, pauses %.2f ms total %.2f ms max\n",
+              names[m], minor.count - minor_before.count,
+              minor.total_ms - minor_before.total_ms, minor.max_ms,
+              after.count - before.count,
+              after.total_ms - before.total_ms, after.max_ms);
+        after.max_ms = Max(after.max_ms, before.max_ms);
+        minor.max_ms = Max(minor.max_ms, minor_before.max_ms);
+    }
+    lisp_generations = old_generations;
+    CollectSpace(&LSpace::Perm, 0);
+    LSpace::Current = sp;
+}
@@ -0,0 +1,267 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#if defined _WIN32
+#   define WIN32_LEAN_AND_MEAN
+#   include <windows.h>
+#else
+#   include <sys/time.h>
+#   include <time.h>
+#endif
+
+#include "common.h"
+
+#include "lisp.h"
+#include "lisp_prof.h"
+#include "dprint.h"
+
+int lisp_profile = 0;
+
+LProfile *LProfiler::m_first = NULL;
+LProfNode LProfiler::m_root;
+LProfiler::Frame *LProfiler::m_frames = NULL;
+int LProfiler::m_depth = 0;
+int LProfiler::m_max_depth = 0;
+
+// Nanoseconds from an arbitrary origin. This is read twice per call, so
+// it has to be the cheapest clock around rather than the Timer class.
+static inline uint64_t prof_clock()
+{
+#if defined _WIN32
+    static double ns_per_tick = 0.;
+    LARGE_INTEGER t;
+    if (ns_per_tick == 0.)
+    {
+        QueryPerformanceFrequency(&t);
+        ns_per_tick = 1e9 / (double)t.QuadPart;
+    }
+    QueryPerformanceCounter(&t);
+    return (uint64_t)(t.QuadPart * ns_per_tick);
+#elif defined CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+#endif
+}
+
+void LProfiler::Enter(LSymbol *sym)
+{
+    LProfile *prof = sym->m_prof;
+    if (!prof)
+    {
+        prof = (LProfile *)calloc(1, sizeof(LProfile));
+        prof->m_sym = sym;
+        prof->m_next = m_first;
+        m_first = prof;
+        sym->m_prof = prof;
+    }
+
+    // Find the call path, keeping the most recent one first since the
+    // same few callees keep coming back
+    LProfNode *parent = m_depth ? m_frames[m_depth - 1].m_node : &m_root;
+    LProfNode **p = &parent->m_child;
+    while (*p && (*p)->m_prof != prof)
+        p = &(*p)->m_sibling;
+    LProfNode *node = *p;
+    if (!node)
+    {
+        node = (LProfNode *)calloc(1, sizeof(LProfNode));
+        node->m_prof = prof;
+        node->m_parent = parent;
+    }
+    else
+        *p = node->m_sibling;
+    node->m_sibling = parent->m_child;
+    parent->m_child = node;
+
+    if (m_depth == m_max_depth)
+    {
+        m_max_depth = m_max_depth ? m_max_depth * 2 : 64;
+        m_frames = (Frame *)realloc(m_frames, sizeof(Frame) * m_max_depth);
+    }
+
+    prof->m_calls++;
+    prof->m_active++;
+    node->m_calls++;
+
+    Frame &f = m_frames[m_depth++];
+    f.m_node = node;
+    f.m_children = 0;
+    f.m_start = prof_clock(); // last, so that the above is not timed
+}
+
+void LProfiler::Leave()
+{
+    uint64_t now = prof_clock();
+
+    Frame &f = m_frames[--m_depth];
+    uint64_t total = now - f.m_start;
+    uint64_t self = total > f.m_children ? total - f.m_children : 0;
+    LProfile *prof = f.m_node->m_prof;
+
+    f.m_node->m_exclusive += self;
+    prof->m_exclusive += self;
+    if (!--prof->m_active)
+        prof->m_inclusive += total;
+    if (m_depth)
+        m_frames[m_depth - 1].m_children += total;
+}
+
+static void reset_node(LProfNode *node)
+{
+    for (LProfNode *n = node->m_child; n; n = n->m_sibling)
+    {
+        n->m_calls = 0;
+        n->m_exclusive = 0;
+        n->m_alloc = 0;
+        reset_node(n);
+    }
+}
+
+void LProfiler::Reset()
+{
+    for (LProfile *prof = m_first; prof; prof = prof->m_next)
+    {
+        prof->m_calls = 0;
+        prof->m_inclusive = prof->m_exclusive = 0;
+        prof->m_alloc = 0;
+    }
+    reset_node(&m_root);
+}
+
+static void free_node(LProfNode *node)
+{
+    while (node->m_child)
+    {
+        LProfNode *n = node->m_child;
+        node->m_child = n->m_sibling;
+        free_node(n);
+        free(n);
+    }
+}
+
+void LProfiler::Uninit()
+{
+    // Symbols are deleted right after this, so do not touch them
+    while (m_first)
+    {
+        LProfile *next = m_first->m_next;
+        free(m_first);
+        m_first = next;
+    }
+    free_node(&m_root);
+    free(m_frames);
+    m_frames = NULL;
+    m_depth = m_max_depth = 0;
+}
+
+static int compare_exclusive(void const *a, void const *b)
+{
+    LProfile const *pa = *(LProfile * const *)a;
+    LProfile const *pb = *(LProfile * const *)b;
+    return pa->m_exclusive < pb->m_exclusive ? 1
+         : pa->m_exclusive > pb->m_exclusive ? -1 : 0;
+}
+
+// All functions called since the last reset, heaviest first
+static LProfile **sorted_profiles(LProfile *first, int &count)
+{
+    count = 0;
+    for (LProfile *prof = first; prof; prof = prof->m_next)
+        count += prof->m_calls != 0;
+
+    LProfile **list = (LProfile **)malloc(sizeof(LProfile *) * (count + 1));
+    int i = 0;
+    for (LProfile *prof = first; prof; prof = prof->m_next)
+        if (prof->m_calls)
+            list[i++] = prof;
+    qsort(list, count, sizeof(LProfile *), compare_exclusive);
+    return list;
+}
+
+bool LProfiler::WriteReport(char const *fn)
+{
+    FILE *fp = fopen(fn, "w");
+    if (!fp)
+        return false;
+
+    int count;
+    LProfile **list = sorted_profiles(m_first, count);
+    fprintf(fp, "%10s %12s %12s %12s  %s\n", "calls", "incl ms", "excl ms",
+            "alloc bytes", "function");
+    for (int i = 0; i < count; i++)
+        fprintf(fp, "%10u %12.3f %12.3f %12llu  %s\n", list[i]->m_calls,
+                list[i]->m_inclusive * 1e-6, list[i]->m_exclusive * 1e-6,
+                (unsigned long long)list[i]->m_alloc,
+                lstring_value(list[i]->m_sym->GetName()));
+    free(list);
+
+    fclose(fp);
+    return true;
+}
+
+// One "caller;callee;... microseconds" line per call path
+static void write_node(FILE *fp, LProfNode *node, char *path, size_t len)
+{
+    for (LProfNode *n = node->m_child; n; n = n->m_sibling)
+    {
+        char const *name = lstring_value(n->m_prof->m_sym->GetName());
+        size_t l = strlen(name);
+        if (len + l + 2 > 4096)
+            continue; // absurdly deep, flame graphs would not show it anyway
+        if (len)
+            path[len] = ';';
+        memcpy(path + len + !!len, name, l + 1);
+
+        unsigned long long us = (n->m_exclusive + 500) / 1000;
+        if (us)
+            fprintf(fp, "%s %llu\n", path, us);
+        write_node(fp, n, path, len + !!len + l);
+        path[len] = '\0';
+    }
+}
+
+bool LProfiler::WriteFolded(char const *fn)
+{
+    FILE *fp = fopen(fn, "w");
+    if (!fp)
+        return false;
+
+    char *path = (char *)malloc(4096);
+    path[0] = '\0';
+    write_node(fp, &m_root, path, 0);
+    free(path);
+
+    fclose(fp);
+    return true;
+}
+
+void LProfiler::PrintTop(int count, void (*print)(char const *format, ...))
+{
+    int total;
+    LProfile **list = sorted_profiles(m_first, total);
+    for (int i = 0; i < total && i < count; i++)
+        print("Lisp: %-24s %8u calls, %9.3f ms incl, %9.3f ms excl, "
+              "%9llu bytes\n", lstring_value(list[i]->m_sym->GetName()),
+              list[i]->m_calls, list[i]->m_inclusive * 1e-6,
+              list[i]->m_exclusive * 1e-6,
+              (unsigned long long)list[i]->m_alloc);
+    free(list);
+}
@@ -0,0 +1,111 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __LISP_PROF_HPP_
+#define __LISP_PROF_HPP_
+
+#include <cstdlib>
+#include <stdint.h>
+
+struct LSymbol;
+struct LProfNode;
+
+// Set to 1 (-lprofile, or the "lprofile" dev command) to record every
+// function call made through a symbol
+extern int lisp_profile;
+
+// Statistics for one function, hung off its symbol
+struct LProfile
+{
+    LSymbol *m_sym;
+    LProfile *m_next;  // all profiled functions
+    uint32_t m_calls;
+    int m_active;      // frames on the call stack, to time recursion once
+    uint64_t m_inclusive, m_exclusive; // nanoseconds
+    uint64_t m_alloc;  // bytes allocated in Lisp spaces by the function
+};
+
+// Call profiler for Lisp functions. Besides the flat statistics it keeps
+// the tree of call paths seen, which WriteFolded() dumps in the folded
+// stack format that flame graph tools read.
+class LProfiler
+{
+public:
+    static void Enter(LSymbol *sym);
+    static void Leave();
+    static inline void Alloc(size_t size);
+
+    // Forget the counts so far, but keep the call tree for active frames
+    static void Reset();
+    static void Uninit();
+
+    // Flat report, sorted by exclusive time, and folded stacks with
+    // exclusive microseconds; both return false if fn cannot be opened
+    static bool WriteReport(char const *fn);
+    static bool WriteFolded(char const *fn);
+
+    // Print the count heaviest functions with dprintf(), or whatever else
+    // a report is printed with
+    static void PrintTop(int count, void (*print)(char const *format, ...));
+
+private:
+    struct Frame
+    {
+        LProfNode *m_node;
+        uint64_t m_start, m_children;
+    };
+
+    static LProfile *m_first;
+    static LProfNode m_root;
+    static Frame *m_frames;
+    static int m_depth, m_max_depth;
+};
+
+// One call path: a function together with the path it was called from
+struct LProfNode
+{
+    LProfile *m_prof;
+    LProfNode *m_parent, *m_child, *m_sibling;
+    uint32_t m_calls;
+    uint64_t m_exclusive;
+    uint64_t m_alloc;
+};
+
+inline void LProfiler::Alloc(size_t size)
+{
+    if (m_depth)
+    {
+        LProfNode *node = m_frames[m_depth - 1].m_node;
+        node->m_alloc += size;
+        node->m_prof->m_alloc += size;
+    }
+}
+
+// Records the enclosing call if profiling was on when it started
+class LProfScope
+{
+public:
+    inline LProfScope(LSymbol *sym) : m_on(lisp_profile != 0)
+    {
+        if (m_on)
+            LProfiler::Enter(sym);
+    }
+
+    inline ~LProfScope()
+    {
+        if (m_on)
+            LProfiler::Leave();
+    }
+
+private:
+    bool m_on;
+};
+
+#endif
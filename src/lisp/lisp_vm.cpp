@@ -0,0 +1,818 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#include "lisp.h"
+#include "lisp_gc.h"
+#include "lisp_vm.h"
+#include "lisp_prof.h"
+#include "symbols.h"
+
+/* The bytecode is a stack machine running on l_user_stack, so that every
+ * intermediate value is seen by the garbage collector. Integer arithmetic
+ * uses a separate stack because numbers must be read as soon as they are
+ * evaluated, exactly like the tree-walking code does: setq modifies
+ * numbers in place, so reading them later could give a different result.
+ *
+ * Only the forms that matter for speed are compiled. Everything else,
+ * including any form with an unusual shape, is kept as a constant and
+ * handed to LObject::Eval() so that its behaviour cannot change. */
+
+enum
+{
+    OP_NIL,      //              push NULL
+    OP_T,        //              push T
+    OP_CONST,    // k            push consts[k]
+    OP_SYMVAL,   // sym          push the value of a symbol
+    OP_FORM,     // k            push consts[k]->Eval()
+    OP_POP,      //              drop the top value
+    OP_REPLACE,  //              pop a value and overwrite the new top
+    OP_JUMP,     // pc
+    OP_JUMPNIL,  // pc           pop, jump if NULL
+    OP_JUMPT,    // pc           pop, jump if not NULL
+    OP_NOT,
+    OP_EQ,
+    OP_EQ0,
+    OP_SETQ,     // sym          assign the top value, leave the result
+    OP_SAVE,     // sym          push the current value of a symbol
+    OP_BIND,     // sym          pop a value into a symbol
+    OP_UNBIND,   // n sym...     restore n saved symbols below the top
+    OP_SELNE,    // pc           pop a key, jump if it differs from the
+                 //              selector found below the result slot
+    OP_SELEND,   //              drop the selector, keep the result
+    OP_INT,      // n            push n on the integer stack
+    OP_INUM,     //              pop a number onto the integer stack
+    OP_IADD,     //              pop a number and add it
+    OP_ISUB,     //              pop a number and subtract it
+    OP_IBOX,     //              move an integer back as a new LNumber
+    OP_IGT,      //              pop a number, compare with an integer
+    OP_ILT,
+    OP_IGE,
+    OP_ILE,
+    OP_IMIN,
+    OP_IMAX,
+    OP_IABS,     //              pop a number, push its absolute value
+    OP_CALLPREP, // sym n k pc   check that sym can take n evaluated
+                 //              arguments, or push consts[k]->Eval()
+                 //              and jump to pc
+    OP_CALL,     // n sym        call with n evaluated arguments
+    OP_RET,
+};
+
+int lisp_bytecode = 1;
+LCode *LBytecode::m_all = NULL;
+
+extern int trace_level;
+
+// Integer stack for arithmetic, not seen by the garbage collector
+#define INT_STACK_SIZE 1024
+static int32_t int_stack[INT_STACK_SIZE];
+static int int_top = 0;
+
+static inline void int_push(int32_t x)
+{
+    if (int_top >= INT_STACK_SIZE)
+    {
+        lbreak("error: integer stack overflow\n");
+        exit(1);
+    }
+    int_stack[int_top++] = x;
+}
+
+// Length of a proper list, or -1
+static int list_length(LObject *list)
+{
+    int n = 0;
+    for (; list; list = CDR(list), n++)
+        if (item_type(list) != L_CONS_CELL)
+            return -1;
+    return n;
+}
+
+// Count a user function's parameters
+static int arg_count(LUserFunction *fun)
+{
+    int n = 0;
+    for (LObject *f = fun->arg_list; f; f = CDR(f))
+        n++;
+    return n;
+}
+
+//
+// The compiler
+//
+class LCompiler
+{
+public:
+    LCompiler() : m_ops(NULL), m_len(0), m_size(0),
+                  m_consts(NULL), m_nconsts(0), m_csize(0) { }
+    ~LCompiler() { free(m_ops); free(m_consts); }
+
+    void Function(LUserFunction *fun)
+    {
+        m_len = m_nconsts = 0;
+        Block(fun->block_list);
+        Emit(OP_RET);
+    }
+
+    intptr_t *m_ops;
+    size_t m_len, m_size;
+    LObject **m_consts;
+    size_t m_nconsts, m_csize;
+
+private:
+    void Emit(intptr_t x)
+    {
+        if (m_len >= m_size)
+        {
+            m_size = m_size ? m_size * 2 : 64;
+            m_ops = (intptr_t *)realloc(m_ops, sizeof(intptr_t) * m_size);
+        }
+        m_ops[m_len++] = x;
+    }
+
+    size_t Label() { Emit(0); return m_len - 1; }
+    void Patch(size_t label) { m_ops[label] = m_len; }
+
+    intptr_t Const(LObject *x)
+    {
+        if (m_nconsts >= m_csize)
+        {
+            m_csize = m_csize ? m_csize * 2 : 16;
+            m_consts = (LObject **)realloc(m_consts, sizeof(LObject *) * m_csize);
+        }
+        m_consts[m_nconsts] = x;
+        return m_nconsts++;
+    }
+
+    void Fallback(LObject *form) { Emit(OP_FORM); Emit(Const(form)); }
+
+    // Evaluate each form of a list, leaving the last value
+    void Block(LObject *list)
+    {
+        if (!list)
+            Emit(OP_NIL);
+        for (; list; list = CDR(list))
+        {
+            Form(CAR(list));
+            if (CDR(list))
+                Emit(OP_POP);
+        }
+    }
+
+    // Blocks nested in special forms must be proper lists
+    static bool IsBlock(LObject *list) { return list_length(list) >= 0; }
+
+    void Form(LObject *x)
+    {
+        if (!x)
+        {
+            Emit(OP_NIL);
+            return;
+        }
+
+        switch (item_type(x))
+        {
+        case L_SYMBOL:
+            if (x == true_symbol)
+                Emit(OP_T);
+            else
+            {
+                Emit(OP_SYMVAL);
+                Emit((intptr_t)x);
+            }
+            break;
+        case L_CHARACTER:
+        case L_STRING:
+        case L_NUMBER:
+        case L_POINTER:
+        case L_FIXED_POINT:
+            // Keep the very same object, setq may modify it in place
+            Emit(OP_CONST);
+            Emit(Const(x));
+            break;
+        case L_CONS_CELL:
+            Call(x);
+            break;
+        default:
+            Fallback(x);
+            break;
+        }
+    }
+
+    void Call(LObject *form)
+    {
+        LSymbol *sym = (LSymbol *)CAR(form);
+        LObject *args = CDR(form);
+        int n = list_length(args);
+
+        if (!sym || item_type(sym) != L_SYMBOL || n < 0)
+        {
+            Fallback(form);
+            return;
+        }
+
+        LObject *fun = sym->m_function;
+        switch (item_type(fun))
+        {
+        case L_SYS_FUNCTION:
+            if (!SysForm((LSysFunction *)fun, args, n))
+                Fallback(form);
+            break;
+        case L_L_FUNCTION:
+            // These take their arguments unevaluated
+            Fallback(form);
+            break;
+        default:
+        {
+            // User and C functions, or functions not defined yet: the
+            // actual type is checked at run time
+            Emit(OP_CALLPREP);
+            Emit((intptr_t)sym);
+            Emit(n);
+            Emit(Const(form));
+            size_t skip = Label();
+            for (LObject *a = args; a; a = CDR(a))
+                Form(CAR(a));
+            Emit(OP_CALL);
+            Emit(n);
+            Emit((intptr_t)sym);
+            Patch(skip);
+            break;
+        }
+        }
+    }
+
+    // Compile a system function inline, return false to fall back
+    bool SysForm(LSysFunction *fun, LObject *args, int n)
+    {
+        if (fun->min_args != -1 && (n < fun->min_args
+                               || (fun->max_args != -1 && n > fun->max_args)))
+            return false; // let the evaluator report the error
+
+        LObject *a1 = n > 0 ? CAR(args) : NULL;
+        LObject *a2 = n > 1 ? CAR(CDR(args)) : NULL;
+        LObject *a3 = n > 2 ? CAR(CDR(CDR(args))) : NULL;
+
+        switch (fun->fun_number)
+        {
+        case SYS_FUNC_QUOTE:
+            if (a1)
+            {
+                Emit(OP_CONST);
+                Emit(Const(a1));
+            }
+            else
+                Emit(OP_NIL);
+            return true;
+        case SYS_FUNC_PROGN:
+            Block(args);
+            return true;
+        case SYS_FUNC_IF:
+        case SYS_FUNC_IF_1PROGN:
+        case SYS_FUNC_IF_2PROGN:
+        case SYS_FUNC_IF_12PROGN:
+        {
+            bool then_block = fun->fun_number == SYS_FUNC_IF_1PROGN
+                           || fun->fun_number == SYS_FUNC_IF_12PROGN;
+            bool else_block = fun->fun_number == SYS_FUNC_IF_2PROGN
+                           || fun->fun_number == SYS_FUNC_IF_12PROGN;
+            if ((then_block && !IsBlock(a2)) || (else_block && !IsBlock(a3)))
+                return false;
+
+            Form(a1);
+            Emit(OP_JUMPNIL);
+            size_t l_else = Label();
+            if (then_block)
+                Block(a2);
+            else
+                Form(a2);
+            Emit(OP_JUMP);
+            size_t l_end = Label();
+            Patch(l_else);
+            if (else_block)
+                Block(a3);
+            else
+                Form(a3);
+            Patch(l_end);
+            return true;
+        }
+        case SYS_FUNC_AND:
+        case SYS_FUNC_OR:
+        {
+            // Both return T or nil, not the value of the last test
+            bool is_and = fun->fun_number == SYS_FUNC_AND;
+            size_t *exits = (size_t *)malloc(sizeof(size_t) * (n + 1));
+            int i = 0;
+            for (LObject *a = args; a; a = CDR(a))
+            {
+                Form(CAR(a));
+                Emit(is_and ? OP_JUMPNIL : OP_JUMPT);
+                exits[i++] = Label();
+            }
+            Emit(is_and ? OP_T : OP_NIL);
+            Emit(OP_JUMP);
+            size_t l_end = Label();
+            for (int j = 0; j < i; j++)
+                Patch(exits[j]);
+            Emit(is_and ? OP_NIL : OP_T);
+            Patch(l_end);
+            free(exits);
+            return true;
+        }
+        case SYS_FUNC_NOT:
+        case SYS_FUNC_NULL:
+            Form(a1);
+            Emit(OP_NOT);
+            return true;
+        case SYS_FUNC_EQ:
+            Form(a1);
+            Form(a2);
+            Emit(OP_EQ);
+            return true;
+        case SYS_FUNC_EQ0:
+            Form(a1);
+            Emit(OP_EQ0);
+            return true;
+        case SYS_FUNC_SETQ:
+        case SYS_FUNC_SETF:
+            if (!a1 || item_type(a1) != L_SYMBOL)
+                return false; // aref, car and cdr places
+            Form(a2);
+            Emit(OP_SETQ);
+            Emit((intptr_t)a1);
+            return true;
+        case SYS_FUNC_LET:
+        {
+            LObject *vars = a1;
+            int nvars = list_length(vars);
+            if (nvars < 0 || !IsBlock(CDR(args)))
+                return false;
+            for (LObject *v = vars; v; v = CDR(v))
+            {
+                LObject *var = CAR(v);
+                if (!var || item_type(var) != L_CONS_CELL
+                     || !CAR(var) || item_type(CAR(var)) != L_SYMBOL
+                     || !CDR(var) || item_type(CDR(var)) != L_CONS_CELL)
+                    return false;
+            }
+            // Bindings are made one after the other, like let*
+            for (LObject *v = vars; v; v = CDR(v))
+            {
+                Emit(OP_SAVE);
+                Emit((intptr_t)CAR(CAR(v)));
+                Form(CAR(CDR(CAR(v))));
+                Emit(OP_BIND);
+                Emit((intptr_t)CAR(CAR(v)));
+            }
+            Block(CDR(args));
+            if (nvars)
+            {
+                Emit(OP_UNBIND);
+                Emit(nvars);
+                for (LObject *v = vars; v; v = CDR(v))
+                    Emit((intptr_t)CAR(CAR(v)));
+            }
+            return true;
+        }
+        case SYS_FUNC_SELECT:
+        {
+            for (LObject *c = CDR(args); c; c = CDR(c))
+                if (!CAR(c) || item_type(CAR(c)) != L_CONS_CELL
+                     || !IsBlock(CDR(CAR(c))))
+                    return false;
+            // Only the first matching clause is run
+            Form(a1);
+            Emit(OP_NIL);
+            size_t *ends = (size_t *)malloc(sizeof(size_t) * n);
+            int i = 0;
+            for (LObject *c = CDR(args); c; c = CDR(c))
+            {
+                Form(CAR(CAR(c)));
+                Emit(OP_SELNE);
+                size_t l_next = Label();
+                for (LObject *b = CDR(CAR(c)); b; b = CDR(b))
+                {
+                    Form(CAR(b));
+                    Emit(OP_REPLACE);
+                }
+                Emit(OP_JUMP);
+                ends[i++] = Label();
+                Patch(l_next);
+            }
+            for (int j = 0; j < i; j++)
+                Patch(ends[j]);
+            Emit(OP_SELEND);
+            free(ends);
+            return true;
+        }
+        case SYS_FUNC_PLUS:
+            Emit(OP_INT);
+            Emit(0);
+            for (LObject *a = args; a; a = CDR(a))
+            {
+                Form(CAR(a));
+                Emit(OP_IADD);
+            }
+            Emit(OP_IBOX);
+            return true;
+        case SYS_FUNC_MINUS:
+            Form(a1);
+            Emit(OP_INUM);
+            for (LObject *a = CDR(args); a; a = CDR(a))
+            {
+                Form(CAR(a));
+                Emit(OP_ISUB);
+            }
+            Emit(OP_IBOX);
+            return true;
+        case SYS_FUNC_GT:
+        case SYS_FUNC_LT:
+        case SYS_FUNC_GE:
+        case SYS_FUNC_LE:
+        case SYS_FUNC_MIN:
+        case SYS_FUNC_MAX:
+            Form(a1);
+            Emit(OP_INUM);
+            Form(a2);
+            switch (fun->fun_number)
+            {
+                case SYS_FUNC_GT: Emit(OP_IGT); break;
+                case SYS_FUNC_LT: Emit(OP_ILT); break;
+                case SYS_FUNC_GE: Emit(OP_IGE); break;
+                case SYS_FUNC_LE: Emit(OP_ILE); break;
+                case SYS_FUNC_MIN: Emit(OP_IMIN); break;
+                case SYS_FUNC_MAX: Emit(OP_IMAX); break;
+            }
+            return true;
+        case SYS_FUNC_ABS:
+            Form(a1);
+            Emit(OP_IABS);
+            return true;
+        }
+
+        return false;
+    }
+};
+
+void LBytecode::Compile(LUserFunction *fun)
+{
+    PtrRef r1(fun);
+    LCompiler c;
+
+    c.Function(fun);
+
+    // The consts array lives next to the function in permanent space
+    int old_count = LSpace::Perm.m_stats.count + LSpace::Perm.m_minor.count;
+    LSpace *sp = LSpace::Current;
+    LSpace::Current = &LSpace::Perm;
+    LArray *consts = LArray::Create(Max((int)c.m_nconsts, 1), NULL);
+    LSpace::Current = sp;
+
+    // If that triggered a collection, the body we compiled has moved
+    if (LSpace::Perm.m_stats.count + LSpace::Perm.m_minor.count != old_count)
+        c.Function(fun);
+
+    memcpy(consts->GetData(), c.m_consts, sizeof(LObject *) * c.m_nconsts);
+
+    LCode *code = (LCode *)malloc(sizeof(LCode)
+                                  + sizeof(intptr_t) * (c.m_len - 1));
+    code->m_len = c.m_len;
+    memcpy(code->m_ops, c.m_ops, sizeof(intptr_t) * c.m_len);
+    code->m_next = m_all;
+    m_all = code;
+
+    fun->consts = consts;
+    fun->code = code;
+    Lisp::Store(fun, consts);
+}
+
+LObject *LBytecode::Run(LUserFunction *fun)
+{
+    if (lisp_bytecode && !trace_level)
+    {
+        if (!fun->code && (uint8_t *)fun >= LSpace::Perm.m_data
+                       && (uint8_t *)fun < LSpace::Perm.m_free)
+        {
+            PtrRef r1(fun);
+            Compile(fun);
+        }
+        if (fun->code)
+            return Execute(fun);
+    }
+
+    LObject *ret = NULL;
+    LObject *block_list = fun->block_list;
+    PtrRef r1(ret), r2(block_list);
+    while (block_list)
+    {
+        ret = CAR(block_list)->Eval();
+        block_list = CDR(block_list);
+    }
+    return ret;
+}
+
+#define PUSH(x) l_user_stack.push(x)
+#define POP() ((LObject *)l_user_stack.pop(1))
+#define TOP() (l_user_stack.sdata[l_user_stack.m_size - 1])
+
+LObject *LBytecode::Execute(LUserFunction *fun)
+{
+    intptr_t const *ops = fun->code->m_ops;
+    LArray *consts = fun->consts; // may be moved by the GC
+    PtrRef r1(consts);
+    size_t pc = 0;
+
+    for (;;)
+    {
+        switch (ops[pc++])
+        {
+        case OP_NIL:
+            PUSH(NULL);
+            break;
+        case OP_T:
+            PUSH(true_symbol);
+            break;
+        case OP_CONST:
+            PUSH(consts->GetData()[ops[pc++]]);
+            break;
+        case OP_SYMVAL:
+        {
+            LObject *v = ((LSymbol *)ops[pc++])->m_value;
+            if (item_type(v) == L_OBJECT_VAR)
+                v = (LObject *)l_obj_get(((LObjectVar *)v)->m_index);
+            PUSH(v);
+            break;
+        }
+        case OP_FORM:
+        {
+            LObject *v = consts->GetData()[ops[pc++]]->Eval();
+            PUSH(v);
+            break;
+        }
+        case OP_POP:
+            l_user_stack.pop(1);
+            break;
+        case OP_REPLACE:
+        {
+            LObject *v = POP();
+            TOP() = v;
+            break;
+        }
+        case OP_JUMP:
+            pc = ops[pc];
+            break;
+        case OP_JUMPNIL:
+            pc = POP() ? pc + 1 : ops[pc];
+            break;
+        case OP_JUMPT:
+            pc = POP() ? ops[pc] : pc + 1;
+            break;
+        case OP_NOT:
+            TOP() = TOP() ? NULL : true_symbol;
+            break;
+        case OP_EQ:
+        {
+            LObject *v2 = POP();
+            TOP() = lisp_eq(TOP(), v2);
+            break;
+        }
+        case OP_EQ0:
+        {
+            LObject *v = (LObject *)TOP();
+            TOP() = (item_type(v) != L_NUMBER || ((LNumber *)v)->m_num != 0)
+                  ? NULL : true_symbol;
+            break;
+        }
+        case OP_SETQ:
+        {
+            LObject *v = ((LSymbol *)ops[pc++])->Setq((LObject *)TOP());
+            TOP() = v;
+            break;
+        }
+        case OP_SAVE:
+            PUSH(((LSymbol *)ops[pc++])->m_value);
+            break;
+        case OP_BIND:
+            ((LSymbol *)ops[pc++])->SetValue(POP());
+            break;
+        case OP_UNBIND:
+        {
+            LObject *ret = POP();
+            int n = (int)ops[pc++];
+            void **saved = l_user_stack.sdata + l_user_stack.m_size - n;
+            for (int i = 0; i < n; i++)
+                ((LSymbol *)ops[pc++])->SetValue((LObject *)saved[i]);
+            l_user_stack.m_size -= n;
+            PUSH(ret);
+            break;
+        }
+        case OP_SELNE:
+        {
+            LObject *key = POP();
+            void *selector = l_user_stack.sdata[l_user_stack.m_size - 2];
+            pc = lisp_equal(selector, key) ? pc + 1 : ops[pc];
+            break;
+        }
+        case OP_SELEND:
+        {
+            LObject *ret = POP();
+            TOP() = ret;
+            break;
+        }
+        case OP_INT:
+            int_push((int32_t)ops[pc++]);
+            break;
+        case OP_INUM:
+            int_push(lnumber_value(POP()));
+            break;
+        case OP_IADD:
+            int_stack[int_top - 1] += lnumber_value(POP());
+            break;
+        case OP_ISUB:
+            int_stack[int_top - 1] -= lnumber_value(POP());
+            break;
+        case OP_IBOX:
+            PUSH(LNumber::Create(int_stack[--int_top]));
+            break;
+        case OP_IGT:
+        case OP_ILT:
+        case OP_IGE:
+        case OP_ILE:
+        {
+            int32_t n2 = lnumber_value(POP());
+            int32_t n1 = int_stack[--int_top];
+            bool r = ops[pc - 1] == OP_IGT ? n1 > n2
+                   : ops[pc - 1] == OP_ILT ? n1 < n2
+                   : ops[pc - 1] == OP_IGE ? n1 >= n2 : n1 <= n2;
+            PUSH(r ? true_symbol : NULL);
+            break;
+        }
+        case OP_IMIN:
+        case OP_IMAX:
+        {
+            int32_t y = lnumber_value(POP());
+            int32_t x = int_stack[--int_top];
+            PUSH(LNumber::Create(ops[pc - 1] == OP_IMIN ? (x < y ? x : y)
+                                                        : (x > y ? x : y)));
+            break;
+        }
+        case OP_IABS:
+            PUSH(LNumber::Create(abs(lnumber_value(POP()))));
+            break;
+        case OP_CALLPREP:
+        {
+            LSymbol *sym = (LSymbol *)ops[pc];
+            int n = (int)ops[pc + 1];
+            LObject *f = sym->m_function;
+            bool ok = false;
+
+            switch (item_type(f))
+            {
+            case L_USER_FUNCTION:
+                // EvalUserFunction() saves the parameters before
+                // evaluating the arguments, so we do the same
+                if (arg_count((LUserFunction *)f) == n)
+                {
+                    for (LObject *a = ((LUserFunction *)f)->arg_list; a; a = CDR(a))
+                        PUSH(((LSymbol *)CAR(a))->m_value);
+                    ok = true;
+                }
+                break;
+            case L_C_FUNCTION:
+            case L_C_BOOL:
+            {
+                LSysFunction *cf = (LSysFunction *)f;
+                ok = cf->min_args == -1 || (n >= cf->min_args
+                       && (cf->max_args == -1 || n <= cf->max_args));
+                break;
+            }
+            }
+
+            if (ok)
+            {
+                PUSH(f);
+                pc += 4;
+            }
+            else
+            {
+                LObject *v = consts->GetData()[ops[pc + 2]]->Eval();
+                PUSH(v);
+                pc = ops[pc + 3];
+            }
+            break;
+        }
+        case OP_CALL:
+        {
+            int n = (int)ops[pc++];
+            LSymbol *sym = (LSymbol *)ops[pc++];
+            void **args = l_user_stack.sdata + l_user_stack.m_size - n;
+            LObject *f = (LObject *)args[-1];
+            LObject *ret = NULL;
+
+            if (item_type(f) == L_USER_FUNCTION)
+            {
+                LUserFunction *uf = (LUserFunction *)f;
+                LObject *params = uf->arg_list;
+                PtrRef r2(params), r3(ret);
+
+                int i = 0;
+                for (LObject *a = params; a; a = CDR(a))
+                    ((LSymbol *)CAR(a))->SetValue((LObject *)args[i++]);
+                l_user_stack.m_size -= n + 1;
+
+                {
+                    LProfScope prof(sym);
+                    ret = Run(uf);
+                }
+
+                void **saved = l_user_stack.sdata + l_user_stack.m_size - n;
+                i = 0;
+                for (LObject *a = params; a; a = CDR(a))
+                    ((LSymbol *)CAR(a))->SetValue((LObject *)saved[i++]);
+                l_user_stack.m_size -= n;
+                PUSH(ret);
+            }
+            else if (LNative const *nat = lisp_natives
+                       ? LNative::Find(((LSysFunction *)f)->fun_number) : NULL)
+            {
+                if (n != nat->m_nargs)
+                    nat->BadArgs(n);
+                LArg a[MAX_NATIVE_ARGS];
+                for (int i = 0; i < n; i++)
+                    nat->Unpack((LObject *)args[i], i, a);
+                ltype t = item_type(f);
+                l_user_stack.m_size -= n + 1;
+
+                long r;
+                {
+                    LProfScope prof(sym);
+                    r = nat->m_fun(a);
+                }
+                if (t == L_C_FUNCTION)
+                    PUSH(LNumber::Create(r));
+                else
+                    PUSH(r ? true_symbol : NULL);
+            }
+            else
+            {
+                LList *first = NULL, *cur = NULL;
+                PtrRef r2(first), r3(cur);
+                for (int i = 0; i < n; i++)
+                {
+                    LList *tmp = LList::Create();
+                    tmp->m_car = (LObject *)l_user_stack.sdata[l_user_stack.m_size - n + i];
+                    if (first)
+                        cur->m_cdr = tmp;
+                    else
+                        first = tmp;
+                    cur = tmp;
+                }
+                // Building the list may have moved the function
+                f = (LObject *)l_user_stack.sdata[l_user_stack.m_size - n - 1];
+                ltype t = item_type(f);
+                int number = ((LSysFunction *)f)->fun_number;
+                l_user_stack.m_size -= n + 1;
+
+                long r;
+                {
+                    LProfScope prof(sym);
+                    r = c_caller(number, first);
+                }
+                if (t == L_C_FUNCTION)
+                    PUSH(LNumber::Create(r));
+                else
+                    PUSH(r ? true_symbol : NULL);
+            }
+            break;
+        }
+        case OP_RET:
+            return POP();
+        }
+    }
+}
+
+void LBytecode::Uninit()
+{
+    while (m_all)
+    {
+        LCode *next = m_all->m_next;
+        free(m_all);
+        m_all = next;
+    }
+}
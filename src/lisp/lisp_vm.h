@@ -0,0 +1,46 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __LISP_VM_HPP_
+#define __LISP_VM_HPP_
+
+#include "lisp.h"
+
+// Bytecode for the body of a user function. Operands are either small
+// integers, indices into the function's consts array, or LSymbol pointers,
+// which are safe to keep here since symbols are never moved by the GC.
+struct LCode
+{
+    LCode *m_next; // all compiled code, freed by LBytecode::Uninit()
+    size_t m_len;
+    intptr_t m_ops[1]; /* Can be allocated much larger than 1 */
+};
+
+class LBytecode
+{
+public:
+    // Evaluate the body of a user function whose arguments are already
+    // bound, compiling it on first use. Falls back to walking block_list
+    // for functions outside of permanent space or while tracing.
+    static LObject *Run(LUserFunction *fun);
+
+    static void Uninit();
+
+private:
+    static void Compile(LUserFunction *fun);
+    static LObject *Execute(LUserFunction *fun);
+
+    static LCode *m_all;
+};
+
+// Set to 0 (-nobytecode) to always use the tree-walking evaluator
+extern int lisp_bytecode;
+
+#endif
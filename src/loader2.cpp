@@ -295,6 +295,8 @@ void load_data(int argc, char **argv)
     pal=NULL;
     color_table=NULL;
 
+    sd_cache.load_bundle();
+
 # if 0
     int should_save_sd_cache = 0;
 
@@ -30,6 +30,7 @@
 #include "dev.h"
 #include "id.h"
 #include "demo.h"
+#include "savewriter.h"
 
 extern void *save_order;         // load from "saveordr.lsp", contains a list ordering the save games
 
@@ -142,9 +143,21 @@ void get_savegame_name(char *buf)  // buf should be at least 50 bytes
   } else dprintf("Warning unable to open lastsave.lsp for writing\n"); */
 }
 
+// Called between frames once a savegame from the save_game function is on
+// disk; the save point already said so when the game was laid out for it
+void savegame_written(char const *name, int ok)
+{
+    if (ok)
+        return;
+    the_game->show_help("Unable to open file for saving.\n");
+    printf("\nFailed to save game.\n");
+    printf("I was trying to save to: '%s'\n", name);
+}
+
 int show_load_icon()
 {
     int i;
+    save_writer.Wait();  // a savegame may still be on its way to disk
     for( i = 0; i < MAX_SAVE_GAMES; i++ )
     {
         char nm[255];
@@ -173,6 +186,7 @@ int load_game(int show_all, char const *title)   // return 0 if the player escap
 
     image *first=NULL;
 
+    save_writer.Wait();  // show the savegame just made, not the one before
     for (start_num=0; start_num<MAX_SAVE_GAMES; start_num++)
     {
         char name[255];
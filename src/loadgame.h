@@ -17,5 +17,6 @@ void get_savegame_name(char *buf);  // buf should be at least 50 bytes
 void last_savegame_name(char *buf);
 void load_number_icons();
 int get_save_spot();
+void savegame_written(char const *name, int ok);
 
 #endif
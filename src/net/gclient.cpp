@@ -35,6 +35,7 @@ extern net_socket *comm_sock,*game_sock;
 extern net_protocol *prot;
 extern char lsf[256];
 extern int start_running;
+extern int net_pipelined;
 
 int game_client::process_server_command()
 {
@@ -85,7 +86,14 @@ int game_client::process_net()
       uint16_t rec_crc=tmp.get_checksum();
       if (rec_crc==tmp.calc_checksum())
       {
-    if (base->current_tick==tmp.tick_received())
+    if (net_pipelined)
+    {
+      // keep anything the engine still needs, it may be running ahead
+      uint8_t tick=tmp.tick_received();
+      if ((uint8_t)(tick-base->next_tick)<NET_WINDOW && !base->merged.find(tick))
+        *base->merged.put(tick)=tmp;
+    }
+    else if (base->current_tick==tmp.tick_received())
     {
       base->packet=tmp;
       wait_local_input=1;
@@ -125,6 +133,17 @@ game_client::game_client(net_socket *client_sock, net_address *server_addr) :
 
 int game_client::input_missing()
 {
+  if (net_pipelined)    // resend everything the server may not have merged yet
+  {
+    for (int i=0; i<NET_WINDOW; i++)
+    {
+      net_packet *pack=base->sent.find(base->next_tick+i);
+      if (pack)
+        game_sock->write(pack->data,pack->packet_size()+pack->packet_prefix_size(),server_data_port);
+    }
+    return 1;
+  }
+
   if (prot->debug_level(net_protocol::DB_IMPORTANT_EVENT))
     fprintf(stderr,"(resending %d)\n",base->packet.tick_received());
   net_packet *pack=&base->packet;
@@ -141,6 +160,16 @@ int game_client::input_missing()
 
 void game_client::add_engine_input()
 {
+  if (net_pipelined)
+  {
+    net_packet *pack=base->sent.put(base->current_tick);
+    pack->add_to_packet(base->packet.packet_data(),base->packet.packet_size());
+    pack->calc_checksum();
+    game_sock->write(pack->data,pack->packet_size()+pack->packet_prefix_size(),server_data_port);
+    base->packet.packet_reset();
+    return;
+  }
+
   net_packet *pack=&base->packet;
   base->input_state=INPUT_COLLECTING;
   wait_local_input=0;
@@ -163,9 +192,11 @@ int game_client::end_reload(int disconnect)  // notify evryone you've reloaded t
 
 int game_client::start_reload()
 {
-  uint8_t cmd=CLCMD_RELOAD_START;
+  uint8_t cmd=CLCMD_RELOAD_START,tick;
   if (client_sock->write(&cmd,1)!=1) return 0;
   if (client_sock->read(&cmd,1)!=1) return 0;
+  if (client_sock->read(&tick,1)!=1) return 0;   // where pipelined input starts over
+  base->reload_tick=tick;
   return 1;
 }
 
@@ -22,6 +22,7 @@ class game_handler     // game_client and game_serevr are derived from here
   virtual int kill_slackers()     { return 1; }
   virtual int quit()              { return 1; }  // should disconnect from everone and close all sockets
   virtual void game_start_wait()  { ; }
+  virtual void pipe_reset()       { ; }  // pipelined games: drop all input, start over at base->next_tick
   virtual ~game_handler()         { ; }
 } ;
 
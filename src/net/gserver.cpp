@@ -40,12 +40,14 @@ extern net_socket *comm_sock,*game_sock;
 extern net_protocol *prot;
 extern join_struct *join_array;
 extern void service_net_request();
+extern int net_pipelined,net_delay,net_rollback;
 
 game_server::game_server()
 {
     player_list = NULL;
     waiting_server_input = 1;
     reload_state = 0;
+    collect_tick = 0;
 }
 
 int game_server::total_players()
@@ -99,48 +101,58 @@ game_server::player_client::~player_client()
 {
   delete comm;
   delete data_address;
+  delete parked;
+}
+
+void game_server::add_deletes(net_packet *pk)   // tell everyone about, then forget, deleted clients
+{
+  player_client *c,*last=NULL;
+  for (c=player_list; c; )
+  {
+    if (c->delete_me())
+    {
+      pk->write_uint8(SCMD_DELETE_CLIENT);
+      pk->write_uint8(c->client_id);
+      if (c->wait_reload())
+      {
+        c->set_wait_reload(0);
+        check_reload_wait();
+      }
+
+      if (last) last->next=c->next;
+      else player_list=c->next;
+      player_client *d=c;
+      c=c->next;
+      delete d;
+    } else
+    {
+      last=c;
+      c=c->next;
+    }
+  }
 }
 
 void game_server::check_collection_complete()
 {
+  if (net_pipelined)
+  {
+    pipe_check();
+    return;
+  }
+
   player_client *c;
   int got_all=waiting_server_input==0;
-  int add_deletes=0;
+  int any_deleted=0;
   for (c=player_list; c && got_all; c=c->next)
   {
     if (c->delete_me())
-      add_deletes=1;
+      any_deleted=1;
     else if (c->has_joined() && c->wait_input())
       got_all=0;
   }
 
-  if (add_deletes)
-  {
-    player_client *last=NULL;
-    for (c=player_list; c; )
-    {
-      if (c->delete_me())
-      {
-    base->packet.write_uint8(SCMD_DELETE_CLIENT);
-    base->packet.write_uint8(c->client_id);
-    if (c->wait_reload())
-    {
-      c->set_wait_reload(0);
-      check_reload_wait();
-    }
-
-    if (last) last->next=c->next;
-    else player_list=c->next;
-    player_client *d=c;
-    c=c->next;
-    delete d;
-      } else
-      {
-    last=c;
-    c=c->next;
-      }
-    }
-  }
+  if (any_deleted)
+    add_deletes(&base->packet);
 
   if (got_all)    // see if we have input from everyone, if so send it out
   {
@@ -164,6 +176,15 @@ void game_server::check_collection_complete()
 
 void game_server::add_engine_input()
 {
+  if (net_pipelined)    // keep our input until everyone's is here for its tick
+  {
+    net_packet *pk=base->sent.put(base->current_tick);
+    pk->add_to_packet(base->packet.packet_data(),base->packet.packet_size());
+    base->packet.packet_reset();
+    pipe_check();
+    return;
+  }
+
   waiting_server_input=0;
   base->input_state=INPUT_COLLECTING;
   base->packet.set_tick_received(base->current_tick);
@@ -181,6 +202,70 @@ void game_server::add_client_input(char *buf, int size, player_client *c)
   }
 }
 
+// Pipelined games: keep input that is for a tick we are not merging yet, or
+// resend what we merged to a client that is resending input we already used
+void game_server::pipe_input(net_packet *pk, player_client *c)
+{
+  uint8_t tick=pk->tick_received();
+  if ((uint8_t)(tick-collect_tick)<NET_WINDOW)
+  {
+    if (!c->parked->find(tick))
+    {
+      c->parked->put(tick)->add_to_packet(pk->packet_data(),pk->packet_size());
+      pipe_check();
+    }
+  } else if ((uint8_t)(collect_tick-tick)<=NET_WINDOW)
+  {
+    net_packet *m=base->merged.find(tick);
+    if (m)
+    {
+      if (prot->debug_level(net_protocol::DB_IMPORTANT_EVENT))
+        fprintf(stderr,"(sending old %d)\n",tick);
+      game_sock->write(m->data,m->packet_size()+m->packet_prefix_size(),c->data_address);
+    }
+  } else if (prot->debug_level(net_protocol::DB_MAJOR_EVENT))
+    fprintf(stderr,"received stale packet (got %d, collecting %d)\n",tick,collect_tick);
+}
+
+// Pipelined games: merge and send out every tick we have everyone's input for
+void game_server::pipe_check()
+{
+  for (;;)
+  {
+    net_packet *own=base->sent.find(collect_tick);
+    if (!own) return;
+
+    player_client *c;
+    for (c=player_list; c; c=c->next)
+      if (c->has_joined() && !c->delete_me() && !c->parked->find(collect_tick))
+        return;
+
+    net_packet *pk=base->merged.put(collect_tick);
+    pk->add_to_packet(own->packet_data(),own->packet_size());
+    for (c=player_list; c; c=c->next)
+      if (c->has_joined() && !c->delete_me())
+      {
+        net_packet *in=c->parked->find(collect_tick);
+        pk->add_to_packet(in->packet_data(),in->packet_size());
+      }
+    add_deletes(pk);
+    pk->calc_checksum();
+
+    for (c=player_list; c; c=c->next)
+      if (c->has_joined())
+        game_sock->write(pk->data,pk->packet_size()+pk->packet_prefix_size(),c->data_address);
+    collect_tick++;
+  }
+}
+
+void game_server::pipe_reset()
+{
+  collect_tick=base->next_tick;
+  for (player_client *c=player_list; c; c=c->next)
+    if (c->parked)
+      c->parked->clear();
+}
+
 void game_server::check_reload_wait()
 {
   player_client *d=player_list;
@@ -214,7 +299,8 @@ int game_server::process_client_command(player_client *c)
     {
       if (reload_state)   // already in reload state, notify client ok to start reloading
       {
-        if (c->comm->write(&cmd,1)!=1)
+        uint8_t ok[2]={ cmd, (uint8_t)base->reload_tick };
+        if (c->comm->write(ok,2)!=2)
       c->set_delete_me(1);
       } else c->set_need_reload_start_ok(1);
       return 1;
@@ -242,7 +328,7 @@ int game_server::process_net()
   int ret=0;
   /**************************       Any game data waiting?       **************************/
   if ((base->input_state==INPUT_COLLECTING ||
-       base->input_state==INPUT_RELOAD)
+       base->input_state==INPUT_RELOAD || net_pipelined)
        && game_sock->ready_to_read())
   {
     net_packet tmp;
@@ -264,7 +350,12 @@ int game_server::process_net()
         found=f;
       if (found)
       {
-        if (base->current_tick==use->tick_received())
+        if (net_pipelined)
+        {
+          if (base->input_state!=INPUT_RELOAD)
+            pipe_input(use,found);
+        }
+        else if (base->current_tick==use->tick_received())
         {
           if (prot->debug_level(net_protocol::DB_MINOR_EVENT))
             fprintf(stderr,"(got data from %d)",found->client_id);
@@ -358,12 +449,22 @@ int game_server::start_reload()
   reload_state=1;
   prot->select(0);
 
+  // the tick everyone sends input for first once reloaded: pipelined games
+  // restart far from any tick still on the way, lockstep ones go on with
+  // the one our level is at, which is the one after the tick being run
+  // unless no tick was run since the last input was sent
+  if (net_pipelined)
+    base->reload_tick=(uint8_t)(collect_tick+128);
+  else
+    base->reload_tick=(uint8_t)(current_level ? current_level->tick_counter()
+                                              : base->current_tick+1);
+
   for (; c; c=c->next)
   {
     if (!c->delete_me() && c->need_reload_start_ok())    // if the client is already waiting for reload state to start, send ok
     {
-      uint8_t cmd=CLCMD_RELOAD_START;
-      if (c->comm->write(&cmd,1)!=1) { c->set_delete_me(1); }
+      uint8_t ok[2]={ CLCMD_RELOAD_START, (uint8_t)base->reload_tick };
+      if (c->comm->write(ok,2)!=2) { c->set_delete_me(1); }
       c->set_need_reload_start_ok(0);
     }
     c->set_wait_reload(1);
@@ -432,7 +533,9 @@ int game_server::add_client(int type, net_socket *sock, net_address *from)
         from->set_port( cport );
 
         uint16_t client_id = lstl( f );
-        if( sock->write( &client_id, 2 ) != 2 )
+        uint8_t pipe[2] = { (uint8_t)net_delay, (uint8_t)net_rollback };
+        if( sock->write( &client_id, 2 ) != 2 ||
+            sock->write( pipe, 2 ) != 2 )
         {
             return 0;
         }
@@ -443,6 +546,11 @@ int game_server::add_client(int type, net_socket *sock, net_address *from)
         join_array[client_id].client_id = client_id;
         strcpy( join_array[client_id].name, name );
         player_list = new player_client( f, sock, from, player_list );
+        if( net_pipelined )
+        {
+            player_list->parked = new net_window;
+            player_list->parked->clear();
+        }
 
         return 1;
     }
@@ -456,7 +564,8 @@ int game_server::kill_slackers()
 {
   player_client *c=player_list;
   for (; c; c=c->next)
-    if (c->wait_input())
+    if (net_pipelined ? c->has_joined() && !c->parked->find(collect_tick)
+                      : c->wait_input())
       c->set_delete_me(1);
   check_collection_complete();
   return 1;
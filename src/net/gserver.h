@@ -38,9 +38,10 @@ class game_server : public game_handler
     int client_id;
     net_socket *comm;
     net_address *data_address;
+    net_window *parked;              // pipelined games: input received ahead of collect_tick
     player_client *next;
     player_client(int client_id, net_socket *comm, net_address *data_address, player_client *next) :
-      client_id(client_id), comm(comm), data_address(data_address), next(next)
+      client_id(client_id), comm(comm), data_address(data_address), parked(NULL), next(next)
       {
     flags=0;
     set_wait_input(1);
@@ -51,9 +52,13 @@ class game_server : public game_handler
 
   player_client *player_list;
   int waiting_server_input, reload_state;
+  uint8_t collect_tick;              // pipelined games: next tick to merge
 
   void add_client_input(char *buf, int size, player_client *c);
+  void add_deletes(net_packet *pk);
   void check_collection_complete();
+  void pipe_input(net_packet *pk, player_client *c);
+  void pipe_check();
   void check_reload_wait();
   int process_client_command(player_client *c);
   int isa_client(int client_id);
@@ -68,6 +73,7 @@ class game_server : public game_handler
   virtual int add_client(int type, net_socket *sock, net_address *from);
   virtual int kill_slackers();
   virtual int quit();
+  virtual void pipe_reset();
   game_server();
   ~game_server();
 } ;
@@ -0,0 +1,336 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#include "loopback.h"
+
+loop_protocol loopback;
+
+// nothing to do but wait for data that is on its way, so sleep rather
+// than keep a core busy that the other clients and bots could use
+static void wait_until(double t)
+{
+  double left;
+  while ((left=t-loopback.now())>0)
+  {
+    Timer wait;
+    wait.WaitMs((float)left);
+  }
+}
+
+loop_protocol::loop_protocol()
+  : seed(1), next_id(1), sockets(0), total_sent(0), total_lost(0),
+    total_bytes(0), enabled(0)
+{
+}
+
+double loop_protocol::now()
+{
+  time_marker t;
+  return t.diff_time(&start)*1000.0;
+}
+
+// a fixed sequence, so that a benchmark loses the same packets every run
+int loop_protocol::random(int range)
+{
+  seed=seed*1103515245+12345;
+  return (seed>>16)%range;
+}
+
+// when size bytes sent now from a socket get to the other end
+double loop_protocol::due_time(loop_socket *from, int size)
+{
+  double t=now();
+  if (net_bandwidth)
+  {
+    from->link_free=(from->link_free>t ? from->link_free : t)+size*1000.0/(net_bandwidth*1024.0);
+    t=from->link_free;
+  }
+  t+=net_lag;
+  if (net_jitter)
+    t+=random(net_jitter*2+1)-net_jitter;
+  return t;
+}
+
+loop_socket *loop_protocol::find_port(int port, net_socket::socket_type type)
+{
+  for (loop_socket *s=sockets; s; s=s->next)
+    if (s->port==port && s->type==type)
+      return s;
+  return NULL;
+}
+
+net_address *loop_protocol::get_node_address(char const *&server_name, int def_port, int force_port)
+{
+  // any name is this process, only the port matters
+  int port=def_port;
+  char const *colon=strchr(server_name,':');
+  if (colon && !force_port)
+    port=atoi(colon+1);
+  server_name+=strlen(server_name);
+  return new loop_address(port);
+}
+
+net_socket *loop_protocol::connect_to_server(net_address *addr, net_socket::socket_type sock_type)
+{
+  int port=((loop_address *)addr)->port;
+  loop_socket *c=new loop_socket(sock_type);
+
+  if (sock_type==net_socket::SOCKET_FAST)
+  {
+    c->dest=port;
+    return c;
+  }
+
+  loop_socket *l=find_port(port,net_socket::SOCKET_SECURE);
+  if (!l)
+  {
+    if (debug_level(DB_MAJOR_EVENT))
+      fprintf(stderr,"loopback: nobody listening on port %d\n",port);
+    delete c;
+    return NULL;
+  }
+
+  // the listener's end of the connection waits in line to be accepted
+  loop_socket *s=new loop_socket(sock_type);
+  s->peer=c;
+  c->peer=s;
+  s->pending_due=due_time(c,0);
+  loop_socket **p=&l->pending;
+  while (*p) p=&(*p)->next_pending;
+  *p=s;
+  return c;
+}
+
+net_socket *loop_protocol::create_listen_socket(int port, net_socket::socket_type sock_type)
+{
+  loop_socket *s=new loop_socket(sock_type);
+  if (!s->listen(port))
+  {
+    delete s;
+    return NULL;
+  }
+  return s;
+}
+
+int loop_protocol::select(int block)
+{
+  for (;;)
+  {
+    int ret=0;
+    double soonest=-1;
+    for (loop_socket *s=sockets; s; s=s->next)
+    {
+      if (s->ready_to_read())
+        ret++;
+      double t=s->next_due();
+      if (t>=0 && (soonest<0 || t<soonest))
+        soonest=t;
+    }
+
+    // blocking with nothing on its way would never return
+    if (ret || !block || soonest<0)
+      return ret;
+    wait_until(soonest);
+  }
+}
+
+void loop_protocol::get_stats(int &sent, int &lost, int64_t &bytes)
+{
+  sent=total_sent;
+  lost=total_lost;
+  bytes=total_bytes;
+}
+
+loop_socket::loop_socket(socket_type type)
+  : type(type), port(-1), peer(0), peer_closed(0), dest(-1), first(0), last(0),
+    pending(0), next_pending(0), pending_due(0), link_free(0)
+{
+  id=loopback.next_id++;
+  next=loopback.sockets;
+  loopback.sockets=this;
+}
+
+loop_socket::~loop_socket()
+{
+  loop_socket **p=&loopback.sockets;
+  while (*p!=this) p=&(*p)->next;
+  *p=next;
+
+  if (peer)
+  {
+    peer->peer=NULL;
+    peer->peer_closed=1;
+  }
+
+  while (first)
+  {
+    loop_packet *f=first;
+    first=first->next;
+    free(f);
+  }
+
+  while (pending)
+  {
+    loop_socket *s=pending;
+    pending=s->next_pending;
+    delete s;
+  }
+}
+
+void loop_socket::receive(int from_port, void const *buf, int size, double due)
+{
+  loop_packet *p=(loop_packet *)malloc(sizeof(loop_packet)+size);
+  p->from_port=from_port;
+  p->size=size;
+  p->pos=0;
+  p->next=NULL;
+  memcpy(p->data,buf,size);
+
+  if (type==SOCKET_SECURE)
+  {
+    // a stream never passes what was sent before, its connection included
+    double after=last ? last->due : pending_due;
+    p->due=due>after ? due : after;
+    if (last) last->next=p;
+    else first=p;
+    last=p;
+    return;
+  }
+
+  // datagrams may arrive in any order
+  p->due=due;
+  loop_packet **q=&first;
+  while (*q && (*q)->due<=due) q=&(*q)->next;
+  p->next=*q;
+  *q=p;
+  if (!p->next) last=p;
+}
+
+// when the next thing shows up for us, or -1 if nothing is on its way
+double loop_socket::next_due()
+{
+  double t=first ? first->due : -1;
+  if (pending && (t<0 || pending->pending_due<t))
+    t=pending->pending_due;
+  return t;
+}
+
+int loop_socket::ready_to_read()
+{
+  double now=loopback.now();
+  if (pending && pending->pending_due<=now)
+    return 1;
+  return first && first->due<=now;
+}
+
+int loop_socket::available()
+{
+  double now=loopback.now();
+  int total=0;
+  for (loop_packet *p=first; p && p->due<=now; p=p->next)
+    total+=p->size-p->pos;
+  return total;
+}
+
+int loop_socket::write(void const *buf, int size, net_address *addr)
+{
+  loopback.total_sent++;
+  loopback.total_bytes+=size;
+
+  if (type==SOCKET_SECURE)
+  {
+    if (!peer) return -1;
+    peer->receive(port,buf,size,loopback.due_time(this,size));
+    return size;
+  }
+
+  int to_port=addr ? ((loop_address *)addr)->port : dest;
+  double due=loopback.due_time(this,size);
+  loop_socket *to=loopback.find_port(to_port,SOCKET_FAST);
+  if (!to || (net_loss && loopback.random(100)<net_loss))
+  {
+    loopback.total_lost++;
+    return size;
+  }
+  to->receive(port,buf,size,due);
+  return size;
+}
+
+int loop_socket::read(void *buf, int size, net_address **addr)
+{
+  if (addr) *addr=NULL;
+
+  if (type==SOCKET_FAST)
+  {
+    if (!first || first->due>loopback.now())
+      return 0;
+    loop_packet *p=first;
+    first=p->next;
+    if (!first) last=NULL;
+    int ret=Min(size,p->size);
+    memcpy(buf,p->data,ret);
+    if (addr) *addr=new loop_address(p->from_port);
+    free(p);
+    return ret;
+  }
+
+  // like a blocking stream, wait for as much as was asked for if it is sent
+  int ret=0;
+  while (ret<size && first)
+  {
+    wait_until(first->due);
+    int n=Min(size-ret,first->size-first->pos);
+    memcpy((uint8_t *)buf+ret,first->data+first->pos,n);
+    ret+=n;
+    first->pos+=n;
+    if (first->pos==first->size)
+    {
+      loop_packet *p=first;
+      first=p->next;
+      if (!first) last=NULL;
+      free(p);
+    }
+  }
+  return ret;
+}
+
+int loop_socket::listen(int x)
+{
+  if (loopback.find_port(x,type))
+  {
+    fprintf(stderr,"loopback: port %d is already in use\n",x);
+    return 0;
+  }
+  port=x;
+  return 1;
+}
+
+net_socket *loop_socket::accept(net_address *&from)
+{
+  from=NULL;
+  if (type!=SOCKET_SECURE || !pending || pending->pending_due>loopback.now())
+    return NULL;
+
+  loop_socket *s=pending;
+  pending=s->next_pending;
+  s->next_pending=NULL;
+  from=new loop_address(s->peer ? s->peer->id : 0);
+  return s;
+}
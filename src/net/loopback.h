@@ -0,0 +1,125 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __LOOPBACK_HPP_
+#define __LOOPBACK_HPP_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "sock.h"
+#include "timing.h"
+
+// set by -netjitter, -netloss and -netbandwidth; -netlag is the latency
+extern int net_jitter, net_loss, net_bandwidth;
+
+//
+// A network inside the process, for trying the game protocol with bot
+// clients (see netbot.h).  Every packet arrives -netlag ms after it was sent
+// give or take -netjitter ms, fast packets get lost -netloss percent of the
+// time, and each socket sends no more than -netbandwidth KB per second.
+// Secure sockets stay reliable and in order, and reading one waits for data
+// that is on its way, like a blocking TCP read would.
+//
+class loop_address : public net_address
+{
+public:
+  int port;
+
+  loop_address(int port) : port(port) { ; }
+  virtual protocol protocol_type() const { return net_address::OTHER; }
+  virtual int equal(const net_address *who) const
+  { return who->protocol_type()==OTHER && ((loop_address *)who)->port==port; }
+  virtual int set_port(int x) { port=x; return 1; }
+  virtual int get_port() { return port; }
+  virtual void print() { printf("loop:%d",port); }
+  virtual net_address *copy() { return new loop_address(port); }
+  virtual void store_string(char *st, int st_length) { snprintf(st,st_length,"loop:%d",port); }
+};
+
+class loop_socket;
+
+class loop_protocol : public net_protocol
+{
+  friend class loop_socket;
+
+  time_marker start;
+  uint32_t seed;
+  int next_id;
+  loop_socket *sockets;        // every socket, to find the one bound to a port
+  int total_sent, total_lost;
+  int64_t total_bytes;
+
+  loop_socket *find_port(int port, net_socket::socket_type type);
+  double due_time(loop_socket *from, int size);
+  int random(int range);
+public :
+  int enabled;                 // set by -loopback
+
+  loop_protocol();
+  double now();                // milliseconds since the protocol started
+
+  net_address *get_local_address() { return new loop_address(0); }
+  net_address *get_node_address(char const *&server_name, int def_port, int force_port);
+  net_socket *connect_to_server(net_address *addr,
+        net_socket::socket_type sock_type=net_socket::SOCKET_SECURE);
+  net_socket *create_listen_socket(int port, net_socket::socket_type sock_type);
+  int installed() { return enabled; }
+  char const *name() { return "Loopback"; }
+  int select(int block);
+
+  void get_stats(int &sent, int &lost, int64_t &bytes);
+};
+
+extern loop_protocol loopback;
+
+class loop_socket : public net_socket
+{
+  friend class loop_protocol;
+
+  struct loop_packet
+  {
+    double due;
+    int from_port, size, pos;
+    loop_packet *next;
+    uint8_t data[1];
+  };
+
+  socket_type type;
+  int id, port;
+  loop_socket *peer;           // the other end of a secure connection
+  int peer_closed;
+  int dest;                    // where a connected fast socket writes to
+  loop_packet *first, *last;   // received, in order of arrival
+  loop_socket *pending;        // listening: connected by the other end, not accepted yet
+  loop_socket *next_pending;
+  double pending_due;          // when this one shows up at its listener
+  double link_free;            // when what we sent so far is on the wire
+  loop_socket *next;
+
+  void receive(int from_port, void const *buf, int size, double due);
+  double next_due();
+public :
+  loop_socket(socket_type type);
+  virtual ~loop_socket();
+
+  virtual int error() { return type==SOCKET_SECURE && peer_closed && !first; }
+  virtual int ready_to_read();
+  virtual int ready_to_write() { return 1; }
+  virtual int write(void const *buf, int size, net_address *addr=NULL);
+  virtual int read(void *buf, int size, net_address **addr=NULL);
+  virtual int get_fd() { return id; }
+  virtual int listen(int port);
+  virtual net_socket *accept(net_address *&from);
+
+  int available();             // bytes we can read right now without waiting
+};
+
+#endif
@@ -0,0 +1,259 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+
+#include "netface.h"
+#include "loopback.h"
+#include "netbot.h"
+
+extern int net_delay;
+
+net_bot *net_bot::first=NULL;
+int net_bot::total_ticks=0;
+int net_bot::total_resends=0;
+
+net_bot::net_bot(int num, int server_port)
+{
+  state=DEAD;
+  client_id=-1;
+  port=server_port+16+num;
+  server_data=NULL;
+  seed=num+1;
+  next_send=next_recv=0;
+  memset(got,0,sizeof(got));
+  last_heard=loopback.now();
+  next=NULL;
+
+  loop_address server(server_port);
+  data=loopback.create_listen_socket(port,net_socket::SOCKET_FAST);
+  comm=loopback.connect_to_server(&server,net_socket::SOCKET_SECURE);
+  if (!data || !comm)
+    return;
+
+  // all of request_server_entry() says, the server reads it when it is ready
+  char name[16];
+  sprintf(name,"bot%d",num+1);
+  uint8_t hello[2]={ CLIENT_ABUSE, (uint8_t)(strlen(name)+1) };
+  uint16_t our_port=lstl(port);
+  comm->write(hello,2);
+  comm->write(name,hello[1]);
+  comm->write(&our_port,2);
+  state=JOINING;
+}
+
+net_bot::~net_bot()
+{
+  delete comm;
+  delete data;
+  delete server_data;
+}
+
+// what the bot does at tick: runs one way or the other for 16 ticks at a
+// time, jumping now and then, the same every time it is asked
+void net_bot::send_input(uint8_t tick)
+{
+  uint32_t h=(seed*2654435761u)^((uint32_t)(tick>>4)*40503u);
+  h=h*1103515245+12345;
+  uint8_t mflags=((h>>16)%3==0 ? 1 : (h>>16)%3==1 ? 2 : 0);
+  if ((tick&7)==(h>>24)%8)
+    mflags|=8;
+
+  net_packet pk;
+  pk.packet_reset();
+  pk.write_uint8(SCMD_SET_INPUT);
+  pk.write_uint8(client_id);
+  pk.write_uint8(mflags);
+  pk.write_uint16(0);
+  pk.write_uint16(0);
+  pk.set_tick_received(tick);
+  pk.calc_checksum();
+  data->write(pk.data,pk.packet_size()+pk.packet_prefix_size(),server_data);
+}
+
+// nothing heard for a while, send again all the input the server may not
+// have used, which also makes it send again what it merged already
+void net_bot::resend()
+{
+  for (uint8_t t=next_recv; t!=next_send; t++)
+  {
+    send_input(t);
+    total_resends++;
+  }
+}
+
+void net_bot::service()
+{
+  if (state==DEAD) return;
+  if (comm->error())
+  {
+    state=DEAD;
+    return;
+  }
+
+  loop_socket *c=(loop_socket *)comm;
+  double now=loopback.now();
+
+  if (state==JOINING)
+  {
+    // registered byte, server game port, kills, client id, delay, rollback
+    if (c->available()<9) return;
+
+    uint8_t reg,pipe[2];
+    uint16_t sport,nkills,cnum;
+    c->read(&reg,1);
+    if (reg!=1)
+    {
+      state=DEAD;
+      return;
+    }
+    c->read(&sport,2);
+    c->read(&nkills,2);
+    c->read(&cnum,2);
+    c->read(pipe,2);     // the server's are ours, we share the globals
+    server_data=new loop_address(lstl(sport));
+    client_id=lstl(cnum);
+
+    uint8_t cmd=CLCMD_RELOAD_START;
+    comm->write(&cmd,1);
+    state=RELOADING;
+    return;
+  }
+
+  if (state==RELOADING)
+  {
+    while (data->ready_to_read())    // not in the game yet
+    {
+      net_packet tmp;
+      data->read(tmp.data,PACKET_MAX_SIZE);
+    }
+    if (c->available()<2) return;
+
+    uint8_t ok[2];
+    c->read(ok,2);
+    uint8_t cmd=CLCMD_RELOAD_END;
+    comm->write(&cmd,1);
+
+    // the level is not loaded, the server does not need us to
+    next_send=next_recv=ok[1];
+    memset(got,0,sizeof(got));
+    for (int i=0; i<Max(net_delay,1); i++)
+      send_input(next_send++);
+    last_heard=now;
+    state=PLAYING;
+    return;
+  }
+
+  while (c->available())
+  {
+    uint8_t cmd,tick;
+    c->read(&cmd,1);
+    if (cmd==CLCMD_REQUEST_RESEND)
+      c->read(&tick,1);
+    else if (cmd==CLCMD_UNJOIN)
+    {
+      state=DEAD;
+      return;
+    }
+  }
+
+  while (data->ready_to_read())
+  {
+    net_packet tmp;
+    int size=data->read(tmp.data,PACKET_MAX_SIZE);
+    if (size!=tmp.packet_size()+tmp.packet_prefix_size())
+      continue;
+    uint16_t rec_crc=tmp.get_checksum();
+    if (rec_crc!=tmp.calc_checksum())
+      continue;
+    uint8_t tick=tmp.tick_received();
+    if ((uint8_t)(tick-next_recv)>=128 || got[tick])
+      continue;    // old, or a copy
+    got[tick]=1;
+
+    // the server wants everyone to reload, or does not want us any more
+    uint8_t *p=tmp.packet_data(),*end=p+tmp.packet_size();
+    for (int n; p<end && (n=scmd_size(p)); p+=n)
+    {
+      if (*p==SCMD_RELOAD)
+        got[tick]=2;
+      else if (*p==SCMD_DELETE_CLIENT && p[1]==client_id)
+      {
+        state=DEAD;
+        return;
+      }
+    }
+
+    while (got[next_recv])
+    {
+      int reload=got[next_recv]==2;
+      got[next_recv]=0;
+      next_recv++;
+      total_ticks++;
+      if (reload)     // the server tells us where to go on from
+      {
+        uint8_t cmd=CLCMD_RELOAD_START;
+        comm->write(&cmd,1);
+        state=RELOADING;
+        return;
+      }
+      send_input(next_send++);
+    }
+    last_heard=now;
+  }
+
+  if (now-last_heard>Max(50,2*(net_lag+net_jitter)))
+  {
+    resend();
+    last_heard=now;
+  }
+}
+
+void net_bot::start(int count, int server_port)
+{
+  for (int i=0; i<count; i++)
+  {
+    net_bot *b=new net_bot(i,server_port);
+    b->next=first;
+    first=b;
+  }
+}
+
+void net_bot::service_all()
+{
+  for (net_bot *b=first; b; b=b->next)
+    b->service();
+}
+
+void net_bot::stop_all()
+{
+  while (first)
+  {
+    net_bot *b=first;
+    first=b->next;
+    delete b;
+  }
+}
+
+void net_bot::get_stats(int &bots, int &ticks, int &resends)
+{
+  bots=0;
+  for (net_bot *b=first; b; b=b->next)
+    bots+=b->state==PLAYING;
+  ticks=total_ticks;
+  resends=total_resends;
+}
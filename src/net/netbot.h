@@ -0,0 +1,55 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __NETBOT_HPP_
+#define __NETBOT_HPP_
+
+#include <stdint.h>
+
+#include "sock.h"
+
+//
+// Clients that join a server in this process through the loopback protocol
+// and play it with made up input, speaking the same protocol as game_client
+// but without running the game.  They skip loading the level, since the
+// server simulates their players anyway, so only the server can check that
+// the game stays in sync.
+//
+class net_bot
+{
+  enum { JOINING, RELOADING, PLAYING, DEAD };
+
+  int state, client_id, port;
+  net_socket *comm, *data;
+  net_address *server_data;
+  uint32_t seed;
+  uint8_t next_send, next_recv;  // next tick to send input for, to hear about
+  uint8_t got[256];              // ticks heard about ahead of next_recv, 2 if reloading
+  double last_heard;
+  net_bot *next;
+
+  void send_input(uint8_t tick);
+  void resend();
+  void service();
+
+  static net_bot *first;
+  static int total_ticks, total_resends;
+public :
+  net_bot(int num, int server_port);
+  ~net_bot();
+
+  // start count bots joining the server listening on server_port
+  static void start(int count, int server_port);
+  static void service_all();
+  static void stop_all();
+  static void get_stats(int &bots, int &ticks, int &resends);
+};
+
+#endif
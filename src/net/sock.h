@@ -40,6 +40,9 @@ public:
   virtual net_socket *accept(net_address *&from) { from=0; return 0; }
 };
 
+// set by -netlag, milliseconds a packet takes to get anywhere
+extern int net_lag;
+
 class net_protocol
 {
 public:
@@ -615,7 +615,7 @@ int tcpip_protocol::handle_responder()
 
 tcpip_protocol::tcpip_protocol()
 //{{{
-  : notifier(0), notify_len(0), responder(0)
+  : notifier(0), notify_len(0), responder(0), lag_first(0), lag_last(0)
 {
 #if (defined(__APPLE__) && !defined(__MACH__))
   GUSISetup(GUSIwithSIOUXSockets);
@@ -634,6 +634,7 @@ int tcpip_protocol::select(int block)
 {
   int ret;
 
+  send_lagged(0);
   memcpy(&read_set,&master_set,sizeof(master_set));
   memcpy(&exception_set,&master_set,sizeof(master_set));
   memcpy(&write_set,&master_write_set,sizeof(master_set));
@@ -641,8 +642,19 @@ int tcpip_protocol::select(int block)
   {
     ret = 0;
     while (ret == 0) {
-      // get number of sockets ready from system call
-      ret = ::select(FD_SETSIZE,&read_set,&write_set,&exception_set,NULL);
+      // get number of sockets ready from system call, waking up now and
+      // then to send lagged packets if there are any
+      timeval tv={ 0,1000};
+      ret = ::select(FD_SETSIZE,&read_set,&write_set,&exception_set,
+                     lag_first ? &tv : NULL);
+      if (ret == 0 && lag_first)
+      {
+        send_lagged(0);
+        memcpy(&read_set,&master_set,sizeof(master_set));
+        memcpy(&exception_set,&master_set,sizeof(master_set));
+        memcpy(&write_set,&master_write_set,sizeof(master_set));
+        continue;
+      }
 
       // remove notifier & responder events from the count of sockets selected
       if (handle_notification())
@@ -667,12 +679,54 @@ int tcpip_protocol::select(int block)
 }
 //}}}///////////////////////////////////
 
+int tcpip_protocol::lag_packet(int fd, void const *buf, int size, sockaddr_in *to)
+//{{{
+{
+  LaggedPacket *p=(LaggedPacket *)malloc(sizeof(LaggedPacket)+size);
+  p->fd=fd;
+  p->size=size;
+  p->to=*to;
+  p->queued.get_time();
+  p->next=0;
+  memcpy(p->data,buf,size);
+
+  // every packet waits just as long, so the list stays in sending order
+  if (lag_last)
+    lag_last->next=p;
+  else
+    lag_first=p;
+  lag_last=p;
+  return size;
+}
+//}}}///////////////////////////////////
+
+// send the packets that waited long enough, or forget them all if drop is
+// set, because their sockets are going away
+void tcpip_protocol::send_lagged(int drop)
+//{{{
+{
+  time_marker now;
+  while (lag_first && (drop || now.diff_time(&lag_first->queued)*1000.0>=net_lag))
+  {
+    LaggedPacket *p=lag_first;
+    if (!drop)
+      sendto(p->fd,p->data,p->size,0,(sockaddr *)&p->to,sizeof(p->to));
+    lag_first=p->next;
+    if (!lag_first)
+      lag_last=0;
+    free(p);
+  }
+}
+//}}}///////////////////////////////////
+
 void tcpip_protocol::cleanup()
 //{{{
 {
     if (notifier)
         end_notify();
 
+    send_lagged(1);
+
     reset_find_list();
 
     if (responder) {
@@ -46,6 +46,7 @@ typedef int socklen_t;
 
 #include "sock.h"
 #include "isllist.h"
+#include "timing.h"
 
 extern fd_set master_set, master_write_set, read_set, exception_set, write_set;
 
@@ -110,6 +111,18 @@ protected:
 
   int handle_notification();
   int handle_responder();
+
+  // -netlag: udp packets waiting to go out
+  struct LaggedPacket
+  {
+      int fd, size;
+      sockaddr_in to;
+      time_marker queued;
+      LaggedPacket *next;
+      char data[1];
+  };
+  LaggedPacket *lag_first, *lag_last;
+  void send_lagged(int drop);
 public :
   fd_set master_set,master_write_set,read_set,exception_set,write_set;
 
@@ -123,6 +136,7 @@ public :
   char const *name() { return "UNIX generic TCPIP"; }
   void cleanup();
   int select(int block);          // return # of sockets available for read & writing
+  int lag_packet(int fd, void const *buf, int size, sockaddr_in *to);
 
   // Notification methods
   virtual net_socket *start_notify(int port, void *data, int len);
@@ -232,6 +246,8 @@ class udp_socket : public unix_fd
   }
   virtual int write(void const *buf, int size, net_address *addr=NULL)
   {
+    if (addr && net_lag)
+      return tcpip.lag_packet(fd,buf,size,&((ip_address *)addr)->addr);
     if (addr)
       return sendto(fd,(char*)buf,size,0,(sockaddr *)(&((ip_address *)addr)->addr),sizeof(((ip_address *)addr)->addr));
     else {
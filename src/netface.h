@@ -94,9 +94,31 @@ enum {
        SCMD_EXT_KEYPRESS,
        SCMD_EXT_KEYRELEASE,
        SCMD_CHAT_KEYPRESS,
-       SCMD_SYNC
+       SCMD_SYNC,
+       SCMD_SYNC_AT            // pipelined games: tick and make_sync() of a tick the sender confirmed
      };
 
+// size of the command at pk, command byte included, or 0 if unknown
+static inline int scmd_size(uint8_t const *pk)
+{
+  switch (*pk)
+  {
+    case SCMD_DELETE_CLIENT : return 2;
+    case SCMD_VIEW_RESIZE : return 2+8*4;
+    case SCMD_SET_INPUT : return 2+5;
+    case SCMD_WEAPON_CHANGE : return 2+4;
+    case SCMD_RELOAD : return 1;
+    case SCMD_KEYPRESS :
+    case SCMD_KEYRELEASE :
+    case SCMD_EXT_KEYPRESS :
+    case SCMD_EXT_KEYRELEASE :
+    case SCMD_CHAT_KEYPRESS :
+    case SCMD_SYNC : return 3;
+    case SCMD_SYNC_AT : return 4;
+  }
+  return 0;
+}
+
 
 struct join_struct
 {
@@ -149,6 +171,31 @@ struct net_packet
 
 } ;
 
+// In pipelined games (-netdelay, -rollback) input is sent a few ticks ahead
+// of the tick it is for, so packets are kept in a ring, by tick stamp
+#define NET_WINDOW 32
+
+struct net_window
+{
+  net_packet packet[NET_WINDOW];
+  uint8_t used[NET_WINDOW];
+
+  void clear() { memset(used,0,sizeof(used)); }
+  net_packet *find(uint8_t tick)
+  {
+    int i=tick%NET_WINDOW;
+    return used[i] && packet[i].tick_received()==tick ? packet+i : NULL;
+  }
+  net_packet *put(uint8_t tick)    // returns an empty packet stamped tick
+  {
+    int i=tick%NET_WINDOW;
+    used[i]=1;
+    packet[i].packet_reset();
+    packet[i].set_tick_received(tick);
+    return packet+i;
+  }
+} ;
+
 struct base_memory_struct
 {
   net_packet packet,                        // current tick data
@@ -162,6 +209,11 @@ struct base_memory_struct
   int16_t input_state;          // COLLECTING or PROCESSING
   int16_t current_tick;         // set by engine, used by driver to confirm packet is not left over
 
+  net_window sent,              // pipelined games: our own input, by the tick it is for
+             merged;            // pipelined games: everyone's input, by tick
+  int16_t next_tick;            // pipelined games: oldest merged packet the engine still needs
+  int16_t reload_tick;          // tick the game restarts at after a reload, sent by the server
+
   join_struct *join_list;
 } ;
 
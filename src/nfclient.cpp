@@ -60,6 +60,17 @@ bFILE *open_nfs_file(char const *filename, char const *mode)
   return new nfs_file(filename,mode);
 }
 
+// Whether nfs_file may read filename from a file server, rather than the
+// plain file open_file() would read anyway
+int nfs_remote_file(char const *filename)
+{
+#if HAVE_NETWORK
+  return (filename[0]=='/' && filename[1]=='/') || net_crcs!=NULL;
+#else
+  return 0;
+#endif
+}
+
 
 nfs_file::nfs_file(char const *filename, char const *mode)
 {
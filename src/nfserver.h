@@ -24,6 +24,7 @@ void remove_client(int client_number);
 
 int net_start();
 bFILE *open_nfs_file(char const *filename, char const *mode);
+int nfs_remote_file(char const *filename);
 
 int NF_open_file(char const *filename, char const *mode);
 long NF_close(int fd);
@@ -47,6 +48,12 @@ int get_remote_lsf(net_address *addr, char *filename);   // filename should be 2
 
 void send_local_request();                          // sends from *base
 int get_inputs_from_server(unsigned char *buf);     // return bytes read into buf (will be less than PACKET_MAX_SIZE
+int net_wait_tick(uint8_t tick);                    // pipelined games: wait for base->merged to have tick, 0 if the net is gone
+void net_pipe_start(uint8_t tick);
+
+extern int net_delay, net_rollback, net_pipelined, net_lag;
+extern int net_jitter, net_loss, net_bandwidth, net_bots;
+void net_stall_stats(int &stalls, float &ms);
 
 
 int client_number();
@@ -260,9 +260,9 @@ void game_object::reload_notify()
     game_object *o=current_object;
     current_object=this;
 
-    void *m = LSpace::Tmp.Mark();
+    LTmpScope scope;
     ((LSymbol *)ns)->EvalFunction(NULL);
-    LSpace::Tmp.Restore(m);
+    scope.End();
 
     current_object=o;
   }
@@ -274,9 +274,9 @@ void game_object::next_sequence()
     if( ns )
     {
         current_object = this;
-        void *m = LSpace::Tmp.Mark();
+        LTmpScope scope;
         ((LSymbol *)ns)->EvalFunction(NULL);
-        LSpace::Tmp.Restore(m);
+        scope.End();
     }
     else
     {
@@ -410,7 +410,7 @@ int game_object::decide()
     old_aistate=aistate();
 
     current_object=this;
-    void *m = LSpace::Tmp.Mark();
+    LTmpScope scope;
 
     time_marker *prof1=NULL;
     if (profiling())
@@ -424,7 +424,7 @@ int game_object::decide()
       delete prof1;
     }
 
-    LSpace::Tmp.Restore(m);
+    scope.End();
 
     if (keep_ai_info())
     {
@@ -484,7 +484,7 @@ void game_object::do_damage(int amount, game_object *from, int32_t hitx, int32_t
     game_object *o = current_object;
     current_object = this;
 
-    void *m = LSpace::Tmp.Mark();
+    LTmpScope scope;
 
     am = LList::Create();
     PtrRef r1(am);
@@ -528,7 +528,7 @@ void game_object::do_damage(int amount, game_object *from, int32_t hitx, int32_t
       delete prof1;
     }
 
-    LSpace::Tmp.Restore(m);
+    scope.End();
 
     current_object = o;
   } else damage_fun(amount,from,hitx,hity,push_xvel,push_yvel);
@@ -624,7 +624,7 @@ void game_object::draw()
   {
     current_object=this;
 
-    void *m = LSpace::Tmp.Mark();
+    LTmpScope scope;
     time_marker *prof1=NULL;
     if (profiling())
       prof1=new time_marker;
@@ -637,7 +637,7 @@ void game_object::draw()
       delete prof1;
     }
 
-    LSpace::Tmp.Restore(m);
+    scope.End();
 
   } else drawer();
 }
@@ -649,7 +649,7 @@ void game_object::map_draw()
   {
     current_object=this;
 
-    void *m = LSpace::Tmp.Mark();
+    LTmpScope scope;
     time_marker *prof1=NULL;
     if (profiling())
       prof1=new time_marker;
@@ -662,7 +662,7 @@ void game_object::map_draw()
       delete prof1;
     }
 
-    LSpace::Tmp.Restore(m);
+    scope.End();
   }
 }
 
@@ -956,6 +956,7 @@ int game_object::tick()      // returns blocked status
     set_yvel(yv);
     x+=xv;
     y+=yv;
+    if (current_level) current_level->update_grid(this);
 
     if (h && stoppable()) return BLOCKED_LEFT|BLOCKED_RIGHT;
 
@@ -1102,6 +1103,7 @@ int game_object::tick()      // returns blocked status
       blocked|=BLOCKED_DOWN;
     }
   }
+  if (current_level) current_level->update_grid(this);
   return blocked;
 }
 
@@ -1154,7 +1156,7 @@ game_object *create(int type, int32_t x, int32_t y, int skip_constructor, int ai
     game_object *o=current_object;
     current_object=g;
 
-    void *m = LSpace::Tmp.Mark();
+    LTmpScope scope;
 
     time_marker *prof1=NULL;
     if (profiling())
@@ -1168,7 +1170,7 @@ game_object *create(int type, int32_t x, int32_t y, int skip_constructor, int ai
       delete prof1;
     }
 
-    LSpace::Tmp.Restore(m);
+    scope.End();
     current_object = o;
   }
   return g;
@@ -1216,7 +1218,7 @@ int game_object::move(int cx, int cy, int button)
     lcx->m_cdr = lcy;
     lcy->m_cdr = lb;
 
-    void *m = LSpace::Tmp.Mark();
+    LTmpScope scope;
 
     time_marker *prof1 = NULL;
     if (profiling())
@@ -1230,8 +1232,6 @@ int game_object::move(int cx, int cy, int button)
       delete prof1;
     }
 
-    LSpace::Tmp.Restore(m);
-
     if (item_type(r)!=L_NUMBER)
     {
       ((LObject *)r)->Print();
@@ -1240,6 +1240,7 @@ int game_object::move(int cx, int cy, int button)
          "ai function.", object_names[otype]);
     }
     ret |= lnumber_value(r);
+    scope.End();
     current_object = o;
   }
   else ret |= mover(cx, cy, button);
@@ -1538,6 +1539,9 @@ int32_t object_list_length(object_node *list)
 game_object::game_object(int Type, int load)
 {
   lvars = NULL;
+  grid_next = grid_prev = NULL;
+  grid_cell = -1;
+  grid_order = target_index = block_index = all_block_index = 0;
 
   if (Type<0xffff)
   {
@@ -1620,7 +1624,7 @@ void game_object::change_type(int new_type)
     game_object *o=current_object;
     current_object=this;
 
-    void *m = LSpace::Tmp.Mark();
+    LTmpScope scope;
 
     time_marker *prof1=NULL;
     if (profiling())
@@ -1634,7 +1638,7 @@ void game_object::change_type(int new_type)
       delete prof1;
     }
 
-    LSpace::Tmp.Restore(m);
+    scope.End();
     current_object = o;
   }
 }
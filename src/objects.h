@@ -57,6 +57,10 @@ class game_object : public simple_object
   sequence *current_sequence() { return figures[otype]->get_sequence(state); }
 public :
   game_object *next,*next_active;
+  game_object *grid_next,*grid_prev;   // bucket links, owned by the level's ObjectGrid
+  int grid_cell,grid_order,            // grid_cell is -1 when not in the grid
+      target_index,                    // position in the level's target list
+      block_index,all_block_index;     // and in its block lists
   int32_t *lvars;
 
   int size();
@@ -0,0 +1,217 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#include "objgrid.h"
+#include "objects.h"
+
+// set to 0 (-nogrid) to make every query fall back to linear list scans
+int use_object_grid = 1;
+
+ObjectGrid::ObjectGrid()
+{
+    m_cells = NULL;
+    m_cols = m_rows = 0;
+    m_cell_w = m_cell_h = 1;
+    m_reach_x = m_reach_y = 0;
+    m_order = 0;
+    m_valid = false;
+    m_by_order = NULL;
+    m_marks = NULL;
+    m_order_size = 0;
+}
+
+ObjectGrid::~ObjectGrid()
+{
+    free(m_cells);
+    free(m_by_order);
+    free(m_marks);
+}
+
+void ObjectGrid::Clear(int32_t w, int32_t h, int tile_w, int tile_h)
+{
+    Invalidate();
+
+    int cell_w = Max(tile_w, 1) * GRID_CELL_TILES_X;
+    int cell_h = Max(tile_h, 1) * GRID_CELL_TILES_Y;
+    int cols = Max((int)(w + cell_w - 1) / cell_w, 1);
+    int rows = Max((int)(h + cell_h - 1) / cell_h, 1);
+
+    if (cols != m_cols || rows != m_rows || !m_cells)
+    {
+        m_cols = cols;
+        m_rows = rows;
+        m_cells = (game_object **)realloc(m_cells,
+                                  sizeof(game_object *) * m_cols * m_rows);
+        memset(m_cells, 0, sizeof(game_object *) * m_cols * m_rows);
+        // The reach only grows while the grid keeps its size, which covers
+        // the per-tick clears of one level. A resized grid usually means
+        // another level, so start over; a new level of the same size keeps
+        // the old reach, which only costs a few extra candidates per query.
+        m_reach_x = m_reach_y = 0;
+    }
+    m_cell_w = cell_w;
+    m_cell_h = cell_h;
+    m_order = 0;
+    m_valid = use_object_grid != 0;
+}
+
+void ObjectGrid::Invalidate()
+{
+    if (m_cells)
+    {
+        for (int i = 0; i < m_cols * m_rows; i++)
+        {
+            for (game_object *o = m_cells[i]; o; o = o->grid_next)
+                o->grid_cell = -1;
+            m_cells[i] = NULL;
+        }
+    }
+    m_valid = false;
+}
+
+int ObjectGrid::CellOf(int32_t x, int32_t y)
+{
+    int cx = x < 0 ? 0 : Min((int)(x / m_cell_w), m_cols - 1);
+    int cy = y < 0 ? 0 : Min((int)(y / m_cell_h), m_rows - 1);
+    return cx + cy * m_cols;
+}
+
+void ObjectGrid::Link(game_object *o, int cell)
+{
+    o->grid_cell = cell;
+    o->grid_prev = NULL;
+    o->grid_next = m_cells[cell];
+    if (o->grid_next)
+        o->grid_next->grid_prev = o;
+    m_cells[cell] = o;
+}
+
+void ObjectGrid::Unlink(game_object *o)
+{
+    if (o->grid_prev)
+        o->grid_prev->grid_next = o->grid_next;
+    else
+        m_cells[o->grid_cell] = o->grid_next;
+    if (o->grid_next)
+        o->grid_next->grid_prev = o->grid_prev;
+    o->grid_cell = -1;
+}
+
+// Keep track of how far a picture can extend from its object's position
+void ObjectGrid::Reach(game_object *o)
+{
+    int32_t x1, y1, x2, y2;
+    o->picture_space(x1, y1, x2, y2);
+    m_reach_x = Max(m_reach_x, Max(o->x - x1, x2 - o->x));
+    m_reach_y = Max(m_reach_y, Max(o->y - y1, y2 - o->y));
+}
+
+void ObjectGrid::Insert(game_object *o)
+{
+    if (!m_valid)
+        return;
+    if (m_order >= m_order_size)
+    {
+        int old_words = m_order_size / 32;
+        m_order_size = Max(m_order_size * 2, 256);
+        m_by_order = (game_object **)realloc(m_by_order,
+                                  sizeof(game_object *) * m_order_size);
+        m_marks = (uint32_t *)realloc(m_marks,
+                                  sizeof(uint32_t) * m_order_size / 32);
+        memset(m_marks + old_words, 0,
+               sizeof(uint32_t) * (m_order_size / 32 - old_words));
+    }
+    m_by_order[m_order] = o;
+    o->grid_order = m_order++;
+    Reach(o);
+    Link(o, CellOf(o->x, o->y));
+}
+
+void ObjectGrid::Remove(game_object *o)
+{
+    if (m_valid && o->grid_cell >= 0)
+        Unlink(o);
+}
+
+void ObjectGrid::Update(game_object *o)
+{
+    if (!m_valid || o->grid_cell < 0)
+        return;
+
+    Reach(o);
+    int cell = CellOf(o->x, o->y);
+    if (cell != o->grid_cell)
+    {
+        Unlink(o);
+        Link(o, cell);
+    }
+}
+
+void ObjectGrid::Query(GridQuery &q, int32_t x1, int32_t y1,
+                       int32_t x2, int32_t y2)
+{
+    int32_t rx = m_reach_x + GRID_SLACK, ry = m_reach_y + GRID_SLACK;
+    int c1 = CellOf(x1 - rx, y1 - ry), c2 = CellOf(x2 + rx, y2 + ry);
+    int cx1 = c1 % m_cols, cy1 = c1 / m_cols;
+    int cx2 = c2 % m_cols, cy2 = c2 / m_cols;
+
+    // Cells are coarse, so also drop what is out of reach within them;
+    // in a crowd that leaves far fewer candidates to sort
+    x1 -= rx; y1 -= ry; x2 += rx; y2 += ry;
+    int lo = m_order, hi = -1;
+    for (int cy = cy1; cy <= cy2; cy++)
+        for (int cx = cx1; cx <= cx2; cx++)
+            for (game_object *o = m_cells[cx + cy * m_cols]; o; o = o->grid_next)
+                if (o->x >= x1 && o->x <= x2 && o->y >= y1 && o->y <= y2)
+                {
+                    int k = o->grid_order;
+                    m_marks[k / 32] |= 1u << (k % 32);
+                    lo = Min(lo, k);
+                    hi = Max(hi, k);
+                }
+
+    // Callers rely on active list order to break ties like a list scan, so
+    // read the marks back in insertion order rather than sort, clearing
+    // them as we go
+    q.total = 0;
+    for (int w = lo / 32; hi >= 0 && w <= hi / 32; w++)
+    {
+        uint32_t bits = m_marks[w];
+        m_marks[w] = 0;
+        for (int k = w * 32; bits; k++, bits >>= 1)
+            if (bits & 1)
+                q.Add(m_by_order[k]);
+    }
+}
+
+void GridQuery::Add(game_object *o)
+{
+    if (total >= size)
+    {
+        size *= 2;
+        if (list == small)
+        {
+            list = (game_object **)malloc(sizeof(game_object *) * size);
+            memcpy(list, small, sizeof(small));
+        }
+        else
+            list = (game_object **)realloc(list, sizeof(game_object *) * size);
+    }
+    list[total++] = o;
+}
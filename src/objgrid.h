@@ -0,0 +1,97 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __OBJGRID_H__
+#define __OBJGRID_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+class game_object;
+class ObjectGrid;
+
+// Size of a grid cell, in foreground tiles
+#define GRID_CELL_TILES_X 4
+#define GRID_CELL_TILES_Y 8
+
+// Extra distance added to the largest picture seen so far when querying,
+// so that small moves done behind the grid's back are still found
+#define GRID_SLACK 32
+
+// Number of results a GridQuery holds before going to the heap
+#define GRID_QUERY_SMALL 64
+
+//
+// Result of an ObjectGrid query. It owns its storage so that queries may
+// nest, e.g. when a damage callback runs a Lisp search of its own.
+//
+class GridQuery
+{
+    friend class ObjectGrid;
+
+public:
+    GridQuery() : list(small), total(0), size(GRID_QUERY_SMALL) { }
+    ~GridQuery() { if (list != small) free(list); }
+
+    void Add(game_object *o);
+
+    game_object **list;
+    int total;
+
+private:
+    game_object *small[GRID_QUERY_SMALL];
+    int size;
+};
+
+//
+// Uniform bucket grid over the active objects of a level. Objects are
+// bucketed by their (x,y) position; queries return every object whose
+// picture may overlap the requested rectangle, sorted in active list order
+// so that callers can reproduce the exact results of a linear scan.
+//
+class ObjectGrid
+{
+public:
+    ObjectGrid();
+    ~ObjectGrid();
+
+    // Empty the grid and size it for a level of w x h pixels
+    void Clear(int32_t w, int32_t h, int tile_w, int tile_h);
+    void Invalidate();
+    bool IsValid() const { return m_valid; }
+
+    void Insert(game_object *o);
+    void Remove(game_object *o);
+    void Update(game_object *o); // call after o->x or o->y changed
+
+    // Fill q with the candidates for the given rectangle
+    void Query(GridQuery &q, int32_t x1, int32_t y1, int32_t x2, int32_t y2);
+
+private:
+    int CellOf(int32_t x, int32_t y);
+    void Link(game_object *o, int cell);
+    void Unlink(game_object *o);
+    void Reach(game_object *o);
+
+    game_object **m_cells;
+    int m_cols, m_rows, m_cell_w, m_cell_h;
+    int32_t m_reach_x, m_reach_y;
+    int m_order;
+    // Objects by insertion order, and one bit per order for Query to mark
+    // its candidates in; the bits are all clear between queries
+    game_object **m_by_order;
+    uint32_t *m_marks;
+    int m_order_size;
+    bool m_valid;
+};
+
+extern int use_object_grid;
+
+#endif // __OBJGRID_H__
@@ -0,0 +1,116 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#include "game.h"
+#include "demo.h"
+#include "jdir.h"
+#include "replay.h"
+
+extern int idle_ticks;
+
+static int compare_names(void const *a, void const *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// Play every demo in dir to its end as fast as possible, checking the sync
+// value recorded with each tick against the one the simulation computes.
+// Any difference means the simulation is no longer the one that recorded
+// the demo. Returns the number of demos that did.
+static int replay_dir(Game *g, char const *dir)
+{
+    char path[256];
+    strncpy(path, dir, sizeof(path) - 1);
+    path[sizeof(path) - 1] = 0;
+    char **files, **dirs;
+    int tfiles, tdirs;
+    get_directory(path, files, tfiles, dirs, tdirs);
+    for (int d = 0; d < tdirs; d++)
+        free(dirs[d]);
+    free(dirs);
+    qsort(files, tfiles, sizeof(char *), compare_names);
+
+    int played = 0, diverged = 0, total_ticks = 0;
+    float total_ms = 0.f;
+
+    for (int f = 0; f < tfiles; f++)
+    {
+        char name[512];
+        snprintf(name, sizeof(name), "%s/%s", path, files[f]);
+        free(files[f]);
+
+        // Anything that does not start like a demo is skipped
+        if (!demo_man.set_state(demo_manager::PLAYING, name))
+            continue;
+
+        Timer timer;
+        int ticks = 0;
+        while (!g->done())
+        {
+            demo_man.do_inputs();
+            if (demo_man.current_state() != demo_manager::PLAYING)
+                break; // demo ran out
+            idle_ticks = 0;
+            g->step();
+            ticks++;
+        }
+        float ms = timer.GetMs();
+
+        // Ending the demo threw its level away, so what is left to report
+        // is what the sync checks saw
+        played++;
+        total_ticks += ticks;
+        total_ms += ms;
+        printf("headless: replay %s: %d ticks in %.1f ms, %.1f ticks/sec",
+               name, ticks, ms,
+               ms > 0.f ? ticks * 1000.f / ms : 0.f);
+        if (demo_man.sync_errors)
+        {
+            diverged++;
+            printf(", first out of sync at tick %d (recorded %04x, "
+                   "computed %04x), %d ticks out of sync (MISMATCH)\n",
+                   (int)demo_man.first_bad_tick, demo_man.bad_recorded,
+                   demo_man.bad_computed, demo_man.sync_errors);
+        }
+        else
+            printf(", in sync\n");
+        if (demo_man.current_state() != demo_manager::NORMAL)
+            demo_man.set_state(demo_manager::NORMAL);
+    }
+    free(files);
+
+    printf("headless: replayed %d demos from %s, %d ticks in %.1f ms, "
+           "%.1f ticks/sec, %d out of sync%s\n", played, path, total_ticks,
+           total_ms, total_ms > 0.f ? total_ticks * 1000.f / total_ms : 0.f,
+           diverged, diverged ? " (MISMATCH)" : "");
+    return diverged;
+}
+
+int replay_run(Game *g, int argc, char **argv)
+{
+    int diverged = 0;
+    for (int i = 1; i + 1 < argc; i++)
+        if (!strcmp(argv[i], "-replaydir"))
+        {
+            demo_man.set_state(demo_manager::NORMAL);
+            diverged += replay_dir(g, argv[i + 1]);
+        }
+    return diverged;
+}
@@ -0,0 +1,22 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+class Game;
+
+// Play every demo of the directories given with -replaydir as fast as
+// possible and check that they stay in sync, printing a line per demo and
+// a summary. Does nothing unless -replaydir was given. Returns the number
+// of demos that went out of sync.
+int replay_run(Game *g, int argc, char **argv);
+
+#endif // __REPLAY_H__
@@ -0,0 +1,436 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#include "rollback.h"
+#include "view.h"
+#include "game.h"
+#include "level.h"
+#include "demo.h"
+#include "loader2.h"
+#include "nfserver.h"
+#include "dprint.h"
+#include "status.h"
+#include "lisp.h"
+
+extern char req_name[100];
+
+Rollback rollback;
+
+Rollback::Rollback()
+{
+    memset(m_snap, 0, sizeof(m_snap));
+    for (int i = 0; i < NET_WINDOW; i++)
+        Lisp::Register((void **)&m_snap[i].globals);
+    m_total_confirmed = m_total_predicted = m_rollbacks = m_resimulated
+        = m_desyncs = m_saves = 0;
+    m_save_ms = 0.f;
+    m_save_bytes = 0;
+    Reset(0);
+    m_reset = false;
+}
+
+Rollback::~Rollback()
+{
+    FreeSnapshots();
+    for (int i = 0; i < NET_WINDOW; i++)
+        Lisp::Unregister((void **)&m_snap[i].globals);
+}
+
+void Rollback::Reset(uint8_t tick)
+{
+    FreeSnapshots();
+    m_next = m_confirmed = tick;
+    m_predicting = false;
+    memset(m_has_input, 0, sizeof(m_has_input));
+    memset(m_has_sync, 0, sizeof(m_has_sync));
+    m_last_sync = -1;
+    // whatever was running when this got called must not go on
+    m_reset = true;
+}
+
+uint8_t Rollback::SendTick() const
+{
+    return m_next + net_delay;
+}
+
+void Rollback::Receive()
+{
+    m_reset = false;
+    Reconcile();
+
+    while (!m_reset)
+    {
+        net_packet *pk = base->merged.find(m_next);
+        if (m_confirmed == m_next && pk)
+        {
+            Apply(pk);
+            if (!m_reset)
+                Confirm(pk, true);
+            break;
+        }
+
+        if (CanPredict())
+        {
+            Predict();
+            break;
+        }
+
+        // Too far ahead: wait for the oldest tick we are missing
+        if (!net_wait_tick(m_confirmed))
+            break;
+        Reconcile();
+    }
+
+    if (!m_reset)
+        m_next++;
+}
+
+bool Rollback::CanPredict()
+{
+    // A level change only happens once everyone agrees it does, loading
+    // levels while re-running ticks would be too slow anyway
+    return (uint8_t)(m_next - m_confirmed) < net_rollback && !req_name[0]
+            && current_level;
+}
+
+// Whether pk is what we predicted: our own input, and the remote players'
+// latest SCMD_SET_INPUT and nothing else
+bool Rollback::Matches(net_packet *pk)
+{
+    uint8_t *p = pk->packet_data(), *end = p + pk->packet_size();
+    int me = client_number(), expected = 0, seen = 0;
+    bool got[256];
+
+    memset(got, 0, sizeof(got));
+    for (int i = 0; i < 256; i++)
+        expected += m_has_input[i];
+
+    while (p < end)
+    {
+        int size = scmd_size(p);
+        if (!size || p + size > end)
+            return false;
+
+        switch (*p)
+        {
+        case SCMD_SYNC:
+        case SCMD_SYNC_AT:
+            break;
+        case SCMD_SET_INPUT:
+            if (p[1] == me)
+                break;
+            if (!m_has_input[p[1]] || got[p[1]]
+                 || memcmp(p + 2, m_input[p[1]], 5))
+                return false;
+            got[p[1]] = true;
+            seen++;
+            break;
+        case SCMD_VIEW_RESIZE:
+        case SCMD_WEAPON_CHANGE:
+        case SCMD_KEYPRESS:
+        case SCMD_KEYRELEASE:
+        case SCMD_EXT_KEYPRESS:
+        case SCMD_EXT_KEYRELEASE:
+        case SCMD_CHAT_KEYPRESS:
+            if (p[1] == me)
+                break;
+            return false;
+        default:
+            return false;
+        }
+        p += size;
+    }
+
+    return seen == expected;
+}
+
+// Run the merged input of tick m_next, which is m_confirmed
+void Rollback::Apply(net_packet *pk)
+{
+    uint8_t buf[PACKET_MAX_SIZE + 1];
+    int size = pk->packet_size();
+
+    m_sync[m_next] = make_sync();
+    m_has_sync[m_next] = true;
+
+    memcpy(buf, pk->packet_data(), size);
+    if (demo_man.state == demo_manager::RECORDING)
+        demo_man.save_packet(buf, size);
+    process_packet_commands(buf, size);
+}
+
+// Run tick m_next with our own input and what we guess the others did,
+// after taking a snapshot to come back to if we guessed wrong
+void Rollback::Predict()
+{
+    uint8_t buf[PACKET_MAX_SIZE + 1];
+    int size = 0;
+
+    Save(m_next);
+    m_sync[m_next] = make_sync();
+    m_has_sync[m_next] = true;
+
+    net_packet *own = base->sent.find(m_next);
+    if (own)
+    {
+        size = own->packet_size();
+        memcpy(buf, own->packet_data(), size);
+    }
+    for (int i = 0; i < 256; i++)
+        if (m_has_input[i] && size + 7 < PACKET_MAX_SIZE)
+        {
+            buf[size++] = SCMD_SET_INPUT;
+            buf[size++] = i;
+            memcpy(buf + size, m_input[i], 5);
+            size += 5;
+        }
+
+    m_predicting = true;
+    process_packet_commands(buf, size);
+    m_predicting = false;
+    m_total_predicted++;
+}
+
+// Tick m_confirmed is known to be right, whether it ran with pk or with a
+// prediction that matched it
+void Rollback::Confirm(net_packet *pk, bool applied)
+{
+    uint8_t *p = pk->packet_data(), *end = p + pk->packet_size();
+    int me = client_number();
+
+    // The game has run past this tick already, so no snapshot here
+    if (!applied && demo_man.state == demo_manager::RECORDING)
+        demo_man.save_packet(p, pk->packet_size(), 0);
+
+    while (p < end)
+    {
+        int size = scmd_size(p);
+        if (!size)
+            break;
+        if (*p == SCMD_SET_INPUT && p[1] != me)
+        {
+            memcpy(m_input[p[1]], p + 2, 5);
+            m_has_input[p[1]] = true;
+        }
+        else if (*p == SCMD_DELETE_CLIENT)
+            m_has_input[p[1]] = false;
+        p += size;
+    }
+
+    Snapshot &s = m_snap[m_confirmed % NET_WINDOW];
+    delete s.level;
+    free(s.keys);
+    s.level = NULL;
+    s.keys = NULL;
+    s.globals = NULL;
+
+    if (m_has_sync[m_confirmed])
+        m_last_sync = m_confirmed;
+    m_confirmed++;
+    base->next_tick = m_confirmed;
+    m_total_confirmed++;
+
+    if (!applied)
+        CheckSyncs(pk);
+}
+
+void Rollback::CheckSyncs(net_packet *pk)
+{
+    uint8_t *p = pk->packet_data(), *end = p + pk->packet_size();
+
+    while (p < end)
+    {
+        int size = scmd_size(p);
+        if (!size)
+            break;
+        if (*p == SCMD_SYNC_AT)
+        {
+            uint16_t x = p[2] | (p[3] << 8);
+            if (!CheckSync(p[1], x))
+            {
+                dprintf("out of sync at tick %d (packet=%d, calced=%d)\n",
+                        p[1], x, m_sync[p[1]]);
+                if (demo_man.current_state() == demo_manager::NORMAL)
+                    net_reload();
+                return;
+            }
+        }
+        p += size;
+    }
+}
+
+bool Rollback::CheckSync(uint8_t tick, uint16_t sync)
+{
+    // Only ticks up to m_confirmed started from a state everyone agrees on
+    if (!net_pipelined || !m_has_sync[tick]
+         || (uint8_t)(m_confirmed - tick) >= 128)
+        return true;
+    if (m_sync[tick] == sync)
+        return true;
+    m_desyncs++;
+    return false;
+}
+
+bool Rollback::LastSync(uint8_t &tick, uint16_t &sync)
+{
+    if (m_last_sync < 0)
+        return false;
+    tick = m_last_sync;
+    sync = m_sync[tick];
+    return true;
+}
+
+// Confirm the predicted ticks whose merged input has arrived, until one
+// was predicted wrong; go back to it then and run everything again
+void Rollback::Reconcile()
+{
+    while (m_confirmed != m_next && !m_reset)
+    {
+        net_packet *pk = base->merged.find(m_confirmed);
+        if (!pk)
+            return;
+        if (!Matches(pk))
+        {
+            Rewind();
+            return;
+        }
+        Confirm(pk, false);
+    }
+}
+
+void Rollback::Rewind()
+{
+    uint8_t end = m_next;
+    int sound = sound_avail;
+
+    Restore(m_confirmed);
+    FreeSnapshots();
+    m_rollbacks++;
+
+    sound_avail &= ~SFX_INITIALIZED; // these ticks were heard already
+    for (m_next = m_confirmed; m_next != end; )
+    {
+        net_packet *pk = m_next == m_confirmed ? base->merged.find(m_next)
+                                               : NULL;
+        if (pk)
+        {
+            Apply(pk);
+            if (!m_reset)
+                Confirm(pk, true);
+        }
+        else
+            Predict();
+        if (m_reset)
+            break;
+
+        the_game->resim_step();
+        m_resimulated++;
+        m_next++;
+
+        // A level change that did not happen the first time around; the
+        // ticks after it are dropped and run again from the new level
+        if (req_name[0])
+            break;
+    }
+    sound_avail = sound;
+}
+
+void Rollback::Save(uint8_t tick)
+{
+    Snapshot &s = m_snap[tick % NET_WINDOW];
+    delete s.level;
+    free(s.keys);
+
+    Timer t;
+    s.level = current_level->save_state();
+    s.views = 0;
+    for (view *v = player_list; v; v = v->next)
+        s.views++;
+    s.keys = (uint8_t *)malloc(s.views * VIEW_KEYMAP_SIZE + 1);
+    int i = 0;
+    for (view *v = player_list; v; v = v->next, i++)
+        v->get_keymap(s.keys + i * VIEW_KEYMAP_SIZE);
+
+    s.globals = Lisp::SaveGlobals();
+
+    m_save_ms += t.GetMs();
+    m_saves++;
+    m_save_bytes += (s.level ? s.level->file_size() : 0)
+                    + s.globals->m_len * sizeof(LObject *);
+}
+
+void Rollback::Restore(uint8_t tick)
+{
+    Snapshot &s = m_snap[tick % NET_WINDOW];
+    if (!s.level)
+        return;
+
+    quiet_status quiet;
+    status_manager *old_stat = stat_man;
+    stat_man = &quiet;
+
+    char *name = strdup(current_level->name());
+    delete current_level;
+    current_level = NULL;
+
+    s.level->seek(0, SEEK_SET);
+    spec_directory sd(s.level);
+    current_level = new level(&sd, s.level, name);
+    free(name);
+
+    stat_man = old_stat;
+
+    int i = 0;
+    for (view *v = player_list; v && i < s.views; v = v->next, i++)
+        v->set_keymap(s.keys + i * VIEW_KEYMAP_SIZE);
+
+    Lisp::RestoreGlobals(s.globals);
+
+    // Whatever the ticks we are undoing asked for
+    req_name[0] = 0;
+}
+
+void Rollback::FreeSnapshots()
+{
+    for (int i = 0; i < NET_WINDOW; i++)
+    {
+        delete m_snap[i].level;
+        free(m_snap[i].keys);
+        m_snap[i].level = NULL;
+        m_snap[i].keys = NULL;
+        m_snap[i].globals = NULL;
+    }
+}
+
+void Rollback::GetStats(int &confirmed, int &predicted, int &rollbacks,
+                        int &resimulated, int &desyncs)
+{
+    confirmed = m_total_confirmed;
+    predicted = m_total_predicted;
+    rollbacks = m_rollbacks;
+    resimulated = m_resimulated;
+    desyncs = m_desyncs;
+}
+
+void Rollback::GetSnapshotStats(int &snapshots, float &ms, int64_t &bytes)
+{
+    snapshots = m_saves;
+    ms = m_save_ms;
+    bytes = m_save_bytes;
+}
@@ -0,0 +1,107 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __ROLLBACK_H__
+#define __ROLLBACK_H__
+
+#include <stdint.h>
+
+#include "netface.h"
+
+class mFILE;
+struct LArray;
+
+//
+// Engine side of pipelined net games. Input is sent -netdelay ticks ahead
+// of the tick it is for, and the server merges everyone's input by tick.
+// With -rollback, a tick whose merged input has not arrived yet is run
+// anyway, with the remote players doing what they did last; the level is
+// snapshotted before it, and restored and run again once the real input
+// turns out to be different. A snapshot is the saved level, the views'
+// key maps and the values of the Lisp symbols.
+//
+class Rollback
+{
+public:
+    Rollback();
+    ~Rollback();
+
+    // Forget everything and start over, with tick as the next one to run
+    void Reset(uint8_t tick);
+
+    // Tick stamp of the input we send next
+    uint8_t SendTick() const;
+
+    // Apply the input of the next tick, predicted if allowed to, once any
+    // earlier predictions that were wrong are fixed; the caller then steps
+    void Receive();
+
+    // Whether the input being processed is a prediction
+    bool Predicting() const { return m_predicting; }
+
+    // Check a SCMD_SYNC_AT against what we had at that tick; false means
+    // we are out of sync. Ticks we know nothing about always pass.
+    bool CheckSync(uint8_t tick, uint16_t sync);
+
+    // The last tick whose start all players agree on, and its make_sync()
+    bool LastSync(uint8_t &tick, uint16_t &sync);
+
+    void GetStats(int &confirmed, int &predicted, int &rollbacks,
+                  int &resimulated, int &desyncs);
+    // Snapshots taken, the time they took and the bytes of level and
+    // globals they held
+    void GetSnapshotStats(int &snapshots, float &ms, int64_t &bytes);
+
+private:
+    struct Snapshot
+    {
+        mFILE *level;
+        int views;
+        uint8_t *keys; // VIEW_KEYMAP_SIZE bytes per view, in list order
+        LArray *globals; // from Lisp::SaveGlobals(), registered with the GC
+    };
+
+    bool CanPredict();
+    bool Matches(net_packet *pk);
+    void Apply(net_packet *pk);
+    void Predict();
+    void Confirm(net_packet *pk, bool applied);
+    void CheckSyncs(net_packet *pk);
+    void Reconcile();
+    void Rewind();
+
+    void Save(uint8_t tick);
+    void Restore(uint8_t tick);
+    void FreeSnapshots();
+
+    uint8_t m_next;      // next tick to run
+    uint8_t m_confirmed; // oldest tick run with predicted input, or m_next
+    bool m_predicting, m_reset;
+
+    Snapshot m_snap[NET_WINDOW]; // taken before running each predicted tick
+
+    // What each remote player sent last, repeated as the prediction
+    uint8_t m_input[256][5];
+    bool m_has_input[256];
+
+    // make_sync() at the start of each tick
+    uint16_t m_sync[256];
+    bool m_has_sync[256];
+    int m_last_sync; // -1 until a tick is confirmed
+
+    int m_total_confirmed, m_total_predicted, m_rollbacks, m_resimulated,
+        m_desyncs, m_saves;
+    float m_save_ms;
+    int64_t m_save_bytes;
+};
+
+extern Rollback rollback;
+
+#endif // __ROLLBACK_H__
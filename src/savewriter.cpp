@@ -0,0 +1,168 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#if defined HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SDL.h"
+
+#include "common.h"
+
+#include "level.h"
+#include "savewriter.h"
+
+SaveWriter save_writer;
+
+// Add job to the end of list
+static void append(SaveJob *&list, SaveJob *job)
+{
+    SaveJob **p = &list;
+    while (*p)
+        p = &(*p)->next;
+    job->next = NULL;
+    *p = job;
+}
+
+SaveWriter::SaveWriter()
+{
+    m_queue = NULL;
+    m_done = NULL;
+    m_writing = false;
+    m_quit = false;
+    m_thread = NULL;
+    m_mutex = NULL;
+    m_cond = NULL;
+}
+
+SaveWriter::~SaveWriter()
+{
+    Stop();
+}
+
+void SaveWriter::Stop()
+{
+    if (m_thread)
+    {
+        SDL_LockMutex(m_mutex);
+        m_quit = true;
+        SDL_CondBroadcast(m_cond);
+        SDL_UnlockMutex(m_mutex);
+        SDL_WaitThread(m_thread, NULL); // it writes the queue out first
+        SDL_DestroyCond(m_cond);
+        SDL_DestroyMutex(m_mutex);
+        m_thread = NULL;
+        m_mutex = NULL;
+        m_cond = NULL;
+    }
+
+    // Nobody is left to tell about them
+    while (m_done)
+    {
+        SaveJob *job = m_done;
+        m_done = job->next;
+        delete job;
+    }
+    m_quit = false;
+}
+
+void SaveWriter::Queue(SaveJob *job)
+{
+    if (!m_thread)
+    {
+        m_mutex = SDL_CreateMutex();
+        m_cond = SDL_CreateCond();
+        m_thread = SDL_CreateThread(ThreadMain, "save", this);
+    }
+
+    if (!m_thread)
+    {
+        // No thread to hand it to, so write it right away
+        job->Write();
+        append(m_done, job);
+        return;
+    }
+
+    SDL_LockMutex(m_mutex);
+    append(m_queue, job);
+    SDL_CondBroadcast(m_cond);
+    SDL_UnlockMutex(m_mutex);
+}
+
+void SaveWriter::Poll()
+{
+    SaveJob *done;
+    if (m_thread)
+    {
+        SDL_LockMutex(m_mutex);
+        done = m_done;
+        m_done = NULL;
+        SDL_UnlockMutex(m_mutex);
+    }
+    else
+    {
+        done = m_done;
+        m_done = NULL;
+    }
+
+    while (done)
+    {
+        SaveJob *job = done;
+        done = job->next;
+        if (job->done)
+            job->done(job->name, job->ok);
+        delete job;
+    }
+}
+
+void SaveWriter::Wait()
+{
+    if (!m_thread)
+        return;
+    SDL_LockMutex(m_mutex);
+    while (m_queue || m_writing)
+        SDL_CondWait(m_cond, m_mutex);
+    SDL_UnlockMutex(m_mutex);
+}
+
+int SaveWriter::ThreadMain(void *data)
+{
+    ((SaveWriter *)data)->Run();
+    return 0;
+}
+
+void SaveWriter::Run()
+{
+    SDL_LockMutex(m_mutex);
+    while (m_queue || !m_quit)
+    {
+        if (!m_queue)
+        {
+            SDL_CondWait(m_cond, m_mutex);
+            continue;
+        }
+
+        SaveJob *job = m_queue;
+        m_queue = job->next;
+        m_writing = true;
+        SDL_UnlockMutex(m_mutex);
+
+        job->Write();
+
+        SDL_LockMutex(m_mutex);
+        append(m_done, job);
+        m_writing = false;
+        SDL_CondBroadcast(m_cond);
+    }
+    SDL_UnlockMutex(m_mutex);
+}
@@ -0,0 +1,59 @@
+/*
+ *  Abuse - dark 2D side-scrolling platform game
+ *  Copyright (c) 1995 Crack dot Com
+ *  Copyright (c) 2005-2011 Sam Hocevar <sam@hocevar.net>
+ *
+ *  This software was released into the Public Domain. As with most public
+ *  domain software, no warranty is made or implied by Crack dot Com, by
+ *  Jonathan Clark, or by Sam Hocevar.
+ */
+
+#ifndef __SAVEWRITER_H__
+#define __SAVEWRITER_H__
+
+class SaveJob;
+
+struct SDL_Thread;
+struct SDL_mutex;
+struct SDL_cond;
+
+//
+// Background thread writing savegames that level::snapshot() laid out in
+// memory, so that the game keeps running while they go to disk. Savegames
+// are written in the order they were queued; their done callbacks are
+// called from Poll(), on the main thread.
+//
+class SaveWriter
+{
+public:
+    SaveWriter();
+    ~SaveWriter();
+
+    // Write job and delete it afterwards
+    void Queue(SaveJob *job);
+
+    // Call the done callbacks of the savegames written since last time
+    void Poll();
+
+    // Wait until everything queued is on disk, e.g. before reading it
+    void Wait();
+
+    // Write what is still queued and stop the thread; Queue() starts it again
+    void Stop();
+
+private:
+    static int ThreadMain(void *data);
+    void Run();
+
+    SaveJob *m_queue, *m_done;  // oldest first
+    bool m_writing;             // the thread has taken a job off the queue
+    bool m_quit;
+
+    SDL_Thread *m_thread;
+    SDL_mutex *m_mutex;
+    SDL_cond *m_cond; // a job was queued or written, or it is time to quit
+};
+
+extern SaveWriter save_writer;
+
+#endif // __SAVEWRITER_H__
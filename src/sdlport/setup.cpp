@@ -42,11 +42,14 @@
 #include "keys.h"
 #include "setup.h"
 #include "errorui.h"
+#include "headless.h"
 
 flags_struct flags;
 keys_struct keys;
 
 extern int xres, yres;
+extern int delta_saves;
+extern int async_saves;
 static unsigned int scale;
 
 //
@@ -64,6 +67,35 @@ void showHelp(const char* executableName)
     printf( "  -f <arg>          Load map file named <arg>\n" );
     printf( "  -lisp             Startup in lisp interpreter mode\n" );
     printf( "  -nodelay          Run at maximum speed\n" );
+    printf( "  -drawthreads <arg> Draw tiles and lighting on <arg> threads\n" );
+    printf( "  -lprofile <arg>   Profile Lisp functions into <arg> and <arg>.folded\n" );
+    printf( "  -noprefetch       Do not read graphics ahead on a background thread\n" );
+    printf( "  -headless         Simulate without video, sound or frame delay\n" );
+    printf( "  -ticks <arg>      Number of ticks to simulate with -headless\n" );
+    printf( "  -replay <arg>     Replay demo <arg> with -headless\n" );
+    printf( "  -seek <arg>       Start the -replay demo at tick <arg>\n" );
+    printf( "  -record <arg>     Record a bot playing the -f level to demo <arg> with -headless\n" );
+    printf( "  -replaydir <arg>  Replay and sync check every demo in <arg> after -headless\n" );
+    printf( "  -lightbench <arg> Time <arg> frames of lighting after -headless\n" );
+    printf( "  -specbench <arg>  Time <arg> reads of the data files after -headless\n" );
+    printf( "  -nommap           Read data files without memory mapping them\n" );
+    printf( "  -fullsaves        Save whole games, not what changed in the level\n" );
+    printf( "  -syncsaves        Write savegames before the game goes on\n" );
+    printf( "  -savebench <arg>  Time <arg> whole and changes-only saves after -headless\n" );
+    printf( "  -loadbench <arg>  Time <arg> loads of the level after -headless\n" );
+    printf( "  -blitbench <arg>  Time <arg> draws of every figure after -headless\n" );
+    printf( "  -callbench <arg>  Time <arg> rounds of AI C function calls after -headless\n" );
+    printf( "  -gcbench <arg>    Time <arg> garbage lists among live Lisp data after -headless\n" );
+    printf( "  -spawn <t> <n>    Add <n> objects of type <t> around the player for -headless\n" );
+    printf( "  -bundle <arg>     Read data from bundle <arg> before loose files\n" );
+    printf( "  -netdelay <arg>   Send net game input <arg> ticks ahead (0..8)\n" );
+    printf( "  -rollback <arg>   Predict up to <arg> ticks of remote input (0..8)\n" );
+    printf( "  -netlag <arg>     Hold back net game packets for <arg> ms\n" );
+    printf( "  -loopback         Play net games inside this process only\n" );
+    printf( "  -netbots <arg>    Have <arg> loopback bots join a -server game\n" );
+    printf( "  -netjitter <arg>  Vary loopback packet delays by <arg> ms\n" );
+    printf( "  -netloss <arg>    Lose <arg> percent of loopback game packets\n" );
+    printf( "  -netbandwidth <arg> Send at most <arg> KB/s per loopback socket\n" );
     printf( "\n" );
     printf( "** Abuse-SDL Options **\n" );
     printf( "  -datadir <arg>    Set the location of the game data to <arg>\n" );
@@ -316,6 +348,25 @@ void parseCommandLine( int argc, char **argv )
         {
             flags.nosound = 1;
         }
+        else if( !strcasecmp( argv[ii], "-headless" ) )
+        {
+            headless = 1;
+            flags.nosound = 1;
+            flags.fullscreen = 0;
+            flags.software = 1;
+        }
+        else if( !strcasecmp( argv[ii], "-nommap" ) )
+        {
+            spec_mmap = 0;
+        }
+        else if( !strcasecmp( argv[ii], "-fullsaves" ) )
+        {
+            delta_saves = 0;
+        }
+        else if( !strcasecmp( argv[ii], "-syncsaves" ) )
+        {
+            async_saves = 0;
+        }
         else if( !strcasecmp( argv[ii], "-antialias" ) )
         {
             flags.antialias = 1;
@@ -376,6 +427,17 @@ void setup( int argc, char **argv )
     // Display our name and version
     printf( "%s %s\n", PACKAGE_NAME, PACKAGE_VERSION );
 
+    // Headless runs must not open a window, so pick SDL's dummy video
+    // driver before initialising; the rest of the flags are parsed below
+    for( int ii = 1; ii < argc; ii++ )
+    {
+        if( !strcasecmp( argv[ii], "-headless" ) )
+        {
+            SDL_setenv( "SDL_VIDEODRIVER", "dummy", 1 );
+            SDL_setenv( "SDL_AUDIODRIVER", "dummy", 1 );
+        }
+    }
+
     // Initialize SDL with video and audio support
     if( SDL_Init( SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER ) < 0 )
     {
@@ -36,6 +36,12 @@ int sequence::cache_in()
   return 1;
 }
 
+void sequence::prefetch()
+{
+  for (int i=0; i<total; i++)
+    cache.prefetch(seq[i]);
+}
+
 sequence::sequence(char *filename, void *pict_list, void *advance_list)
 {
   if (item_type(pict_list)==L_STRING)
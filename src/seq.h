@@ -35,6 +35,7 @@ public :
                  else return cache.fig(seq[current])->backward; }
   figure *get_figure(short current) { return cache.fig(seq[current]); }
   int cache_in();
+  void prefetch();
   int x_center(short current) { return (short) (cache.fig(seq[current])->xcfg); }
   int length() { return total; }
   int get_advance(int current) { return cache.fig(seq[current])->advance; }
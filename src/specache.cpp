@@ -31,6 +31,30 @@ void spec_directory_cache::load(bFILE *fp)
   }
 }
 
+void spec_directory_cache::load_bundle()
+{
+  if (!in_spec_main_file(BUNDLE_DIRECTORY))
+    return;
+
+  bFILE *fp=open_file(BUNDLE_DIRECTORY,"rb");
+  if (!fp->open_failure())
+  {
+    short tfn=fp->read_uint16();
+    unsigned char len;
+    char fn[256];
+    for (int i=0; i<tfn; i++)
+    {
+      fp->read(&len,1);
+      fp->read(fn,len);
+      if (in_spec_main_file(fn))
+        get_spec_directory(fn,fp);
+      else
+        spec_directory skip(fp);  // a file of its own overrides the bundle
+    }
+  }
+  delete fp;
+}
+
 void spec_directory_cache::save(bFILE *fp)
 {
   int total = 0;
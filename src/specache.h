@@ -15,6 +15,11 @@
 
 #include <string.h>
 
+// The entry of a bundle made by "abuse-tool pack" that holds the
+// directories of the spec files packed in it, in the format of
+// spec_directory_cache::save(), so they need not be read one by one
+#define BUNDLE_DIRECTORY "bundle directory"
+
 class spec_directory_cache
 {
   class filename_node
@@ -40,6 +45,8 @@ class spec_directory_cache
   void clear();                             // frees up all allocated memory
   void load(bFILE *fp);
   void save(bFILE *fp);
+  void load_bundle();                       // see BUNDLE_DIRECTORY
+
   ~spec_directory_cache() { clear(); }
 } ;
 
@@ -20,8 +20,11 @@
 #include "image.h"
 #include "pcxread.h"
 #include "crc.h"
+#include "specache.h"
 
 static void Usage();
+static int Pack(char const *bundle, char const *profile,
+                int count, char **files);
 
 enum
 {
@@ -35,6 +38,9 @@ enum
     CMD_TYPE,
     CMD_GETPCX,
     CMD_PUTPCX,
+    CMD_PACK,
+    CMD_COMPRESS,
+    CMD_DECOMPRESS,
 };
 
 int main(int argc, char *argv[])
@@ -54,6 +60,9 @@ int main(int argc, char *argv[])
             : !strcmp(argv[2], "type") ? CMD_TYPE
             : !strcmp(argv[2], "getpcx") ? CMD_GETPCX
             : !strcmp(argv[2], "putpcx") ? CMD_PUTPCX
+            : !strcmp(argv[2], "pack") ? CMD_PACK
+            : !strcmp(argv[2], "compress") ? CMD_COMPRESS
+            : !strcmp(argv[2], "decompress") ? CMD_DECOMPRESS
             : CMD_INVALID;
 
     if (cmd == CMD_INVALID)
@@ -97,6 +106,9 @@ int main(int argc, char *argv[])
     case CMD_PUTPCX:
         minargc = 6;
         break;
+    case CMD_PACK:
+        minargc = 5;
+        break;
     }
 
     if (argc < minargc)
@@ -106,6 +118,10 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    /* Packing makes a new file out of others */
+    if (cmd == CMD_PACK)
+        return Pack(argv[1], argv[3], argc - 4, argv + 4);
+
     /* Open the SPEC file */
     char tmpfile[4096];
     char const *file = argv[1];
@@ -358,19 +374,183 @@ int main(int argc, char *argv[])
         dir.entries[id] = new spec_entry(type, name, NULL, len, 0);
         dir.entries[id]->data = data;
     }
+    else if (cmd == CMD_COMPRESS || cmd == CMD_DECOMPRESS)
+    {
+        dir.FullyLoad(&fp);
+    }
     else
     {
         /* Not implemented yet */
         return EXIT_FAILURE;
     }
 
-    /* If we get here, we need to write the directory back */
+    /* Everything was unpacked by FullyLoad(), so pack again what was
+     * compressed, unless told otherwise. Files in a bundle are left alone
+     * since the game needs to seek in them. */
+    long before = 0, after = 0;
+    for (int i = 0; i < dir.total; i++)
+    {
+        spec_entry *se = dir.entries[i];
+        before += se->disk_size();
+        bool pack = cmd == CMD_COMPRESS ? se->type != SPEC_NORMAL_FILE
+                                          && strcmp(se->name, BUNDLE_DIRECTORY)
+                  : cmd != CMD_DECOMPRESS && se->zsize;
+        se->zsize = 0;
+        void *packed = pack ? spec_pack(se) : NULL;
+        if (packed)
+        {
+            free(se->data);
+            se->data = packed;
+        }
+        after += se->disk_size();
+    }
+    if (cmd == CMD_COMPRESS || cmd == CMD_DECOMPRESS)
+        printf("%li bytes of entries, now %li\n", before, after);
+
+    /* If we get here, we need to write the directory back, to a new file
+     * since the entries may have shrunk */
+    dir.calc_offsets();
+    {
+        jFILE out(tmpfile, "wb");
+        if (out.open_failure())
+        {
+            fprintf(stderr, "abuse-tool: cannot create %s\n", tmpfile);
+            return EXIT_FAILURE;
+        }
+        dir.write(&out);
+        for (int i = 0; i < dir.total; i++)
+            out.write(dir.entries[i]->data, dir.entries[i]->disk_size());
+    }
+    if (rename(tmpfile, file))
+    {
+        fprintf(stderr, "abuse-tool: cannot replace %s\n", file);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* Pack files into one SPEC file that the game can read them from instead
+ * (see set_spec_main_file()). Files the cache profile uses go first, most
+ * used first, the others after them in the order given. The directories
+ * of the SPEC files among them also go in one entry of their own, so that
+ * the game finds them all with a single read. */
+static int Pack(char const *bundle, char const *profile,
+                int count, char **files)
+{
+    int *rank = (int *)malloc(count * sizeof(int));
+    int next = 0;
+    for (int i = 0; i < count; i++)
+        rank[i] = -1;
+
+    if (strcmp(profile, "-"))
+    {
+        jFILE fp(profile, "rb");
+        spec_directory dir(&fp);
+        spec_entry *se = fp.open_failure() ? NULL
+                       : dir.find("cache profile info");
+        if (!se)
+        {
+            fprintf(stderr, "abuse-tool: no cache profile in %s\n", profile);
+            return EXIT_FAILURE;
+        }
+
+        /* The format of CacheList::prof_write() */
+        fp.seek(se->offset, SEEK_SET);
+        int tnames = fp.read_uint16();
+        int *fnum = (int *)malloc(tnames * sizeof(int));
+        for (int i = 0; i < tnames; i++)
+        {
+            char name[256];
+            int len = fp.read_uint8();
+            fp.read(name, len);
+            name[len ? len - 1 : 0] = '\0';
+            fnum[i] = -1;
+            for (int j = 0; j < count; j++)
+                if (!strcmp(files[j], name))
+                    fnum[i] = j;
+        }
+
+        int tsaved = fp.read_uint32();
+        for (int i = 0; i < tsaved; i++)
+        {
+            fp.read_uint8(); /* type */
+            int f = fp.read_uint16();
+            fp.read_uint32(); /* offset */
+            if (f < tnames && fnum[f] >= 0 && rank[fnum[f]] < 0)
+                rank[fnum[f]] = next++;
+        }
+        free(fnum);
+        printf("%i of %i files are in the cache profile\n", next, count);
+    }
+
+    for (int i = 0; i < count; i++)
+        if (rank[i] < 0)
+            rank[i] = next++;
+
+    /* Read everything, and the directories of the SPEC files */
+    spec_directory dir;
+    mFILE dirs;
+    int nspec = 0;
+    uint8_t **data = (uint8_t **)malloc(count * sizeof(uint8_t *));
+    long *len = (long *)malloc(count * sizeof(long));
+
+    dirs.write_uint16(0);
+    for (int i = 0; i < count; i++)
+    {
+        jFILE fp(files[i], "rb");
+        if (fp.open_failure())
+        {
+            fprintf(stderr, "abuse-tool: cannot open %s\n", files[i]);
+            return EXIT_FAILURE;
+        }
+        len[i] = fp.file_size();
+        data[i] = (uint8_t *)malloc(len[i]);
+        fp.read(data[i], len[i]);
+
+        mFILE mfp(data[i], len[i], 0);
+        spec_directory sd(&mfp);
+        if (sd.total)
+        {
+            uint8_t l = strlen(files[i]) + 1;
+            dirs.write(&l, 1);
+            dirs.write(files[i], l);
+            sd.write(&dirs);
+            nspec++;
+        }
+    }
+    dirs.seek(0, SEEK_SET);
+    dirs.write_uint16(nspec);
+
+    spec_entry *se = new spec_entry(SPEC_DATA_ARRAY, BUNDLE_DIRECTORY, NULL,
+                                    dirs.file_size(), 0);
+    se->data = malloc(se->size);
+    dirs.seek(0, SEEK_SET);
+    dirs.read(se->data, se->size);
+    dir.add_by_hand(se);
+
+    for (int r = 0; r < count; r++)
+        for (int i = 0; i < count; i++)
+            if (rank[i] == r)
+            {
+                se = new spec_entry(SPEC_NORMAL_FILE, files[i], NULL,
+                                    len[i], 0);
+                se->data = data[i];
+                dir.add_by_hand(se);
+            }
+
+    jFILE out(bundle, "wb");
+    if (out.open_failure())
+    {
+        fprintf(stderr, "abuse-tool: cannot create %s\n", bundle);
+        return EXIT_FAILURE;
+    }
     dir.calc_offsets();
-    fp.seek(0, SEEK_SET); // FIXME: create a new file
-    dir.write(&fp);
+    dir.write(&out);
     for (int i = 0; i < dir.total; i++)
-        fp.write(dir.entries[i]->data, dir.entries[i]->size);
+        out.write(dir.entries[i]->data, dir.entries[i]->size);
 
+    printf("packed %i files, %i directories, into %s\n", count, nspec, bundle);
     return EXIT_SUCCESS;
 }
 
@@ -393,5 +573,10 @@ static void Usage()
         "   type <id> <type>             set entry <id> type to <type>\n"
         "   move <id1> <id2>             move entry <id1> to position <id2>\n"
         "   del <id>                     delete entry <id>\n"
+        "   compress                     compress the entries that get smaller\n"
+        "   decompress                   store all entries uncompressed\n"
+        "   pack <profile> <files...>    create <spec_file> as a bundle of <files>,\n"
+        "                                in the order of the cache profile in level\n"
+        "                                <profile>, or as given if it is -\n"
         "See the abuse-tool(6) manual page for more information.\n");
 }
@@ -40,6 +40,7 @@
 #include "sbar.h"
 #include "nfserver.h"
 #include "chat.h"
+#include "rollback.h"
 
 #define SHIFT_DOWN_DEFAULT 24
 #define SHIFT_RIGHT_DEFAULT 0
@@ -450,11 +451,11 @@ void view::add_chat_key(int key)  // return string if buf is complete
       game_object *o=current_object;
       current_object=m_focus;
 
-      void *m = LSpace::Tmp.Mark();
+      LTmpScope scope;
       void *list=NULL;
       push_onto_list(LString::Create(m_chat_buf),list);
       ((LSymbol *)l_chat_input)->EvalFunction(list);
-      LSpace::Tmp.Restore(m);
+      scope.End();
 
       current_object=o;
 
@@ -1168,7 +1169,7 @@ void process_packet_commands(uint8_t *pk, int size)
       } break;
       case SCMD_RELOAD :
       {
-    if (!already_reloaded)
+    if (!already_reloaded && !rollback.Predicting())
     {
       net_reload();
       already_reloaded=1;
@@ -1188,6 +1189,22 @@ void process_packet_commands(uint8_t *pk, int size)
     else if (x!=sync_uint16 && !already_reloaded)
     {
       dprintf("out of sync %d (packet=%d, calced=%d)\n",current_level->tick_counter(),x,sync_uint16);
+      if (demo_man.current_state()==demo_manager::NORMAL)
+        net_reload();
+      else if (demo_man.current_state()==demo_manager::PLAYING)
+        demo_man.sync_error(current_level->tick_counter(),x,sync_uint16);
+      already_reloaded=1;
+    }
+      } break;
+      case SCMD_SYNC_AT :
+      {
+    uint8_t tick=*(pk++);
+    uint16_t x;
+    memcpy(&x,pk,2);  pk+=2;
+    x=lstl(x);
+    if (!rollback.Predicting() && !already_reloaded && !rollback.CheckSync(tick,x))
+    {
+      dprintf("out of sync at tick %d (packet=%d)\n",tick,x);
       if (demo_man.current_state()==demo_manager::NORMAL)
         net_reload();
       already_reloaded=1;
@@ -30,6 +30,7 @@ struct suggest_struct
 
 class view;
 
+#define VIEW_KEYMAP_SIZE (512 / 8)
 
 class view
 {
@@ -40,6 +41,9 @@ public:
   int key_down(int key) { return m_keymap[key/8]&(1<<(key%8)); }
   void set_key_down(int key, int x) { if (x) m_keymap[key/8]|=(1<<(key%8)); else m_keymap[key/8]&=~(1<<(key%8)); }
   void reset_keymap() { memset(m_keymap,0,sizeof(m_keymap)); }
+  // level files do not keep the key state, so snapshots copy it separately
+  void get_keymap(uint8_t *buf) { memcpy(buf,m_keymap,VIEW_KEYMAP_SIZE); }
+  void set_keymap(uint8_t const *buf) { memcpy(m_keymap,buf,VIEW_KEYMAP_SIZE); }
   void add_chat_key(int key);
 
   char name[100];
@@ -127,7 +131,7 @@ public:
     game_object *m_focus; // object we are focusing on (player)
 
 private:
-    uint8_t m_keymap[512 / 8];
+    uint8_t m_keymap[VIEW_KEYMAP_SIZE];
     char m_chat_buf[60];
 };
 